@@ -134,6 +134,19 @@ struct block_t
  *      with preheader and or body (increase
  *      and decrease are supported). Use it as it is optimised.
  * - block_Duplicate : create a copy of a block.
+ * - block_Shareable : turn a block into one whose payload can be shared
+ *      (consumes the block).
+ * - block_Share : create a new reference to the payload of a shareable
+ *      block, or a copy of any other block.
+ * - block_Unshare : make the payload of a block private, copying it if it is
+ *      shared with other blocks (consumes the block).
+ *
+ * Shared payloads are read-only: write to a block payload only after
+ * block_Unshare(). block_Realloc() takes care of it when it expands a
+ * shared payload. Stream outputs can receive shared blocks, so muxers
+ * must unshare before they write in place, and stream outputs that feed
+ * decoders unshare their input, as decoders and packetizers may work in
+ * place.
  ****************************************************************************/
 VLC_API void block_Init( block_t *, void *, size_t );
 VLC_API block_t *block_Alloc( size_t ) VLC_USED VLC_MALLOC;
@@ -167,6 +180,33 @@ static inline void block_Release( block_t *p_block )
     p_block->pf_release( p_block );
 }
 
+VLC_API block_t *block_Shareable( block_t * ) VLC_USED;
+VLC_API block_t *block_Share( block_t * ) VLC_USED;
+VLC_API block_t *block_Unshare( block_t * ) VLC_USED;
+
+/****************************************************************************
+ * Block allocation cache
+ ****************************************************************************
+ * - block_pool_Enable : make block_Alloc() reuse the released blocks through
+ *      per-thread free lists of a few size classes (disabled by default);
+ *      blocks released by another thread go back to the allocating one
+ * - block_pool_GetStats : read the cache statistics
+ ****************************************************************************/
+#define BLOCK_POOL_CLASSES 5
+
+typedef struct
+{
+    uint64_t hits; /**< allocations served from a cache */
+    uint64_t misses; /**< allocations of a cacheable size from the heap */
+    uint64_t remote; /**< releases handed back to the allocating thread */
+    size_t bytes; /**< payload bytes currently cached */
+    size_t size[BLOCK_POOL_CLASSES]; /**< payload size of each class */
+    size_t count[BLOCK_POOL_CLASSES]; /**< blocks cached in each class */
+} block_pool_stats_t;
+
+VLC_API void block_pool_Enable(bool);
+VLC_API void block_pool_GetStats(block_pool_stats_t *);
+
 VLC_API block_t *block_heap_Alloc(void *, size_t) VLC_USED VLC_MALLOC;
 VLC_API block_t *block_mmap_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC;
 VLC_API block_t * block_shm_Alloc(void *addr, size_t length) VLC_USED VLC_MALLOC;
@@ -342,4 +382,33 @@ static inline void vlc_fifo_Cleanup(void *fifo)
 }
 #define vlc_fifo_CleanupPush(fifo) vlc_cleanup_push(vlc_fifo_Cleanup, fifo)
 
+/****************************************************************************
+ * Single-producer single-consumer queues of blocks.
+ ****************************************************************************
+ * Bounded lock-free ring of blocks, for when exactly one thread queues and
+ * exactly one other thread dequeues. Queueing and dequeueing never take a
+ * lock; a blocked consumer is woken up through a semaphore only if it
+ * actually went to sleep.
+ *
+ * - vlc_spsc_New : create a queue of (at least) the given capacity
+ * - vlc_spsc_Delete : destroy a queue and free all blocks in it
+ * - vlc_spsc_Queue : queue a block (producer), fails if the queue is full
+ * - vlc_spsc_TryDequeue : dequeue a block if any (consumer)
+ * - vlc_spsc_Dequeue : dequeue a block, waiting if the queue is empty
+ * - vlc_spsc_Dequeue_i11e : same but stops waiting if interrupted
+ * - vlc_spsc_GetCount / vlc_spsc_GetBytes : current queue depth and size
+ *
+ * vlc_spsc_Dequeue is a cancellation point.
+ ****************************************************************************/
+typedef struct vlc_spsc_t vlc_spsc_t;
+
+VLC_API vlc_spsc_t *vlc_spsc_New(size_t capacity) VLC_USED VLC_MALLOC;
+VLC_API void vlc_spsc_Delete(vlc_spsc_t *);
+VLC_API int vlc_spsc_Queue(vlc_spsc_t *, block_t *);
+VLC_API block_t *vlc_spsc_TryDequeue(vlc_spsc_t *) VLC_USED;
+VLC_API block_t *vlc_spsc_Dequeue(vlc_spsc_t *) VLC_USED;
+VLC_API block_t *vlc_spsc_Dequeue_i11e(vlc_spsc_t *) VLC_USED;
+VLC_API size_t vlc_spsc_GetCount(vlc_spsc_t *) VLC_USED;
+VLC_API size_t vlc_spsc_GetBytes(vlc_spsc_t *) VLC_USED;
+
 #endif /* VLC_BLOCK_H */
@@ -145,6 +145,51 @@ VLC_API int httpd_StreamHeader( httpd_stream_t *, uint8_t *p_data, int i_data );
 VLC_API int httpd_StreamSend( httpd_stream_t *, const block_t *p_block );
 VLC_API int httpd_StreamSetHTTPHeaders(httpd_stream_t *, httpd_header *, size_t);
 
+/* What to do with a client falling behind a stream by more than its buffer */
+enum
+{
+    HTTPD_STREAM_LAG_KEYFRAME,   /* skip to the next keyframe */
+    HTTPD_STREAM_LAG_DISCONNECT, /* close the connection */
+    HTTPD_STREAM_LAG_SPILL,      /* keep the late data in a per-client buffer,
+                                  * then skip to the next keyframe once full */
+};
+
+/**
+ * Sets how clients start and fall behind a stream.
+ * If b_burst is true, new clients start from the last keyframe still in the
+ * stream buffer, rather than wait for the next one.
+ * i_spill_max is the per-client buffer size for HTTPD_STREAM_LAG_SPILL.
+ * Without keyframes, skipping resumes from the last block.
+ */
+VLC_API void httpd_StreamSetPolicy( httpd_stream_t *, bool b_burst, int i_lag_policy, size_t i_spill_max );
+
+typedef struct
+{
+    unsigned i_clients;
+    uint64_t i_max_lag;     /* bytes, of the furthest behind client */
+    size_t   i_spill;       /* bytes, in all the client spill buffers */
+    unsigned i_drops;       /* times a client fell behind */
+    uint64_t i_dropped;     /* bytes skipped by clients */
+    unsigned i_disconnects; /* clients closed for falling behind */
+} httpd_stream_stats_t;
+
+typedef struct
+{
+    char     psz_ip[64];    /* NI_MAXNUMERICHOST */
+    int      i_port;
+    uint64_t i_lag;         /* bytes not sent yet */
+    size_t   i_spill;
+    unsigned i_drops;
+    uint64_t i_dropped;
+} httpd_client_stats_t;
+
+/**
+ * Gets the lag statistics of a stream. Counters include the clients already
+ * gone. If pp_clients is not NULL, it is set to an array of
+ * stats->i_clients entries (or NULL), to be freed with free().
+ */
+VLC_API int httpd_StreamGetStats( httpd_stream_t *, httpd_stream_stats_t *, httpd_client_stats_t **pp_clients );
+
 /* Msg functions facilities */
 VLC_API void httpd_MsgAdd( httpd_message_t *, const char *psz_name, const char *psz_value, ... ) VLC_FORMAT( 3, 4 );
 /* return "" if not found. The string is not allocated */
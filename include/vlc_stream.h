@@ -90,6 +90,7 @@ enum stream_query_e
     STREAM_GET_META,        /**< arg1= vlc_meta_t **       res=can fail */
     STREAM_GET_CONTENT_TYPE,    /**< arg1= char **         res=can fail */
     STREAM_GET_SIGNAL,      /**< arg1=double *pf_quality, arg2=double *pf_strength   res=can fail */
+    STREAM_GET_RECV_STATS,  /**< arg1=uint64_t *pi_packets, arg2=uint64_t *pi_syscalls, arg3=unsigned *pi_max_batch   res=can fail */
 
     STREAM_SET_PAUSE_STATE = 0x200, /**< arg1= bool        res=can fail */
     STREAM_SET_TITLE,       /**< arg1= int          res=can fail */
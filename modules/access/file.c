@@ -52,6 +52,9 @@
 #   include <unistd.h>
 #endif
 #include <dirent.h>
+#ifdef HAVE_MMAP
+#   include <sys/mman.h>
+#endif
 
 #include <vlc_common.h>
 #include "fs.h"
@@ -64,14 +67,29 @@
 #include <vlc_fs.h>
 #include <vlc_url.h>
 #include <vlc_interrupt.h>
+#include <vlc_block.h>
 
 struct access_sys_t
 {
     int fd;
 
     bool b_pace_control;
+
+#ifdef HAVE_MMAP
+    /* Memory mapped reading */
+    uint64_t i_pos;
+    size_t   i_window;
+    size_t   i_page_mask;
+#endif
 };
 
+#ifdef HAVE_MMAP
+/* Size of the mappings, which are handed over to the stream as blocks.
+ * Windows start small after a seek, and grow back while reading on. */
+# define MMAP_WINDOW_MIN (64 << 10)
+# define MMAP_WINDOW_MAX (2 << 20)
+#endif
+
 #if !defined (_WIN32) && !defined (__OS2__)
 static bool IsRemote (int fd)
 {
@@ -127,8 +145,15 @@ static bool IsRemote (const char *path)
 #ifndef HAVE_POSIX_FADVISE
 # define posix_fadvise(fd, off, len, adv)
 #endif
+#ifndef HAVE_POSIX_MADVISE
+# define posix_madvise(addr, len, adv)
+#endif
 
 static ssize_t Read (access_t *, uint8_t *, size_t);
+#ifdef HAVE_MMAP
+static block_t *MmapBlock (access_t *);
+static int MmapSeek (access_t *, uint64_t);
+#endif
 static int FileSeek (access_t *, uint64_t);
 static int NoSeek (access_t *, uint64_t);
 static int FileControl (access_t *, int, va_list);
@@ -237,6 +262,21 @@ int FileOpen( vlc_object_t *p_this )
             fcntl (fd, F_RDAHEAD, 0);
         else
             fcntl (fd, F_RDAHEAD, 1);
+#endif
+#ifdef HAVE_MMAP
+        /* Mapping pages of a file that gets truncated raises SIGBUS, so this
+         * is opt-in, and only for local regular files. */
+        if (S_ISREG (st.st_mode) && var_InheritBool (p_access, "file-mmap")
+         && !IsRemote(fd, p_access->psz_filepath))
+        {
+            msg_Dbg (p_access, "using memory mapped reading");
+            p_access->pf_read = NULL;
+            p_access->pf_block = MmapBlock;
+            p_access->pf_seek = MmapSeek;
+            p_sys->i_pos = 0;
+            p_sys->i_window = MMAP_WINDOW_MIN;
+            p_sys->i_page_mask = sysconf (_SC_PAGESIZE) - 1;
+        }
 #endif
     }
     else
@@ -259,7 +299,7 @@ void FileClose (vlc_object_t * p_this)
 {
     access_t     *p_access = (access_t*)p_this;
 
-    if (p_access->pf_read == NULL)
+    if (p_access->pf_readdir != NULL)
     {
         DirClose (p_this);
         return;
@@ -298,6 +338,81 @@ static ssize_t Read (access_t *p_access, uint8_t *p_buffer, size_t i_len)
     return val;
 }
 
+#ifdef HAVE_MMAP
+/*****************************************************************************
+ * MmapBlock: hand out a mapping of the next window of the file
+ *****************************************************************************/
+static block_t *MmapBlock (access_t *p_access)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    struct stat st;
+
+    /* The file may be growing (or shrinking) while we read it */
+    if (fstat (p_sys->fd, &st))
+    {
+        msg_Err (p_access, "read error: %s", vlc_strerror_c(errno));
+        goto eof;
+    }
+    if ((uint64_t)st.st_size <= p_sys->i_pos)
+        goto eof;
+
+    uint64_t i_offset = p_sys->i_pos & ~(uint64_t)p_sys->i_page_mask;
+    size_t i_skip = p_sys->i_pos - i_offset;
+    size_t i_len = p_sys->i_window;
+    if (i_len > (uint64_t)st.st_size - p_sys->i_pos)
+        i_len = st.st_size - p_sys->i_pos;
+
+    uint8_t *addr = mmap (NULL, i_skip + i_len, PROT_READ, MAP_SHARED,
+                          p_sys->fd, i_offset);
+    if (addr == MAP_FAILED)
+    {
+        msg_Err (p_access, "memory mapping error: %s", vlc_strerror_c(errno));
+        dialog_Fatal (p_access, _("File reading failed"),
+                      _("VLC could not read the file (%s)."),
+                      vlc_strerror(errno));
+        goto eof;
+    }
+
+    if (p_sys->i_window >= MMAP_WINDOW_MAX)
+    {
+        /* Streaming through: fault the whole window in at once, and start
+         * reading the next one from disk */
+        posix_madvise (addr, i_skip + i_len, POSIX_MADV_SEQUENTIAL);
+        posix_madvise (addr, i_skip + i_len, POSIX_MADV_WILLNEED);
+        posix_fadvise (p_sys->fd, p_sys->i_pos + i_len, p_sys->i_window,
+                       POSIX_FADV_WILLNEED);
+    }
+    else
+    {
+        /* Likely probing or seeking around: no read-ahead */
+        posix_madvise (addr, i_skip + i_len, POSIX_MADV_RANDOM);
+        p_sys->i_window *= 2;
+    }
+
+    block_t *p_block = block_mmap_Alloc (addr + i_skip, i_len);
+    if (p_block == NULL)
+        return NULL;
+
+    p_sys->i_pos += i_len;
+    return p_block;
+
+eof:
+    p_access->info.b_eof = true;
+    return NULL;
+}
+
+static int MmapSeek (access_t *p_access, uint64_t i_pos)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+
+    if (i_pos != p_sys->i_pos)
+        p_sys->i_window = MMAP_WINDOW_MIN;
+    p_sys->i_pos = i_pos;
+    p_access->info.b_eof = false;
+    return VLC_SUCCESS;
+}
+#endif
+
 /*****************************************************************************
  * Seek: seek to a specific location in a file
  *****************************************************************************/
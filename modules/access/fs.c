@@ -30,12 +30,21 @@
 #include "fs.h"
 #include <vlc_plugin.h>
 
+#define MMAP_TEXT N_("Memory mapped reading")
+#define MMAP_LONGTEXT N_( \
+    "Read local files through memory mappings instead of copying them. " \
+    "This saves CPU time on fast storage, but VLC will crash if the file " \
+    "is truncated while it is being read." )
+
 vlc_module_begin ()
     set_description( N_("File input") )
     set_shortname( N_("File") )
     set_category( CAT_INPUT )
     set_subcategory( SUBCAT_INPUT_ACCESS )
     add_obsolete_string( "file-cat" )
+#ifdef HAVE_MMAP
+    add_bool( "file-mmap", false, MMAP_TEXT, MMAP_LONGTEXT, true )
+#endif
     set_capability( "access", 50 )
     add_shortcut( "file", "fd", "stream" )
     set_callbacks( FileOpen, FileClose )
@@ -55,6 +55,9 @@ static void Close( vlc_object_t * );
 
 #define BUFFER_TEXT N_("Receive buffer")
 #define BUFFER_LONGTEXT N_("UDP receive buffer size (bytes)" )
+#define BATCH_TEXT N_("Receive batch size")
+#define BATCH_LONGTEXT N_("Maximum number of datagrams received with a " \
+    "single system call. 1 disables batching." )
 
 vlc_module_begin ()
     set_shortname( N_("UDP" ) )
@@ -64,6 +67,8 @@ vlc_module_begin ()
 
     add_obsolete_integer( "server-port" ) /* since 2.0.0 */
     add_integer( "udp-buffer", 0x400000, BUFFER_TEXT, BUFFER_LONGTEXT, true )
+    add_integer( "udp-batch", 32, BATCH_TEXT, BATCH_LONGTEXT, true )
+        change_integer_range( 1, 1024 )
 
     set_capability( "access", 0 )
     add_shortcut( "udp", "udpstream", "udp4", "udp6" )
@@ -78,6 +83,17 @@ struct access_sys_t
     block_fifo_t *fifo;
     vlc_sem_t semaphore;
     vlc_thread_t thread;
+#ifdef HAVE_RECVMMSG
+    /* Batched receive state (owned by the reading thread) */
+    unsigned batch;
+    block_t **slab;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+#endif
+    /* Statistics (protected by the FIFO lock) */
+    uint64_t packets;
+    uint64_t syscalls;
+    unsigned max_batch;
 };
 
 /*****************************************************************************
@@ -86,6 +102,9 @@ struct access_sys_t
 static block_t *BlockUDP( access_t * );
 static int Control( access_t *, int, va_list );
 static void* ThreadRead( void *data );
+#ifdef HAVE_RECVMMSG
+static void* ThreadReadBatch( void *data );
+#endif
 
 /*****************************************************************************
  * Open: open the socket
@@ -179,11 +198,35 @@ static int Open( vlc_object_t *p_this )
     }
 
     sys->fifo_size = var_InheritInteger( p_access, "udp-buffer");
+    sys->packets = sys->syscalls = 0;
+    sys->max_batch = 0;
     vlc_sem_init( &sys->semaphore, 0 );
 
-    if( vlc_clone( &sys->thread, ThreadRead, p_access,
+    void *(*reader)( void * ) = ThreadRead;
+#ifdef HAVE_RECVMMSG
+    sys->batch = var_InheritInteger( p_access, "udp-batch" );
+    sys->slab = NULL;
+    sys->msgs = NULL;
+    sys->iov = NULL;
+    if( sys->batch > 1 )
+    {
+        sys->slab = calloc( sys->batch, sizeof( *sys->slab ) );
+        sys->msgs = calloc( sys->batch, sizeof( *sys->msgs ) );
+        sys->iov = calloc( sys->batch, sizeof( *sys->iov ) );
+        if( likely(sys->slab != NULL && sys->msgs != NULL
+                && sys->iov != NULL) )
+            reader = ThreadReadBatch;
+    }
+#endif
+
+    if( vlc_clone( &sys->thread, reader, p_access,
                    VLC_THREAD_PRIORITY_INPUT ) )
     {
+#ifdef HAVE_RECVMMSG
+        free( sys->iov );
+        free( sys->msgs );
+        free( sys->slab );
+#endif
         vlc_sem_destroy( &sys->semaphore );
         block_FifoRelease( sys->fifo );
         net_Close( sys->fd );
@@ -205,6 +248,22 @@ static void Close( vlc_object_t *p_this )
 
     vlc_cancel( sys->thread );
     vlc_join( sys->thread, NULL );
+
+    if( sys->syscalls > 0 )
+        msg_Dbg( p_access, "received %"PRIu64" datagrams in %"PRIu64
+                 " system calls (%.2f per call, largest batch %u)",
+                 sys->packets, sys->syscalls,
+                 (double)sys->packets / (double)sys->syscalls,
+                 sys->max_batch );
+#ifdef HAVE_RECVMMSG
+    if( sys->slab != NULL )
+        for( unsigned i = 0; i < sys->batch; i++ )
+            if( sys->slab[i] != NULL )
+                block_Release( sys->slab[i] );
+    free( sys->iov );
+    free( sys->msgs );
+    free( sys->slab );
+#endif
     vlc_sem_destroy( &sys->semaphore );
     block_FifoRelease( sys->fifo );
     net_Close( sys->fd );
@@ -235,6 +294,21 @@ static int Control( access_t *p_access, int i_query, va_list args )
                    * var_InheritInteger(p_access, "network-caching");
             break;
 
+        case ACCESS_GET_RECV_STATS:
+        {
+            access_sys_t *sys = p_access->p_sys;
+            uint64_t *pi_packets = va_arg( args, uint64_t * );
+            uint64_t *pi_syscalls = va_arg( args, uint64_t * );
+            unsigned *pi_max_batch = va_arg( args, unsigned * );
+
+            vlc_fifo_Lock( sys->fifo );
+            *pi_packets = sys->packets;
+            *pi_syscalls = sys->syscalls;
+            *pi_max_batch = sys->max_batch;
+            vlc_fifo_Unlock( sys->fifo );
+            break;
+        }
+
         default:
             return VLC_EGENERIC;
     }
@@ -304,9 +378,106 @@ static void* ThreadRead( void *data )
         }
 
         vlc_fifo_QueueUnlocked(sys->fifo, pkt);
+        sys->packets++;
+        sys->syscalls++;
+        sys->max_batch = 1;
         vlc_fifo_Unlock(sys->fifo);
         vlc_sem_post(&sys->semaphore);
     }
 
     return NULL;
 }
+
+#ifdef HAVE_RECVMMSG
+/*****************************************************************************
+ * ThreadReadBatch: Pull as many packets as available with each system call.
+ *****************************************************************************
+ * The slab holds preallocated MTU-sized blocks. Blocks filled by recvmmsg()
+ * are chained and queued at once; only the consumed slots are refilled.
+ *****************************************************************************/
+static void* ThreadReadBatch( void *data )
+{
+    access_t *access = data;
+    access_sys_t *sys = access->p_sys;
+    unsigned avail = 0; /* preallocated blocks at the head of the slab */
+
+    for(;;)
+    {
+        while (avail < sys->batch)
+        {
+            block_t *pkt = block_Alloc(MTU);
+            if (unlikely(pkt == NULL))
+                break;
+            sys->slab[avail++] = pkt;
+        }
+
+        if (unlikely(avail == 0))
+        {   /* OOM - dequeue and discard one packet */
+            char dummy;
+            recv(sys->fd, &dummy, 1, 0);
+            continue;
+        }
+
+        for (unsigned i = 0; i < avail; i++)
+        {
+            sys->iov[i].iov_base = sys->slab[i]->p_buffer;
+            sys->iov[i].iov_len = MTU;
+            memset(&sys->msgs[i].msg_hdr, 0, sizeof (sys->msgs[i].msg_hdr));
+            sys->msgs[i].msg_hdr.msg_iov = &sys->iov[i];
+            sys->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int count;
+
+        do
+        {
+#ifndef LIBVLC_USE_PTHREAD
+            struct pollfd ufd = { .fd = sys->fd, .events = POLLIN };
+            while (poll(&ufd, 1, -1) <= 0); /* cancellation point */
+#endif
+            /* Block for the first datagram only, then drain the socket */
+            count = recvmmsg(sys->fd, sys->msgs, avail, MSG_WAITFORONE, NULL);
+        }
+        while (count <= 0);
+
+        block_t *chain = NULL, **pp = &chain;
+        size_t bytes = 0;
+
+        for (int i = 0; i < count; i++)
+        {
+            block_t *pkt = sys->slab[i];
+
+            pkt->i_buffer = sys->msgs[i].msg_len;
+            bytes += pkt->i_buffer;
+            *pp = pkt;
+            pp = &pkt->p_next;
+        }
+
+        avail -= count;
+        memmove(sys->slab, sys->slab + count, avail * sizeof (*sys->slab));
+        memset(sys->slab + avail, 0, count * sizeof (*sys->slab));
+
+        vlc_fifo_Lock(sys->fifo);
+        /* Discard old buffers on overflow */
+        while (vlc_fifo_GetBytes(sys->fifo) + bytes > sys->fifo_size
+            && !vlc_fifo_IsEmpty(sys->fifo))
+        {
+            int canc = vlc_savecancel();
+            block_Release(vlc_fifo_DequeueUnlocked(sys->fifo));
+            vlc_restorecancel(canc);
+        }
+
+        vlc_fifo_QueueUnlocked(sys->fifo, chain);
+        sys->packets += count;
+        sys->syscalls++;
+        if ((unsigned)count > sys->max_batch)
+            sys->max_batch = count;
+        vlc_fifo_Unlock(sys->fifo);
+
+        for (int i = 0; i < count; i++)
+            vlc_sem_post(&sys->semaphore);
+    }
+
+    return NULL;
+}
+#endif
@@ -61,6 +61,22 @@ static void Close( vlc_object_t * );
 #define METACUBE_TEXT N_("Metacube")
 #define METACUBE_LONGTEXT N_("Use the Metacube protocol. Needed for streaming " \
                              "to the Cubemap reflector.")
+#define BURST_TEXT N_("Burst from the last keyframe")
+#define BURST_LONGTEXT N_("New clients get the data since the last " \
+                          "keyframe right away, instead of waiting for the " \
+                          "next keyframe." )
+#define LAG_TEXT N_("Lagging clients")
+#define LAG_LONGTEXT N_("What to do with clients that cannot keep up " \
+                        "with the stream: skip to the next keyframe, " \
+                        "disconnect them, or buffer the late data for each " \
+                        "client, up to the spill size." )
+#define SPILL_TEXT N_("Spill size (kB)")
+#define SPILL_LONGTEXT N_("Late data buffered for each lagging client " \
+                          "before it skips to the next keyframe." )
+
+static const char *const ppsz_lag[] = { "keyframe", "disconnect", "spill" };
+static const char *const ppsz_lag_text[] = {
+    N_("Skip to the next keyframe"), N_("Disconnect"), N_("Spill") };
 
 
 vlc_module_begin ()
@@ -78,6 +94,13 @@ vlc_module_begin ()
                 MIME_TEXT, MIME_LONGTEXT, true )
     add_bool( SOUT_CFG_PREFIX "metacube", false,
               METACUBE_TEXT, METACUBE_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "burst", false,
+              BURST_TEXT, BURST_LONGTEXT, true )
+    add_string( SOUT_CFG_PREFIX "lag", "keyframe",
+                LAG_TEXT, LAG_LONGTEXT, true )
+        change_string_list( ppsz_lag, ppsz_lag_text )
+    add_integer_with_range( SOUT_CFG_PREFIX "spill", 2048, 0, 1024 * 1024,
+                            SPILL_TEXT, SPILL_LONGTEXT, true )
     set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -86,7 +109,7 @@ vlc_module_end ()
  * Exported prototypes
  *****************************************************************************/
 static const char *const ppsz_sout_options[] = {
-    "user", "pwd", "mime", "metacube", NULL
+    "user", "pwd", "mime", "metacube", "burst", "lag", "spill", NULL
 };
 
 static ssize_t Write( sout_access_out_t *, block_t * );
@@ -275,6 +298,20 @@ static int Open( vlc_object_t *p_this )
         return VLC_EGENERIC;
     }
 
+    char *psz_lag = var_GetString( p_access, SOUT_CFG_PREFIX "lag" );
+    int i_lag = HTTPD_STREAM_LAG_KEYFRAME;
+
+    if( psz_lag != NULL && !strcmp( psz_lag, "disconnect" ) )
+        i_lag = HTTPD_STREAM_LAG_DISCONNECT;
+    else if( psz_lag != NULL && !strcmp( psz_lag, "spill" ) )
+        i_lag = HTTPD_STREAM_LAG_SPILL;
+    free( psz_lag );
+
+    httpd_StreamSetPolicy( p_sys->p_httpd_stream,
+                           var_GetBool( p_access, SOUT_CFG_PREFIX "burst" ),
+                           i_lag,
+                           var_GetInteger( p_access, SOUT_CFG_PREFIX "spill" ) * 1024 );
+
     if( p_sys->b_metacube )
     {
         httpd_header headers[] = {{ "Content-encoding", "metacube" }};
@@ -298,6 +335,40 @@ static int Open( vlc_object_t *p_this )
     return VLC_SUCCESS;
 }
 
+/*****************************************************************************
+ * Stats: report the clients that fell behind the stream
+ *****************************************************************************/
+static void Stats( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    httpd_stream_stats_t stats;
+    httpd_client_stats_t *p_clients;
+
+    if( httpd_StreamGetStats( p_sys->p_httpd_stream, &stats, &p_clients ) )
+        return;
+
+    if( stats.i_drops > 0 || stats.i_disconnects > 0 || stats.i_spill > 0 )
+    {
+        msg_Dbg( p_access, "%u client(s), max lag %"PRIu64" bytes, "
+                 "%zu bytes spilled, %u drop(s) (%"PRIu64" bytes), "
+                 "%u disconnection(s)", stats.i_clients, stats.i_max_lag,
+                 stats.i_spill, stats.i_drops, stats.i_dropped,
+                 stats.i_disconnects );
+
+        for( unsigned i = 0; i < stats.i_clients; i++ )
+        {
+            const httpd_client_stats_t *cs = &p_clients[i];
+
+            if( cs->i_drops > 0 || cs->i_spill > 0 )
+                msg_Dbg( p_access, " client %s:%d: lag %"PRIu64" bytes, "
+                         "%zu bytes spilled, %u drop(s) (%"PRIu64" bytes)",
+                         cs->psz_ip, cs->i_port, cs->i_lag, cs->i_spill,
+                         cs->i_drops, cs->i_dropped );
+        }
+    }
+    free( p_clients );
+}
+
 /*****************************************************************************
  * Close: close the target
  *****************************************************************************/
@@ -306,6 +377,7 @@ static void Close( vlc_object_t * p_this )
     sout_access_out_t       *p_access = (sout_access_out_t*)p_this;
     sout_access_out_sys_t   *p_sys = p_access->p_sys;
 
+    Stats( p_access );
     httpd_StreamDelete( p_sys->p_httpd_stream );
     httpd_HostDelete( p_sys->p_httpd_host );
 
@@ -57,6 +57,9 @@
 
 #define MAX_RENAME_RETRIES        10
 
+/* Data waiting for the writer threads, before the muxer has to wait */
+#define MAX_QUEUED_BYTES          (32 * 1024 * 1024)
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -105,6 +108,10 @@ static void Close( vlc_object_t * );
 #define INTITIAL_SEG_TEXT N_("Number of first segment")
 #define INITIAL_SEG_LONGTEXT N_("The number of the first segment generated")
 
+#define THREADS_TEXT N_("Writer threads")
+#define THREADS_LONGTEXT N_("Number of threads writing segments and index "\
+                            "in the background")
+
 vlc_module_begin ()
     set_description( N_("HTTP Live streaming output") )
     set_shortname( N_("LiveHTTP" ))
@@ -115,6 +122,8 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "seglen", 10, SEGLEN_TEXT, SEGLEN_LONGTEXT, false )
     add_integer( SOUT_CFG_PREFIX "numsegs", 0, NUMSEGS_TEXT, NUMSEGS_LONGTEXT, false )
     add_integer( SOUT_CFG_PREFIX "initial-segment-number", 1, INTITIAL_SEG_TEXT, INITIAL_SEG_LONGTEXT, false )
+    add_integer_with_range( SOUT_CFG_PREFIX "threads", 2, 1, 16,
+                            THREADS_TEXT, THREADS_LONGTEXT, true )
     add_bool( SOUT_CFG_PREFIX "splitanywhere", false,
               SPLITANYWHERE_TEXT, SPLITANYWHERE_LONGTEXT, true )
     add_bool( SOUT_CFG_PREFIX "delsegs", true,
@@ -156,6 +165,7 @@ static const char *const ppsz_sout_options[] = {
     "key-loadfile",
     "generate-iv",
     "initial-segment-number",
+    "threads",
     NULL
 };
 
@@ -172,11 +182,27 @@ typedef struct output_segment
     float f_seglength;
     uint32_t i_segment_number;
     uint8_t aes_ivs[16];
+    uint8_t aes_key[16];
+
+    /* Queued data, taken by one writer thread at a time */
+    block_t *p_blocks;
+    block_t **pp_last;
+    size_t i_queued;
+    mtime_t i_closedate;
+    bool b_closed;  /* no more data will be queued */
+    bool b_busy;    /* a writer thread owns the file */
+    bool b_done;    /* the file is complete */
+    bool b_failed;
+
+    /* Writer thread side */
+    int i_handle;
+    gcry_cipher_hd_t aes_ctx;
+    uint8_t stuffing_bytes[16];
+    ssize_t stuffing_size;
 } output_segment_t;
 
 struct sout_access_out_sys_t
 {
-    char *psz_cursegPath;
     char *psz_indexPath;
     char *psz_indexUrl;
     char *psz_keyfile;
@@ -188,7 +214,7 @@ struct sout_access_out_sys_t
     size_t  i_seglen;
     float   f_seglen;
     block_t *block_buffer;
-    int i_handle;
+    output_segment_t *p_segment; /* being muxed */
     unsigned i_numsegs;
     unsigned i_initial_segment;
     bool b_delsegs;
@@ -198,11 +224,27 @@ struct sout_access_out_sys_t
     bool b_generate_iv;
     bool b_segment_has_data;
     uint8_t aes_ivs[16];
-    gcry_cipher_hd_t aes_ctx;
-    char *key_uri;
-    uint8_t stuffing_bytes[16];
-    ssize_t stuffing_size;
+    uint8_t aes_key[16];
+    char *key_uri; /* muxer thread only, segments have their own copy */
+
+    /* Segment files and index are written by a pool of threads.
+     * The lock protects the segments and their queues. */
+    vlc_thread_t *threads;
+    unsigned i_threads;
+    vlc_mutex_t lock;
+    vlc_cond_t wait;    /* for the writer threads */
+    vlc_cond_t drained; /* for the muxer, when the queue is full */
     vlc_array_t *segments_t;
+    vlc_array_t *pending_t; /* segments not completely written yet */
+    size_t i_queued;
+    uint32_t i_published;
+    bool b_ending;
+    bool b_error;
+    bool b_quit;
+
+    /* Serializes the index writes, i_indexed being the last listed */
+    vlc_mutex_t index_lock;
+    uint32_t i_indexed;
 };
 
 static int LoadCryptFile( sout_access_out_t *p_access);
@@ -210,6 +252,8 @@ static int CryptSetup( sout_access_out_t *p_access, char *keyfile );
 static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer );
 static ssize_t writeSegment( sout_access_out_t *p_access );
 static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys );
+static void destroySegment( output_segment_t *segment );
+static void *WriterThread( void * );
 /*****************************************************************************
  * Open: open the file
  *****************************************************************************/
@@ -245,8 +289,8 @@ static int Open( vlc_object_t *p_this )
     p_sys->b_segment_has_data = false;
 
     p_sys->segments_t = vlc_array_new();
+    p_sys->pending_t = vlc_array_new();
 
-    p_sys->stuffing_size = 0;
     p_sys->i_opendts = VLC_TS_INVALID;
     p_sys->i_dts_offset  = 0;
 
@@ -274,32 +318,60 @@ static int Open( vlc_object_t *p_this )
 
     p_access->p_sys = p_sys;
 
-    if( p_sys->psz_keyfile && ( LoadCryptFile( p_access ) < 0 ) )
+    if( ( p_sys->psz_keyfile && ( LoadCryptFile( p_access ) < 0 ) ) ||
+        ( !p_sys->psz_keyfile && ( CryptSetup( p_access, NULL ) < 0 ) ) )
     {
-        free( p_sys->psz_indexUrl );
-        free( p_sys->psz_indexPath );
-        free( p_sys );
         msg_Err( p_access, "Encryption init failed" );
-        return VLC_EGENERIC;
-    }
-    else if( !p_sys->psz_keyfile && ( CryptSetup( p_access, NULL ) < 0 ) )
-    {
-        free( p_sys->psz_indexUrl );
-        free( p_sys->psz_indexPath );
-        free( p_sys );
-        msg_Err( p_access, "Encryption init failed" );
-        return VLC_EGENERIC;
+        goto error;
     }
 
-    p_sys->i_handle = -1;
+    p_sys->p_segment = NULL;
     p_sys->i_segment = p_sys->i_initial_segment-1;
-    p_sys->psz_cursegPath = NULL;
+    p_sys->i_published = p_sys->i_segment;
+    p_sys->i_indexed = p_sys->i_segment;
+
+    vlc_mutex_init( &p_sys->lock );
+    vlc_mutex_init( &p_sys->index_lock );
+    vlc_cond_init( &p_sys->wait );
+    vlc_cond_init( &p_sys->drained );
+
+    unsigned i_threads = var_GetInteger( p_access, SOUT_CFG_PREFIX "threads" );
+    p_sys->threads = malloc( i_threads * sizeof( *p_sys->threads ) );
+    if( unlikely( p_sys->threads == NULL ) )
+        goto error_threads;
+    for( p_sys->i_threads = 0; p_sys->i_threads < i_threads; p_sys->i_threads++ )
+    {
+        if( vlc_clone( &p_sys->threads[p_sys->i_threads], WriterThread,
+                       p_access, VLC_THREAD_PRIORITY_LOW ) )
+            break;
+    }
+    if( p_sys->i_threads == 0 )
+    {
+        msg_Err( p_access, "cannot spawn writer thread" );
+        free( p_sys->threads );
+        goto error_threads;
+    }
 
     p_access->pf_write = Write;
     p_access->pf_seek  = Seek;
     p_access->pf_control = Control;
 
     return VLC_SUCCESS;
+
+error_threads:
+    vlc_cond_destroy( &p_sys->drained );
+    vlc_cond_destroy( &p_sys->wait );
+    vlc_mutex_destroy( &p_sys->index_lock );
+    vlc_mutex_destroy( &p_sys->lock );
+error:
+    free( p_sys->key_uri );
+    vlc_array_destroy( p_sys->pending_t );
+    vlc_array_destroy( p_sys->segments_t );
+    free( p_sys->psz_keyfile );
+    free( p_sys->psz_indexUrl );
+    free( p_sys->psz_indexPath );
+    free( p_sys );
+    return VLC_EGENERIC;
 }
 
 /************************************************************************
@@ -330,23 +402,12 @@ static int CryptSetup( sout_access_out_t *p_access, char *key_file )
 
     vlc_gcrypt_init();
 
-    /*Setup encryption cipher*/
-    gcry_error_t err = gcry_cipher_open( &p_sys->aes_ctx, GCRY_CIPHER_AES,
-                                         GCRY_CIPHER_MODE_CBC, 0 );
-    if( err )
-    {
-        msg_Err( p_access, "Openin AES Cipher failed: %s", gpg_strerror(err));
-        free( keyfile );
-        return VLC_EGENERIC;
-    }
-
     int keyfd = vlc_open( keyfile, O_RDONLY | O_NONBLOCK );
     if( unlikely( keyfd == -1 ) )
     {
         msg_Err( p_access, "Unable to open keyfile %s: %s", keyfile,
                  vlc_strerror_c(errno) );
         free( keyfile );
-        gcry_cipher_close( p_sys->aes_ctx );
         return VLC_EGENERIC;
     }
     free( keyfile );
@@ -357,17 +418,11 @@ static int CryptSetup( sout_access_out_t *p_access, char *key_file )
     if( keylen < 16 )
     {
         msg_Err( p_access, "No key at least 16 octects (you provided %zd), no encryption", keylen );
-        gcry_cipher_close( p_sys->aes_ctx );
         return VLC_EGENERIC;
     }
 
-    err = gcry_cipher_setkey( p_sys->aes_ctx, key, 16 );
-    if(err)
-    {
-        msg_Err(p_access, "Setting AES key failed: %s", gpg_strerror(err));
-        gcry_cipher_close( p_sys->aes_ctx );
-        return VLC_EGENERIC;
-    }
+    /* The ciphers are set up by the writer threads, for each segment */
+    memcpy( p_sys->aes_key, key, 16 );
 
     if( p_sys->b_generate_iv )
         vlc_rand_bytes( p_sys->aes_ivs, sizeof(uint8_t)*16);
@@ -441,11 +496,11 @@ static int LoadCryptFile( sout_access_out_t *p_access )
 }
 
 /************************************************************************
- * CryptKey: Set encryption IV to current segment number
+ * CryptKey: Set the segment key, and IV to the segment number
  ************************************************************************/
-static int CryptKey( sout_access_out_t *p_access, uint32_t i_segment )
+static void CryptKey( sout_access_out_sys_t *p_sys, output_segment_t *segment )
 {
-    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    uint32_t i_segment = segment->i_segment_number;
 
     if( !p_sys->b_generate_iv )
     {
@@ -457,12 +512,36 @@ static int CryptKey( sout_access_out_t *p_access, uint32_t i_segment )
         p_sys->aes_ivs[12] = (i_segment >> 24 ) & 0xff;
     }
 
-    gcry_error_t err = gcry_cipher_setiv( p_sys->aes_ctx,
-                                          p_sys->aes_ivs, 16);
+    memcpy( segment->aes_ivs, p_sys->aes_ivs, sizeof(uint8_t)*16 );
+    memcpy( segment->aes_key, p_sys->aes_key, sizeof(uint8_t)*16 );
+}
+
+/************************************************************************
+ * CryptOpen: Setup the segment cipher, from the writer thread
+ ************************************************************************/
+static int CryptOpen( sout_access_out_t *p_access, output_segment_t *segment )
+{
+    gcry_error_t err = gcry_cipher_open( &segment->aes_ctx, GCRY_CIPHER_AES,
+                                         GCRY_CIPHER_MODE_CBC, 0 );
+    if( err )
+    {
+        msg_Err( p_access, "Openin AES Cipher failed: %s", gpg_strerror(err));
+        return VLC_EGENERIC;
+    }
+
+    err = gcry_cipher_setkey( segment->aes_ctx, segment->aes_key, 16 );
+    if( err )
+    {
+        msg_Err(p_access, "Setting AES key failed: %s", gpg_strerror(err));
+        gcry_cipher_close( segment->aes_ctx );
+        return VLC_EGENERIC;
+    }
+
+    err = gcry_cipher_setiv( segment->aes_ctx, segment->aes_ivs, 16);
     if( err )
     {
         msg_Err(p_access, "Setting AES IVs failed: %s", gpg_strerror(err) );
-        gcry_cipher_close( p_sys->aes_ctx);
+        gcry_cipher_close( segment->aes_ctx );
         return VLC_EGENERIC;
     }
     return VLC_SUCCESS;
@@ -508,25 +587,27 @@ static void destroySegment( output_segment_t *segment )
     free( segment->psz_duration );
     free( segment->psz_uri );
     free( segment->psz_key_uri );
+    block_ChainRelease( segment->p_blocks );
     free( segment );
 }
 
 /************************************************************************
  * segmentAmountNeeded: check that playlist has atleast 3*p_sys->i_seglength of segments
  * return how many segments are needed for that (max of p_sys->i_segment )
+ * among the i_count first ones, which are complete
  ************************************************************************/
-static uint32_t segmentAmountNeeded( sout_access_out_sys_t *p_sys )
+static uint32_t segmentAmountNeeded( sout_access_out_sys_t *p_sys, unsigned i_count )
 {
     float duration = .0f;
-    for( unsigned index = 1; (int)index <= vlc_array_count( p_sys->segments_t ); index++ )
+    for( unsigned index = 1; index <= i_count; index++ )
     {
-        output_segment_t* segment = vlc_array_item_at_index( p_sys->segments_t, vlc_array_count( p_sys->segments_t ) - index );
+        output_segment_t* segment = vlc_array_item_at_index( p_sys->segments_t, i_count - index );
         duration += segment->f_seglength;
 
         if( duration >= (float)( 3 * p_sys->i_seglen ) )
             return __MAX(index, p_sys->i_numsegs);
     }
-    return vlc_array_count( p_sys->segments_t )-1;
+    return i_count-1;
 
 }
 
@@ -536,7 +617,8 @@ static uint32_t segmentAmountNeeded( sout_access_out_sys_t *p_sys )
  * check that the first item has been around outside playlist
  * segment->f_seglength + (p_sys->i_numsegs * p_sys->i_seglen) before it is removed.
  ************************************************************************/
-static bool isFirstItemRemovable( sout_access_out_sys_t *p_sys, uint32_t i_firstseg, uint32_t i_index_offset )
+static bool isFirstItemRemovable( sout_access_out_sys_t *p_sys, uint32_t i_firstseg,
+                                  uint32_t i_lastseg, uint32_t i_index_offset )
 {
     float duration = .0f;
 
@@ -545,7 +627,7 @@ static bool isFirstItemRemovable( sout_access_out_sys_t *p_sys, uint32_t i_first
      */
     for( unsigned int index = 0; index < i_index_offset; index++ )
     {
-        output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t, p_sys->i_segment - i_firstseg + index );
+        output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t, i_lastseg - i_firstseg + index );
         duration += segment->f_seglength;
     }
     output_segment_t *first = vlc_array_item_at_index( p_sys->segments_t, 0 );
@@ -553,71 +635,130 @@ static bool isFirstItemRemovable( sout_access_out_sys_t *p_sys, uint32_t i_first
     return duration >= (first->f_seglength + (float)(p_sys->i_numsegs * p_sys->i_seglen));
 }
 
+/************************************************************************
+ * writeIndex: Replace the index file, through a temporary one
+ ************************************************************************/
+static int writeIndex( sout_access_out_t *p_access, const char *psz_index, size_t i_index )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    char *psz_idxTmp;
+    if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
+        return -1;
+
+    FILE *fp = vlc_fopen( psz_idxTmp, "wt");
+    if ( !fp )
+    {
+        msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
+        free( psz_idxTmp );
+        return -1;
+    }
+
+    if ( fwrite( psz_index, 1, i_index, fp ) != i_index )
+    {
+        msg_Err( p_access, "cannot write index file `%s'", psz_idxTmp );
+        fclose( fp );
+        vlc_unlink( psz_idxTmp );
+        free( psz_idxTmp );
+        return -1;
+    }
+    fclose( fp );
+
+    /* readers only ever see a complete index */
+    int val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
+
+    if ( val < 0 )
+    {
+        vlc_unlink( psz_idxTmp );
+        msg_Err( p_access, "Error moving LiveHttp index file" );
+    }
+    else
+        msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
+
+    free( psz_idxTmp );
+    return val;
+}
+
+/************************************************************************
+ * appendIndex: Append formatted text to the index being built
+ ************************************************************************/
+static int appendIndex( char **ppsz_index, size_t *pi_index, const char *psz_fmt, ... )
+{
+    char *psz_line;
+    va_list args;
+
+    va_start( args, psz_fmt );
+    int i_line = vasprintf( &psz_line, psz_fmt, args );
+    va_end( args );
+    if ( i_line < 0 )
+        return -1;
+
+    char *psz_new = realloc( *ppsz_index, *pi_index + i_line + 1 );
+    if ( !psz_new )
+    {
+        free( psz_line );
+        return -1;
+    }
+    memcpy( psz_new + *pi_index, psz_line, i_line + 1 );
+    free( psz_line );
+    *ppsz_index = psz_new;
+    *pi_index += i_line;
+    return 0;
+}
+
 /************************************************************************
  * updateIndexAndDel: If necessary, update index file & delete old segments
+ * The index lists the segments up to i_lastseg, and is built with the
+ * lock held, which is released while writing files.
  ************************************************************************/
-static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys,
+                              uint32_t i_lastseg, bool b_isend )
 {
 
     uint32_t i_firstseg;
     unsigned i_index_offset = 0;
+    char *psz_index = NULL;
+    size_t i_index = 0;
+
+    output_segment_t *oldest = vlc_array_item_at_index( p_sys->segments_t, 0 );
+    unsigned i_count = i_lastseg - oldest->i_segment_number + 1;
 
     if ( p_sys->i_numsegs == 0 ||
-         p_sys->i_segment < ( p_sys->i_numsegs + p_sys->i_initial_segment ) )
+         i_lastseg < ( p_sys->i_numsegs + p_sys->i_initial_segment ) )
     {
         i_firstseg = p_sys->i_initial_segment;
     }
     else
     {
-        unsigned numsegs = segmentAmountNeeded( p_sys );
-        i_firstseg = ( p_sys->i_segment - numsegs ) + 1;
-        i_index_offset = vlc_array_count( p_sys->segments_t ) - numsegs;
+        unsigned numsegs = segmentAmountNeeded( p_sys, i_count );
+        i_firstseg = ( i_lastseg - numsegs ) + 1;
+        i_index_offset = i_count - numsegs;
     }
 
-    // First update index
+    // First build the index
     if ( p_sys->psz_indexPath )
     {
-        int val;
-        FILE *fp;
-        char *psz_idxTmp;
-        if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
-            return -1;
-
-        fp = vlc_fopen( psz_idxTmp, "wt");
-        if ( !fp )
-        {
-            msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
-            free( psz_idxTmp );
-            return -1;
-        }
-
-        if ( fprintf( fp, "#EXTM3U\n#EXT-X-TARGETDURATION:%zu\n#EXT-X-VERSION:3\n#EXT-X-ALLOW-CACHE:%s"
+        if ( appendIndex( &psz_index, &i_index, "#EXTM3U\n#EXT-X-TARGETDURATION:%zu\n#EXT-X-VERSION:3\n#EXT-X-ALLOW-CACHE:%s"
                           "%s\n#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n%s", p_sys->i_seglen,
                           p_sys->b_caching ? "YES" : "NO",
                           p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT",
                           i_firstseg, ((p_sys->i_initial_segment > 1) && (p_sys->i_initial_segment == i_firstseg)) ? "#EXT-X-DISCONTINUITY\n" : ""
-                          ) < 0 )
-        {
-            free( psz_idxTmp );
-            fclose( fp );
+                          ) )
             return -1;
-        }
-        char *psz_current_uri=NULL;
+        const char *psz_current_uri = NULL;
 
 
-        for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
+        for ( uint32_t i = i_firstseg; i <= i_lastseg; i++ )
         {
             //scale to i_index_offset..numsegs + i_index_offset
             uint32_t index = i - i_firstseg + i_index_offset;
 
             output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, index );
-            if( p_sys->key_uri &&
+            if( segment->psz_key_uri &&
                 ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
               )
             {
                 int ret = 0;
-                free( psz_current_uri );
-                psz_current_uri = strdup( segment->psz_key_uri );
+                psz_current_uri = segment->psz_key_uri;
                 if( p_sys->b_generate_iv )
                 {
                     unsigned long long iv_hi = segment->aes_ivs[0];
@@ -629,66 +770,62 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
                         iv_lo <<= 8;
                         iv_lo |= segment->aes_ivs[8+i] & 0xff;
                     }
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
-                                   segment->psz_key_uri, iv_hi, iv_lo );
+                    ret = appendIndex( &psz_index, &i_index, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
+                                       segment->psz_key_uri, iv_hi, iv_lo );
 
                 } else {
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
+                    ret = appendIndex( &psz_index, &i_index, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
                 }
-                if( ret < 0 )
+                if( ret )
                 {
-                    free( psz_current_uri );
-                    free( psz_idxTmp );
-                    fclose( fp );
+                    free( psz_index );
                     return -1;
                 }
             }
 
-            val = fprintf( fp, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri);
-            if ( val < 0 )
+            if ( appendIndex( &psz_index, &i_index, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri ) )
             {
-                free( psz_current_uri );
-                free( psz_idxTmp );
-                fclose( fp );
+                free( psz_index );
                 return -1;
             }
         }
-        free( psz_current_uri );
-
-        if ( b_isend )
-        {
-            if ( fputs ( STR_ENDLIST, fp ) < 0)
-            {
-                free( psz_idxTmp );
-                fclose( fp ) ;
-                return -1;
-            }
-
-        }
-        fclose( fp );
-
-        val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
 
-        if ( val < 0 )
+        if ( b_isend && appendIndex( &psz_index, &i_index, "%s", STR_ENDLIST ) )
         {
-            vlc_unlink( psz_idxTmp );
-            msg_Err( p_access, "Error moving LiveHttp index file" );
+            free( psz_index );
+            return -1;
         }
-        else
-            msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
-
-        free( psz_idxTmp );
     }
 
     // Then take care of deletion
     // Try to follow pantos draft 11 section 6.2.2
+    vlc_array_t deleted;
+    vlc_array_init( &deleted );
     while( p_sys->b_delsegs && p_sys->i_numsegs &&
-           isFirstItemRemovable( p_sys, i_firstseg, i_index_offset )
+           isFirstItemRemovable( p_sys, i_firstseg, i_lastseg, i_index_offset )
          )
     {
          output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t, 0 );
-         msg_Dbg( p_access, "Removing segment number %d", segment->i_segment_number );
          vlc_array_remove( p_sys->segments_t, 0 );
+         vlc_array_append( &deleted, segment );
+         i_index_offset -=1;
+    }
+
+    /* Another thread may have published a newer index meanwhile */
+    vlc_mutex_unlock( &p_sys->lock );
+    vlc_mutex_lock( &p_sys->index_lock );
+    if ( psz_index && ( i_lastseg > p_sys->i_indexed || b_isend ) )
+    {
+        writeIndex( p_access, psz_index, i_index );
+        p_sys->i_indexed = i_lastseg;
+    }
+    vlc_mutex_unlock( &p_sys->index_lock );
+    free( psz_index );
+
+    for( int i = 0; i < vlc_array_count( &deleted ); i++ )
+    {
+         output_segment_t *segment = vlc_array_item_at_index( &deleted, i );
+         msg_Dbg( p_access, "Removing segment number %d", segment->i_segment_number );
 
          if ( segment->psz_filename )
          {
@@ -696,60 +833,270 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
          }
 
          destroySegment( segment );
-         i_index_offset -=1;
     }
-
+    vlc_array_clear( &deleted );
+    vlc_mutex_lock( &p_sys->lock );
 
     return 0;
 }
 
 /*****************************************************************************
- * closeCurrentSegment: Close the segment file
+ * writeSegmentData: Encrypt and write queued data, from a writer thread
  *****************************************************************************/
-static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+static int writeSegmentData( sout_access_out_t *p_access, output_segment_t *segment,
+                             block_t *p_chain )
 {
-    if ( p_sys->i_handle >= 0 )
+    if ( segment->i_handle < 0 )
     {
-        output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, vlc_array_count( p_sys->segments_t ) - 1 );
+        int fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
+                             O_TRUNC, 0666 );
+        if ( fd == -1 )
+        {
+            msg_Err( p_access, "cannot open `%s' (%s)", segment->psz_filename,
+                     vlc_strerror_c(errno) );
+            block_ChainRelease( p_chain );
+            return -1;
+        }
 
-        if( p_sys->key_uri )
+        if( segment->psz_key_uri && CryptOpen( p_access, segment ) != VLC_SUCCESS )
         {
-            size_t pad = 16 - p_sys->stuffing_size;
-            memset(&p_sys->stuffing_bytes[p_sys->stuffing_size], pad, pad);
-            gcry_error_t err = gcry_cipher_encrypt( p_sys->aes_ctx, p_sys->stuffing_bytes, 16, NULL, 0 );
+            close( fd );
+            vlc_unlink( segment->psz_filename );
+            block_ChainRelease( p_chain );
+            return -1;
+        }
+        segment->i_handle = fd;
+        msg_Dbg( p_access, "Successfully opened livehttp file: %s (%"PRIu32")" , segment->psz_filename, segment->i_segment_number );
+    }
 
-            if( err ) {
-               msg_Err( p_access, "Couldn't encrypt 16 bytes: %s", gpg_strerror(err) );
-            } else {
+    block_t *output = p_chain ? block_ChainGather( p_chain ) : NULL;
+    bool crypted = false;
+    while( output )
+    {
+        if( segment->psz_key_uri && !crypted )
+        {
+            if( segment->stuffing_size )
+            {
+                output = block_Realloc( output, segment->stuffing_size, output->i_buffer );
+                if( unlikely(!output ) )
+                    return -1;
+                memcpy( output->p_buffer, segment->stuffing_bytes, segment->stuffing_size );
+                segment->stuffing_size = 0;
+            }
+            size_t original = output->i_buffer;
+            size_t padded = (output->i_buffer + 15 ) & ~15;
+            size_t pad = padded - original;
+            if( pad )
+            {
+                segment->stuffing_size = 16-pad;
+                output->i_buffer -= segment->stuffing_size;
+                memcpy(segment->stuffing_bytes, &output->p_buffer[output->i_buffer], segment->stuffing_size);
+            }
 
-            int ret = vlc_write( p_sys->i_handle, p_sys->stuffing_bytes, 16 );
-            if( ret != 16 )
-                msg_Err( p_access, "Couldn't write 16 bytes" );
+            gcry_error_t err = gcry_cipher_encrypt( segment->aes_ctx,
+                                output->p_buffer, output->i_buffer, NULL, 0 );
+            if( err )
+            {
+                msg_Err( p_access, "Encryption failure: %s ", gpg_strerror(err) );
+                block_ChainRelease( output );
+                return -1;
             }
-            p_sys->stuffing_size = 0;
-        }
+            crypted=true;
 
+        }
 
-        close( p_sys->i_handle );
-        p_sys->i_handle = -1;
+        ssize_t val = vlc_write( segment->i_handle, output->p_buffer, output->i_buffer );
+        if ( val == -1 )
+        {
+           if ( errno == EINTR )
+              continue;
+           msg_Err( p_access, "cannot write `%s' (%s)", segment->psz_filename,
+                    vlc_strerror_c(errno) );
+           block_ChainRelease( output );
+           return -1;
+        }
 
-        if( ! ( us_asprintf( &segment->psz_duration, "%.2f", p_sys->f_seglen ) ) )
+        if ( (size_t)val >= output->i_buffer )
         {
-            msg_Err( p_access, "Couldn't set duration on closed segment");
-            return;
+           block_t *p_next = output->p_next;
+           block_Release (output);
+           output = p_next;
+           crypted=false;
         }
-        segment->f_seglength = p_sys->f_seglen;
+        else
+        {
+           output->p_buffer += val;
+           output->i_buffer -= val;
+        }
+    }
+    return 0;
+}
 
-        segment->i_segment_number = p_sys->i_segment;
+/*****************************************************************************
+ * closeSegmentFile: Pad the encrypted data and close the file
+ *****************************************************************************/
+static void closeSegmentFile( sout_access_out_t *p_access, output_segment_t *segment )
+{
+    if ( segment->i_handle < 0 )
+        return;
 
-        if ( p_sys->psz_cursegPath )
+    if( segment->psz_key_uri )
+    {
+        size_t pad = 16 - segment->stuffing_size;
+        memset(&segment->stuffing_bytes[segment->stuffing_size], pad, pad);
+        gcry_error_t err = gcry_cipher_encrypt( segment->aes_ctx, segment->stuffing_bytes, 16, NULL, 0 );
+
+        if( err ) {
+           msg_Err( p_access, "Couldn't encrypt 16 bytes: %s", gpg_strerror(err) );
+        } else {
+
+        int ret = vlc_write( segment->i_handle, segment->stuffing_bytes, 16 );
+        if( ret != 16 )
+            msg_Err( p_access, "Couldn't write 16 bytes" );
+        }
+        segment->stuffing_size = 0;
+        gcry_cipher_close( segment->aes_ctx );
+    }
+
+    close( segment->i_handle );
+    segment->i_handle = -1;
+}
+
+static output_segment_t *nextPendingSegment( sout_access_out_sys_t *p_sys )
+{
+    for( int i = 0; i < vlc_array_count( p_sys->pending_t ); i++ )
+    {
+        output_segment_t *segment = vlc_array_item_at_index( p_sys->pending_t, i );
+        if( !segment->b_busy && ( segment->p_blocks || segment->b_closed ) )
+            return segment;
+    }
+    return NULL;
+}
+
+/*****************************************************************************
+ * publishSegments: Update the index up to the last segment completed in order,
+ * called with the lock held
+ *****************************************************************************/
+static void publishSegments( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys )
+{
+    output_segment_t *oldest = vlc_array_item_at_index( p_sys->segments_t, 0 );
+    uint32_t i_lastseg = p_sys->i_published;
+
+    for( ;; )
+    {
+        int index = i_lastseg + 1 - oldest->i_segment_number;
+        if( index >= vlc_array_count( p_sys->segments_t ) )
+            break;
+        output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t, index );
+        if( !segment->b_done || segment->b_failed )
+            break;
+        i_lastseg++;
+    }
+
+    if( i_lastseg == p_sys->i_published )
+        return;
+    p_sys->i_published = i_lastseg;
+    updateIndexAndDel( p_access, p_sys, i_lastseg,
+                       p_sys->b_ending && i_lastseg == p_sys->i_segment );
+}
+
+/*****************************************************************************
+ * WriterThread: Write the queued segment data, then publish the segments
+ *****************************************************************************/
+static void *WriterThread( void *data )
+{
+    sout_access_out_t *p_access = data;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &p_sys->lock );
+    for( ;; )
+    {
+        output_segment_t *segment;
+        while( !( segment = nextPendingSegment( p_sys ) ) && !p_sys->b_quit )
+            vlc_cond_wait( &p_sys->wait, &p_sys->lock );
+        if( !segment )
+            break; /* everything was written */
+
+        /* Data of a segment is written by a single thread at a time */
+        block_t *p_chain = segment->p_blocks;
+        size_t i_size = segment->i_queued;
+        bool b_close = segment->b_closed;
+        bool b_failed = segment->b_failed;
+        segment->p_blocks = NULL;
+        segment->pp_last = &segment->p_blocks;
+        segment->i_queued = 0;
+        segment->b_busy = true;
+        vlc_mutex_unlock( &p_sys->lock );
+
+        int val = 0;
+        if( b_failed )
+            block_ChainRelease( p_chain );
+        else
+            val = writeSegmentData( p_access, segment, p_chain );
+        if( b_close )
+            closeSegmentFile( p_access, segment );
+
+        vlc_mutex_lock( &p_sys->lock );
+        p_sys->i_queued -= i_size;
+        vlc_cond_signal( &p_sys->drained );
+        segment->b_busy = false;
+        if( val < 0 )
+        {
+            segment->b_failed = true;
+            p_sys->b_error = true;
+        }
+
+        if( b_close )
         {
-            msg_Dbg( p_access, "LiveHttpSegmentComplete: %s (%"PRIu32")" , p_sys->psz_cursegPath, p_sys->i_segment );
-            free( p_sys->psz_cursegPath );
-            p_sys->psz_cursegPath = 0;
-            updateIndexAndDel( p_access, p_sys, b_isend );
+            mtime_t i_latency = mdate() - segment->i_closedate;
+            segment->b_done = true;
+            vlc_array_remove( p_sys->pending_t,
+                              vlc_array_index_of_item( p_sys->pending_t, segment ) );
+
+            if( !segment->b_failed )
+            {
+                msg_Dbg( p_access, "LiveHttpSegmentComplete: %s (%"PRIu32"), written in %"PRId64" ms",
+                         segment->psz_filename, segment->i_segment_number, i_latency / 1000 );
+                if( i_latency > p_sys->i_seglenm )
+                    msg_Warn( p_access, "segment %"PRIu32" written %"PRId64" ms after its end, "
+                              "storage is too slow", segment->i_segment_number, i_latency / 1000 );
+            }
+            publishSegments( p_access, p_sys );
         }
     }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+/*****************************************************************************
+ * closeCurrentSegment: Hand the segment over to the writer threads
+ *****************************************************************************/
+static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+{
+    output_segment_t *segment = p_sys->p_segment;
+    if ( !segment )
+        return;
+
+    vlc_mutex_lock( &p_sys->lock );
+    if( us_asprintf( &segment->psz_duration, "%.2f", p_sys->f_seglen ) == -1 )
+    {
+        msg_Err( p_access, "Couldn't set duration on closed segment");
+        segment->psz_duration = NULL;
+        segment->b_failed = true;
+        p_sys->b_error = true;
+    }
+    segment->f_seglength = p_sys->f_seglen;
+    segment->i_closedate = mdate();
+    segment->b_closed = true;
+    if( b_isend )
+        p_sys->b_ending = true;
+    vlc_cond_signal( &p_sys->wait );
+    vlc_mutex_unlock( &p_sys->lock );
+
+    p_sys->p_segment = NULL;
 }
 
 /*****************************************************************************
@@ -799,11 +1146,17 @@ static void Close( vlc_object_t * p_this )
 
     closeCurrentSegment( p_access, p_sys, true );
 
-    if( p_sys->key_uri )
-    {
-        gcry_cipher_close( p_sys->aes_ctx );
-        free( p_sys->key_uri );
-    }
+    /* Let the writer threads complete the files and the index */
+    vlc_mutex_lock( &p_sys->lock );
+    p_sys->b_quit = true;
+    vlc_cond_broadcast( &p_sys->wait );
+    vlc_mutex_unlock( &p_sys->lock );
+
+    for( unsigned i = 0; i < p_sys->i_threads; i++ )
+        vlc_join( p_sys->threads[i], NULL );
+    free( p_sys->threads );
+
+    free( p_sys->key_uri );
 
     while( vlc_array_count( p_sys->segments_t ) > 0 )
     {
@@ -818,7 +1171,14 @@ static void Close( vlc_object_t * p_this )
         destroySegment( segment );
     }
     vlc_array_destroy( p_sys->segments_t );
+    vlc_array_destroy( p_sys->pending_t );
+
+    vlc_cond_destroy( &p_sys->drained );
+    vlc_cond_destroy( &p_sys->wait );
+    vlc_mutex_destroy( &p_sys->index_lock );
+    vlc_mutex_destroy( &p_sys->lock );
 
+    free( p_sys->psz_keyfile );
     free( p_sys->psz_indexUrl );
     free( p_sys->psz_indexPath );
     free( p_sys );
@@ -851,8 +1211,6 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
  *****************************************************************************/
 static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys )
 {
-    int fd;
-
     uint32_t i_newseg = p_sys->i_segment + 1;
 
     /* Create segment and fill it info that we can (everything excluding duration */
@@ -861,6 +1219,8 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
         return -1;
 
     segment->i_segment_number = i_newseg;
+    segment->i_handle = -1;
+    segment->pp_last = &segment->p_blocks;
     segment->psz_filename = formatSegmentPath( p_access->psz_path, i_newseg, true );
     char *psz_idxFormat = p_sys->psz_indexUrl ? p_sys->psz_indexUrl : p_access->psz_path;
     segment->psz_uri = formatSegmentPath( psz_idxFormat , i_newseg, false );
@@ -872,18 +1232,6 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
         return -1;
     }
 
-    fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
-                     O_TRUNC, 0666 );
-    if ( fd == -1 )
-    {
-        msg_Err( p_access, "cannot open `%s' (%s)", segment->psz_filename,
-                 vlc_strerror_c(errno) );
-        destroySegment( segment );
-        return -1;
-    }
-
-    vlc_array_append( p_sys->segments_t, segment);
-
     if( p_sys->psz_keyfile )
     {
         LoadCryptFile( p_access );
@@ -892,17 +1240,25 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
     if( p_sys->key_uri )
     {
         segment->psz_key_uri = strdup( p_sys->key_uri );
-        CryptKey( p_access, i_newseg );
-        if( p_sys->b_generate_iv )
-            memcpy( segment->aes_ivs, p_sys->aes_ivs, sizeof(uint8_t)*16 );
+        CryptKey( p_sys, segment );
     }
-    msg_Dbg( p_access, "Successfully opened livehttp file: %s (%"PRIu32")" , segment->psz_filename, i_newseg );
 
-    p_sys->psz_cursegPath = strdup(segment->psz_filename);
-    p_sys->i_handle = fd;
+    /* The file itself is created by the writer threads */
+    vlc_mutex_lock( &p_sys->lock );
+    if( p_sys->b_error )
+    {
+        vlc_mutex_unlock( &p_sys->lock );
+        destroySegment( segment );
+        return -1;
+    }
+    vlc_array_append( p_sys->segments_t, segment );
+    vlc_array_append( p_sys->pending_t, segment );
     p_sys->i_segment = i_newseg;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    p_sys->p_segment = segment;
     p_sys->b_segment_has_data = false;
-    return fd;
+    return 0;
 }
 /*****************************************************************************
  * CheckSegmentChange: Check if segment needs to be closed and new opened
@@ -924,14 +1280,14 @@ static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer )
         msg_Dbg( p_access, "dts offset %"PRId64, p_sys->i_dts_offset );
     }
 
-    if( p_sys->i_handle > 0 && p_sys->b_segment_has_data &&
+    if( p_sys->p_segment && p_sys->b_segment_has_data &&
        (( p_buffer->i_length + p_buffer->i_dts - p_sys->i_opendts +
           p_sys->i_dts_offset ) >= p_sys->i_seglenm ) )
     {
         closeCurrentSegment( p_access, p_sys, false );
     }
 
-    if ( unlikely( p_sys->i_handle < 0 ) )
+    if ( unlikely( !p_sys->p_segment ) )
     {
         p_sys->i_dts_offset = 0;
         p_sys->i_opendts = output ? output->i_dts : p_buffer->i_dts;
@@ -949,70 +1305,45 @@ static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer )
 static ssize_t writeSegment( sout_access_out_t *p_access )
 {
     sout_access_out_sys_t *p_sys = p_access->p_sys;
-    block_t *output = p_sys->block_buffer ? block_ChainGather( p_sys->block_buffer ) : NULL;
+    output_segment_t *segment = p_sys->p_segment;
+    block_t *output = p_sys->block_buffer;
     p_sys->block_buffer = NULL;
-    ssize_t i_write=0;
-    bool crypted = false;
-    while( output )
+
+    if( !output )
+        return 0;
+    if( !segment )
     {
-        if( p_sys->key_uri && !crypted )
-        {
-            if( p_sys->stuffing_size )
-            {
-                output = block_Realloc( output, p_sys->stuffing_size, output->i_buffer );
-                if( unlikely(!output ) )
-                    return VLC_ENOMEM;
-                memcpy( output->p_buffer, p_sys->stuffing_bytes, p_sys->stuffing_size );
-                p_sys->stuffing_size = 0;
-            }
-            size_t original = output->i_buffer;
-            size_t padded = (output->i_buffer + 15 ) & ~15;
-            size_t pad = padded - original;
-            if( pad )
-            {
-                p_sys->stuffing_size = 16-pad;
-                output->i_buffer -= p_sys->stuffing_size;
-                memcpy(p_sys->stuffing_bytes, &output->p_buffer[output->i_buffer], p_sys->stuffing_size);
-            }
+        block_ChainRelease( output );
+        return -1;
+    }
 
-            gcry_error_t err = gcry_cipher_encrypt( p_sys->aes_ctx,
-                                output->p_buffer, output->i_buffer, NULL, 0 );
-            if( err )
-            {
-                msg_Err( p_access, "Encryption failure: %s ", gpg_strerror(err) );
-                return -1;
-            }
-            crypted=true;
+    size_t i_size;
+    mtime_t i_length;
+    block_ChainProperties( output, NULL, &i_size, &i_length );
+    p_sys->f_seglen =
+        (float)(i_length +
+                output->i_dts - p_sys->i_opendts + p_sys->i_dts_offset) / CLOCK_FREQ;
 
-        }
+    /* Queue for the writer threads, waiting when storage doesn't keep up */
+    vlc_mutex_lock( &p_sys->lock );
+    while( p_sys->i_queued > 0 && p_sys->i_queued + i_size > MAX_QUEUED_BYTES &&
+           !p_sys->b_error )
+        vlc_cond_wait( &p_sys->drained, &p_sys->lock );
 
-        ssize_t val = vlc_write( p_sys->i_handle, output->p_buffer, output->i_buffer );
-        if ( val == -1 )
-        {
-           if ( errno == EINTR )
-              continue;
-           return -1;
-        }
+    if( p_sys->b_error )
+    {
+        vlc_mutex_unlock( &p_sys->lock );
+        block_ChainRelease( output );
+        return -1;
+    }
 
-        p_sys->f_seglen =
-            (float)(output->i_length +
-                    output->i_dts - p_sys->i_opendts + p_sys->i_dts_offset) / CLOCK_FREQ;
+    block_ChainLastAppend( &segment->pp_last, output );
+    segment->i_queued += i_size;
+    p_sys->i_queued += i_size;
+    vlc_cond_signal( &p_sys->wait );
+    vlc_mutex_unlock( &p_sys->lock );
 
-        if ( (size_t)val >= output->i_buffer )
-        {
-           block_t *p_next = output->p_next;
-           block_Release (output);
-           output = p_next;
-           crypted=false;
-        }
-        else
-        {
-           output->p_buffer += val;
-           output->i_buffer -= val;
-        }
-        i_write += val;
-    }
-    return i_write;
+    return i_size;
 }
 
 /*****************************************************************************
@@ -46,10 +46,21 @@
 #else
 #   include <sys/socket.h>
 #endif
+#ifdef HAVE_SENDMMSG
+#   include <netinet/udp.h>
+#endif
 
 #include <vlc_network.h>
 
 #define MAX_EMPTY_BLOCKS 200
+#define MAX_BATCH 64 /* also the kernel limit of UDP GSO segments */
+#define GSO_MAX_BYTES 65000
+
+/* Upper bounds (in microseconds) of the send delay histogram buckets */
+static const mtime_t delay_buckets[] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, INT64_MAX
+};
+#define DELAY_BUCKETS (sizeof (delay_buckets) / sizeof (delay_buckets[0]))
 
 /*****************************************************************************
  * Module descriptor
@@ -70,6 +81,14 @@ static void Close( vlc_object_t * );
                           "of packets that will be sent at a time. It " \
                           "helps reducing the scheduling load on " \
                           "heavily-loaded systems." )
+#define WINDOW_TEXT N_("Pacing window (ms)")
+#define WINDOW_LONGTEXT N_("Packets due within this delay after a paced " \
+                           "packet are sent together with it, with a " \
+                           "single system call. Packets already due are " \
+                           "always sent together." )
+#define GSO_TEXT N_("Segmentation offload")
+#define GSO_LONGTEXT N_("Let the kernel split groups of equally sized " \
+                        "packets (UDP GSO), if supported." )
 
 vlc_module_begin ()
     set_description( N_("UDP stream output") )
@@ -79,6 +98,10 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000, CACHING_TEXT, CACHING_LONGTEXT, true )
     add_integer( SOUT_CFG_PREFIX "group", 1, GROUP_TEXT, GROUP_LONGTEXT,
                                  true )
+    add_integer( SOUT_CFG_PREFIX "window", 0, WINDOW_TEXT, WINDOW_LONGTEXT,
+                 true )
+        change_integer_range( 0, 1000 )
+    add_bool( SOUT_CFG_PREFIX "gso", true, GSO_TEXT, GSO_LONGTEXT, true )
 
     set_capability( "sout access", 0 )
     add_shortcut( "udp" )
@@ -92,6 +115,8 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "caching",
     "group",
+    "window",
+    "gso",
     NULL
 };
 
@@ -118,8 +143,30 @@ struct sout_access_out_sys_t
     size_t        i_mtu;
 
     block_fifo_t *p_fifo;
-    block_fifo_t *p_empty_blocks;
     block_t      *p_buffer;
+    block_t      *p_empty; /**< packets available to Write() */
+
+    /* Sent packets handed back to Write() for reuse, one batch at a time */
+    vlc_mutex_t   recycle_lock;
+    block_t      *p_recycled;
+    unsigned      i_recycled;
+
+    /* Transmit state (owned by the sending thread) */
+    mtime_t       i_window;
+    block_t      *pp_batch[MAX_BATCH];
+    unsigned      i_batch;
+    block_t      *p_pending; /**< dequeued paced packet not yet due */
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec  iov[MAX_BATCH];
+#endif
+    bool          b_gso;
+
+    /* Transmit statistics (owned by the sending thread) */
+    uint64_t      i_sent_packets;
+    uint64_t      i_sent_batches;
+    uint64_t      late_hist[DELAY_BUCKETS];
+    uint64_t      jitter_hist[DELAY_BUCKETS];
 
     vlc_thread_t  thread;
 };
@@ -211,15 +258,26 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_mtu = var_CreateGetInteger( p_this, "mtu" );
     p_sys->b_mtu_warning = false;
     p_sys->p_fifo = block_FifoNew();
-    p_sys->p_empty_blocks = block_FifoNew();
     p_sys->p_buffer = NULL;
+    p_sys->p_empty = NULL;
+    vlc_mutex_init( &p_sys->recycle_lock );
+    p_sys->p_recycled = NULL;
+    p_sys->i_recycled = 0;
+    p_sys->i_window = INT64_C(1000)
+                    * var_GetInteger( p_access, SOUT_CFG_PREFIX "window" );
+    p_sys->i_batch = 0;
+    p_sys->p_pending = NULL;
+    p_sys->b_gso = var_GetBool( p_access, SOUT_CFG_PREFIX "gso" );
+    p_sys->i_sent_packets = p_sys->i_sent_batches = 0;
+    memset( p_sys->late_hist, 0, sizeof (p_sys->late_hist) );
+    memset( p_sys->jitter_hist, 0, sizeof (p_sys->jitter_hist) );
 
     if( vlc_clone( &p_sys->thread, ThreadWrite, p_access,
                            VLC_THREAD_PRIORITY_HIGHEST ) )
     {
         msg_Err( p_access, "cannot spawn sout access thread" );
         block_FifoRelease( p_sys->p_fifo );
-        block_FifoRelease( p_sys->p_empty_blocks );
+        vlc_mutex_destroy( &p_sys->recycle_lock );
         net_Close (i_handle);
         free (p_sys);
         return VLC_EGENERIC;
@@ -243,8 +301,34 @@ static void Close( vlc_object_t * p_this )
     vlc_cancel( p_sys->thread );
     vlc_join( p_sys->thread, NULL );
     block_FifoRelease( p_sys->p_fifo );
-    block_FifoRelease( p_sys->p_empty_blocks );
 
+    if( p_sys->i_sent_batches > 0 )
+    {
+        char late[DELAY_BUCKETS * 21], jitter[DELAY_BUCKETS * 21];
+        size_t late_len = 0, jitter_len = 0;
+
+        for( size_t i = 0; i < DELAY_BUCKETS; i++ )
+        {
+            late_len += snprintf( late + late_len, sizeof (late) - late_len,
+                                  " %"PRIu64, p_sys->late_hist[i] );
+            jitter_len += snprintf( jitter + jitter_len,
+                                    sizeof (jitter) - jitter_len,
+                                    " %"PRIu64, p_sys->jitter_hist[i] );
+        }
+        msg_Dbg( p_access, "sent %"PRIu64" packets in %"PRIu64" batches",
+                 p_sys->i_sent_packets, p_sys->i_sent_batches );
+        msg_Dbg( p_access, "send delay (<1,<2,<5,<10,<20,<50,<100,>=100 ms):"
+                 "%s", late );
+        msg_Dbg( p_access, "send jitter (<1,<2,<5,<10,<20,<50,<100,>=100 ms):"
+                 "%s", jitter );
+    }
+
+    for( unsigned i = 0; i < p_sys->i_batch; i++ )
+        block_Release( p_sys->pp_batch[i] );
+    if( p_sys->p_pending ) block_Release( p_sys->p_pending );
+    block_ChainRelease( p_sys->p_recycled );
+    vlc_mutex_destroy( &p_sys->recycle_lock );
+    block_ChainRelease( p_sys->p_empty );
     if( p_sys->p_buffer ) block_Release( p_sys->p_buffer );
 
     net_Close( p_sys->i_handle );
@@ -369,23 +453,31 @@ static block_t *NewUDPPacket( sout_access_out_t *p_access, mtime_t i_dts)
     sout_access_out_sys_t *p_sys = p_access->p_sys;
     block_t *p_buffer;
 
-    while ( block_FifoCount( p_sys->p_empty_blocks ) > MAX_EMPTY_BLOCKS )
-    {
-        p_buffer = block_FifoGet( p_sys->p_empty_blocks );
-        block_Release( p_buffer );
+    if( p_sys->p_empty == NULL )
+    {   /* Take back all the packets sent in the mean time at once */
+        vlc_mutex_lock( &p_sys->recycle_lock );
+        p_sys->p_empty = p_sys->p_recycled;
+        p_sys->p_recycled = NULL;
+        p_sys->i_recycled = 0;
+        vlc_mutex_unlock( &p_sys->recycle_lock );
     }
 
-    if( block_FifoCount( p_sys->p_empty_blocks ) == 0 )
+    if( p_sys->p_empty == NULL )
     {
         p_buffer = block_Alloc( p_sys->i_mtu );
     }
     else
     {
-        p_buffer = block_FifoGet(p_sys->p_empty_blocks );
+        p_buffer = p_sys->p_empty;
+        p_sys->p_empty = p_buffer->p_next;
+        p_buffer->p_next = NULL;
         p_buffer->i_flags = 0;
         p_buffer = block_Realloc( p_buffer, 0, p_sys->i_mtu );
     }
 
+    if( unlikely(p_buffer == NULL) )
+        return NULL;
+
     p_buffer->i_dts = i_dts;
     p_buffer->i_buffer = 0;
 
@@ -393,75 +485,314 @@ static block_t *NewUDPPacket( sout_access_out_t *p_access, mtime_t i_dts)
 }
 
 /*****************************************************************************
- * ThreadWrite: Write a packet on the network at the good time.
+ * RecyclePackets: hand sent packets back to Write()
  *****************************************************************************/
-static void* ThreadWrite( void *data )
+static void RecyclePackets( sout_access_out_sys_t *p_sys,
+                            block_t **pp_packets, unsigned i_count )
+{
+    unsigned i_keep;
+
+    vlc_mutex_lock( &p_sys->recycle_lock );
+    if( p_sys->i_recycled < MAX_EMPTY_BLOCKS )
+        i_keep = __MIN( i_count, MAX_EMPTY_BLOCKS - p_sys->i_recycled );
+    else
+        i_keep = 0;
+
+    for( unsigned i = 0; i < i_keep; i++ )
+    {
+        pp_packets[i]->p_next = p_sys->p_recycled;
+        p_sys->p_recycled = pp_packets[i];
+    }
+    p_sys->i_recycled += i_keep;
+    vlc_mutex_unlock( &p_sys->recycle_lock );
+
+    for( unsigned i = i_keep; i < i_count; i++ )
+        block_Release( pp_packets[i] );
+}
+
+static void UpdateHistogram( uint64_t *hist, mtime_t i_delay )
+{
+    size_t i = 0;
+
+    while( i_delay >= delay_buckets[i] )
+        i++;
+    hist[i]++;
+}
+
+#if defined(HAVE_SENDMMSG) && defined(UDP_SEGMENT)
+/*****************************************************************************
+ * SendGSO: send the batch as a single buffer segmented by the kernel
+ *****************************************************************************
+ * All packets but the last one must have the same size, and the last one
+ * cannot be larger. Returns -1 if the batch must be sent otherwise.
+ *****************************************************************************/
+static int SendGSO( sout_access_out_t *p_access )
 {
-    sout_access_out_t *p_access = data;
     sout_access_out_sys_t *p_sys = p_access->p_sys;
-    mtime_t i_date_last = -1;
-    const unsigned i_group = var_GetInteger( p_access,
-                                             SOUT_CFG_PREFIX "group" );
-    mtime_t i_to_send = i_group;
-    unsigned i_dropped_packets = 0;
+    const unsigned i_count = p_sys->i_batch;
+    const size_t i_segment = p_sys->iov[0].iov_len;
+    size_t i_total = 0;
 
-    for (;;)
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        size_t i_len = p_sys->iov[i].iov_len;
+
+        if( i_len > i_segment || (i_len < i_segment && i + 1 < i_count) )
+            return -1;
+        i_total += i_len;
+    }
+    if( i_segment == 0 || i_total > GSO_MAX_BYTES )
+        return -1;
+
+    union
+    {
+        char buf[CMSG_SPACE(sizeof (uint16_t))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = p_sys->iov,
+        .msg_iovlen = i_count,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof (control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR( &msg );
+    uint16_t i_gso_size = i_segment;
+
+    cmsg->cmsg_level = IPPROTO_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof (i_gso_size));
+    memcpy( CMSG_DATA(cmsg), &i_gso_size, sizeof (i_gso_size) );
+
+    if( sendmsg( p_sys->i_handle, &msg, 0 ) >= 0 )
+        return 0;
+
+    switch( errno )
+    {
+        case EINVAL:
+        case EIO:
+        case ENOPROTOOPT:
+        case EOPNOTSUPP:
+            msg_Dbg( p_access, "segmentation offload not available: %s",
+                     vlc_strerror_c(errno) );
+            p_sys->b_gso = false;
+            break;
+    }
+    return -1;
+}
+#endif
+
+/*****************************************************************************
+ * SendBatch: send all the packets of the current batch
+ *****************************************************************************/
+static void SendBatch( sout_access_out_t *p_access )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    const unsigned i_count = p_sys->i_batch;
+
+#ifdef HAVE_SENDMMSG
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        p_sys->iov[i].iov_base = p_sys->pp_batch[i]->p_buffer;
+        p_sys->iov[i].iov_len = p_sys->pp_batch[i]->i_buffer;
+        memset( &p_sys->msgs[i], 0, sizeof (p_sys->msgs[i]) );
+        p_sys->msgs[i].msg_hdr.msg_iov = &p_sys->iov[i];
+        p_sys->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+# ifdef UDP_SEGMENT
+    if( p_sys->b_gso && i_count > 1 && SendGSO( p_access ) == 0 )
+        return;
+# endif
+
+    for( unsigned i = 0; i < i_count; )
     {
-        block_t *p_pk = block_FifoGet( p_sys->p_fifo );
-        mtime_t       i_date, i_sent;
+        int val = sendmmsg( p_sys->i_handle, p_sys->msgs + i, i_count - i, 0 );
+        if( val <= 0 )
+        {
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+            i++; /* skip the failed packet */
+        }
+        else
+            i += val;
+    }
+#else
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        block_t *p_pk = p_sys->pp_batch[i];
+
+        if ( send( p_sys->i_handle, p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )
+            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
+    }
+#endif
+}
+
+/*****************************************************************************
+ * DequeuePacket: take the next packet to send from the locked FIFO
+ *****************************************************************************
+ * Packets following a hole of more than 2 seconds are dropped. Every
+ * group-th packet and every packet carrying a clock reference is paced, i.e.
+ * held until its date; the others are sent as soon as possible after the
+ * previous paced packet.
+ *****************************************************************************/
+typedef struct
+{
+    unsigned i_group;
+    unsigned i_to_send;
+    unsigned i_dropped_packets;
+    mtime_t  i_date_last;
+} pacing_t;
+
+static block_t *DequeuePacket( sout_access_out_t *p_access, pacing_t *pacing,
+                               mtime_t *pi_date, bool *pb_paced )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    block_t *p_pk;
+
+    if( p_sys->p_pending != NULL )
+    {
+        p_pk = p_sys->p_pending;
+        p_sys->p_pending = NULL;
+        *pi_date = p_sys->i_caching + p_pk->i_dts;
+        *pb_paced = true;
+        return p_pk;
+    }
+
+    while( (p_pk = vlc_fifo_DequeueUnlocked( p_sys->p_fifo )) != NULL )
+    {
+        mtime_t i_date = p_sys->i_caching + p_pk->i_dts;
 
-        i_date = p_sys->i_caching + p_pk->i_dts;
-        if( i_date_last > 0 )
+        if( pacing->i_date_last > 0 )
         {
-            if( i_date - i_date_last > 2000000 )
+            if( i_date - pacing->i_date_last > 2000000 )
             {
-                if( !i_dropped_packets )
+                if( !pacing->i_dropped_packets )
                     msg_Dbg( p_access, "mmh, hole (%"PRId64" > 2s) -> drop",
-                             i_date - i_date_last );
+                             i_date - pacing->i_date_last );
 
-                block_FifoPut( p_sys->p_empty_blocks, p_pk );
+                block_Release( p_pk );
 
-                i_date_last = i_date;
-                i_dropped_packets++;
+                pacing->i_date_last = i_date;
+                pacing->i_dropped_packets++;
                 continue;
             }
-            else if( i_date - i_date_last < -1000 )
+            else if( i_date - pacing->i_date_last < -1000 )
             {
-                if( !i_dropped_packets )
+                if( !pacing->i_dropped_packets )
                     msg_Dbg( p_access, "mmh, packets in the past (%"PRId64")",
-                             i_date_last - i_date );
+                             pacing->i_date_last - i_date );
             }
         }
+        pacing->i_date_last = i_date;
+
+        pacing->i_to_send--;
+        *pb_paced = !pacing->i_to_send || (p_pk->i_flags & BLOCK_FLAG_CLOCK);
+        if( *pb_paced )
+            pacing->i_to_send = pacing->i_group;
+        *pi_date = i_date;
+        break;
+    }
+    return p_pk;
+}
 
-        block_cleanup_push( p_pk );
-        i_to_send--;
-        if( !i_to_send || (p_pk->i_flags & BLOCK_FLAG_CLOCK) )
+/*****************************************************************************
+ * ThreadWrite: Write a packet on the network at the good time.
+ *****************************************************************************
+ * Packets that can go out together are sent in one batch: the unpaced ones,
+ * then the first paced packet at its date along with the following packets
+ * that are due by then or within the pacing window.
+ *****************************************************************************/
+static void* ThreadWrite( void *data )
+{
+    sout_access_out_t *p_access = data;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    pacing_t pacing = {
+        .i_group = var_GetInteger( p_access, SOUT_CFG_PREFIX "group" ),
+        .i_dropped_packets = 0,
+        .i_date_last = -1,
+    };
+    mtime_t i_late_last = 0;
+
+    pacing.i_to_send = pacing.i_group;
+
+    for (;;)
+    {
+        mtime_t i_deadline = -1; /* date of the paced packet, if any */
+        block_t *p_pk;
+        mtime_t i_date;
+        bool b_paced;
+
+        /* Unpaced packets, up to the first paced one */
+        vlc_fifo_Lock( p_sys->p_fifo );
+        vlc_fifo_CleanupPush( p_sys->p_fifo );
+        while( p_sys->i_batch < MAX_BATCH )
         {
-            mwait( i_date );
-            i_to_send = i_group;
+            p_pk = DequeuePacket( p_access, &pacing, &i_date, &b_paced );
+            if( p_pk == NULL )
+            {
+                if( p_sys->i_batch > 0 )
+                    break;
+                vlc_fifo_Wait( p_sys->p_fifo );
+                continue;
+            }
+
+            p_sys->pp_batch[p_sys->i_batch++] = p_pk;
+            if( b_paced )
+            {
+                i_deadline = i_date;
+                break;
+            }
         }
-        if ( send( p_sys->i_handle, p_pk->p_buffer, p_pk->i_buffer, 0 ) == -1 )
-            msg_Warn( p_access, "send error: %s", vlc_strerror_c(errno) );
         vlc_cleanup_pop();
+        vlc_fifo_Unlock( p_sys->p_fifo );
 
-        if( i_dropped_packets )
+        if( i_deadline >= 0 )
         {
-            msg_Dbg( p_access, "dropped %i packets", i_dropped_packets );
-            i_dropped_packets = 0;
+            mwait( i_deadline );
+
+            /* Packets that are due by now or within the window */
+            mtime_t i_limit = __MAX( i_deadline + p_sys->i_window, mdate() );
+
+            vlc_fifo_Lock( p_sys->p_fifo );
+            while( p_sys->i_batch < MAX_BATCH )
+            {
+                p_pk = DequeuePacket( p_access, &pacing, &i_date, &b_paced );
+                if( p_pk == NULL )
+                    break;
+                if( b_paced && i_date > i_limit )
+                {   /* Not due yet: keep it for the next batch */
+                    p_sys->p_pending = p_pk;
+                    break;
+                }
+                p_sys->pp_batch[p_sys->i_batch++] = p_pk;
+            }
+            vlc_fifo_Unlock( p_sys->p_fifo );
         }
 
-#if 1
-        i_sent = mdate();
-        if ( i_sent > i_date + 20000 )
+        SendBatch( p_access );
+
+        if( pacing.i_dropped_packets )
         {
-            msg_Dbg( p_access, "packet has been sent too late (%"PRId64 ")",
-                     i_sent - i_date );
+            msg_Dbg( p_access, "dropped %i packets",
+                     pacing.i_dropped_packets );
+            pacing.i_dropped_packets = 0;
         }
-#endif
 
-        block_FifoPut( p_sys->p_empty_blocks, p_pk );
+        if( i_deadline >= 0 )
+        {
+            mtime_t i_late = mdate() - i_deadline;
+
+            if( i_late < 0 )
+                i_late = 0;
+            UpdateHistogram( p_sys->late_hist, i_late );
+            UpdateHistogram( p_sys->jitter_hist,
+                             llabs( i_late - i_late_last ) );
+            i_late_last = i_late;
+        }
+        p_sys->i_sent_packets += p_sys->i_batch;
+        p_sys->i_sent_batches++;
 
-        i_date_last = i_date;
+        RecyclePackets( p_sys, p_sys->pp_batch, p_sys->i_batch );
+        p_sys->i_batch = 0;
     }
     return NULL;
 }
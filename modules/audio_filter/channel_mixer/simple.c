@@ -261,6 +261,9 @@ static void DoWork_6_1_to_5_x( filter_t * p_filter,  block_t * p_in_buf, block_t
 #if defined (CAN_COMPILE_ARM)
 #include "simple_neon.h"
 #define GET_WORK(in, out) GET_WORK_##in##_to_##out##_neon()
+#elif defined (CAN_COMPILE_SSE) && (VLC_GCC_VERSION(4, 9) || defined (__clang__))
+#include "simple_sse.h"
+#define GET_WORK(in, out) GET_WORK_##in##_to_##out##_sse()
 #else
 #define GET_WORK(in, out) DoWork_##in##_to_##out
 #endif
@@ -371,7 +374,7 @@ static block_t *Filter( filter_t *p_filter, block_t *p_block )
       p_filter->fmt_out.audio.i_bitspersample *
         p_filter->fmt_out.audio.i_channels / 8;
 
-    block_t *p_out = block_Alloc( i_out_size );
+    block_t *p_out = filter_NewAudioBuffer( p_filter, i_out_size );
     if( !p_out )
     {
         msg_Warn( p_filter, "can't get output buffer" );
@@ -0,0 +1,109 @@
+/*****************************************************************************
+ * simple_sse.c : simple channel mixer SSE kernels
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#if defined (CAN_COMPILE_SSE) && (VLC_GCC_VERSION(4, 9) || defined (__clang__))
+#include <immintrin.h>
+
+void convert_7_x_to_2_0_sse( float *dst, const float *src, int num, bool lfe );
+void convert_5_x_to_2_0_sse( float *dst, const float *src, int num, bool lfe );
+
+/*
+ * Two frames are mixed at a time, left and right side by side in each
+ * vector. The operations are done in the same order as in simple.c, so the
+ * output is the same as with the C code.
+ */
+
+/* Loads the pair of channels c and c+1 of two consecutive frames */
+VLC_SSE
+static inline __m128 LoadPairs( const float *src, size_t stride, unsigned c )
+{
+    __m128 v = _mm_loadl_pi( _mm_setzero_ps(), (const __m64 *)(src + c) );
+    return _mm_loadh_pi( v, (const __m64 *)(src + stride + c) );
+}
+
+/* Loads channel c of two consecutive frames, twice each */
+VLC_SSE
+static inline __m128 LoadDup( const float *src, size_t stride, unsigned c )
+{
+    __m128 v = _mm_unpacklo_ps( _mm_load_ss( src + c ),
+                                _mm_load_ss( src + stride + c ) );
+    return _mm_unpacklo_ps( v, v );
+}
+
+VLC_SSE
+void convert_7_x_to_2_0_sse( float *dst, const float *src, int num, bool lfe )
+{
+    const size_t stride = 7 + lfe;
+    const __m128 center = _mm_set1_ps( 0.7071f );
+    const __m128 quarter = _mm_set1_ps( 0.25f );
+
+    for( ; num >= 2; num -= 2 )
+    {
+        __m128 ctr = _mm_mul_ps( LoadDup( src, stride, 6 ), center );
+        __m128 sum = _mm_add_ps( ctr, LoadPairs( src, stride, 0 ) );
+        sum = _mm_add_ps( sum, _mm_mul_ps( LoadPairs( src, stride, 2 ),
+                                           quarter ) );
+        sum = _mm_add_ps( sum, _mm_mul_ps( LoadPairs( src, stride, 4 ),
+                                           quarter ) );
+        _mm_storeu_ps( dst, sum );
+        src += 2 * stride;
+        dst += 4;
+    }
+
+    if( num > 0 )
+    {
+        float ctr = src[6] * 0.7071f;
+        dst[0] = ctr + src[0] + src[2] / 4 + src[4] / 4;
+        dst[1] = ctr + src[1] + src[3] / 4 + src[5] / 4;
+    }
+}
+
+VLC_SSE
+void convert_5_x_to_2_0_sse( float *dst, const float *src, int num, bool lfe )
+{
+    const size_t stride = 5 + lfe;
+    const __m128 center = _mm_set1_ps( 0.7071f );
+
+    for( ; num >= 2; num -= 2 )
+    {
+        __m128 mix = _mm_add_ps( LoadDup( src, stride, 4 ),
+                                 LoadPairs( src, stride, 2 ) );
+        mix = _mm_add_ps( LoadPairs( src, stride, 0 ),
+                          _mm_mul_ps( center, mix ) );
+        _mm_storeu_ps( dst, mix );
+        src += 2 * stride;
+        dst += 4;
+    }
+
+    if( num > 0 )
+    {
+        dst[0] = src[0] + 0.7071f * (src[4] + src[2]);
+        dst[1] = src[1] + 0.7071f * (src[4] + src[3]);
+    }
+}
+#endif
@@ -0,0 +1,389 @@
+/*****************************************************************************
+ * bandlimited-bench.c: compares the band-limited resampler kernels
+ *****************************************************************************
+ * Copyright (C) 2002, 2006 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: bandlimited-bench [in_rate out_rate channels [seconds]]
+ *
+ * Resamples a sine wave with the original per-tap filter, with the polyphase
+ * bank and the C kernel, and with the polyphase bank and the fastest kernel
+ * for this CPU. The THD+N of the output, the largest difference with the
+ * original filter and the throughput are reported for each of them.
+ *
+ * Without arguments, runs a few common conversions and checks the results. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+
+#include "bandlimited.h"
+#include "polyphase.h"
+
+/*****************************************************************************
+ * Original filter, one coefficient at a time
+ *****************************************************************************/
+static void FilterFloatUP( const float Imp[], const float ImpD[], uint16_t Nwing, float *p_in,
+                            float *p_out, uint32_t ui_remainder,
+                            uint32_t ui_output_rate, int16_t Inc, int i_nb_channels )
+{
+    const float *Hp, *Hdp, *End;
+    float t, temp;
+    uint32_t ui_linear_remainder;
+    int i;
+
+    Hp = &Imp[(ui_remainder<<Nhc)/ui_output_rate];
+    Hdp = &ImpD[(ui_remainder<<Nhc)/ui_output_rate];
+
+    End = &Imp[Nwing];
+
+    ui_linear_remainder = (ui_remainder<<Nhc) -
+                            (ui_remainder<<Nhc)/ui_output_rate*ui_output_rate;
+
+    if (Inc == 1)               /* If doing right wing...              */
+    {                           /* ...drop extra coeff, so when Ph is  */
+        End--;                  /*    0.5, we don't do too many mult's */
+        if (ui_remainder == 0)  /* If the phase is zero...           */
+        {                       /* ...then we've already skipped the */
+            Hp += Npc;          /*    first sample, so we must also  */
+            Hdp += Npc;         /*    skip ahead in Imp[] and ImpD[] */
+        }
+    }
+
+    while (Hp < End) {
+        t = *Hp;                /* Get filter coeff */
+                                /* t is now interp'd filter coeff */
+        t += *Hdp * ui_linear_remainder / ui_output_rate / Npc;
+        for( i = 0; i < i_nb_channels; i++ )
+        {
+            temp = t;
+            temp *= *(p_in+i);  /* Mult coeff by input sample */
+            *(p_out+i) += temp; /* The filter output */
+        }
+        Hdp += Npc;             /* Filter coeff differences step */
+        Hp += Npc;              /* Filter coeff step */
+        p_in += (Inc * i_nb_channels); /* Input signal step */
+    }
+}
+
+static void FilterFloatUD( const float Imp[], const float ImpD[], uint16_t Nwing, float *p_in,
+                           float *p_out, uint32_t ui_remainder,
+                           uint32_t ui_output_rate, uint32_t ui_input_rate,
+                           int16_t Inc, int i_nb_channels )
+{
+    const float *Hp, *Hdp, *End;
+    float t, temp;
+    uint32_t ui_linear_remainder;
+    int i, ui_counter = 0;
+
+    Hp = Imp + (ui_remainder<<Nhc) / ui_input_rate;
+    Hdp = ImpD  + (ui_remainder<<Nhc) / ui_input_rate;
+
+    End = &Imp[Nwing];
+
+    if (Inc == 1)               /* If doing right wing...              */
+    {                           /* ...drop extra coeff, so when Ph is  */
+        End--;                  /*    0.5, we don't do too many mult's */
+        if (ui_remainder == 0)  /* If the phase is zero...           */
+        {                       /* ...then we've already skipped the */
+            Hp = Imp +          /* first sample, so we must also  */
+                  (ui_output_rate << Nhc) / ui_input_rate;
+            Hdp = ImpD +        /* skip ahead in Imp[] and ImpD[] */
+                  (ui_output_rate << Nhc) / ui_input_rate;
+            ui_counter++;
+        }
+    }
+
+    while (Hp < End) {
+        t = *Hp;                /* Get filter coeff */
+                                /* t is now interp'd filter coeff */
+        ui_linear_remainder =
+          ((ui_output_rate * ui_counter + ui_remainder)<< Nhc) -
+          ((ui_output_rate * ui_counter + ui_remainder)<< Nhc) /
+          ui_input_rate * ui_input_rate;
+        t += *Hdp * ui_linear_remainder / ui_input_rate / Npc;
+        for( i = 0; i < i_nb_channels; i++ )
+        {
+            temp = t;
+            temp *= *(p_in+i);  /* Mult coeff by input sample */
+            *(p_out+i) += temp; /* The filter output */
+        }
+
+        ui_counter++;
+
+        /* Filter coeff step */
+        Hp = Imp + ((ui_output_rate * ui_counter + ui_remainder)<< Nhc)
+                    / ui_input_rate;
+        /* Filter coeff differences step */
+        Hdp = ImpD + ((ui_output_rate * ui_counter + ui_remainder)<< Nhc)
+                     / ui_input_rate;
+
+        p_in += (Inc * i_nb_channels); /* Input signal step */
+    }
+}
+
+/*****************************************************************************
+ * Resampling loop, as in ResampleFloat()
+ *****************************************************************************/
+typedef enum { IMPL_ORIGINAL, IMPL_BANK } impl_t;
+
+typedef struct
+{
+    unsigned i_in_rate;
+    unsigned i_out_rate;
+    unsigned i_channels;
+    size_t   i_in_frames;
+    float   *p_in;
+} bench_t;
+
+static size_t Resample( const bench_t *p_bench, impl_t impl,
+                        bl_kernel_t pf_filter, float *p_out )
+{
+    const unsigned i_in_rate = p_bench->i_in_rate;
+    const unsigned i_out_rate = p_bench->i_out_rate;
+    const unsigned i_channels = p_bench->i_channels;
+    const bool b_up = i_out_rate >= i_in_rate;
+    const size_t i_wing = bl_GetWing( (double)i_out_rate / i_in_rate );
+    float coeffs[bl_GetMaxTaps( i_in_rate, i_out_rate, b_up )];
+    bl_bank_t bank;
+    unsigned i_remainder = 0;
+    size_t i_out = 0;
+
+    if( bl_BankInit( &bank, i_in_rate, i_out_rate, b_up ) )
+        abort();
+
+    for( size_t i_in = i_wing; i_in < p_bench->i_in_frames - i_wing; i_in++ )
+    {
+        float *p_in = p_bench->p_in + i_in * i_channels;
+
+        while( i_remainder < i_out_rate )
+        {
+            float *p_sample = p_out + i_out * i_channels;
+
+            if( impl == IMPL_ORIGINAL )
+            {
+                for( unsigned c = 0; c < i_channels; c++ )
+                    p_sample[c] = 0.f;
+                if( b_up )
+                {
+                    FilterFloatUP( SMALL_FILTER_FLOAT_IMP,
+                                   SMALL_FILTER_FLOAT_IMPD, SMALL_FILTER_NWING,
+                                   p_in, p_sample, i_remainder, i_out_rate,
+                                   -1, i_channels );
+                    FilterFloatUP( SMALL_FILTER_FLOAT_IMP,
+                                   SMALL_FILTER_FLOAT_IMPD, SMALL_FILTER_NWING,
+                                   p_in + i_channels, p_sample,
+                                   i_out_rate - i_remainder, i_out_rate,
+                                   1, i_channels );
+                }
+                else
+                {
+                    FilterFloatUD( SMALL_FILTER_FLOAT_IMP,
+                                   SMALL_FILTER_FLOAT_IMPD, SMALL_FILTER_NWING,
+                                   p_in, p_sample, i_remainder, i_out_rate,
+                                   i_in_rate, -1, i_channels );
+                    FilterFloatUD( SMALL_FILTER_FLOAT_IMP,
+                                   SMALL_FILTER_FLOAT_IMPD, SMALL_FILTER_NWING,
+                                   p_in + i_channels, p_sample,
+                                   i_out_rate - i_remainder, i_out_rate,
+                                   i_in_rate, 1, i_channels );
+                }
+            }
+            else
+            {
+                const bl_phase_t *p_phase = bl_BankGet( &bank, i_remainder );
+                bl_phase_t phase;
+
+                if( p_phase == NULL )
+                {
+                    bl_ComputePhase( &phase, coeffs, i_remainder, i_in_rate,
+                                     i_out_rate, b_up );
+                    p_phase = &phase;
+                }
+                pf_filter( p_sample, p_in - (p_phase->i_left - 1) * i_channels,
+                           i_channels, p_phase->p_coeffs, p_phase->i_taps,
+                           i_channels );
+            }
+
+            i_out++;
+            i_remainder += i_in_rate;
+        }
+        i_remainder -= i_out_rate;
+    }
+
+    bl_BankClean( &bank );
+    return i_out;
+}
+
+/*****************************************************************************
+ * Measurements
+ *****************************************************************************/
+#define BENCH_FREQ 997.
+
+/* Phase of the test tone, different for each channel */
+static double ChannelPhase( unsigned c )
+{
+    return 0.7 * c;
+}
+
+/* Total harmonic distortion plus noise, in dB, of the worst channel. The tone
+ * is fitted by least squares and the remainder is the distortion. */
+static double ThdN( const float *p_out, size_t i_frames, unsigned i_channels,
+                    unsigned i_rate )
+{
+    const double w = 2. * M_PI * BENCH_FREQ / i_rate;
+    const size_t i_skip = i_frames / 20; /* edges */
+    double worst = -INFINITY;
+
+    for( unsigned c = 0; c < i_channels; c++ )
+    {
+        double ss = 0., sc = 0., cc = 0., ys = 0., yc = 0.;
+        for( size_t i = i_skip; i < i_frames - i_skip; i++ )
+        {
+            double s = sin( w * i ), co = cos( w * i );
+            double y = p_out[i * i_channels + c];
+            ss += s * s; sc += s * co; cc += co * co;
+            ys += y * s; yc += y * co;
+        }
+        double det = ss * cc - sc * sc;
+        double a = (ys * cc - yc * sc) / det;
+        double b = (yc * ss - ys * sc) / det;
+
+        double signal = 0., noise = 0.;
+        for( size_t i = i_skip; i < i_frames - i_skip; i++ )
+        {
+            double fit = a * sin( w * i ) + b * cos( w * i );
+            double err = p_out[i * i_channels + c] - fit;
+            signal += fit * fit;
+            noise += err * err;
+        }
+        double thdn = 10. * log10( noise / signal );
+        if( thdn > worst )
+            worst = thdn;
+    }
+    return worst;
+}
+
+typedef struct
+{
+    double thdn;      /* dB */
+    double diff;      /* largest difference with the original filter */
+    double msamples;  /* output samples per second, in millions */
+} result_t;
+
+static size_t Run( const bench_t *p_bench, impl_t impl, bl_kernel_t pf_filter,
+                   float *p_out, const float *p_ref, size_t i_ref,
+                   result_t *p_res )
+{
+    mtime_t i_start = mdate();
+    size_t i_frames = Resample( p_bench, impl, pf_filter, p_out );
+    mtime_t i_time = mdate() - i_start;
+
+    p_res->thdn = ThdN( p_out, i_frames, p_bench->i_channels,
+                        p_bench->i_out_rate );
+    p_res->msamples = (double)i_frames * p_bench->i_channels /
+                      __MAX(i_time, 1);
+    p_res->diff = 0.;
+    for( size_t i = 0; i < __MIN(i_ref, i_frames) * p_bench->i_channels; i++ )
+        p_res->diff = __MAX(p_res->diff, fabs( p_out[i] - p_ref[i] ));
+    return i_frames;
+}
+
+static int Bench( unsigned i_in_rate, unsigned i_out_rate,
+                  unsigned i_channels, double seconds )
+{
+    bench_t bench = {
+        .i_in_rate = i_in_rate,
+        .i_out_rate = i_out_rate,
+        .i_channels = i_channels,
+        .i_in_frames = seconds * i_in_rate,
+    };
+    const size_t i_out_max = bench.i_in_frames * (uint64_t)i_out_rate
+                             / i_in_rate + 2;
+    const double w = 2. * M_PI * BENCH_FREQ / i_in_rate;
+
+    bench.p_in = malloc( bench.i_in_frames * i_channels * sizeof(float) );
+    float *p_ref = malloc( i_out_max * i_channels * sizeof(float) );
+    float *p_out = malloc( i_out_max * i_channels * sizeof(float) );
+    if( bench.p_in == NULL || p_ref == NULL || p_out == NULL )
+        abort();
+    /* Don't count the page faults */
+    memset( p_ref, 0, i_out_max * i_channels * sizeof(float) );
+    memset( p_out, 0, i_out_max * i_channels * sizeof(float) );
+
+    for( size_t i = 0; i < bench.i_in_frames; i++ )
+        for( unsigned c = 0; c < i_channels; c++ )
+            bench.p_in[i * i_channels + c] = .5 * sin( w * i + ChannelPhase( c ) );
+
+    result_t original, scalar, best;
+    size_t i_ref = Run( &bench, IMPL_ORIGINAL, NULL, p_ref, NULL, 0,
+                        &original );
+    Run( &bench, IMPL_BANK, bl_FilterC, p_out, p_ref, i_ref, &scalar );
+    Run( &bench, IMPL_BANK, bl_GetKernel(), p_out, p_ref, i_ref, &best );
+
+    printf( "%6u -> %6u Hz, %u channels:\n", i_in_rate, i_out_rate,
+            i_channels );
+    printf( "  original %7.2f dB THD+N %33.1f Msamples/s\n",
+            original.thdn, original.msamples );
+    printf( "  C        %7.2f dB THD+N, %.2e max difference, %5.1f Msamples/s\n",
+            scalar.thdn, scalar.diff, scalar.msamples );
+    printf( "  best     %7.2f dB THD+N, %.2e max difference, %5.1f Msamples/s\n",
+            best.thdn, best.diff, best.msamples );
+
+    free( p_out );
+    free( p_ref );
+    free( bench.p_in );
+
+    int i_ret = 0;
+    /* Same quality, and the same output within rounding errors */
+    if( scalar.thdn > original.thdn + .5 || best.thdn > original.thdn + .5 )
+    {
+        fprintf( stderr, "FAILED: THD+N differs from the original filter\n" );
+        i_ret = 1;
+    }
+    if( scalar.diff > 1e-5 || best.diff > 1e-5 )
+    {
+        fprintf( stderr, "FAILED: output differs from the original filter\n" );
+        i_ret = 1;
+    }
+    return i_ret;
+}
+
+int main( int argc, char **argv )
+{
+    if( argc > 3 )
+        return Bench( atoi( argv[1] ), atoi( argv[2] ), atoi( argv[3] ),
+                      (argc > 4) ? atof( argv[4] ) : 10. );
+
+    int i_ret = 0;
+    i_ret |= Bench( 44100, 48000, 2, 1. );
+    i_ret |= Bench( 48000, 44100, 2, 1. );
+    i_ret |= Bench( 44100, 48000, 8, 1. );
+    i_ret |= Bench( 48000, 44100, 8, 1. );
+    i_ret |= Bench( 22050, 48000, 1, 1. );
+    i_ret |= Bench( 96000, 48000, 6, 1. );
+    /* too many phases for the bank */
+    i_ret |= Bench( 44100, 48001, 6, 1. );
+    return i_ret;
+}
@@ -31,6 +31,10 @@
  * It uses a Kaiser-windowed sinc-function low-pass filter and the width of the
  * filter is 13 samples.
  *
+ * The filter taps of each phase are precomputed in a polyphase bank when the
+ * rates allow it (see polyphase.h), and all the channels of an output sample
+ * are filtered at once.
+ *
  *****************************************************************************/
 
 #ifdef HAVE_CONFIG_H
@@ -45,7 +49,7 @@
 
 #include <assert.h>
 
-#include "bandlimited.h"
+#include "polyphase.h"
 
 /*****************************************************************************
  * Local prototypes
@@ -77,6 +81,10 @@ struct filter_sys_t
     unsigned int i_remainder;                /* remainder of previous sample */
     bool b_first;
 
+    bl_bank_t bank;                          /* taps for the current rates */
+    float *p_coeffs;                      /* taps of a phase not in the bank */
+    bl_kernel_t pf_filter;
+
     date_t end_date;
 };
 
@@ -145,7 +153,7 @@ static block_t *Resample( filter_t * p_filter, block_t * p_in_buf )
     size_t i_out_size = i_bytes_per_frame * ( 1 + ( p_in_buf->i_nb_samples *
               p_filter->fmt_out.audio.i_rate / p_filter->fmt_in.audio.i_rate) )
             + p_filter->p_sys->i_buf_size;
-    block_t *p_out_buf = block_Alloc( i_out_size );
+    block_t *p_out_buf = filter_NewAudioBuffer( p_filter, i_out_size );
     if( !p_out_buf )
     {
         block_Release( p_in_buf );
@@ -165,9 +173,34 @@ static block_t *Resample( filter_t * p_filter, block_t * p_in_buf )
         p_sys->b_first = false;
     }
 
+    unsigned int i_in_rate = p_filter->fmt_in.audio.i_rate;
+    if( p_sys->bank.i_in_rate != i_in_rate ||
+        p_sys->bank.i_out_rate != i_out_rate )
+    {
+        /* The taps of a phase outside of the bank are computed on the fly,
+         * for either direction as the old factor may be applied first */
+        size_t i_max_taps =
+            __MAX( bl_GetMaxTaps( i_in_rate, i_out_rate, true ),
+                   bl_GetMaxTaps( i_in_rate, i_out_rate, false ) );
+        float *p_coeffs = realloc( p_sys->p_coeffs,
+                                   i_max_taps * sizeof(*p_coeffs) );
+        if( unlikely(p_coeffs == NULL) )
+        {
+            block_Release( p_in_buf );
+            block_Release( p_out_buf );
+            return NULL;
+        }
+        p_sys->p_coeffs = p_coeffs;
+
+        bl_BankClean( &p_sys->bank );
+        if( bl_BankInit( &p_sys->bank, i_in_rate, i_out_rate,
+                         i_out_rate >= i_in_rate ) )
+            msg_Warn( p_filter, "cannot allocate the filter bank" );
+    }
+
     size_t i_in_nb = p_in_buf->i_nb_samples;
     size_t i_in, i_out = 0;
-    double d_factor, d_scale_factor, d_old_scale_factor;
+    double d_factor;
     size_t i_filter_wing;
 
 #if 0
@@ -196,17 +229,9 @@ static block_t *Resample( filter_t * p_filter, block_t * p_in_buf )
     float *p_in = (float *)p_in_buf->p_buffer;
     const float *p_in_orig = p_in;
 
-    /* Make sure the output buffer is reset */
-    memset( p_out_buf->p_buffer, 0, p_out_buf->i_buffer );
-
     /* Calculate the new length of the filter wing */
     d_factor = (double)i_out_rate / p_filter->fmt_in.audio.i_rate;
-    i_filter_wing = ((SMALL_FILTER_NMULT+1)/2.0) * __MAX(1.0,1.0/d_factor) + 1;
-
-    /* Account for increased filter gain when using factors less than 1 */
-    d_old_scale_factor = SMALL_FILTER_SCALE *
-        p_sys->d_old_factor + 0.5;
-    d_scale_factor = SMALL_FILTER_SCALE * d_factor + 0.5;
+    i_filter_wing = bl_GetWing( d_factor );
 
     /* Apply the old rate until we have enough samples for the new one */
     i_in = p_sys->i_old_wing;
@@ -310,6 +335,13 @@ static int OpenFilter( vlc_object_t *p_this )
 
     p_sys->i_old_wing = 0;
     p_sys->b_first = true;
+
+    p_sys->bank.i_in_rate = p_sys->bank.i_out_rate = 0;
+    p_sys->bank.i_phases = 0;
+    p_sys->bank.p_phases = NULL;
+    p_sys->bank.p_coeffs = NULL;
+    p_sys->p_coeffs = NULL;
+    p_sys->pf_filter = bl_GetKernel();
     p_filter->pf_audio_filter = Resample;
 
     msg_Dbg( p_this, "%4.4s/%iKHz/%i->%4.4s/%iKHz/%i",
@@ -332,109 +364,12 @@ static int OpenFilter( vlc_object_t *p_this )
 static void CloseFilter( vlc_object_t *p_this )
 {
     filter_t *p_filter = (filter_t *)p_this;
+    bl_BankClean( &p_filter->p_sys->bank );
+    free( p_filter->p_sys->p_coeffs );
     free( p_filter->p_sys->p_buf );
     free( p_filter->p_sys );
 }
 
-static void FilterFloatUP( const float Imp[], const float ImpD[], uint16_t Nwing, float *p_in,
-                            float *p_out, uint32_t ui_remainder,
-                            uint32_t ui_output_rate, int16_t Inc, int i_nb_channels )
-{
-    const float *Hp, *Hdp, *End;
-    float t, temp;
-    uint32_t ui_linear_remainder;
-    int i;
-
-    Hp = &Imp[(ui_remainder<<Nhc)/ui_output_rate];
-    Hdp = &ImpD[(ui_remainder<<Nhc)/ui_output_rate];
-
-    End = &Imp[Nwing];
-
-    ui_linear_remainder = (ui_remainder<<Nhc) -
-                            (ui_remainder<<Nhc)/ui_output_rate*ui_output_rate;
-
-    if (Inc == 1)               /* If doing right wing...              */
-    {                           /* ...drop extra coeff, so when Ph is  */
-        End--;                  /*    0.5, we don't do too many mult's */
-        if (ui_remainder == 0)  /* If the phase is zero...           */
-        {                       /* ...then we've already skipped the */
-            Hp += Npc;          /*    first sample, so we must also  */
-            Hdp += Npc;         /*    skip ahead in Imp[] and ImpD[] */
-        }
-    }
-
-    while (Hp < End) {
-        t = *Hp;                /* Get filter coeff */
-                                /* t is now interp'd filter coeff */
-        t += *Hdp * ui_linear_remainder / ui_output_rate / Npc;
-        for( i = 0; i < i_nb_channels; i++ )
-        {
-            temp = t;
-            temp *= *(p_in+i);  /* Mult coeff by input sample */
-            *(p_out+i) += temp; /* The filter output */
-        }
-        Hdp += Npc;             /* Filter coeff differences step */
-        Hp += Npc;              /* Filter coeff step */
-        p_in += (Inc * i_nb_channels); /* Input signal step */
-    }
-}
-
-static void FilterFloatUD( const float Imp[], const float ImpD[], uint16_t Nwing, float *p_in,
-                           float *p_out, uint32_t ui_remainder,
-                           uint32_t ui_output_rate, uint32_t ui_input_rate,
-                           int16_t Inc, int i_nb_channels )
-{
-    const float *Hp, *Hdp, *End;
-    float t, temp;
-    uint32_t ui_linear_remainder;
-    int i, ui_counter = 0;
-
-    Hp = Imp + (ui_remainder<<Nhc) / ui_input_rate;
-    Hdp = ImpD  + (ui_remainder<<Nhc) / ui_input_rate;
-
-    End = &Imp[Nwing];
-
-    if (Inc == 1)               /* If doing right wing...              */
-    {                           /* ...drop extra coeff, so when Ph is  */
-        End--;                  /*    0.5, we don't do too many mult's */
-        if (ui_remainder == 0)  /* If the phase is zero...           */
-        {                       /* ...then we've already skipped the */
-            Hp = Imp +          /* first sample, so we must also  */
-                  (ui_output_rate << Nhc) / ui_input_rate;
-            Hdp = ImpD +        /* skip ahead in Imp[] and ImpD[] */
-                  (ui_output_rate << Nhc) / ui_input_rate;
-            ui_counter++;
-        }
-    }
-
-    while (Hp < End) {
-        t = *Hp;                /* Get filter coeff */
-                                /* t is now interp'd filter coeff */
-        ui_linear_remainder =
-          ((ui_output_rate * ui_counter + ui_remainder)<< Nhc) -
-          ((ui_output_rate * ui_counter + ui_remainder)<< Nhc) /
-          ui_input_rate * ui_input_rate;
-        t += *Hdp * ui_linear_remainder / ui_input_rate / Npc;
-        for( i = 0; i < i_nb_channels; i++ )
-        {
-            temp = t;
-            temp *= *(p_in+i);  /* Mult coeff by input sample */
-            *(p_out+i) += temp; /* The filter output */
-        }
-
-        ui_counter++;
-
-        /* Filter coeff step */
-        Hp = Imp + ((ui_output_rate * ui_counter + ui_remainder)<< Nhc)
-                    / ui_input_rate;
-        /* Filter coeff differences step */
-        Hdp = ImpD + ((ui_output_rate * ui_counter + ui_remainder)<< Nhc)
-                     / ui_input_rate;
-
-        p_in += (Inc * i_nb_channels); /* Input signal step */
-    }
-}
-
 static int ReallocBuffer( block_t **pp_out_buf,
                           float **pp_out, size_t i_out,
                           int i_nb_channels, int i_bytes_per_frame )
@@ -451,7 +386,6 @@ static int ReallocBuffer( block_t **pp_out_buf,
         return VLC_EGENERIC;
 
     *pp_out = (float*)(*pp_out_buf)->p_buffer + i_out * i_nb_channels;
-    memset( *pp_out, 0, i_extra_frame * i_bytes_per_frame );
     return VLC_SUCCESS;
 }
 
@@ -467,6 +401,8 @@ static void ResampleFloat( filter_t *p_filter,
     float *p_in = *pp_in;
     size_t i_out = *pi_out;
     float *p_out = (float*)(*pp_out_buf)->p_buffer + i_out * i_nb_channels;
+    /* The upsampling taps are shorter, use them if we can */
+    const bool b_up = d_factor >= 1;
 
     for( ; i_in < i_in_end; i_in++ )
     {
@@ -489,49 +425,26 @@ static void ResampleFloat( filter_t *p_filter,
                                i_out, i_nb_channels, i_bytes_per_frame ) )
                 return;
 
-            if( d_factor >= 1 )
-            {
-                /* FilterFloatUP() is faster if we can use it */
-
-                /* Perform left-wing inner product */
-                FilterFloatUP( SMALL_FILTER_FLOAT_IMP, SMALL_FILTER_FLOAT_IMPD,
-                               SMALL_FILTER_NWING, p_in, p_out,
-                               p_sys->i_remainder,
-                               p_filter->fmt_out.audio.i_rate,
-                               -1, i_nb_channels );
-                /* Perform right-wing inner product */
-                FilterFloatUP( SMALL_FILTER_FLOAT_IMP, SMALL_FILTER_FLOAT_IMPD,
-                               SMALL_FILTER_NWING, p_in + i_nb_channels, p_out,
-                               p_filter->fmt_out.audio.i_rate -
-                               p_sys->i_remainder,
-                               p_filter->fmt_out.audio.i_rate,
-                               1, i_nb_channels );
+            const bl_phase_t *p_phase = NULL;
+            bl_phase_t phase;
 
-#if 0
-                /* Normalize for unity filter gain */
-                for( i = 0; i < i_nb_channels; i++ )
-                {
-                    *(p_out+i) *= d_old_scale_factor;
-                }
-#endif
-            }
-            else
+            if( b_up == p_sys->bank.b_up )
+                p_phase = bl_BankGet( &p_sys->bank, p_sys->i_remainder );
+            if( p_phase == NULL )
             {
-                /* Perform left-wing inner product */
-                FilterFloatUD( SMALL_FILTER_FLOAT_IMP, SMALL_FILTER_FLOAT_IMPD,
-                               SMALL_FILTER_NWING, p_in, p_out,
-                               p_sys->i_remainder,
-                               p_filter->fmt_out.audio.i_rate, p_filter->fmt_in.audio.i_rate,
-                               -1, i_nb_channels );
-                /* Perform right-wing inner product */
-                FilterFloatUD( SMALL_FILTER_FLOAT_IMP, SMALL_FILTER_FLOAT_IMPD,
-                               SMALL_FILTER_NWING, p_in + i_nb_channels, p_out,
-                               p_filter->fmt_out.audio.i_rate -
-                               p_sys->i_remainder,
-                               p_filter->fmt_out.audio.i_rate, p_filter->fmt_in.audio.i_rate,
-                               1, i_nb_channels );
+                bl_ComputePhase( &phase, p_sys->p_coeffs, p_sys->i_remainder,
+                                 p_filter->fmt_in.audio.i_rate,
+                                 p_filter->fmt_out.audio.i_rate, b_up );
+                p_phase = &phase;
             }
 
+            /* Inner product of both wings, the left one ending with the
+             * current input sample */
+            p_sys->pf_filter( p_out,
+                              p_in - (p_phase->i_left - 1) * i_nb_channels,
+                              i_nb_channels, p_phase->p_coeffs,
+                              p_phase->i_taps, i_nb_channels );
+
             p_out += i_nb_channels;
             i_out++;
 
@@ -0,0 +1,380 @@
+/*****************************************************************************
+ * polyphase.c : polyphase filter bank for the band-limited resampler
+ *****************************************************************************
+ * Copyright (C) 2002, 2006 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "bandlimited.h"
+#include "polyphase.h"
+
+#if defined (CAN_COMPILE_SSE) && (VLC_GCC_VERSION(4, 9) || defined (__clang__))
+# define HAVE_SSE_KERNELS 1
+# include <immintrin.h>
+#endif
+#if defined (__ARM_NEON__) || defined (__ARM_NEON)
+# define HAVE_NEON_KERNEL 1
+# include <arm_neon.h>
+#endif
+
+/* Largest bank, in coefficients */
+#define BL_BANK_MAX (1 << 18)
+
+unsigned bl_GetWing( double d_factor )
+{
+    return ((SMALL_FILTER_NMULT+1)/2.0) * __MAX(1.0, 1.0/d_factor) + 1;
+}
+
+unsigned bl_GetMaxTaps( uint32_t i_in_rate, uint32_t i_out_rate, bool b_up )
+{
+    if( b_up )
+        return 2 * (SMALL_FILTER_NWING / Npc + 1);
+    return 2 * ((uint64_t)SMALL_FILTER_NWING * i_in_rate /
+                ((uint64_t)i_out_rate << Nhc) + 2);
+}
+
+/*****************************************************************************
+ * Filter wings: one coefficient per input sample, away from the current one.
+ * The coefficients are interpolated between the entries of the impulse
+ * response table exactly as the band-limited filter always did.
+ *****************************************************************************/
+static unsigned WingUp( float *p_coeffs, uint32_t i_remainder,
+                        uint32_t i_out_rate, int i_inc )
+{
+    uint32_t i_index = (i_remainder<<Nhc) / i_out_rate;
+    uint32_t i_end = SMALL_FILTER_NWING;
+    const uint32_t i_linear_remainder = (i_remainder<<Nhc) -
+                                        i_index * i_out_rate;
+    unsigned n = 0;
+
+    if( i_inc == 1 )            /* If doing right wing...              */
+    {                           /* ...drop extra coeff, so when Ph is  */
+        i_end--;                /*    0.5, we don't do too many mult's */
+        if( i_remainder == 0 )  /* If the phase is zero, we've already */
+            i_index += Npc;     /* skipped the first sample            */
+    }
+
+    for( ; i_index < i_end; i_index += Npc )
+        p_coeffs[n++] = SMALL_FILTER_FLOAT_IMP[i_index] +
+                        SMALL_FILTER_FLOAT_IMPD[i_index] * i_linear_remainder
+                            / i_out_rate / Npc;
+    return n;
+}
+
+static unsigned WingDown( float *p_coeffs, uint32_t i_remainder,
+                          uint32_t i_out_rate, uint32_t i_in_rate, int i_inc )
+{
+    uint32_t i_end = SMALL_FILTER_NWING;
+    unsigned i_counter = 0, n = 0;
+
+    if( i_inc == 1 )            /* If doing right wing...              */
+    {                           /* ...drop extra coeff, so when Ph is  */
+        i_end--;                /*    0.5, we don't do too many mult's */
+        if( i_remainder == 0 )  /* If the phase is zero, we've already */
+            i_counter++;        /* skipped the first sample            */
+    }
+
+    for( ;; i_counter++ )
+    {
+        const uint32_t i_pos = (i_out_rate * i_counter + i_remainder) << Nhc;
+        const uint32_t i_index = i_pos / i_in_rate;
+        if( i_index >= i_end )
+            break;
+
+        const uint32_t i_linear_remainder = i_pos - i_index * i_in_rate;
+        p_coeffs[n++] = SMALL_FILTER_FLOAT_IMP[i_index] +
+                        SMALL_FILTER_FLOAT_IMPD[i_index] * i_linear_remainder
+                            / i_in_rate / Npc;
+    }
+    return n;
+}
+
+void bl_ComputePhase( bl_phase_t *p_phase, float *p_coeffs,
+                      uint32_t i_remainder, uint32_t i_in_rate,
+                      uint32_t i_out_rate, bool b_up )
+{
+    unsigned i_left, i_right;
+
+    /* The left wing goes backward from the current input sample, the right
+     * wing forward from the next one. */
+    if( b_up )
+    {
+        i_left = WingUp( p_coeffs, i_remainder, i_out_rate, -1 );
+        i_right = WingUp( p_coeffs + i_left, i_out_rate - i_remainder,
+                          i_out_rate, 1 );
+    }
+    else
+    {
+        i_left = WingDown( p_coeffs, i_remainder, i_out_rate, i_in_rate, -1 );
+        i_right = WingDown( p_coeffs + i_left, i_out_rate - i_remainder,
+                            i_out_rate, i_in_rate, 1 );
+    }
+    assert( i_left + i_right <= bl_GetMaxTaps( i_in_rate, i_out_rate, b_up ) );
+
+    /* Put the left wing in the order of the input samples */
+    for( unsigned i = 0, j = i_left - 1; i < j; i++, j-- )
+    {
+        float f_coeff = p_coeffs[i];
+        p_coeffs[i] = p_coeffs[j];
+        p_coeffs[j] = f_coeff;
+    }
+
+    p_phase->i_left = i_left;
+    p_phase->i_taps = i_left + i_right;
+    p_phase->p_coeffs = p_coeffs;
+}
+
+int bl_BankInit( bl_bank_t *p_bank, uint32_t i_in_rate, uint32_t i_out_rate,
+                 bool b_up )
+{
+    const unsigned i_max_taps = bl_GetMaxTaps( i_in_rate, i_out_rate, b_up );
+    const uint32_t i_step = GCD( i_in_rate, i_out_rate );
+    const uint32_t i_phases = i_out_rate / i_step;
+
+    p_bank->i_in_rate = i_in_rate;
+    p_bank->i_out_rate = i_out_rate;
+    p_bank->b_up = b_up;
+    p_bank->i_step = i_step;
+    p_bank->i_phases = 0;
+    p_bank->p_phases = NULL;
+    p_bank->p_coeffs = NULL;
+
+    if( (uint64_t)i_phases * i_max_taps > BL_BANK_MAX )
+        return VLC_SUCCESS; /* computed on the fly */
+
+    p_bank->p_phases = malloc( i_phases * sizeof(*p_bank->p_phases) );
+    p_bank->p_coeffs = malloc( i_phases * i_max_taps *
+                               sizeof(*p_bank->p_coeffs) );
+    if( unlikely(p_bank->p_phases == NULL || p_bank->p_coeffs == NULL) )
+    {
+        bl_BankClean( p_bank );
+        return VLC_ENOMEM;
+    }
+
+    for( uint32_t i = 0; i < i_phases; i++ )
+        bl_ComputePhase( &p_bank->p_phases[i],
+                         p_bank->p_coeffs + i * i_max_taps, i * i_step,
+                         i_in_rate, i_out_rate, b_up );
+    p_bank->i_phases = i_phases;
+    return VLC_SUCCESS;
+}
+
+void bl_BankClean( bl_bank_t *p_bank )
+{
+    free( p_bank->p_phases );
+    free( p_bank->p_coeffs );
+    p_bank->p_phases = NULL;
+    p_bank->p_coeffs = NULL;
+    p_bank->i_phases = 0;
+}
+
+/*****************************************************************************
+ * Kernels: all channels of an output sample at once
+ *****************************************************************************/
+void bl_FilterC( float *restrict p_out, const float *restrict p_in,
+                 size_t i_stride, const float *restrict p_coeffs,
+                 unsigned i_taps, unsigned i_channels )
+{
+    for( unsigned c = 0; c < i_channels; c++ )
+        p_out[c] = 0.f;
+
+    for( unsigned k = 0; k < i_taps; k++ )
+    {
+        const float f_coeff = p_coeffs[k];
+        const float *p_sample = p_in + k * i_stride;
+
+        for( unsigned c = 0; c < i_channels; c++ )
+            p_out[c] += f_coeff * p_sample[c];
+    }
+}
+
+#ifdef HAVE_SSE_KERNELS
+VLC_SSE
+static float HorizontalSumSSE( __m128 sum )
+{
+    sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+    sum = _mm_add_ss( sum, _mm_shuffle_ps( sum, sum, 1 ) );
+    return _mm_cvtss_f32( sum );
+}
+
+VLC_SSE
+static void FilterSSE( float *restrict p_out, const float *restrict p_in,
+                       size_t i_stride, const float *restrict p_coeffs,
+                       unsigned i_taps, unsigned i_channels )
+{
+    unsigned c = 0, k = 0;
+
+    if( i_channels == 1 && i_stride == 1 )
+    {   /* Mono: four taps per vector */
+        __m128 sum = _mm_setzero_ps();
+        for( ; k + 4 <= i_taps; k += 4 )
+            sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( p_coeffs + k ),
+                                               _mm_loadu_ps( p_in + k ) ) );
+        float f_sum = HorizontalSumSSE( sum );
+        for( ; k < i_taps; k++ )
+            f_sum += p_coeffs[k] * p_in[k];
+        p_out[0] = f_sum;
+        return;
+    }
+
+    if( i_channels == 2 && i_stride == 2 )
+    {   /* Stereo: two taps per vector */
+        __m128 sum = _mm_setzero_ps();
+        for( ; k + 2 <= i_taps; k += 2 )
+        {
+            __m128 coeffs = _mm_loadl_pi( _mm_setzero_ps(),
+                                          (const __m64 *)(p_coeffs + k) );
+            coeffs = _mm_unpacklo_ps( coeffs, coeffs );
+            sum = _mm_add_ps( sum, _mm_mul_ps( coeffs,
+                                               _mm_loadu_ps( p_in + 2 * k ) ) );
+        }
+        sum = _mm_add_ps( sum, _mm_movehl_ps( sum, sum ) );
+        float f_sum[4];
+        _mm_storeu_ps( f_sum, sum );
+        for( ; k < i_taps; k++ )
+        {
+            f_sum[0] += p_coeffs[k] * p_in[2 * k];
+            f_sum[1] += p_coeffs[k] * p_in[2 * k + 1];
+        }
+        p_out[0] = f_sum[0];
+        p_out[1] = f_sum[1];
+        return;
+    }
+
+    for( ; c + 4 <= i_channels; c += 4 )
+    {
+        __m128 sum = _mm_setzero_ps();
+        for( k = 0; k < i_taps; k++ )
+        {
+            __m128 coeff = _mm_set1_ps( p_coeffs[k] );
+            __m128 in = _mm_loadu_ps( p_in + k * i_stride + c );
+            sum = _mm_add_ps( sum, _mm_mul_ps( coeff, in ) );
+        }
+        _mm_storeu_ps( p_out + c, sum );
+    }
+    if( c < i_channels )
+        bl_FilterC( p_out + c, p_in + c, i_stride, p_coeffs, i_taps,
+                    i_channels - c );
+}
+
+VLC_AVX
+static void FilterAVX( float *restrict p_out, const float *restrict p_in,
+                       size_t i_stride, const float *restrict p_coeffs,
+                       unsigned i_taps, unsigned i_channels )
+{
+    unsigned c = 0;
+
+    for( ; c + 8 <= i_channels; c += 8 )
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for( unsigned k = 0; k < i_taps; k++ )
+        {
+            __m256 coeff = _mm256_set1_ps( p_coeffs[k] );
+            __m256 in = _mm256_loadu_ps( p_in + k * i_stride + c );
+            sum = _mm256_add_ps( sum, _mm256_mul_ps( coeff, in ) );
+        }
+        _mm256_storeu_ps( p_out + c, sum );
+    }
+    /* Avoid the SSE transition penalty */
+    _mm256_zeroupper();
+    if( c < i_channels )
+        FilterSSE( p_out + c, p_in + c, i_stride, p_coeffs, i_taps,
+                   i_channels - c );
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+static void FilterNEON( float *restrict p_out, const float *restrict p_in,
+                        size_t i_stride, const float *restrict p_coeffs,
+                        unsigned i_taps, unsigned i_channels )
+{
+    unsigned c = 0, k = 0;
+
+    if( i_channels == 1 && i_stride == 1 )
+    {   /* Mono: four taps per vector */
+        float32x4_t sum = vdupq_n_f32( 0.f );
+        for( ; k + 4 <= i_taps; k += 4 )
+            sum = vmlaq_f32( sum, vld1q_f32( p_coeffs + k ),
+                             vld1q_f32( p_in + k ) );
+        float32x2_t half = vadd_f32( vget_low_f32( sum ),
+                                     vget_high_f32( sum ) );
+        float f_sum = vget_lane_f32( vpadd_f32( half, half ), 0 );
+        for( ; k < i_taps; k++ )
+            f_sum += p_coeffs[k] * p_in[k];
+        p_out[0] = f_sum;
+        return;
+    }
+
+    if( i_channels == 2 && i_stride == 2 )
+    {   /* Stereo: two taps per vector */
+        float32x4_t sum = vdupq_n_f32( 0.f );
+        for( ; k + 2 <= i_taps; k += 2 )
+        {
+            float32x4_t coeffs = vcombine_f32( vdup_n_f32( p_coeffs[k] ),
+                                               vdup_n_f32( p_coeffs[k + 1] ) );
+            sum = vmlaq_f32( sum, coeffs, vld1q_f32( p_in + 2 * k ) );
+        }
+        float32x2_t half = vadd_f32( vget_low_f32( sum ),
+                                     vget_high_f32( sum ) );
+        float f_left = vget_lane_f32( half, 0 );
+        float f_right = vget_lane_f32( half, 1 );
+        for( ; k < i_taps; k++ )
+        {
+            f_left += p_coeffs[k] * p_in[2 * k];
+            f_right += p_coeffs[k] * p_in[2 * k + 1];
+        }
+        p_out[0] = f_left;
+        p_out[1] = f_right;
+        return;
+    }
+
+    for( ; c + 4 <= i_channels; c += 4 )
+    {
+        float32x4_t sum = vdupq_n_f32( 0.f );
+        for( k = 0; k < i_taps; k++ )
+            sum = vmlaq_n_f32( sum, vld1q_f32( p_in + k * i_stride + c ),
+                               p_coeffs[k] );
+        vst1q_f32( p_out + c, sum );
+    }
+    if( c < i_channels )
+        bl_FilterC( p_out + c, p_in + c, i_stride, p_coeffs, i_taps,
+                    i_channels - c );
+}
+#endif
+
+bl_kernel_t bl_GetKernel( void )
+{
+#ifdef HAVE_SSE_KERNELS
+    if( vlc_CPU_AVX() )
+        return FilterAVX;
+    if( vlc_CPU_SSE() )
+        return FilterSSE;
+#endif
+#ifdef HAVE_NEON_KERNEL
+    return FilterNEON;
+#else
+    return bl_FilterC;
+#endif
+}
@@ -0,0 +1,115 @@
+/*****************************************************************************
+ * polyphase.h : polyphase filter bank for the band-limited resampler
+ *****************************************************************************
+ * Copyright (C) 2002, 2006 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_RESAMPLER_POLYPHASE_H
+#define VLC_RESAMPLER_POLYPHASE_H 1
+
+/*
+ * An output sample lies between two input samples. Its position, the phase,
+ * is given by the remainder of the resampler, between 0 and the output rate.
+ * For a given phase, the output sample is the dot product of the filter taps
+ * with the input samples around it, for every channel.
+ *
+ * The remainder always moves by multiples of the greatest common divisor of
+ * the rates, so there are only output rate / GCD phases. When that is small
+ * enough, the taps of every phase are computed once, in a bank.
+ */
+
+/* Filter taps for one phase */
+typedef struct
+{
+    unsigned i_left;  /* taps up to the current input sample, included */
+    unsigned i_taps;  /* total number of taps */
+    const float *p_coeffs;
+} bl_phase_t;
+
+typedef struct
+{
+    uint32_t i_in_rate;
+    uint32_t i_out_rate;
+    bool     b_up;     /* taps computed for upsampling */
+    uint32_t i_step;   /* remainder difference between two phases */
+    unsigned i_phases; /* 0 if the taps are computed for each sample */
+    bl_phase_t *p_phases;
+    float *p_coeffs;
+} bl_bank_t;
+
+/**
+ * Computes p_out[c] = sum(p_coeffs[k] * p_in[k * i_stride + c]) for each of
+ * the i_channels channels.
+ */
+typedef void (*bl_kernel_t)( float *p_out, const float *p_in, size_t i_stride,
+                             const float *p_coeffs, unsigned i_taps,
+                             unsigned i_channels );
+
+/**
+ * Returns the number of input samples needed on each side of the current
+ * one, for the given resampling factor.
+ */
+unsigned bl_GetWing( double d_factor );
+
+/**
+ * Returns the maximum number of taps of a phase.
+ */
+unsigned bl_GetMaxTaps( uint32_t i_in_rate, uint32_t i_out_rate, bool b_up );
+
+/**
+ * Computes the taps for the given remainder into p_coeffs, which must have
+ * room for bl_GetMaxTaps() coefficients.
+ */
+void bl_ComputePhase( bl_phase_t *p_phase, float *p_coeffs,
+                      uint32_t i_remainder, uint32_t i_in_rate,
+                      uint32_t i_out_rate, bool b_up );
+
+/**
+ * Computes the bank of all phases, if it is not too large. Otherwise, the
+ * bank is left empty and the phases must be computed with bl_ComputePhase().
+ */
+int  bl_BankInit( bl_bank_t *p_bank, uint32_t i_in_rate, uint32_t i_out_rate,
+                  bool b_up );
+void bl_BankClean( bl_bank_t *p_bank );
+
+/**
+ * Returns the phase for the given remainder, or NULL if it is not in the bank.
+ */
+static inline const bl_phase_t *bl_BankGet( const bl_bank_t *p_bank,
+                                            uint32_t i_remainder )
+{
+    if( p_bank->i_phases == 0 || i_remainder % p_bank->i_step )
+        return NULL;
+
+    uint32_t i_phase = i_remainder / p_bank->i_step;
+    if( i_phase >= p_bank->i_phases )
+        return NULL;
+    return &p_bank->p_phases[i_phase];
+}
+
+/**
+ * Portable kernel.
+ */
+void bl_FilterC( float *p_out, const float *p_in, size_t i_stride,
+                 const float *p_coeffs, unsigned i_taps, unsigned i_channels );
+
+/**
+ * Returns the fastest kernel for this CPU.
+ */
+bl_kernel_t bl_GetKernel( void );
+
+#endif
@@ -43,6 +43,10 @@ static int  Open( vlc_object_t * );
 static void Close( vlc_object_t * );
 static block_t *DoWork( filter_t *, block_t * );
 
+static const char *const search_mode_list[] = { "exhaustive", "coarse" };
+static const char *const search_mode_list_text[] = {
+    N_("Exhaustive"), N_("Coarse then fine") };
+
 vlc_module_begin ()
     set_description( N_("Audio tempo scaler synched with rate") )
     set_shortname( N_("Scaletempo") )
@@ -56,6 +60,12 @@ vlc_module_begin ()
         N_("Overlap Length"), N_("Percentage of stride to overlap"), true )
     add_integer_with_range( "scaletempo-search", 14, 0, 200,
         N_("Search Length"), N_("Length in milliseconds to search for best overlap position"), true )
+    add_string( "scaletempo-search-mode", "exhaustive",
+        N_("Search Mode"), N_("Exhaustive search tries every overlap position. "
+        "Coarse search first tries every few positions on decimated audio, "
+        "then refines around the best one: it is much faster, but may "
+        "sometimes miss the best position."), true )
+        change_string_list( search_mode_list, search_mode_list_text )
 
     set_callbacks( Open, Close )
 vlc_module_end ()
@@ -111,43 +121,131 @@ struct filter_sys_t
     void     *buf_pre_corr;
     void     *table_window;
     unsigned(*best_overlap_offset)( filter_t *p_filter );
+    /* coarse search */
+    unsigned  frames_decimation;  /* 1 for exhaustive search */
+    unsigned  frames_search_coarse;
+    unsigned  frames_overlap_coarse;
+    float    *buf_pre_corr_coarse;
+    float    *buf_queue_coarse;
 };
 
+/*****************************************************************************
+ * dot_product: with independent sums, so that it can be vectorized
+ *****************************************************************************/
+static float dot_product( const float *a, const float *b, unsigned n )
+{
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    unsigned i;
+
+    for( i = 0; i + 4 <= n; i += 4 ) {
+        s0 += a[i]   * b[i];
+        s1 += a[i+1] * b[i+1];
+        s2 += a[i+2] * b[i+2];
+        s3 += a[i+3] * b[i+3];
+    }
+    for( ; i < n; i++ )
+        s0 += a[i] * b[i];
+    return ( s0 + s1 ) + ( s2 + s3 );
+}
+
+/*****************************************************************************
+ * pre_correlate: window the end of the previous stride
+ *****************************************************************************/
+static void pre_correlate( filter_sys_t *p )
+{
+    const float *pw = p->table_window;
+    const float *po = (const float *)p->buf_overlap + p->samples_per_frame;
+    float *ppc = p->buf_pre_corr;
+
+    for( unsigned i = p->samples_per_frame; i < p->samples_overlap; i++ )
+        *ppc++ = *pw++ * *po++;
+}
+
+/*****************************************************************************
+ * search_offsets: find the best overlap offset in [off_min, off_max[
+ *****************************************************************************/
+static unsigned search_offsets( filter_sys_t *p,
+                                unsigned off_min, unsigned off_max )
+{
+    const unsigned samples = p->samples_overlap - p->samples_per_frame;
+    const float *search_start = (const float *)p->buf_queue
+                              + ( off_min + 1 ) * p->samples_per_frame;
+    float best_corr = INT_MIN;
+    unsigned best_off = off_min;
+
+    for( unsigned off = off_min; off < off_max; off++ ) {
+        float corr = dot_product( p->buf_pre_corr, search_start, samples );
+        if( corr > best_corr ) {
+            best_corr = corr;
+            best_off  = off;
+        }
+        search_start += p->samples_per_frame;
+    }
+    return best_off;
+}
+
 /*****************************************************************************
  * best_overlap_offset: calculate best offset for overlap
  *****************************************************************************/
 static unsigned best_overlap_offset_float( filter_t *p_filter )
 {
     filter_sys_t *p = p_filter->p_sys;
-    float *pw, *po, *ppc, *search_start;
-    float best_corr = INT_MIN;
-    unsigned best_off = 0;
-    unsigned i, off;
-
-    pw  = p->table_window;
-    po  = p->buf_overlap;
-    po += p->samples_per_frame;
-    ppc = p->buf_pre_corr;
-    for( i = p->samples_per_frame; i < p->samples_overlap; i++ ) {
-      *ppc++ = *pw++ * *po++;
+
+    pre_correlate( p );
+    return search_offsets( p, 0, p->frames_search ) * p->bytes_per_frame;
+}
+
+/*
+ * The coarse search only looks at every frames_decimation-th frame, both in
+ * the overlap and in the queue, and only tries every frames_decimation-th
+ * offset. That divides its cost by the square of the decimation. The best
+ * offset is then refined at full resolution around the coarse one.
+ *
+ * Decimated frames are gathered into contiguous buffers, so that the coarse
+ * correlation is a plain dot product too.
+ */
+static unsigned best_overlap_offset_coarse( filter_t *p_filter )
+{
+    filter_sys_t *p = p_filter->p_sys;
+    const unsigned nch = p->samples_per_frame;
+    const unsigned step = p->frames_decimation;
+    const size_t bytes_frame = nch * sizeof (float);
+    unsigned i;
+
+    pre_correlate( p );
+
+    /* buf_pre_corr starts at the second frame of the overlap */
+    const float *ppc = (const float *)p->buf_pre_corr + ( step - 1 ) * nch;
+    float *pd = p->buf_pre_corr_coarse;
+    for( i = 0; i < p->frames_overlap_coarse; i++ ) {
+        memcpy( pd, ppc, bytes_frame );
+        ppc += step * nch;
+        pd  += nch;
     }
 
-    search_start = (float *)p->buf_queue + p->samples_per_frame;
-    for( off = 0; off < p->frames_search; off++ ) {
-      float corr = 0;
-      float *ps = search_start;
-      ppc = p->buf_pre_corr;
-      for( i = p->samples_per_frame; i < p->samples_overlap; i++ ) {
-        corr += *ppc++ * *ps++;
-      }
-      if( corr > best_corr ) {
-        best_corr = corr;
-        best_off  = off;
-      }
-      search_start += p->samples_per_frame;
+    const float *pq = (const float *)p->buf_queue + step * nch;
+    pd = p->buf_queue_coarse;
+    for( i = 0; i < p->frames_search_coarse + p->frames_overlap_coarse - 1; i++ ) {
+        memcpy( pd, pq, bytes_frame );
+        pq += step * nch;
+        pd += nch;
     }
 
-    return best_off * p->bytes_per_frame;
+    const unsigned samples = p->frames_overlap_coarse * nch;
+    float best_corr = INT_MIN;
+    unsigned best_off = 0;
+    for( i = 0; i < p->frames_search_coarse; i++ ) {
+        float corr = dot_product( p->buf_pre_corr_coarse,
+                                  p->buf_queue_coarse + i * nch, samples );
+        if( corr > best_corr ) {
+            best_corr = corr;
+            best_off  = i * step;
+        }
+    }
+
+    unsigned off_min = best_off >= step ? best_off - step + 1 : 0;
+    unsigned off_max = __MIN( best_off + step, p->frames_search );
+    return search_offsets( p, off_min, off_max ) * p->bytes_per_frame;
 }
 
 /*****************************************************************************
@@ -338,6 +436,21 @@ static int reinit_buffers( filter_t *p_filter )
                 *pw++ = v;
         }
         p->best_overlap_offset = best_overlap_offset_float;
+
+        unsigned step = p->frames_decimation;
+        p->frames_search_coarse  = ( p->frames_search + step - 1 ) / step;
+        p->frames_overlap_coarse = ( frames_overlap - 1 ) / step;
+        if( step > 1 && p->frames_overlap_coarse > 0 )
+        {
+            p->buf_pre_corr_coarse = malloc( p->frames_overlap_coarse
+                                             * p->bytes_per_frame );
+            p->buf_queue_coarse = malloc( ( p->frames_search_coarse
+                                            + p->frames_overlap_coarse - 1 )
+                                          * p->bytes_per_frame );
+            if( !p->buf_pre_corr_coarse || !p->buf_queue_coarse )
+                return VLC_ENOMEM;
+            p->best_overlap_offset = best_overlap_offset_coarse;
+        }
     }
 
     unsigned new_size = ( p->frames_search + frames_stride + frames_overlap ) * p->bytes_per_frame;
@@ -408,14 +521,24 @@ static int Open( vlc_object_t *p_this )
     p_sys->percent_overlap = var_InheritFloat( p_this, "scaletempo-overlap" );
     p_sys->ms_search       = var_InheritInteger( p_this, "scaletempo-search" );
 
-    msg_Dbg( p_this, "params: %i stride, %.3f overlap, %i search",
-             p_sys->ms_stride, p_sys->percent_overlap, p_sys->ms_search );
+    /* Decimate the coarse search to about 12 kHz */
+    char *psz_mode = var_InheritString( p_this, "scaletempo-search-mode" );
+    p_sys->frames_decimation = 1;
+    if( psz_mode != NULL && !strcmp( psz_mode, "coarse" ) )
+        p_sys->frames_decimation = __MAX( p_sys->sample_rate / 12000, 1 );
+    free( psz_mode );
+
+    msg_Dbg( p_this, "params: %i stride, %.3f overlap, %i search, %u decimation",
+             p_sys->ms_stride, p_sys->percent_overlap, p_sys->ms_search,
+             p_sys->frames_decimation );
 
     p_sys->buf_queue      = NULL;
     p_sys->buf_overlap    = NULL;
     p_sys->table_blend    = NULL;
     p_sys->buf_pre_corr   = NULL;
     p_sys->table_window   = NULL;
+    p_sys->buf_pre_corr_coarse = NULL;
+    p_sys->buf_queue_coarse    = NULL;
     p_sys->bytes_overlap  = 0;
     p_sys->bytes_queued   = 0;
     p_sys->bytes_to_slide = 0;
@@ -442,6 +565,8 @@ static void Close( vlc_object_t *p_this )
     free( p_sys->table_blend );
     free( p_sys->buf_pre_corr );
     free( p_sys->table_window );
+    free( p_sys->buf_pre_corr_coarse );
+    free( p_sys->buf_queue_coarse );
     free( p_sys );
 }
 
@@ -468,7 +593,7 @@ static block_t *DoWork( filter_t * p_filter, block_t * p_in_buf )
     }
 
     size_t i_outsize = calculate_output_buffer_size ( p_filter, p_in_buf->i_buffer );
-    block_t *p_out_buf = block_Alloc( i_outsize );
+    block_t *p_out_buf = filter_NewAudioBuffer( p_filter, i_outsize );
     if( p_out_buf == NULL )
         return NULL;
 
@@ -0,0 +1,217 @@
+/*****************************************************************************
+ * amplify.c : audio volume kernels
+ *****************************************************************************
+ * Copyright (C) 2002 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "amplify.h"
+
+#if defined (CAN_COMPILE_SSE) && (VLC_GCC_VERSION(4, 9) || defined (__clang__))
+# define HAVE_SSE_KERNELS 1
+# include <immintrin.h>
+#endif
+
+void amp_FL32C( float *p, size_t i_samples, float f_mult )
+{
+    for( size_t i = 0; i < i_samples; i++ )
+        p[i] *= f_mult;
+}
+
+void amp_FL64C( double *p, size_t i_samples, double d_mult )
+{
+    for( size_t i = 0; i < i_samples; i++ )
+        p[i] *= d_mult;
+}
+
+void amp_S16C( int16_t *p, size_t i_samples, int i_mult )
+{
+    for( size_t i = 0; i < i_samples; i++ )
+    {
+        int_fast32_t s = (p[i] * (int_fast32_t)i_mult) >> 8;
+        if( s > INT16_MAX )
+            s = INT16_MAX;
+        else
+        if( s < INT16_MIN )
+            s = INT16_MIN;
+        p[i] = s;
+    }
+}
+
+#ifdef HAVE_SSE_KERNELS
+VLC_SSE
+static void FL32SSE( float *p, size_t i_samples, float f_mult )
+{
+    const __m128 mult = _mm_set1_ps( f_mult );
+    size_t i = 0;
+
+    for( ; i + 8 <= i_samples; i += 8 )
+    {
+        __m128 a = _mm_loadu_ps( p + i );
+        __m128 b = _mm_loadu_ps( p + i + 4 );
+        _mm_storeu_ps( p + i, _mm_mul_ps( a, mult ) );
+        _mm_storeu_ps( p + i + 4, _mm_mul_ps( b, mult ) );
+    }
+    amp_FL32C( p + i, i_samples - i, f_mult );
+}
+
+VLC_AVX
+static void FL32AVX( float *p, size_t i_samples, float f_mult )
+{
+    const __m256 mult = _mm256_set1_ps( f_mult );
+    size_t i = 0;
+
+    for( ; i + 16 <= i_samples; i += 16 )
+    {
+        __m256 a = _mm256_loadu_ps( p + i );
+        __m256 b = _mm256_loadu_ps( p + i + 8 );
+        _mm256_storeu_ps( p + i, _mm256_mul_ps( a, mult ) );
+        _mm256_storeu_ps( p + i + 8, _mm256_mul_ps( b, mult ) );
+    }
+    /* Avoid the SSE transition penalty */
+    _mm256_zeroupper();
+    amp_FL32C( p + i, i_samples - i, f_mult );
+}
+
+VLC_SSE2
+static void FL64SSE2( double *p, size_t i_samples, double d_mult )
+{
+    const __m128d mult = _mm_set1_pd( d_mult );
+    size_t i = 0;
+
+    for( ; i + 4 <= i_samples; i += 4 )
+    {
+        __m128d a = _mm_loadu_pd( p + i );
+        __m128d b = _mm_loadu_pd( p + i + 2 );
+        _mm_storeu_pd( p + i, _mm_mul_pd( a, mult ) );
+        _mm_storeu_pd( p + i + 2, _mm_mul_pd( b, mult ) );
+    }
+    amp_FL64C( p + i, i_samples - i, d_mult );
+}
+
+VLC_AVX
+static void FL64AVX( double *p, size_t i_samples, double d_mult )
+{
+    const __m256d mult = _mm256_set1_pd( d_mult );
+    size_t i = 0;
+
+    for( ; i + 8 <= i_samples; i += 8 )
+    {
+        __m256d a = _mm256_loadu_pd( p + i );
+        __m256d b = _mm256_loadu_pd( p + i + 4 );
+        _mm256_storeu_pd( p + i, _mm256_mul_pd( a, mult ) );
+        _mm256_storeu_pd( p + i + 4, _mm256_mul_pd( b, mult ) );
+    }
+    _mm256_zeroupper();
+    amp_FL64C( p + i, i_samples - i, d_mult );
+}
+
+/* The 32-bits products are rebuilt from their low and high halves, shifted,
+ * then packed back to 16 bits with signed saturation, like the C clipping. */
+VLC_SSE2
+static void S16SSE2( int16_t *p, size_t i_samples, int i_mult )
+{
+    if( i_mult > INT16_MAX || i_mult < INT16_MIN )
+    {
+        amp_S16C( p, i_samples, i_mult );
+        return;
+    }
+
+    const __m128i mult = _mm_set1_epi16( i_mult );
+    size_t i = 0;
+
+    for( ; i + 8 <= i_samples; i += 8 )
+    {
+        __m128i s = _mm_loadu_si128( (const __m128i *)(p + i) );
+        __m128i lo = _mm_mullo_epi16( s, mult );
+        __m128i hi = _mm_mulhi_epi16( s, mult );
+        __m128i a = _mm_srai_epi32( _mm_unpacklo_epi16( lo, hi ), 8 );
+        __m128i b = _mm_srai_epi32( _mm_unpackhi_epi16( lo, hi ), 8 );
+        _mm_storeu_si128( (__m128i *)(p + i), _mm_packs_epi32( a, b ) );
+    }
+    amp_S16C( p + i, i_samples - i, i_mult );
+}
+
+VLC_AVX2
+static void S16AVX2( int16_t *p, size_t i_samples, int i_mult )
+{
+    if( i_mult > INT16_MAX || i_mult < INT16_MIN )
+    {
+        amp_S16C( p, i_samples, i_mult );
+        return;
+    }
+
+    const __m256i mult = _mm256_set1_epi16( i_mult );
+    size_t i = 0;
+
+    /* Unpacking and packing both work within 128-bits lanes, so the samples
+     * come back in their original order. */
+    for( ; i + 16 <= i_samples; i += 16 )
+    {
+        __m256i s = _mm256_loadu_si256( (const __m256i *)(p + i) );
+        __m256i lo = _mm256_mullo_epi16( s, mult );
+        __m256i hi = _mm256_mulhi_epi16( s, mult );
+        __m256i a = _mm256_srai_epi32( _mm256_unpacklo_epi16( lo, hi ), 8 );
+        __m256i b = _mm256_srai_epi32( _mm256_unpackhi_epi16( lo, hi ), 8 );
+        _mm256_storeu_si256( (__m256i *)(p + i), _mm256_packs_epi32( a, b ) );
+    }
+    _mm256_zeroupper();
+    amp_S16C( p + i, i_samples - i, i_mult );
+}
+#endif
+
+amp_fl32_t amp_GetFL32( unsigned i_cpu )
+{
+#ifdef HAVE_SSE_KERNELS
+    if( i_cpu & VLC_CPU_AVX )
+        return FL32AVX;
+    if( i_cpu & VLC_CPU_SSE )
+        return FL32SSE;
+#endif
+    VLC_UNUSED(i_cpu);
+    return amp_FL32C;
+}
+
+amp_fl64_t amp_GetFL64( unsigned i_cpu )
+{
+#ifdef HAVE_SSE_KERNELS
+    if( i_cpu & VLC_CPU_AVX )
+        return FL64AVX;
+    if( i_cpu & VLC_CPU_SSE2 )
+        return FL64SSE2;
+#endif
+    VLC_UNUSED(i_cpu);
+    return amp_FL64C;
+}
+
+amp_s16_t amp_GetS16( unsigned i_cpu )
+{
+#ifdef HAVE_SSE_KERNELS
+    if( i_cpu & VLC_CPU_AVX2 )
+        return S16AVX2;
+    if( i_cpu & VLC_CPU_SSE2 )
+        return S16SSE2;
+#endif
+    VLC_UNUSED(i_cpu);
+    return amp_S16C;
+}
@@ -0,0 +1,52 @@
+/*****************************************************************************
+ * amplify.h : audio volume kernels
+ *****************************************************************************
+ * Copyright (C) 2002 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_AUDIO_MIXER_AMPLIFY_H
+#define VLC_AUDIO_MIXER_AMPLIFY_H 1
+
+/*
+ * Each kernel multiplies i_samples samples in place. The vector kernels give
+ * exactly the same results as the portable ones.
+ */
+
+typedef void (*amp_fl32_t)( float *p, size_t i_samples, float f_mult );
+typedef void (*amp_fl64_t)( double *p, size_t i_samples, double d_mult );
+
+/**
+ * Computes p[i] = clip((p[i] * i_mult) >> 8), i_mult being in Q8.
+ */
+typedef void (*amp_s16_t)( int16_t *p, size_t i_samples, int i_mult );
+
+/**
+ * Portable kernels.
+ */
+void amp_FL32C( float *p, size_t i_samples, float f_mult );
+void amp_FL64C( double *p, size_t i_samples, double d_mult );
+void amp_S16C( int16_t *p, size_t i_samples, int i_mult );
+
+/**
+ * Return the fastest kernels for the given CPU capabilities, normally those
+ * of vlc_CPU().
+ */
+amp_fl32_t amp_GetFL32( unsigned i_cpu );
+amp_fl64_t amp_GetFL64( unsigned i_cpu );
+amp_s16_t  amp_GetS16( unsigned i_cpu );
+
+#endif
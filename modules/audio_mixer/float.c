@@ -34,6 +34,9 @@
 #include <vlc_plugin.h>
 #include <vlc_aout.h>
 #include <vlc_aout_volume.h>
+#include <vlc_cpu.h>
+
+#include "amplify.h"
 
 /*****************************************************************************
  * Local prototypes
@@ -57,28 +60,24 @@ vlc_module_end ()
 static void FilterFL32( audio_volume_t *p_volume, block_t *p_buffer,
                         float f_multiplier )
 {
+    amp_fl32_t pf_amplify = (amp_fl32_t)p_volume->sys;
     if( f_multiplier == 1.f )
         return; /* nothing to do */
 
     float *p = (float *)p_buffer->p_buffer;
-    for( size_t i = p_buffer->i_buffer / sizeof(*p); i > 0; i-- )
-        *(p++) *= f_multiplier;
-
-    (void) p_volume;
+    pf_amplify( p, p_buffer->i_buffer / sizeof(*p), f_multiplier );
 }
 
 static void FilterFL64( audio_volume_t *p_volume, block_t *p_buffer,
                         float f_multiplier )
 {
+    amp_fl64_t pf_amplify = (amp_fl64_t)p_volume->sys;
     double *p = (double *)p_buffer->p_buffer;
     double mult = f_multiplier;
     if( mult == 1. )
         return; /* nothing to do */
 
-    for( size_t i = p_buffer->i_buffer / sizeof(*p); i > 0; i-- )
-        *(p++) *= mult;
-
-    (void) p_volume;
+    pf_amplify( p, p_buffer->i_buffer / sizeof(*p), mult );
 }
 
 /**
@@ -92,9 +91,11 @@ static int Create( vlc_object_t *p_this )
     {
         case VLC_CODEC_FL32:
             p_volume->amplify = FilterFL32;
+            p_volume->sys = (void *)amp_GetFL32( vlc_CPU() );
             break;
         case VLC_CODEC_FL64:
             p_volume->amplify = FilterFL64;
+            p_volume->sys = (void *)amp_GetFL64( vlc_CPU() );
             break;
         default:
             return -1;
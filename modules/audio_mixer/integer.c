@@ -29,6 +29,9 @@
 #include <vlc_plugin.h>
 #include <vlc_aout.h>
 #include <vlc_aout_volume.h>
+#include <vlc_cpu.h>
+
+#include "amplify.h"
 
 static int Activate (vlc_object_t *);
 
@@ -63,23 +66,14 @@ static void FilterS32N (audio_volume_t *vol, block_t *block, float volume)
 
 static void FilterS16N (audio_volume_t *vol, block_t *block, float volume)
 {
+    amp_s16_t amplify = (amp_s16_t)vol->sys;
     int16_t *p = (int16_t *)block->p_buffer;
 
     int_fast16_t mult = lroundf (volume * 0x1.p8f);
     if (mult == (1 << 8))
         return;
 
-    for (size_t n = block->i_buffer / sizeof (*p); n > 0; n--)
-    {
-        int_fast32_t s = (*p * (int_fast32_t)mult) >> 8;
-        if (s > INT16_MAX)
-            s = INT16_MAX;
-        else
-        if (s < INT16_MIN)
-            s = INT16_MIN;
-        *(p++) = s;
-    }
-    (void) vol;
+    amplify (p, block->i_buffer / sizeof (*p), mult);
 }
 
 static void FilterU8 (audio_volume_t *vol, block_t *block, float volume)
@@ -114,6 +108,7 @@ static int Activate (vlc_object_t *obj)
             break;
         case VLC_CODEC_S16N:
             vol->amplify = FilterS16N;
+            vol->sys = (void *)amp_GetS16 (vlc_CPU ());
             break;
         case VLC_CODEC_U8:
             vol->amplify = FilterU8;
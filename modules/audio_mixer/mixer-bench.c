@@ -0,0 +1,353 @@
+/*****************************************************************************
+ * mixer-bench.c: compares the audio volume and channel mixer kernels
+ *****************************************************************************
+ * Copyright (C) 2002 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: mixer-bench [samples]
+ *
+ * Checks that every vector kernel supported by this CPU gives the same output
+ * as the C code, then reports the throughput of each of them on a buffer of
+ * the given number of samples.
+ *
+ * The volume kernels must be bit-exact. The downmixes add several channels,
+ * and the compiler is free to reorder the additions of the C code (we build
+ * with -ffast-math), so they are only checked to within rounding errors. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "amplify.h"
+
+#if defined (CAN_COMPILE_SSE) && (VLC_GCC_VERSION(4, 9) || defined (__clang__))
+# define HAVE_SSE_KERNELS 1
+void convert_7_x_to_2_0_sse( float *dst, const float *src, int num, bool lfe );
+void convert_5_x_to_2_0_sse( float *dst, const float *src, int num, bool lfe );
+#endif
+
+#define BENCH_TIME (CLOCK_FREQ / 5)
+
+typedef struct
+{
+    const char *psz_name;
+    unsigned i_cpu;
+} level_t;
+
+/* Each level enables the kernels of the previous ones */
+static const level_t levels[] = {
+    { "C", 0 },
+#ifdef HAVE_SSE_KERNELS
+    { "SSE2", VLC_CPU_SSE | VLC_CPU_SSE2 },
+    { "AVX", VLC_CPU_SSE | VLC_CPU_SSE2 | VLC_CPU_AVX },
+    { "AVX2", VLC_CPU_SSE | VLC_CPU_SSE2 | VLC_CPU_AVX | VLC_CPU_AVX2 },
+#endif
+};
+
+static const float volumes[] = { 0.f, .25f, .7071f, 1.337f, 2.f };
+
+static unsigned i_seed = 1;
+
+static int32_t Random( void )
+{
+    i_seed = i_seed * 1103515245 + 12345;
+    return (int32_t)i_seed >> 8;
+}
+
+static void Report( const char *psz_what, const char *psz_kernel,
+                    size_t i_samples, mtime_t i_time, unsigned i_runs )
+{
+    printf( "  %-12s %-5s %8.1f Msamples/s\n", psz_what, psz_kernel,
+            (double)i_samples * i_runs / __MAX(i_time, 1) );
+}
+
+/* Runs the kernel over and over on the same buffer, for a fixed time */
+#define BENCH(psz_what, psz_kernel, call, i_samples) \
+    do { \
+        unsigned i_runs = 0; \
+        mtime_t i_start = mdate(), i_time; \
+        do { \
+            call; \
+            i_runs++; \
+        } while( (i_time = mdate() - i_start) < BENCH_TIME ); \
+        Report( psz_what, psz_kernel, i_samples, i_time, i_runs ); \
+    } while( 0 )
+
+/*****************************************************************************
+ * Volume
+ *****************************************************************************/
+static int TestFL32( size_t i_max )
+{
+    float *p_in = malloc( i_max * sizeof (float) );
+    float *p_ref = malloc( i_max * sizeof (float) );
+    float *p_out = malloc( i_max * sizeof (float) );
+    amp_fl32_t prev = NULL;
+    int i_ret = 0;
+
+    if( p_in == NULL || p_ref == NULL || p_out == NULL )
+        abort();
+    for( size_t i = 0; i < i_max; i++ )
+        p_in[i] = Random() * 0x1.p-23f;
+
+    for( size_t l = 0; l < ARRAY_SIZE(levels); l++ )
+    {
+        if( (vlc_CPU() & levels[l].i_cpu) != levels[l].i_cpu )
+            continue;
+        amp_fl32_t pf_kernel = amp_GetFL32( levels[l].i_cpu );
+        if( pf_kernel == prev )
+            continue;
+        prev = pf_kernel;
+
+        /* Every length up to a few vectors, to cover the tails */
+        for( size_t v = 0; v < ARRAY_SIZE(volumes); v++ )
+            for( size_t n = 0; n < __MIN(i_max, 67); n++ )
+            {
+                memcpy( p_ref, p_in, n * sizeof (float) );
+                memcpy( p_out, p_in, n * sizeof (float) );
+                amp_FL32C( p_ref, n, volumes[v] );
+                pf_kernel( p_out, n, volumes[v] );
+                if( memcmp( p_ref, p_out, n * sizeof (float) ) )
+                {
+                    fprintf( stderr, "FAILED: FL32 %s, volume %f, %zu samples\n",
+                             levels[l].psz_name, volumes[v], n );
+                    i_ret = 1;
+                }
+            }
+
+        memcpy( p_out, p_in, i_max * sizeof (float) );
+        BENCH( "FL32 volume", levels[l].psz_name,
+               pf_kernel( p_out, i_max, 1.f ), i_max );
+    }
+    free( p_out );
+    free( p_ref );
+    free( p_in );
+    return i_ret;
+}
+
+static int TestFL64( size_t i_max )
+{
+    double *p_in = malloc( i_max * sizeof (double) );
+    double *p_ref = malloc( i_max * sizeof (double) );
+    double *p_out = malloc( i_max * sizeof (double) );
+    amp_fl64_t prev = NULL;
+    int i_ret = 0;
+
+    if( p_in == NULL || p_ref == NULL || p_out == NULL )
+        abort();
+    for( size_t i = 0; i < i_max; i++ )
+        p_in[i] = Random() * 0x1.p-23;
+
+    for( size_t l = 0; l < ARRAY_SIZE(levels); l++ )
+    {
+        if( (vlc_CPU() & levels[l].i_cpu) != levels[l].i_cpu )
+            continue;
+        amp_fl64_t pf_kernel = amp_GetFL64( levels[l].i_cpu );
+        if( pf_kernel == prev )
+            continue;
+        prev = pf_kernel;
+
+        for( size_t v = 0; v < ARRAY_SIZE(volumes); v++ )
+            for( size_t n = 0; n < __MIN(i_max, 67); n++ )
+            {
+                memcpy( p_ref, p_in, n * sizeof (double) );
+                memcpy( p_out, p_in, n * sizeof (double) );
+                amp_FL64C( p_ref, n, volumes[v] );
+                pf_kernel( p_out, n, volumes[v] );
+                if( memcmp( p_ref, p_out, n * sizeof (double) ) )
+                {
+                    fprintf( stderr, "FAILED: FL64 %s, volume %f, %zu samples\n",
+                             levels[l].psz_name, volumes[v], n );
+                    i_ret = 1;
+                }
+            }
+
+        memcpy( p_out, p_in, i_max * sizeof (double) );
+        BENCH( "FL64 volume", levels[l].psz_name,
+               pf_kernel( p_out, i_max, 1. ), i_max );
+    }
+    free( p_out );
+    free( p_ref );
+    free( p_in );
+    return i_ret;
+}
+
+static int TestS16( size_t i_max )
+{
+    int16_t *p_in = malloc( i_max * sizeof (int16_t) );
+    int16_t *p_ref = malloc( i_max * sizeof (int16_t) );
+    int16_t *p_out = malloc( i_max * sizeof (int16_t) );
+    amp_s16_t prev = NULL;
+    int i_ret = 0;
+
+    if( p_in == NULL || p_ref == NULL || p_out == NULL )
+        abort();
+    /* Full scale, so that the amplified samples get clipped */
+    for( size_t i = 0; i < i_max; i++ )
+        p_in[i] = Random();
+    p_in[0] = INT16_MIN;
+    if( i_max > 1 )
+        p_in[1] = INT16_MAX;
+
+    for( size_t l = 0; l < ARRAY_SIZE(levels); l++ )
+    {
+        if( (vlc_CPU() & levels[l].i_cpu) != levels[l].i_cpu )
+            continue;
+        amp_s16_t pf_kernel = amp_GetS16( levels[l].i_cpu );
+        if( pf_kernel == prev )
+            continue;
+        prev = pf_kernel;
+
+        for( size_t v = 0; v < ARRAY_SIZE(volumes); v++ )
+            for( size_t n = 0; n < __MIN(i_max, 67); n++ )
+            {
+                /* Same as the integer volume plugin */
+                int i_mult = lroundf( volumes[v] * 0x1.p8f );
+
+                memcpy( p_ref, p_in, n * sizeof (int16_t) );
+                memcpy( p_out, p_in, n * sizeof (int16_t) );
+                amp_S16C( p_ref, n, i_mult );
+                pf_kernel( p_out, n, i_mult );
+                if( memcmp( p_ref, p_out, n * sizeof (int16_t) ) )
+                {
+                    fprintf( stderr, "FAILED: S16N %s, volume %f, %zu samples\n",
+                             levels[l].psz_name, volumes[v], n );
+                    i_ret = 1;
+                }
+            }
+
+        memcpy( p_out, p_in, i_max * sizeof (int16_t) );
+        BENCH( "S16N volume", levels[l].psz_name,
+               pf_kernel( p_out, i_max, 1 << 8 ), i_max );
+    }
+    free( p_out );
+    free( p_ref );
+    free( p_in );
+    return i_ret;
+}
+
+/*****************************************************************************
+ * Channel mixer
+ *****************************************************************************/
+typedef void (*downmix_t)( float *dst, const float *src, int num, bool lfe );
+
+/* These must compute exactly like DoWork_7_x_to_2_0() and
+ * DoWork_5_x_to_2_0() in simple.c. */
+static void Convert_7_x_to_2_0_C( float *dst, const float *src, int num,
+                                  bool lfe )
+{
+    for( int i = num; i--; )
+    {
+        float ctr = src[6] * 0.7071f;
+        *dst++ = ctr + src[0] + src[2] / 4 + src[4] / 4;
+        *dst++ = ctr + src[1] + src[3] / 4 + src[5] / 4;
+
+        src += 7;
+
+        if( lfe ) src++;
+    }
+}
+
+static void Convert_5_x_to_2_0_C( float *dst, const float *src, int num,
+                                  bool lfe )
+{
+    for( int i = num; i--; )
+    {
+        *dst++ = src[0] + 0.7071f * (src[4] + src[2]);
+        *dst++ = src[1] + 0.7071f * (src[4] + src[3]);
+
+        src += 5;
+
+        if( lfe ) src++;
+    }
+}
+
+static int TestDownmix( const char *psz_what, unsigned i_channels,
+                        downmix_t pf_ref, downmix_t pf_kernel,
+                        const char *psz_kernel, size_t i_max )
+{
+    const size_t i_frames = i_max / (i_channels + 1);
+    float *p_in = malloc( i_frames * (i_channels + 1) * sizeof (float) );
+    float *p_ref = malloc( i_frames * 2 * sizeof (float) );
+    float *p_out = malloc( i_frames * 2 * sizeof (float) );
+    int i_ret = 0;
+
+    if( p_in == NULL || p_ref == NULL || p_out == NULL )
+        abort();
+    for( size_t i = 0; i < i_frames * (i_channels + 1); i++ )
+        p_in[i] = Random() * 0x1.p-23f;
+
+    /* The samples are within [-1, 1[, so are the rounding errors of the
+     * output within a few 2^-23. */
+    for( int lfe = 0; lfe < 2; lfe++ )
+        for( size_t n = 0; n < __MIN(i_frames, 19); n++ )
+        {
+            pf_ref( p_ref, p_in, n, lfe );
+            pf_kernel( p_out, p_in, n, lfe );
+            for( size_t i = 0; i < n * 2; i++ )
+                if( fabsf( p_ref[i] - p_out[i] ) > 0x1.p-20f )
+                {
+                    fprintf( stderr, "FAILED: %s %s, LFE %d, %zu frames\n",
+                             psz_what, psz_kernel, lfe, n );
+                    i_ret = 1;
+                    break;
+                }
+        }
+
+    BENCH( psz_what, psz_kernel, pf_kernel( p_out, p_in, i_frames, true ),
+           i_frames * (i_channels + 1) );
+    free( p_out );
+    free( p_ref );
+    free( p_in );
+    return i_ret;
+}
+
+int main( int argc, char **argv )
+{
+    size_t i_max = (argc > 1) ? strtoul( argv[1], NULL, 0 ) : 8192;
+    int i_ret = 0;
+
+    if( i_max == 0 )
+        return 1;
+
+    printf( "%zu samples:\n", i_max );
+    i_ret |= TestFL32( i_max );
+    i_ret |= TestFL64( i_max );
+    i_ret |= TestS16( i_max );
+
+    i_ret |= TestDownmix( "7.1 to 2.0", 7, Convert_7_x_to_2_0_C,
+                          Convert_7_x_to_2_0_C, "C", i_max );
+    i_ret |= TestDownmix( "5.1 to 2.0", 5, Convert_5_x_to_2_0_C,
+                          Convert_5_x_to_2_0_C, "C", i_max );
+#ifdef HAVE_SSE_KERNELS
+    if( vlc_CPU_SSE() )
+    {
+        i_ret |= TestDownmix( "7.1 to 2.0", 7, Convert_7_x_to_2_0_C,
+                              convert_7_x_to_2_0_sse, "SSE", i_max );
+        i_ret |= TestDownmix( "5.1 to 2.0", 5, Convert_5_x_to_2_0_C,
+                              convert_5_x_to_2_0_sse, "SSE", i_max );
+    }
+#endif
+    return i_ret;
+}
@@ -30,9 +30,11 @@
 #include "playlist/BaseAdaptationSet.h"
 #include "playlist/BaseRepresentation.h"
 #include "http/HTTPConnectionManager.h"
+#include "http/Downloader.hpp"
 #include "logic/AlwaysBestAdaptationLogic.h"
 #include "logic/RateBasedAdaptationLogic.h"
 #include "logic/AlwaysLowestAdaptationLogic.hpp"
+#include "logic/BufferBasedAdaptationLogic.hpp"
 #include "plumbing/StreamOutput.hpp"
 #include <vlc_stream.h>
 #include <vlc_demux.h>
@@ -48,6 +50,7 @@ PlaylistManager::PlaylistManager( demux_t *p_demux_,
                                   AbstractStreamOutputFactory *factory,
                                   AbstractAdaptationLogic::LogicType type ) :
              conManager     ( NULL ),
+             downloader     ( NULL ),
              logicType      ( type ),
              playlist       ( pl ),
              streamOutputFactory( factory ),
@@ -60,9 +63,10 @@ PlaylistManager::PlaylistManager( demux_t *p_demux_,
 
 PlaylistManager::~PlaylistManager   ()
 {
+    unsetPeriod();
+    delete downloader;
     delete conManager;
     delete streamOutputFactory;
-    unsetPeriod();
     delete playlist;
 }
 
@@ -122,7 +126,7 @@ bool PlaylistManager::setupPeriod()
                 if(!set->description.Get().empty())
                     st->setDescription(set->description.Get());
 
-                st->create(logic, tracker, streamOutputFactory);
+                st->create(logic, tracker, streamOutputFactory, downloader);
 
                 streams.push_back(st);
             } catch (int) {
@@ -135,13 +139,18 @@ bool PlaylistManager::setupPeriod()
 
 bool PlaylistManager::start()
 {
-    if(!setupPeriod())
-        return false;
-
     conManager = new (std::nothrow) HTTPConnectionManager(VLC_OBJECT(p_demux->s));
     if(!conManager)
         return false;
 
+    downloader = new (std::nothrow) Downloader(VLC_OBJECT(p_demux->s), conManager);
+    if(!downloader ||
+       !downloader->start(var_InheritInteger(p_demux, "adaptative-connections")))
+        return false;
+
+    if(!setupPeriod())
+        return false;
+
     playlist->playbackStart.Set(time(NULL));
     nextPlaylistupdate = playlist->playbackStart.Get();
 
@@ -165,7 +174,7 @@ Stream::status PlaylistManager::demux(mtime_t nzdeadline, bool send)
                 continue;
         }
 
-        Stream::status i_ret = st->demux(conManager, nzdeadline, send);
+        Stream::status i_ret = st->demux(nzdeadline, send);
 
         if(i_ret == Stream::status_buffering)
         {
@@ -401,6 +410,8 @@ AbstractAdaptationLogic *PlaylistManager::createLogic(AbstractAdaptationLogic::L
         case AbstractAdaptationLogic::FixedRate:
         case AbstractAdaptationLogic::AlwaysLowest:
             return new (std::nothrow) AlwaysLowestAdaptationLogic();
+        case AbstractAdaptationLogic::BufferBased:
+            return new (std::nothrow) BufferBasedAdaptationLogic();
         case AbstractAdaptationLogic::Default:
         case AbstractAdaptationLogic::RateBased:
             return new (std::nothrow) RateBasedAdaptationLogic(0, 0);
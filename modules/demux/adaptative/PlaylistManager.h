@@ -37,6 +37,7 @@ namespace adaptative
     namespace http
     {
         class HTTPConnectionManager;
+        class Downloader;
     }
 
     using namespace playlist;
@@ -80,6 +81,7 @@ namespace adaptative
             virtual AbstractAdaptationLogic *createLogic(AbstractAdaptationLogic::LogicType);
 
             HTTPConnectionManager              *conManager;
+            Downloader                         *downloader;
             AbstractAdaptationLogic::LogicType  logicType;
             AbstractPlaylist                    *playlist;
             AbstractStreamOutputFactory         *streamOutputFactory;
@@ -18,8 +18,7 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 #include "Streams.hpp"
-#include "http/HTTPConnection.hpp"
-#include "http/HTTPConnectionManager.h"
+#include "http/Downloader.hpp"
 #include "logic/AbstractAdaptationLogic.h"
 #include "playlist/SegmentChunk.hpp"
 #include "plumbing/StreamOutput.hpp"
@@ -37,7 +36,15 @@ Stream::Stream(demux_t * demux_, const StreamFormat &format_)
     format = format_;
     output = NULL;
     adaptationLogic = NULL;
-    currentChunk = NULL;
+    downloader = NULL;
+    prefetchCount = __MAX(1, var_InheritInteger(p_demux, "adaptative-prefetch"));
+    prefetchDuration = CLOCK_FREQ * var_InheritInteger(p_demux, "adaptative-buffer");
+    segmentDuration = 0;
+    /* what the decoders buffer once sent (see DEMUX_GET_PTS_DELAY) */
+    downstreamDelay = INT64_C(1000) * var_InheritInteger(p_demux, "network-caching");
+    sentDeadline = VLC_TS_INVALID;
+    chunkRead = 0;
+    chunkStart = true;
     eof = false;
     disabled = false;
     segmentTracker = NULL;
@@ -46,7 +53,7 @@ Stream::Stream(demux_t * demux_, const StreamFormat &format_)
 
 Stream::~Stream()
 {
-    delete currentChunk;
+    flush(false);
     delete adaptationLogic;
     delete output;
     delete segmentTracker;
@@ -67,11 +74,13 @@ StreamType Stream::mimeToType(const std::string &mime)
 }
 
 void Stream::create(AbstractAdaptationLogic *logic, SegmentTracker *tracker,
-                    const AbstractStreamOutputFactory *factory)
+                    const AbstractStreamOutputFactory *factory,
+                    Downloader *downloader_)
 {
     adaptationLogic = logic;
     segmentTracker = tracker;
     streamOutputFactory = factory;
+    downloader = downloader_;
     updateFormat(format);
 }
 
@@ -130,20 +139,74 @@ bool Stream::operator ==(const Stream &stream) const
     return stream.type == type;
 }
 
-SegmentChunk * Stream::getChunk()
+void Stream::prefetch()
 {
-    if (currentChunk == NULL && output && !eof)
+    while(output && !eof && prefetched.size() < prefetchCount)
     {
+        /* Bound the buffered duration, when segments have a known time */
+        mtime_t start = segmentTracker->getSegmentStart();
+        if(!prefetched.empty() &&
+           start - prefetched.front().second >= prefetchDuration)
+            break;
+
         if(esCount() && !isSelected())
         {
-            disabled = true;
-            return NULL;
+            if(prefetched.empty())
+                disabled = true;
+            break;
+        }
+
+        /* With short segments, the count limits the queue first. A
+         * segment is selected when a slot is free, so the level can then
+         * be at most one segment below the queue capacity. */
+        if(!prefetched.empty() && start > prefetched.back().second)
+            segmentDuration = start - prefetched.back().second;
+        mtime_t maxLevel = prefetchDuration;
+        if(segmentDuration && segmentDuration * prefetchCount < maxLevel)
+            maxLevel = segmentDuration * prefetchCount;
+        maxLevel -= __MIN(segmentDuration, maxLevel);
+        adaptationLogic->updateBufferingLevel(getBufferingLevel(),
+                                              maxLevel + downstreamDelay);
+
+        SegmentChunk *chunk = segmentTracker->getNextChunk(output->switchAllowed());
+        if(chunk == NULL)
+        {
+            /* might just not be available yet while others are pending */
+            if(prefetched.empty())
+                eof = true;
+            break;
+        }
+
+        DownloadTask *task = new (std::nothrow) DownloadTask(chunk);
+        if(!task)
+        {
+            delete chunk;
+            break;
         }
-        currentChunk = segmentTracker->getNextChunk(output->switchAllowed());
-        if (currentChunk == NULL)
-            eof = true;
+        prefetched.push_back(std::make_pair(task, start));
+        downloader->schedule(task);
     }
-    return currentChunk;
+}
+
+void Stream::flush(bool keepcurrent)
+{
+    /* Only a partly read chunk has to be kept */
+    size_t keep = (keepcurrent && !chunkStart) ? 1 : 0;
+
+    while(prefetched.size() > keep)
+    {
+        DownloadTask *task = prefetched.back().first;
+        downloader->cancel(task);
+        delete task->getChunk();
+        delete task;
+        prefetched.pop_back();
+    }
+    if(keep == 0)
+    {
+        chunkStart = true;
+        chunkRead = 0;
+    }
+    sentDeadline = VLC_TS_INVALID;
 }
 
 bool Stream::seekAble() const
@@ -175,7 +238,7 @@ bool Stream::isDisabled() const
     return disabled;
 }
 
-Stream::status Stream::demux(HTTPConnectionManager *connManager, mtime_t nz_deadline, bool send)
+Stream::status Stream::demux(mtime_t nz_deadline, bool send)
 {
     if(!output)
         return Stream::status_eof;
@@ -183,7 +246,7 @@ Stream::status Stream::demux(HTTPConnectionManager *connManager, mtime_t nz_dead
     if(nz_deadline + VLC_TS_0 > output->getPCR()) /* not already demuxed */
     {
         /* need to read, demuxer still buffering, ... */
-        if(read(connManager) <= 0)
+        if(read() <= 0)
         {
             if(output->isEmpty())
                 return Stream::status_eof;
@@ -195,67 +258,50 @@ Stream::status Stream::demux(HTTPConnectionManager *connManager, mtime_t nz_dead
     }
 
     if(send)
+    {
         output->sendToDecoder(nz_deadline);
+        sentDeadline = nz_deadline;
+    }
 
     return Stream::status_demuxed;
 }
 
-size_t Stream::read(HTTPConnectionManager *connManager)
+size_t Stream::read()
 {
-    SegmentChunk *chunk = getChunk();
-    if(!chunk)
-        return 0;
-
-    if(!chunk->getConnection())
+    for(;;)
     {
-       if(!connManager->connectChunk(chunk))
-        return 0;
-    }
+        prefetch();
+        if(prefetched.empty())
+            return 0;
 
-    size_t readsize = 0;
-    bool b_segment_head_chunk = false;
+        DownloadTask *task = prefetched.front().first;
+        SegmentChunk *chunk = static_cast<SegmentChunk *>(task->getChunk());
+        block_t *block = downloader->read(task);
 
-    /* New chunk, do query */
-    if(chunk->getBytesRead() == 0)
-    {
-        if(chunk->getConnection()->query(chunk->getPath()) != VLC_SUCCESS)
+        if(block == NULL)
         {
-            chunk->getConnection()->releaseChunk();
-            currentChunk = NULL;
+            if(!downloader->isFinished(task))
+                return 0; /* interrupted */
+
+            /* End of chunk, or failed download: move on to the next one */
+            if(task->getSize() > 0)
+                adaptationLogic->updateDownloadRate(task->getSize(),
+                                                    task->getDuration());
+            prefetched.pop_front();
+            delete task;
             delete chunk;
-            return 0;
+            chunkStart = true;
+            chunkRead = 0;
+            continue;
         }
-        b_segment_head_chunk = true;
-    }
 
-    /* Because we don't know Chunk size at start, we need to get size
-       from content length */
-    readsize = chunk->getBytesToRead();
-    if (readsize > 32768)
-        readsize = 32768;
+        bool b_segment_head_chunk = chunkStart;
+        chunkStart = false;
 
-    block_t *block = block_Alloc(readsize);
-    if(!block)
-        return 0;
-
-    mtime_t time = mdate();
-    ssize_t ret = chunk->getConnection()->read(block->p_buffer, readsize);
-    time = mdate() - time;
-
-    if(ret < 0)
-    {
-        block_Release(block);
-        chunk->getConnection()->releaseChunk();
-        currentChunk = NULL;
-        delete chunk;
-        return 0;
-    }
-    else
-    {
-        block->i_buffer = (size_t)ret;
-
-        adaptationLogic->updateDownloadRate(block->i_buffer, time);
         chunk->onDownload(&block);
+        if(block == NULL)
+            continue;
+        block->i_flags &= ~(BLOCK_FLAG_CHUNK_START|BLOCK_FLAG_CHUNK_END);
 
         StreamFormat chunkStreamFormat = chunk->getStreamFormat();
         if(output && chunkStreamFormat != output->getStreamFormat())
@@ -264,22 +310,16 @@ size_t Stream::read(HTTPConnectionManager *connManager)
             updateFormat(chunkStreamFormat);
         }
 
-        if (chunk->getBytesToRead() == 0)
-        {
-            chunk->getConnection()->releaseChunk();
-            currentChunk = NULL;
-            delete chunk;
-        }
-    }
-
-    readsize = block->i_buffer;
+        size_t readsize = block->i_buffer;
+        chunkRead += readsize;
 
-    if(output)
-        output->pushBlock(block, b_segment_head_chunk);
-    else
-        block_Release(block);
+        if(output)
+            output->pushBlock(block, b_segment_head_chunk);
+        else
+            block_Release(block);
 
-    return readsize;
+        return readsize;
+    }
 }
 
 bool Stream::setPosition(mtime_t time, bool tryonly)
@@ -291,24 +331,52 @@ bool Stream::setPosition(mtime_t time, bool tryonly)
     if(!tryonly && ret)
     {
         output->setPosition(time);
-        if(output->reinitsOnSeek())
-        {
-            if(currentChunk)
-            {
-                currentChunk->getConnection()->releaseChunk();
-                delete currentChunk;
-            }
-            currentChunk = NULL;
-        }
+        flush(!output->reinitsOnSeek());
     }
     return ret;
 }
 
 mtime_t Stream::getPosition() const
 {
+    if(!prefetched.empty())
+        return prefetched.front().second;
     return segmentTracker->getSegmentStart();
 }
 
+mtime_t Stream::getBufferingLevel() const
+{
+    mtime_t level = 0;
+
+    /* Demuxed, but not played yet: the data waiting to be sent, and what
+     * was sent to the decoders, which buffer it for the PTS delay */
+    if(sentDeadline != VLC_TS_INVALID)
+    {
+        mtime_t pcr = output ? output->getPCR() : VLC_TS_INVALID;
+        if(pcr > VLC_TS_0 + sentDeadline)
+            level += pcr - VLC_TS_0 - sentDeadline;
+        level += downstreamDelay;
+    }
+
+    /* Downloaded, but not demuxed yet */
+    std::list<std::pair<DownloadTask *, mtime_t> >::const_iterator it;
+    for(it = prefetched.begin(); it != prefetched.end(); ++it)
+    {
+        if(!downloader->isDownloaded((*it).first))
+            break;
+        /* a segment ends where the next one starts */
+        std::list<std::pair<DownloadTask *, mtime_t> >::const_iterator next = it;
+        mtime_t end = (++next != prefetched.end()) ? (*next).second
+                                                   : segmentTracker->getSegmentStart();
+        mtime_t duration = end - (*it).second;
+        /* only the part of the current chunk that the demuxer did not get */
+        size_t size = (*it).first->getSize();
+        if(it == prefetched.begin() && size > 0)
+            duration = duration * (mtime_t)(size - __MIN(chunkRead, size)) / (mtime_t)size;
+        level += duration;
+    }
+    return level;
+}
+
 void Stream::prune()
 {
     segmentTracker->pruneFromCurrent();
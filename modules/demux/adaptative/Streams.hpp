@@ -26,6 +26,7 @@
 
 #include <string>
 #include <list>
+#include <utility>
 #include <vlc_common.h>
 #include <vlc_es.h>
 #include "StreamsType.hpp"
@@ -37,7 +38,8 @@ namespace adaptative
 
     namespace http
     {
-        class HTTPConnectionManager;
+        class Downloader;
+        class DownloadTask;
     }
 
     namespace logic
@@ -66,7 +68,7 @@ namespace adaptative
         bool operator==(const Stream &) const;
         static StreamType mimeToType(const std::string &mime);
         void create(AbstractAdaptationLogic *, SegmentTracker *,
-                    const AbstractStreamOutputFactory *);
+                    const AbstractStreamOutputFactory *, Downloader *);
         void updateFormat(StreamFormat &);
         void setLanguage(const std::string &);
         void setDescription(const std::string &);
@@ -79,22 +81,34 @@ namespace adaptative
         bool reactivate(mtime_t);
         bool isDisabled() const;
         typedef enum {status_eof, status_eop, status_buffering, status_demuxed} status;
-        status demux(HTTPConnectionManager *, mtime_t, bool);
+        status demux(mtime_t, bool);
         bool setPosition(mtime_t, bool);
         mtime_t getPosition() const;
+        /* media time buffered ahead of the playback */
+        mtime_t getBufferingLevel() const;
         void prune();
         void runUpdates();
 
     private:
-        SegmentChunk *getChunk();
-        size_t read(HTTPConnectionManager *);
+        void prefetch();
+        void flush(bool);
+        size_t read();
         demux_t *p_demux;
         StreamType type;
         StreamFormat format;
         AbstractStreamOutput *output;
         AbstractAdaptationLogic *adaptationLogic;
         SegmentTracker *segmentTracker;
-        SegmentChunk *currentChunk;
+        Downloader *downloader;
+        /* chunks downloaded ahead, with their segment start time */
+        std::list<std::pair<DownloadTask *, mtime_t> > prefetched;
+        unsigned prefetchCount;
+        mtime_t prefetchDuration;
+        mtime_t segmentDuration;
+        mtime_t downstreamDelay;
+        mtime_t sentDeadline; /* last time sent to the decoders */
+        size_t chunkRead; /* bytes of the current chunk given to the demuxer */
+        bool chunkStart;
         bool disabled;
         bool eof;
         std::string language;
@@ -67,12 +67,27 @@ static void Close   (vlc_object_t *);
 
 #define ADAPT_LOGIC_TEXT N_("Adaptation Logic")
 
+#define ADAPT_PREFETCH_TEXT N_("Segments to prefetch")
+#define ADAPT_PREFETCH_LONGTEXT N_("Maximum number of segments downloaded " \
+                                   "ahead of playback, for each stream")
+
+#define ADAPT_BUFFER_TEXT N_("Prefetch buffer duration (s)")
+#define ADAPT_BUFFER_LONGTEXT N_("Maximum duration of the segments " \
+                                 "downloaded ahead of playback")
+
+#define ADAPT_CONNECTIONS_TEXT N_("Parallel downloads")
+#define ADAPT_CONNECTIONS_LONGTEXT N_("Number of segments downloaded at " \
+                                      "the same time, over persistent " \
+                                      "connections")
+
 static const int pi_logics[] = {AbstractAdaptationLogic::RateBased,
+                                AbstractAdaptationLogic::BufferBased,
                                 AbstractAdaptationLogic::FixedRate,
                                 AbstractAdaptationLogic::AlwaysLowest,
                                 AbstractAdaptationLogic::AlwaysBest};
 
 static const char *const ppsz_logics[] = { N_("Bandwidth Adaptive"),
+                                           N_("Buffer Adaptive"),
                                            N_("Fixed Bandwidth"),
                                            N_("Lowest Bandwidth/Quality"),
                                            N_("Highest Bandwith/Quality")};
@@ -89,6 +104,12 @@ vlc_module_begin ()
         add_integer( "adaptative-width",  480, ADAPT_WIDTH_TEXT,  ADAPT_WIDTH_TEXT,  true )
         add_integer( "adaptative-height", 360, ADAPT_HEIGHT_TEXT, ADAPT_HEIGHT_TEXT, true )
         add_integer( "adaptative-bw",     250, ADAPT_BW_TEXT,     ADAPT_BW_LONGTEXT,     false )
+        add_integer_with_range( "adaptative-prefetch", 3, 1, 32,
+                                ADAPT_PREFETCH_TEXT, ADAPT_PREFETCH_LONGTEXT, true )
+        add_integer( "adaptative-buffer", 30,
+                     ADAPT_BUFFER_TEXT, ADAPT_BUFFER_LONGTEXT, true )
+        add_integer_with_range( "adaptative-connections", 4, 1, 16,
+                                ADAPT_CONNECTIONS_TEXT, ADAPT_CONNECTIONS_LONGTEXT, true )
         set_callbacks( Open, Close )
 vlc_module_end ()
 
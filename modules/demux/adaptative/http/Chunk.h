@@ -31,6 +31,11 @@
 
 typedef struct block_t block_t;
 
+/* Position of the blocks passed to Chunk::onDownload() in the chunk, as the
+ * chunk itself may already be downloaded further ahead */
+#define BLOCK_FLAG_CHUNK_START (0x01 << 24) /* BLOCK_FLAG_PRIVATE_SHIFT */
+#define BLOCK_FLAG_CHUNK_END   (0x02 << 24)
+
 namespace adaptative
 {
     namespace http
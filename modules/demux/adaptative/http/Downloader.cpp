@@ -0,0 +1,287 @@
+/*
+ * Downloader.cpp
+ *****************************************************************************
+ * Copyright (C) 2015 - VideoLAN and VLC Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "Downloader.hpp"
+#include "HTTPConnectionManager.h"
+#include "HTTPConnection.hpp"
+#include "Chunk.h"
+
+#include <vlc_block.h>
+#include <algorithm>
+
+using namespace adaptative::http;
+
+DownloadTask::DownloadTask(Chunk *chunk_)
+{
+    state = QUEUED;
+    chunk = chunk_;
+    p_head = NULL;
+    pp_last = &p_head;
+    waiting = false;
+    aborted = false;
+    vlc_sem_init(&ready, 0);
+    ctx = NULL;
+    size = 0;
+    duration = 0;
+}
+
+DownloadTask::~DownloadTask()
+{
+    block_ChainRelease(p_head);
+    vlc_sem_destroy(&ready);
+}
+
+Chunk * DownloadTask::getChunk() const
+{
+    return chunk;
+}
+
+size_t DownloadTask::getSize() const
+{
+    return size;
+}
+
+mtime_t DownloadTask::getDuration() const
+{
+    return duration;
+}
+
+Downloader::Downloader(vlc_object_t *obj_, HTTPConnectionManager *manager)
+{
+    obj = obj_;
+    connManager = manager;
+    killed = false;
+    vlc_mutex_init(&lock);
+    vlc_cond_init(&waitcond);
+    vlc_cond_init(&donecond);
+}
+
+Downloader::~Downloader()
+{
+    vlc_mutex_lock(&lock);
+    killed = true;
+    std::list<DownloadTask *>::const_iterator it;
+    for(it = running.begin(); it != running.end(); ++it)
+    {
+        (*it)->aborted = true;
+        if((*it)->ctx)
+            vlc_interrupt_kill((*it)->ctx);
+    }
+    vlc_cond_broadcast(&waitcond);
+    vlc_mutex_unlock(&lock);
+
+    for(size_t i = 0; i < threads.size(); i++)
+        vlc_join(threads[i], NULL);
+
+    vlc_cond_destroy(&donecond);
+    vlc_cond_destroy(&waitcond);
+    vlc_mutex_destroy(&lock);
+}
+
+bool Downloader::start(unsigned count)
+{
+    for(unsigned i = 0; i < count; i++)
+    {
+        vlc_thread_t th;
+        if(vlc_clone(&th, downloaderThread, this, VLC_THREAD_PRIORITY_INPUT))
+            break;
+        threads.push_back(th);
+    }
+    return !threads.empty();
+}
+
+void Downloader::schedule(DownloadTask *task)
+{
+    vlc_mutex_lock(&lock);
+    queue.push_back(task);
+    vlc_cond_signal(&waitcond);
+    vlc_mutex_unlock(&lock);
+}
+
+void Downloader::cancel(DownloadTask *task)
+{
+    vlc_mutex_lock(&lock);
+    if(task->state == DownloadTask::QUEUED)
+    {
+        queue.remove(task);
+    }
+    else if(task->state == DownloadTask::RUNNING)
+    {
+        task->aborted = true;
+        if(task->ctx)
+            vlc_interrupt_kill(task->ctx);
+        while(task->state == DownloadTask::RUNNING)
+            vlc_cond_wait(&donecond, &lock);
+    }
+    vlc_mutex_unlock(&lock);
+}
+
+block_t * Downloader::read(DownloadTask *task)
+{
+    block_t *p_block;
+
+    vlc_mutex_lock(&lock);
+    while(task->p_head == NULL && (task->state == DownloadTask::QUEUED ||
+                                   task->state == DownloadTask::RUNNING))
+    {
+        task->waiting = true;
+        vlc_mutex_unlock(&lock);
+        int canc = vlc_sem_wait_i11e(&task->ready);
+        vlc_mutex_lock(&lock);
+        task->waiting = false;
+        if(canc)
+            break;
+    }
+
+    p_block = task->p_head;
+    if(p_block)
+    {
+        task->p_head = p_block->p_next;
+        if(task->p_head == NULL)
+            task->pp_last = &task->p_head;
+        p_block->p_next = NULL;
+    }
+    vlc_mutex_unlock(&lock);
+    return p_block;
+}
+
+bool Downloader::isFinished(const DownloadTask *task)
+{
+    vlc_mutex_lock(&lock);
+    bool b_finished = task->p_head == NULL &&
+                      (task->state == DownloadTask::DONE ||
+                       task->state == DownloadTask::FAILED);
+    vlc_mutex_unlock(&lock);
+    return b_finished;
+}
+
+bool Downloader::isDownloaded(const DownloadTask *task)
+{
+    vlc_mutex_lock(&lock);
+    bool b_downloaded = task->state == DownloadTask::DONE ||
+                        task->state == DownloadTask::FAILED;
+    vlc_mutex_unlock(&lock);
+    return b_downloaded;
+}
+
+void * Downloader::downloaderThread(void *opaque)
+{
+    static_cast<Downloader *>(opaque)->run();
+    return NULL;
+}
+
+void Downloader::run()
+{
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock(&lock);
+    for(;;)
+    {
+        while(!killed && queue.empty())
+            vlc_cond_wait(&waitcond, &lock);
+        if(killed)
+            break;
+
+        DownloadTask *task = queue.front();
+        queue.pop_front();
+        running.push_back(task);
+        task->state = DownloadTask::RUNNING;
+        task->ctx = vlc_interrupt_create();
+        vlc_mutex_unlock(&lock);
+
+        vlc_interrupt_set(task->ctx);
+        bool b_ok = download(task);
+        vlc_interrupt_set(NULL);
+
+        vlc_mutex_lock(&lock);
+        if(task->ctx)
+            vlc_interrupt_destroy(task->ctx);
+        task->ctx = NULL;
+        task->state = (b_ok && !task->aborted) ? DownloadTask::DONE
+                                               : DownloadTask::FAILED;
+        running.remove(task);
+        if(task->waiting)
+            vlc_sem_post(&task->ready);
+        vlc_cond_broadcast(&donecond);
+    }
+    vlc_mutex_unlock(&lock);
+
+    vlc_restorecancel(canc);
+}
+
+void Downloader::append(DownloadTask *task, block_t *p_block)
+{
+    vlc_mutex_lock(&lock);
+    *task->pp_last = p_block;
+    task->pp_last = &p_block->p_next;
+    if(task->waiting)
+        vlc_sem_post(&task->ready);
+    vlc_mutex_unlock(&lock);
+}
+
+bool Downloader::download(DownloadTask *task)
+{
+    Chunk *chunk = task->chunk;
+
+    if(!connManager->connectChunk(chunk))
+        return false;
+
+    HTTPConnection *conn = chunk->getConnection();
+    mtime_t start = mdate();
+    bool b_ok = (conn->query(chunk->getPath()) == VLC_SUCCESS);
+
+    while(b_ok && chunk->getBytesToRead() > 0 && !vlc_killed())
+    {
+        size_t readsize = std::min((size_t)chunk->getBytesToRead(), READ_SIZE);
+        block_t *p_block = block_Alloc(readsize);
+        if(!p_block)
+        {
+            b_ok = false;
+            break;
+        }
+
+        ssize_t ret = conn->read(p_block->p_buffer, readsize);
+        if(ret < 0)
+        {
+            block_Release(p_block);
+            b_ok = false;
+            break;
+        }
+
+        p_block->i_buffer = ret;
+        if(task->size == 0)
+            p_block->i_flags |= BLOCK_FLAG_CHUNK_START;
+        if(chunk->getBytesToRead() == 0)
+            p_block->i_flags |= BLOCK_FLAG_CHUNK_END;
+        task->size += ret;
+        append(task, p_block);
+    }
+
+    /* per segment timing, from the request to the last byte */
+    task->duration = mdate() - start;
+    connManager->releaseChunk(chunk);
+
+    if(!b_ok && !vlc_killed())
+        msg_Warn(obj, "Failed to retrieve %s", chunk->getUrl().c_str());
+    return b_ok;
+}
@@ -0,0 +1,113 @@
+/*
+ * Downloader.hpp
+ *****************************************************************************
+ * Copyright (C) 2015 - VideoLAN and VLC Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef DOWNLOADER_HPP
+#define DOWNLOADER_HPP
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_interrupt.h>
+#include <list>
+#include <vector>
+
+namespace adaptative
+{
+    namespace http
+    {
+        class HTTPConnectionManager;
+        class Chunk;
+
+        /* A chunk fetched in the background, handed over block by block */
+        class DownloadTask
+        {
+            friend class Downloader;
+
+            public:
+                DownloadTask(Chunk *);
+                ~DownloadTask();
+
+                Chunk *     getChunk    () const;
+                size_t      getSize     () const;
+                mtime_t     getDuration () const;
+
+            private:
+                enum
+                {
+                    QUEUED,
+                    RUNNING,
+                    DONE,
+                    FAILED,
+                }                   state;
+                Chunk              *chunk;
+                block_t            *p_head;
+                block_t           **pp_last;
+                bool                waiting;
+                bool                aborted;
+                vlc_sem_t           ready;
+                vlc_interrupt_t    *ctx;
+                size_t              size;
+                mtime_t             duration;
+        };
+
+        /* Runs the HTTP requests of all the streams on a pool of threads,
+         * each reusing the keep-alive connections of the manager */
+        class Downloader
+        {
+            public:
+                Downloader(vlc_object_t *, HTTPConnectionManager *);
+                ~Downloader();
+
+                bool        start       (unsigned threads);
+                void        schedule    (DownloadTask *);
+                /* Removes the task from the queue, or aborts its download.
+                 * The task can be deleted afterwards. */
+                void        cancel      (DownloadTask *);
+                /* Returns the next block of the task, waiting for it if
+                 * needed, or NULL at the end of the task or if the calling
+                 * thread is interrupted. */
+                block_t *   read        (DownloadTask *);
+                bool        isFinished  (const DownloadTask *);
+                /* The whole chunk was fetched, even if not read yet */
+                bool        isDownloaded(const DownloadTask *);
+
+            private:
+                static void * downloaderThread(void *);
+                void        run         ();
+                bool        download    (DownloadTask *);
+                void        append      (DownloadTask *, block_t *);
+
+                vlc_object_t               *obj;
+                HTTPConnectionManager      *connManager;
+                vlc_mutex_t                 lock;
+                vlc_cond_t                  waitcond;
+                vlc_cond_t                  donecond;
+                std::list<DownloadTask *>   queue;
+                std::list<DownloadTask *>   running;
+                std::vector<vlc_thread_t>   threads;
+                bool                        killed;
+
+                static const size_t         READ_SIZE = 65536;
+        };
+    }
+}
+
+#endif // DOWNLOADER_HPP
@@ -37,23 +37,37 @@ const uint64_t  HTTPConnectionManager::CHUNKDEFAULTBITRATE    = 1;
 HTTPConnectionManager::HTTPConnectionManager    (vlc_object_t *stream) :
                        stream                   (stream)
 {
+    vlc_mutex_init(&lock);
 }
 HTTPConnectionManager::~HTTPConnectionManager   ()
 {
     this->closeAllConnections();
+    vlc_mutex_destroy(&lock);
 }
 
 void HTTPConnectionManager::closeAllConnections      ()
 {
     releaseAllConnections();
+    vlc_mutex_lock(&lock);
     vlc_delete_all(this->connectionPool);
+    vlc_mutex_unlock(&lock);
 }
 
 void HTTPConnectionManager::releaseAllConnections()
 {
+    vlc_mutex_lock(&lock);
     std::vector<HTTPConnection *>::iterator it;
     for(it = connectionPool.begin(); it != connectionPool.end(); ++it)
         (*it)->releaseChunk();
+    vlc_mutex_unlock(&lock);
+}
+
+void HTTPConnectionManager::releaseChunk(Chunk *chunk)
+{
+    vlc_mutex_lock(&lock);
+    if(chunk->getConnection())
+        chunk->getConnection()->releaseChunk();
+    vlc_mutex_unlock(&lock);
 }
 
 HTTPConnection * HTTPConnectionManager::getConnectionForHost(const std::string &hostname)
@@ -61,7 +75,7 @@ HTTPConnection * HTTPConnectionManager::getConnectionForHost(const std::string &
     std::vector<HTTPConnection *>::const_iterator it;
     for(it = connectionPool.begin(); it != connectionPool.end(); ++it)
     {
-        if(!(*it)->getHostname().compare(hostname) && (*it)->isAvailable())
+        if((*it)->isAvailable() && !(*it)->getHostname().compare(hostname))
             return *it;
     }
     return NULL;
@@ -77,26 +91,32 @@ bool HTTPConnectionManager::connectChunk(Chunk *chunk)
     msg_Dbg(stream, "Retrieving %s @%zu", chunk->getUrl().c_str(),
             chunk->getStartByte());
 
+    /* Connections can be shared by several downloading threads. A new one
+     * only connects on its first query, outside of the lock. */
+    vlc_mutex_lock(&lock);
     HTTPConnection *conn = getConnectionForHost(chunk->getHostname());
     if(!conn)
     {
         const bool tls = (chunk->getScheme() == "https");
         Socket *socket = tls ? new (std::nothrow) TLSSocket(): new (std::nothrow) Socket();
         if(!socket)
+        {
+            vlc_mutex_unlock(&lock);
             return false;
+        }
         /* disable pipelined tls until we have ticket/resume session support */
         conn = new (std::nothrow) HTTPConnection(stream, socket, chunk, !tls);
         if(!conn)
         {
+            vlc_mutex_unlock(&lock);
             delete socket;
             return false;
         }
         connectionPool.push_back(conn);
-        if (!chunk->getConnection()->connect(chunk->getHostname(), chunk->getPort()))
-            return false;
     }
 
     conn->bindChunk(chunk);
+    vlc_mutex_unlock(&lock);
 
     if(chunk->getBitrate() <= 0)
         chunk->setBitrate(HTTPConnectionManager::CHUNKDEFAULTBITRATE);
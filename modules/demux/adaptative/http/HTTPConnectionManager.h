@@ -49,10 +49,12 @@ namespace adaptative
                 void    closeAllConnections ();
                 void    releaseAllConnections ();
                 bool    connectChunk        (Chunk *chunk);
+                void    releaseChunk        (Chunk *chunk);
 
             private:
                 std::vector<HTTPConnection *>                       connectionPool;
                 vlc_object_t                                       *stream;
+                vlc_mutex_t                                         lock;
 
                 static const uint64_t   CHUNKDEFAULTBITRATE;
 
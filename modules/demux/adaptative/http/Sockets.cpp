@@ -20,6 +20,7 @@
 #include "Sockets.hpp"
 
 #include <vlc_network.h>
+#include <vlc_interrupt.h>
 #include <cerrno>
 
 using namespace adaptative::http;
@@ -64,7 +65,7 @@ ssize_t Socket::read(vlc_object_t *stream, void *p_buffer, size_t len)
     do
     {
         size = net_Read(stream, netfd, p_buffer, len);
-    } while (size < 0 && (errno == EINTR || errno==EAGAIN) );
+    } while (size < 0 && (errno == EINTR || errno==EAGAIN) && !vlc_killed() );
     return size;
 }
 
@@ -47,6 +47,9 @@ namespace adaptative
 
                 virtual BaseRepresentation* getCurrentRepresentation(BaseAdaptationSet *) const = 0;
                 virtual void                updateDownloadRate     (size_t, mtime_t);
+                /* media time buffered ahead of the playback, and the most
+                 * it can reach when a segment is selected */
+                virtual void                updateBufferingLevel   (mtime_t, mtime_t);
 
                 enum LogicType
                 {
@@ -54,7 +57,8 @@ namespace adaptative
                     AlwaysBest,
                     AlwaysLowest,
                     RateBased,
-                    FixedRate
+                    FixedRate,
+                    BufferBased
                 };
         };
     }
@@ -0,0 +1,65 @@
+/*
+ * BufferBasedAdaptationLogic.cpp
+ *****************************************************************************
+ * Copyright (C) 2015 - VideoLAN and VLC authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "BufferBasedAdaptationLogic.hpp"
+#include "Representationselectors.hpp"
+
+#include "../playlist/BaseRepresentation.h"
+#include "../playlist/BaseAdaptationSet.h"
+
+#include <algorithm>
+
+using namespace adaptative::logic;
+using namespace adaptative::playlist;
+
+BufferBasedAdaptationLogic::BufferBasedAdaptationLogic() :
+    AbstractAdaptationLogic()
+{
+}
+
+BaseRepresentation *BufferBasedAdaptationLogic::getCurrentRepresentation(BaseAdaptationSet *adaptSet) const
+{
+    if(adaptSet == NULL)
+        return NULL;
+
+    std::vector<uint64_t> ladder;
+    std::vector<BaseRepresentation *> reps = adaptSet->getRepresentations();
+    std::vector<BaseRepresentation *>::const_iterator it;
+    for(it=reps.begin(); it!=reps.end(); ++it)
+        ladder.push_back((*it)->getBandwidth());
+    std::sort(ladder.begin(), ladder.end());
+    ladder.erase(std::unique(ladder.begin(), ladder.end()), ladder.end());
+
+    RepresentationSelector selector;
+    return selector.select(adaptSet, rateMap.select(ladder));
+}
+
+void BufferBasedAdaptationLogic::updateDownloadRate(size_t size, mtime_t time)
+{
+    rateMap.updateDownloadRate(size, time);
+}
+
+void BufferBasedAdaptationLogic::updateBufferingLevel(mtime_t level, mtime_t max)
+{
+    rateMap.updateBufferingLevel(level, max);
+}
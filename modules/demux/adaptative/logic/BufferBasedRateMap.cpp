@@ -0,0 +1,116 @@
+/*
+ * BufferBasedRateMap.cpp
+ *****************************************************************************
+ * Copyright (C) 2015 - VideoLAN and VLC authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "BufferBasedRateMap.hpp"
+
+using namespace adaptative::logic;
+
+BufferBasedRateMap::BufferBasedRateMap()
+{
+    level = 0;
+    reservoir = 0;
+    cushion = 0;
+    throughput = 0;
+    current = 0;
+    startup = true;
+}
+
+void BufferBasedRateMap::updateBufferingLevel(mtime_t level_, mtime_t max)
+{
+    /* Keep clear of both ends, as the level moves by whole segments */
+    reservoir = max / 4;
+    cushion = max / 2;
+
+    /* The buffer is draining: throughput can't be trusted anymore */
+    if(startup && level_ < level && level_ <= reservoir)
+        startup = false;
+    level = level_;
+}
+
+void BufferBasedRateMap::updateDownloadRate(size_t size, mtime_t time)
+{
+    if(unlikely(time <= 0))
+        return;
+
+    uint64_t bps = (uint64_t) size * 8 * CLOCK_FREQ / time;
+    throughput = (throughput) ? (throughput * 3 + bps) / 4 : bps;
+}
+
+uint64_t BufferBasedRateMap::getThroughput() const
+{
+    return throughput;
+}
+
+uint64_t BufferBasedRateMap::mapLevel(const std::vector<uint64_t> &ladder) const
+{
+    if(level <= reservoir || cushion == 0)
+        return ladder.front();
+    if(level >= reservoir + cushion)
+        return ladder.back();
+    return ladder.front() + (ladder.back() - ladder.front()) *
+                            (level - reservoir) / cushion;
+}
+
+uint64_t BufferBasedRateMap::select(const std::vector<uint64_t> &ladder)
+{
+    if(ladder.empty())
+        return 0;
+
+    const size_t last = ladder.size() - 1;
+    size_t i = 0; /* highest bitrate not above the current one */
+    while(i < last && ladder[i + 1] <= current)
+        i++;
+
+    const uint64_t rate = mapLevel(ladder);
+    const uint64_t ratePlus = ladder[(i < last) ? i + 1 : last];
+    const uint64_t rateMinus = ladder[(i > 0) ? i - 1 : 0];
+
+    size_t next = i;
+    if(rate >= ratePlus)
+    {
+        /* but don't go up to what the link can't sustain */
+        while(next < last && ladder[next + 1] <= rate &&
+              (!throughput || ladder[next + 1] <= throughput))
+            next++;
+    }
+    else if(rate <= rateMinus)
+    {
+        next = 0;
+        while(next < i && ladder[next] < rate)
+            next++;
+    }
+
+    if(startup && throughput)
+    {
+        size_t fast = 0;
+        while(fast < last && ladder[fast + 1] <= throughput * 3 / 4)
+            fast++;
+        if(fast > next)
+            next = fast;
+        else /* the buffer now leads */
+            startup = false;
+    }
+
+    current = ladder[next];
+    return current;
+}
@@ -0,0 +1,71 @@
+/*
+ * BufferBasedRateMap.hpp
+ *****************************************************************************
+ * Copyright (C) 2015 - VideoLAN and VLC authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef BUFFERBASEDRATEMAP_HPP
+#define BUFFERBASEDRATEMAP_HPP
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vector>
+
+namespace adaptative
+{
+    namespace logic
+    {
+        /* Maps the buffer occupancy to a bitrate of the ladder (BBA).
+         *
+         * Below the reservoir the lowest bitrate is used, above the cushion
+         * the highest one, and in between the rate grows linearly with the
+         * buffer. The current bitrate is only left when the mapped rate
+         * crosses one of its neighbours, so that small buffer variations
+         * don't cause switches. Switching up is also bounded by the measured
+         * throughput, and while the buffer fills up at startup, that
+         * throughput can select a higher bitrate than the buffer.
+         *
+         * Doesn't depend on the playlist, so that it can be run offline. */
+        class BufferBasedRateMap
+        {
+            public:
+                BufferBasedRateMap();
+
+                /* level, and maximum level the buffer can reach when a
+                 * segment is selected */
+                void        updateBufferingLevel(mtime_t, mtime_t);
+                void        updateDownloadRate  (size_t, mtime_t);
+                /* Returns the bitrate to use among the ascending ladder */
+                uint64_t    select              (const std::vector<uint64_t> &);
+                uint64_t    getThroughput       () const;
+
+            private:
+                uint64_t    mapLevel            (const std::vector<uint64_t> &) const;
+
+                mtime_t     level;
+                mtime_t     reservoir;
+                mtime_t     cushion;
+                uint64_t    throughput;
+                uint64_t    current;
+                bool        startup;
+        };
+    }
+}
+
+#endif // BUFFERBASEDRATEMAP_HPP
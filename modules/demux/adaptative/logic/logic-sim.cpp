@@ -0,0 +1,353 @@
+/*
+ * logic-sim.cpp: replays bandwidth traces against the adaptation logics
+ *****************************************************************************
+ * Copyright (C) 2015 - VideoLAN and VLC authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: adaptative-logic-sim [trace [ladder]]
+ *
+ * The trace holds one "<seconds> <kbit/s>" line per bandwidth step, '#'
+ * starting comments. The ladder is a comma separated list of kbit/s.
+ * Segments are fetched one after the other, as long as the buffer has room,
+ * and the switches, stalls and average bitrate are reported for each logic.
+ *
+ * Without arguments, runs built-in traces and checks the results. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "BufferBasedRateMap.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace adaptative::logic;
+
+namespace
+{
+    struct TraceStep
+    {
+        mtime_t  duration;
+        uint64_t bps;
+    };
+    typedef std::vector<TraceStep> Trace;
+
+    /* The decisions of a logic, on a plain bitrate ladder */
+    class SimLogic
+    {
+        public:
+            virtual ~SimLogic() {}
+            virtual void updateBufferingLevel(mtime_t, mtime_t) {}
+            virtual void updateDownloadRate(size_t, mtime_t) = 0;
+            virtual uint64_t select(const std::vector<uint64_t> &) = 0;
+    };
+
+    class SimBufferBased : public SimLogic
+    {
+        public:
+            virtual void updateBufferingLevel(mtime_t level, mtime_t max)
+            {
+                rateMap.updateBufferingLevel(level, max);
+            }
+            virtual void updateDownloadRate(size_t size, mtime_t time)
+            {
+                rateMap.updateDownloadRate(size, time);
+            }
+            virtual uint64_t select(const std::vector<uint64_t> &ladder)
+            {
+                return rateMap.select(ladder);
+            }
+
+        private:
+            BufferBasedRateMap rateMap;
+    };
+
+    /* Same policy as the RateBasedAdaptationLogic: 3/4 of the running
+     * average of the throughput */
+    class SimRateBased : public SimLogic
+    {
+        public:
+            SimRateBased() : bpsAvg(0), bpsSamplecount(0) {}
+            virtual void updateDownloadRate(size_t size, mtime_t time)
+            {
+                if(time <= 0)
+                    return;
+                uint64_t bps = (uint64_t) size * 8 * CLOCK_FREQ / time;
+                bpsSamplecount++;
+                if(bps >= bpsAvg)
+                    bpsAvg += (bps - bpsAvg) / bpsSamplecount;
+                else
+                    bpsAvg -= (bpsAvg - bps) / bpsSamplecount;
+            }
+            virtual uint64_t select(const std::vector<uint64_t> &ladder)
+            {
+                size_t i = 0;
+                while(i + 1 < ladder.size() && ladder[i + 1] <= bpsAvg * 3 / 4)
+                    i++;
+                return ladder[i];
+            }
+
+        private:
+            uint64_t bpsAvg;
+            uint64_t bpsSamplecount;
+    };
+
+    struct SimResult
+    {
+        unsigned segments;
+        unsigned switches;
+        unsigned stalls;
+        mtime_t  stalled;
+        uint64_t bitrate; /* average */
+    };
+
+    class Simulator
+    {
+        public:
+            Simulator(const Trace &trace_, const std::vector<uint64_t> &ladder_)
+                : trace(trace_), ladder(ladder_)
+            {
+                segmentDuration = 4 * CLOCK_FREQ;
+                /* default prefetch of 3 segments, and 1 s of network caching
+                 * held by the decoders */
+                maxLevel = 3 * segmentDuration + CLOCK_FREQ;
+            }
+
+            SimResult run(SimLogic *logic)
+            {
+                memset(&res, 0, sizeof(res));
+
+                mtime_t end = 0;
+                for(size_t i = 0; i < trace.size(); i++)
+                    end += trace[i].duration;
+
+                now = 0;
+                level = 0;
+                playing = false;
+                started = false;
+
+                uint64_t previous = 0, total = 0;
+                while(now < end)
+                {
+                    /* wait for room in the buffer */
+                    if(level + segmentDuration > maxLevel)
+                        advance(level + segmentDuration - maxLevel);
+
+                    logic->updateBufferingLevel(level, maxLevel - segmentDuration);
+                    uint64_t bitrate = logic->select(ladder);
+                    if(previous && bitrate != previous)
+                        res.switches++;
+                    previous = bitrate;
+
+                    size_t size = bitrate * segmentDuration / CLOCK_FREQ / 8;
+                    mtime_t duration = transfer(size);
+                    if(duration < 0)
+                        break; /* no bandwidth left */
+                    advance(duration);
+                    logic->updateDownloadRate(size, duration);
+
+                    level += segmentDuration;
+                    playing = started = true;
+                    res.segments++;
+                    total += bitrate;
+                }
+
+                if(res.segments)
+                    res.bitrate = total / res.segments;
+                return res;
+            }
+
+        private:
+            /* Time taken to fetch size bytes from now on, or -1 */
+            mtime_t transfer(size_t size) const
+            {
+                double bits = (double) size * 8;
+                mtime_t start = 0, t = now;
+                for(size_t i = 0; i < trace.size(); i++)
+                {
+                    const TraceStep &step = trace[i];
+                    if(start + step.duration <= t)
+                    {
+                        start += step.duration;
+                        continue;
+                    }
+                    mtime_t avail = start + step.duration - t;
+                    double sent = (double) step.bps * avail / CLOCK_FREQ;
+                    if(sent >= bits)
+                        return t + (mtime_t)(bits * CLOCK_FREQ / step.bps) - now;
+                    bits -= sent;
+                    t += avail;
+                    start += step.duration;
+                }
+                return -1;
+            }
+
+            /* Plays the buffer for the given time, counting stalls */
+            void advance(mtime_t duration)
+            {
+                now += duration;
+                if(!playing)
+                {
+                    if(started)
+                        res.stalled += duration;
+                    return;
+                }
+                if(level >= duration)
+                {
+                    level -= duration;
+                    return;
+                }
+                res.stalled += duration - level;
+                res.stalls++;
+                level = 0;
+                playing = false;
+            }
+
+            const Trace                 &trace;
+            const std::vector<uint64_t> &ladder;
+            mtime_t                     segmentDuration;
+            mtime_t                     maxLevel;
+            mtime_t                     now;
+            mtime_t                     level;
+            bool                        playing;
+            bool                        started;
+            SimResult                   res;
+    };
+
+    void report(const char *name, const SimResult &res)
+    {
+        printf("%-12s %4u segments, %3u switches, %3u stalls (%5.1f s), "
+               "%6" PRIu64 " kb/s average\n", name, res.segments, res.switches,
+               res.stalls, (double) res.stalled / CLOCK_FREQ, res.bitrate / 1000);
+    }
+
+    void simulate(const Trace &trace, const std::vector<uint64_t> &ladder,
+                  SimResult *buffer, SimResult *rate)
+    {
+        Simulator sim(trace, ladder);
+        SimBufferBased bufferBased;
+        SimRateBased rateBased;
+
+        *buffer = sim.run(&bufferBased);
+        *rate = sim.run(&rateBased);
+        report("buffer", *buffer);
+        report("rate", *rate);
+    }
+
+    Trace makeTrace(mtime_t total, mtime_t period, uint64_t low, uint64_t high)
+    {
+        Trace trace;
+        for(mtime_t t = 0; t < total; t += period)
+        {
+            TraceStep step = { period, ((t / period) % 2) ? high : low };
+            trace.push_back(step);
+        }
+        return trace;
+    }
+
+    bool loadTrace(const char *path, Trace *trace)
+    {
+        FILE *fp = fopen(path, "r");
+        if(fp == NULL)
+        {
+            perror(path);
+            return false;
+        }
+
+        char line[256];
+        while(fgets(line, sizeof(line), fp))
+        {
+            double secs, kbps;
+            if(line[0] == '#' || sscanf(line, "%lf %lf", &secs, &kbps) != 2)
+                continue;
+            TraceStep step = { (mtime_t)(secs * CLOCK_FREQ), (uint64_t)(kbps * 1000) };
+            trace->push_back(step);
+        }
+        fclose(fp);
+        return !trace->empty();
+    }
+
+    int check(bool ok, const char *what)
+    {
+        if(!ok)
+            fprintf(stderr, "FAILED: %s\n", what);
+        return ok ? 0 : 1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<uint64_t> ladder;
+    SimResult buffer, rate;
+
+    if(argc > 2)
+    {
+        for(char *p = argv[2]; *p; p = (*p == ',') ? p + 1 : p)
+            ladder.push_back(strtoull(p, &p, 10) * 1000);
+    }
+    else
+    {
+        static const unsigned kbps[] = { 250, 500, 1000, 2000, 4000 };
+        for(size_t i = 0; i < sizeof(kbps) / sizeof(kbps[0]); i++)
+            ladder.push_back(kbps[i] * 1000);
+    }
+
+    if(argc > 1)
+    {
+        Trace trace;
+        if(!loadTrace(argv[1], &trace))
+            return 1;
+        simulate(trace, ladder, &buffer, &rate);
+        return 0;
+    }
+
+    int i_ret = 0;
+
+    puts("steady 8 Mb/s:");
+    simulate(makeTrace(300 * CLOCK_FREQ, 300 * CLOCK_FREQ, 8000000, 8000000),
+             ladder, &buffer, &rate);
+    i_ret |= check(buffer.stalls == 0, "stall on a steady link");
+    i_ret |= check(buffer.bitrate >= 3000000, "top bitrate not reached");
+
+    puts("steady 300 kb/s:");
+    simulate(makeTrace(300 * CLOCK_FREQ, 300 * CLOCK_FREQ, 300000, 300000),
+             ladder, &buffer, &rate);
+    i_ret |= check(buffer.stalls == 0, "stall on a slow link");
+
+    puts("congested, 1.2 to 4 Mb/s every 6 s:");
+    simulate(makeTrace(600 * CLOCK_FREQ, 6 * CLOCK_FREQ, 1200000, 4000000),
+             ladder, &buffer, &rate);
+    i_ret |= check(buffer.switches <= rate.switches, "more switches than rate based");
+    i_ret |= check(buffer.stalled <= rate.stalled, "longer stalls than rate based");
+    i_ret |= check(buffer.stalls == 0, "stall on a congested link");
+
+    puts("outage, 3 Mb/s with 100 kb/s for 20 s every minute:");
+    Trace outage;
+    for(int i = 0; i < 10; i++)
+    {
+        TraceStep good = { 40 * CLOCK_FREQ, 3000000 }, bad = { 20 * CLOCK_FREQ, 100000 };
+        outage.push_back(good);
+        outage.push_back(bad);
+    }
+    simulate(outage, ladder, &buffer, &rate);
+    i_ret |= check(buffer.stalled <= rate.stalled, "longer stalls than rate based");
+
+    return i_ret;
+}
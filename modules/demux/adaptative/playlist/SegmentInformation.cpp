@@ -98,7 +98,7 @@ std::size_t SegmentInformation::getSegments(SegmentInfoType type, std::vector<IS
             }
             else if ( segmentList && !segmentList->getSegments().empty() )
             {
-                std::vector<ISegment *>::const_iterator it;
+                std::deque<ISegment *>::const_iterator it;
                 for(it=segmentList->getSegments().begin();
                     it!=segmentList->getSegments().end(); ++it)
                 {
@@ -162,6 +162,21 @@ ISegment * SegmentInformation::getNextSegment(SegmentInfoType type, uint64_t i_p
     if( type != INFOTYPE_MEDIA )
         return NULL;
 
+    /* Plain segment lists, as for live playlists, can grow large:
+     * look the number up instead of flattening the whole list */
+    if( !mediaSegmentTemplate && segmentList && !segmentList->getSegments().empty() )
+    {
+        ISegment *seg = segmentList->getNextSegmentByNumber( i_pos );
+        if( seg == NULL )
+            return NULL;
+        if( seg->subSegments().front() == seg ) /* no subsegments */
+        {
+            *pi_newpos = seg->getSequenceNumber();
+            *pb_gap = (*pi_newpos != i_pos);
+            return seg;
+        }
+    }
+
     std::vector<ISegment *> retSegments;
     const size_t size = getSegments( type, retSegments );
     if( size )
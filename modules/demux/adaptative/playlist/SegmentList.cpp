@@ -26,53 +26,66 @@
 #include "Segment.h"
 #include "SegmentInformation.hpp"
 
+#include <algorithm>
+
 using namespace adaptative::playlist;
 
+static bool segmentNumberLess(const ISegment *seg, uint64_t number)
+{
+    return seg->getSequenceNumber() < number;
+}
+
 SegmentList::SegmentList( SegmentInformation *parent ):
     SegmentInfoCommon( parent ), TimescaleAble( parent )
 {
 }
 SegmentList::~SegmentList()
 {
-    std::vector<ISegment *>::iterator it;
+    std::deque<ISegment *>::iterator it;
     for(it = segments.begin(); it != segments.end(); ++it)
         delete(*it);
 }
 
-const std::vector<ISegment*>& SegmentList::getSegments() const
+const std::deque<ISegment*>& SegmentList::getSegments() const
 {
     return segments;
 }
 
 ISegment * SegmentList::getSegmentByNumber(uint64_t number)
 {
-    std::vector<ISegment *>::const_iterator it = segments.begin();
-    for(it = segments.begin(); it != segments.end(); ++it)
-    {
-        ISegment *seg = *it;
-        if(seg->getSequenceNumber() == number)
-        {
-            return seg;
-        }
-        else if (seg->getSequenceNumber() > number)
-        {
-            break;
-        }
-    }
+    ISegment *seg = getNextSegmentByNumber(number);
+    if(seg && seg->getSequenceNumber() == number)
+        return seg;
     return NULL;
 }
 
+ISegment * SegmentList::getNextSegmentByNumber(uint64_t number)
+{
+    /* segments are sorted by sequence number */
+    std::deque<ISegment *>::const_iterator it =
+            std::lower_bound(segments.begin(), segments.end(), number, segmentNumberLess);
+    return (it != segments.end()) ? *it : NULL;
+}
+
 void SegmentList::addSegment(ISegment *seg)
 {
+    stime_t start = 0;
+    if(!segments.empty())
+    {
+        const ISegment *prev = segments.back();
+        start = starts.back() + ((prev->duration.Get()) ? prev->duration.Get()
+                                                        : duration.Get());
+    }
     seg->setParent(this);
     segments.push_back(seg);
+    starts.push_back(start);
 }
 
 void SegmentList::mergeWith(SegmentList *updated)
 {
     const ISegment * lastSegment = (segments.empty()) ? NULL : segments.back();
 
-    std::vector<ISegment *>::iterator it;
+    std::deque<ISegment *>::iterator it;
     for(it = updated->segments.begin(); it != updated->segments.end(); ++it)
     {
         if( !lastSegment || lastSegment->compare( *it ) < 0 )
@@ -81,14 +94,14 @@ void SegmentList::mergeWith(SegmentList *updated)
             delete *it;
     }
     updated->segments.clear();
+    updated->starts.clear();
 }
 
 void SegmentList::pruneBySegmentNumber(uint64_t tobelownum)
 {
-    std::vector<ISegment *>::iterator it = segments.begin();
-    while(it != segments.end())
+    while(!segments.empty())
     {
-        ISegment *seg = *it;
+        ISegment *seg = segments.front();
 
         if(seg->getSequenceNumber() >= tobelownum)
             break;
@@ -96,22 +109,28 @@ void SegmentList::pruneBySegmentNumber(uint64_t tobelownum)
         if(seg->chunksuse.Get()) /* can't prune from here, still in use */
             break;
 
-        delete *it;
-        it = segments.erase(it);
+        delete seg;
+        segments.pop_front();
+        starts.pop_front();
     }
 }
 
 bool SegmentList::getSegmentNumberByScaledTime(stime_t time, uint64_t *ret) const
 {
-    std::vector<ISegment *> allsubsegments;
-    std::vector<ISegment *>::const_iterator it;
-    for(it=segments.begin(); it!=segments.end(); ++it)
-    {
-        std::vector<ISegment *> list = (*it)->subSegments();
-        allsubsegments.insert( allsubsegments.end(), list.begin(), list.end() );
-    }
+    if(segments.empty() || (segments.size() > 1 && starts[1] == starts[0]))
+        return false;
 
-    return SegmentInfoCommon::getSegmentNumberByScaledTime(allsubsegments, time, ret);
+    /* Assuming there won't be any discontinuity in sequence */
+    const ISegment *first = segments.front();
+    if(time < first->startTime.Get())
+        return false;
+    time += starts.front() - first->startTime.Get();
+
+    /* last segment starting at or before time */
+    std::deque<stime_t>::const_iterator it =
+            std::upper_bound(starts.begin(), starts.end(), time);
+    *ret = segments[it - starts.begin() - 1]->getSequenceNumber();
+    return true;
 }
 
 mtime_t SegmentList::getPlaybackTimeBySegmentNumber(uint64_t number)
@@ -124,24 +143,19 @@ mtime_t SegmentList::getPlaybackTimeBySegmentNumber(uint64_t number)
     if(first->getSequenceNumber() > number)
         return VLC_TS_INVALID;
 
-    stime_t time = first->startTime.Get();
-    std::vector<ISegment *>::iterator it = segments.begin();
-    for(it = segments.begin(); it != segments.end(); ++it)
+    /* Assuming there won't be any discontinuity in sequence */
+    stime_t time = first->startTime.Get() - starts.front();
+    std::deque<ISegment *>::const_iterator it =
+            std::lower_bound(segments.begin(), segments.end(), number, segmentNumberLess);
+    if(it != segments.end() && (*it)->getSequenceNumber() == number)
     {
-        const ISegment *seg = *it;
-        /* Assuming there won't be any discontinuity in sequence */
-        if(seg->getSequenceNumber() == number)
-        {
-            break;
-        }
-        else if(seg->duration.Get())
-        {
-            time += seg->duration.Get();
-        }
-        else
-        {
-            time += duration.Get();
-        }
+        time += starts[it - segments.begin()];
+    }
+    else /* past the end */
+    {
+        const ISegment *last = segments.back();
+        time += starts.back() + ((last->duration.Get()) ? last->duration.Get()
+                                                        : duration.Get());
     }
 
     return VLC_TS_0 + CLOCK_FREQ * time / timescale;
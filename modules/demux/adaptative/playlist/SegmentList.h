@@ -31,6 +31,8 @@
 
 #include "SegmentInfoCommon.h"
 
+#include <deque>
+
 namespace adaptative
 {
     namespace playlist
@@ -45,8 +47,10 @@ namespace adaptative
                 SegmentList             ( SegmentInformation * = NULL );
                 virtual ~SegmentList    ();
 
-                const std::vector<ISegment *>&   getSegments() const;
+                const std::deque<ISegment *>&    getSegments() const;
                 ISegment *              getSegmentByNumber(uint64_t);
+                /* first segment numbered from the given number, or NULL */
+                ISegment *              getNextSegmentByNumber(uint64_t);
                 void                    addSegment(ISegment *seg);
                 void                    mergeWith(SegmentList *);
                 void                    pruneBySegmentNumber(uint64_t);
@@ -54,7 +58,10 @@ namespace adaptative
                 mtime_t                 getPlaybackTimeBySegmentNumber(uint64_t);
 
             private:
-                std::vector<ISegment *>  segments;
+                /* expired segments are popped from the front */
+                std::deque<ISegment *>   segments;
+                /* start of each segment, summing the previous durations */
+                std::deque<stime_t>      starts;
         };
     }
 }
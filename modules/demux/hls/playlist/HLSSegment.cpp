@@ -78,7 +78,7 @@ void HLSSegment::onChunkDownload(block_t **pp_block, SegmentChunk *chunk, BaseRe
     {
         block_t *p_block = *pp_block;
         /* first bytes */
-        if(!ctx && chunk->getBytesRead() == p_block->i_buffer)
+        if(!ctx && (p_block->i_flags & BLOCK_FLAG_CHUNK_START))
         {
             vlc_gcrypt_init();
             if (encryption.iv.size() != 16)
@@ -112,7 +112,7 @@ void HLSSegment::onChunkDownload(block_t **pp_block, SegmentChunk *chunk, BaseRe
             else
             {
                 /* last bytes */
-                if(chunk->getBytesToRead() == 0)
+                if(p_block->i_flags & BLOCK_FLAG_CHUNK_END)
                 {
                     /* remove the PKCS#7 padding from the buffer */
                     const uint8_t pad = p_block->p_buffer[p_block->i_buffer - 1];
@@ -157,7 +157,8 @@ bool M3U8Parser::appendSegmentsFromPlaylistURI(vlc_object_t *p_obj, Representati
         stream_t *substream = stream_MemoryNew(p_obj, (uint8_t *)p_data, i_data, false);
         if(substream)
         {
-            std::list<Tag *> tagslist = parseEntries(substream);
+            /* Only the segments following the known ones need parsing */
+            std::list<Tag *> tagslist = parseEntries(substream, rep->nextSequence);
             stream_Delete(substream);
 
             parseSegments(p_obj, rep, tagslist);
@@ -177,12 +178,13 @@ void M3U8Parser::parseSegments(vlc_object_t *p_obj, Representation *rep, const s
     rep->b_loaded = true;
 
     stime_t totalduration = 0;
-    stime_t nzStartTime = 0;
+    stime_t nzStartTime = rep->nextStartTime;
     uint64_t sequenceNumber = 0;
     std::size_t prevbyterangeoffset = 0;
     const SingleValueTag *ctx_byterange = NULL;
     SegmentEncryption encryption;
     const ValuesListTag *ctx_extinf = NULL;
+    const AttributesTag *ctx_key = NULL;
 
     std::list<Tag *>::const_iterator it;
     for(it = tagslist.begin(); it != tagslist.end(); ++it)
@@ -213,9 +215,17 @@ void M3U8Parser::parseSegments(vlc_object_t *p_obj, Representation *rep, const s
                     break;
                 }
 
+                /* Keys are only retrieved once a segment uses them */
+                if(ctx_key)
+                {
+                    setEncryption(p_obj, ctx_key, &encryption);
+                    ctx_key = NULL;
+                }
+
                 HLSSegment *segment = new (std::nothrow) HLSSegment(rep, sequenceNumber++);
                 if(!segment)
                     break;
+                rep->nextSequence = sequenceNumber;
 
                 segment->setSourceUrl(uritag->getValue().value);
 
@@ -257,42 +267,8 @@ void M3U8Parser::parseSegments(vlc_object_t *p_obj, Representation *rep, const s
                 break;
 
             case AttributesTag::EXTXKEY:
-            {
-                const AttributesTag *keytag = static_cast<const AttributesTag *>(tag);
-                if( keytag->getAttributeByName("METHOD") &&
-                    keytag->getAttributeByName("METHOD")->value == "AES-128" &&
-                    keytag->getAttributeByName("URI") )
-                {
-                    encryption.method = SegmentEncryption::AES_128;
-                    encryption.key.clear();
-                    uint8_t *p_data;
-                    const uint64_t read = Retrieve::HTTP(p_obj, keytag->getAttributeByName("URI")->quotedString(),
-                                                         (void **) &p_data);
-                    if(p_data)
-                    {
-                        if(read == 16)
-                        {
-                            encryption.key.resize(16);
-                            memcpy(&encryption.key[0], p_data, 16);
-                        }
-                        free(p_data);
-                    }
-
-                    if(keytag->getAttributeByName("IV"))
-                    {
-                        encryption.iv.clear();
-                        encryption.iv = keytag->getAttributeByName("IV")->hexSequence();
-                    }
-                }
-                else
-                {
-                    /* unsupported or invalid */
-                    encryption.method = SegmentEncryption::NONE;
-                    encryption.key.clear();
-                    encryption.iv.clear();
-                }
-            }
-            break;
+                ctx_key = static_cast<const AttributesTag *>(tag);
+                break;
 
             case Tag::EXTXENDLIST:
                 rep->b_live = false;
@@ -309,8 +285,46 @@ void M3U8Parser::parseSegments(vlc_object_t *p_obj, Representation *rep, const s
         rep->getPlaylist()->duration.Set(totalduration * CLOCK_FREQ / rep->timescale.Get());
     }
 
+    rep->nextStartTime = nzStartTime;
     rep->setSegmentList(segmentList);
 }
+
+void M3U8Parser::setEncryption(vlc_object_t *p_obj, const AttributesTag *keytag,
+                               SegmentEncryption *encryption)
+{
+    if( keytag->getAttributeByName("METHOD") &&
+        keytag->getAttributeByName("METHOD")->value == "AES-128" &&
+        keytag->getAttributeByName("URI") )
+    {
+        encryption->method = SegmentEncryption::AES_128;
+        encryption->key.clear();
+        uint8_t *p_data;
+        const uint64_t read = Retrieve::HTTP(p_obj, keytag->getAttributeByName("URI")->quotedString(),
+                                             (void **) &p_data);
+        if(p_data)
+        {
+            if(read == 16)
+            {
+                encryption->key.resize(16);
+                memcpy(&encryption->key[0], p_data, 16);
+            }
+            free(p_data);
+        }
+
+        if(keytag->getAttributeByName("IV"))
+        {
+            encryption->iv.clear();
+            encryption->iv = keytag->getAttributeByName("IV")->hexSequence();
+        }
+    }
+    else
+    {
+        /* unsupported or invalid */
+        encryption->method = SegmentEncryption::NONE;
+        encryption->key.clear();
+        encryption->iv.clear();
+    }
+}
 M3U8 * M3U8Parser::parse(stream_t *p_stream, const std::string &playlisturl)
 {
     char *psz_line = stream_ReadLine(p_stream);
@@ -442,14 +456,81 @@ M3U8 * M3U8Parser::parse(stream_t *p_stream, const std::string &playlisturl)
     return playlist;
 }
 
-std::list<Tag *> M3U8Parser::parseEntries(stream_t *stream)
+static bool isSegmentLine(const char *psz_line)
+{
+    if(*psz_line != '#')
+        return *psz_line != '\0'; /* URI */
+
+    return !strncmp(psz_line, "#EXTINF:", 8) ||
+           !strncmp(psz_line, "#EXT-X-BYTERANGE:", 17) ||
+           !strncmp(psz_line, "#EXT-X-KEY:", 11) ||
+           !strncmp(psz_line, "#EXT-X-PROGRAM-DATE-TIME:", 25) ||
+           !strcmp(psz_line, "#EXT-X-DISCONTINUITY");
+}
+
+std::list<Tag *> M3U8Parser::parseEntries(stream_t *stream, uint64_t i_skip)
 {
     std::list<Tag *> entrieslist;
     Tag *lastTag = NULL;
     char *psz_line;
 
+    /* Segments numbered below i_skip are dropped without being parsed,
+     * only keeping track of the sequence, key and byte range they set */
+    bool b_skip = (i_skip > 0);
+    uint64_t sequence = 0;
+    std::string keyattributes;
+    std::size_t byterangeoffset = 0;
+    bool b_fixbyterange = false;
+
     while((psz_line = stream_ReadLine(stream)))
     {
+        if(b_skip)
+        {
+            if(!strncmp(psz_line, "#EXT-X-MEDIA-SEQUENCE:", 22))
+            {
+                sequence = strtoull(psz_line + 22, NULL, 10);
+            }
+            else if(isSegmentLine(psz_line))
+            {
+                if(sequence < i_skip)
+                {
+                    if(*psz_line != '#')
+                    {
+                        sequence++;
+                    }
+                    else if(!strncmp(psz_line, "#EXT-X-KEY:", 11))
+                    {
+                        keyattributes = std::string(psz_line + 11);
+                    }
+                    else if(!strncmp(psz_line, "#EXT-X-BYTERANGE:", 17))
+                    {
+                        char *end;
+                        std::size_t length = strtoull(psz_line + 17, &end, 10);
+                        if(*end == '@')
+                            byterangeoffset = strtoull(end + 1, NULL, 10);
+                        byterangeoffset += length;
+                        b_fixbyterange = true;
+                    }
+                    free(psz_line);
+                    continue;
+                }
+
+                /* First new segment, restore the state of the dropped ones */
+                std::ostringstream os;
+                os << sequence;
+                Tag *tag = TagFactory::createTagByName("EXT-X-MEDIA-SEQUENCE", os.str());
+                if(tag)
+                    entrieslist.push_back(tag);
+                if(!keyattributes.empty())
+                {
+                    tag = TagFactory::createTagByName("EXT-X-KEY", keyattributes);
+                    if(tag)
+                        entrieslist.push_back(tag);
+                }
+                b_skip = false;
+            }
+        }
+
         if(*psz_line == '#')
         {
             if(!strncmp(psz_line, "#EXT", 4)) //tag
@@ -467,6 +548,18 @@ std::list<Tag *> M3U8Parser::parseEntries(stream_t *stream)
                     key = std::string(psz_line + 1);
                 }
 
+                /* implicit offset, following a dropped range */
+                if(b_fixbyterange && key == "EXT-X-BYTERANGE")
+                {
+                    if(attributes.find('@') == std::string::npos)
+                    {
+                        std::ostringstream os;
+                        os << attributes << '@' << byterangeoffset;
+                        attributes = os.str();
+                    }
+                    b_fixbyterange = false;
+                }
+
                 if(!key.empty())
                 {
                     Tag *tag = TagFactory::createTagByName(key, attributes);
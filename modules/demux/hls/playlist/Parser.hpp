@@ -52,6 +52,7 @@ namespace hls
         class AttributesTag;
         class Tag;
         class Representation;
+        class SegmentEncryption;
 
         class M3U8Parser
         {
@@ -67,7 +68,8 @@ namespace hls
                 void createAndFillRepresentation(vlc_object_t *, BaseAdaptationSet *,
                                                  const AttributesTag *, const std::list<Tag *>&);
                 void parseSegments(vlc_object_t *, Representation *, const std::list<Tag *>&);
-                std::list<Tag *> parseEntries(stream_t *);
+                void setEncryption(vlc_object_t *, const AttributesTag *, SegmentEncryption *);
+                std::list<Tag *> parseEntries(stream_t *, uint64_t = 0);
         };
     }
 }
@@ -43,6 +43,8 @@ Representation::Representation  ( BaseAdaptationSet *set ) :
     b_loaded = false;
     switchpolicy = SegmentInformation::SWITCH_SEGMENT_ALIGNED; /* FIXME: based on streamformat */
     nextPlaylistupdate = 0;
+    nextSequence = 0;
+    nextStartTime = 0;
 }
 
 Representation::~Representation ()
@@ -55,6 +55,9 @@ namespace hls
                 bool b_live;
                 bool b_loaded;
                 mtime_t nextPlaylistupdate;
+                /* where a playlist reload has to resume */
+                uint64_t nextSequence;
+                stime_t nextStartTime;
                 Url playlistUrl;
                 Property<std::string> audio;
                 Property<std::string> video;
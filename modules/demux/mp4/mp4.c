@@ -132,6 +132,7 @@ static uint32_t MP4_TrackGetReadSize( mp4_track_t *, uint32_t * );
 static int      MP4_TrackNextSample( demux_t *, mp4_track_t *, uint32_t );
 static void     MP4_TrackSetELST( demux_t *, mp4_track_t *, int64_t );
 static bool     MP4_TrackIsInterleaved( const mp4_track_t * );
+static void     TrackGetChunk( const mp4_track_t *, uint32_t, mp4_chunk_t * );
 
 static void     MP4_UpdateSeekpoint( demux_t * );
 
@@ -231,6 +232,22 @@ static MP4_Box_t * MP4_GetTrakByTrackID( MP4_Box_t *p_moov, const uint32_t i_id
     return p_trak;
 }
 
+/* Return the number of samples of the i_index-th stts entry of a chunk */
+static inline uint32_t MP4_ChunkGetDTSCount( const mp4_chunk_t *p_chunk,
+                                             uint32_t i_index )
+{
+    return p_chunk->p_sample_count_dts[i_index] -
+           ( i_index == 0 ? p_chunk->i_skip_dts : 0 );
+}
+
+/* Return the number of samples of the i_index-th ctts entry of a chunk */
+static inline uint32_t MP4_ChunkGetPTSCount( const mp4_chunk_t *p_chunk,
+                                             uint32_t i_index )
+{
+    return p_chunk->p_sample_count_pts[i_index] -
+           ( i_index == 0 ? p_chunk->i_skip_pts : 0 );
+}
+
 /* Return time in microsecond of a track */
 static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
 {
@@ -239,7 +256,7 @@ static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
     if( p_sys->b_fragmented )
         p_chunk = p_track->cchunk;
     else
-        p_chunk = &p_track->chunk[p_track->i_chunk];
+        p_chunk = &p_track->chunk;
 
     unsigned int i_index = 0;
     unsigned int i_sample = p_track->i_sample - p_chunk->i_sample_first;
@@ -247,16 +264,16 @@ static inline int64_t MP4_TrackGetDTS( demux_t *p_demux, mp4_track_t *p_track )
 
     while( i_sample > 0 && i_index < p_chunk->i_entries_dts )
     {
-        if( i_sample > p_chunk->p_sample_count_dts[i_index] )
+        const uint32_t i_count = MP4_ChunkGetDTSCount( p_chunk, i_index );
+        if( i_sample > i_count )
         {
-            i_dts += p_chunk->p_sample_count_dts[i_index] *
-                p_chunk->p_sample_delta_dts[i_index];
-            i_sample -= p_chunk->p_sample_count_dts[i_index];
+            i_dts += (uint64_t)i_count * p_chunk->p_sample_delta_dts[i_index];
+            i_sample -= i_count;
             i_index++;
         }
         else
         {
-            i_dts += i_sample * p_chunk->p_sample_delta_dts[i_index];
+            i_dts += (uint64_t)i_sample * p_chunk->p_sample_delta_dts[i_index];
             break;
         }
     }
@@ -289,11 +306,11 @@ static inline bool MP4_TrackGetPTSDelta( demux_t *p_demux, mp4_track_t *p_track,
                                          int64_t *pi_delta )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
-    mp4_chunk_t *ck;
+    const mp4_chunk_t *ck;
     if( p_sys->b_fragmented )
         ck = p_track->cchunk;
     else
-        ck = &p_track->chunk[p_track->i_chunk];
+        ck = &p_track->chunk;
 
     unsigned int i_index = 0;
     unsigned int i_sample = p_track->i_sample - ck->i_sample_first;
@@ -303,14 +320,15 @@ static inline bool MP4_TrackGetPTSDelta( demux_t *p_demux, mp4_track_t *p_track,
 
     for( i_index = 0; i_index < ck->i_entries_pts ; i_index++ )
     {
-        if( i_sample < ck->p_sample_count_pts[i_index] )
+        const uint32_t i_count = MP4_ChunkGetPTSCount( ck, i_index );
+        if( i_sample < i_count )
         {
             *pi_delta = ck->p_sample_offset_pts[i_index] * CLOCK_FREQ /
                         (int64_t)p_track->i_timescale;
             return true;
         }
 
-        i_sample -= ck->p_sample_count_pts[i_index];
+        i_sample -= i_count;
     }
     return false;
 }
@@ -1808,9 +1826,10 @@ static void LoadChapterApple( demux_t  *p_demux, mp4_track_t *tk )
                 TAB_APPEND( p_sys->p_title->i_seekpoint, p_sys->p_title->seekpoint, s );
             }
         }
-        if( tk->i_sample+1 >= tk->chunk[tk->i_chunk].i_sample_first +
-                              tk->chunk[tk->i_chunk].i_sample_count )
-            tk->i_chunk++;
+        if( tk->i_sample+1 >= tk->chunk.i_sample_first +
+                              tk->chunk.i_sample_count &&
+            ++tk->i_chunk < tk->i_chunk_count )
+            TrackGetChunk( tk, tk->i_chunk, &tk->chunk );
     }
 }
 static void LoadChapter( demux_t  *p_demux )
@@ -1869,7 +1888,141 @@ static bool MP4_TrackIsInterleaved( const mp4_track_t *p_track )
     return true;
 }
 
-/* now create basic chunk data, the rest will be filled by MP4_CreateSamplesIndex */
+/* Return the index of the last entry of a sorted table lower or equal to
+ * i_value, or 0 if there is none */
+static uint32_t TableLookup( const uint32_t *p_table, uint32_t i_count,
+                             uint32_t i_value )
+{
+    uint32_t i_low = 0, i_high = i_count;
+    while( i_high - i_low > 1 )
+    {
+        uint32_t i_mid = i_low + ( i_high - i_low ) / 2;
+        if( p_table[i_mid] <= i_value )
+            i_low = i_mid;
+        else
+            i_high = i_mid;
+    }
+    return i_low;
+}
+
+/* Fill a moov chunk from the sample tables, i_chunk must be valid */
+static void TrackGetChunk( const mp4_track_t *p_track, uint32_t i_chunk,
+                           mp4_chunk_t *ck )
+{
+    const MP4_Box_data_stsc_t *stsc = p_track->p_stsc;
+    const MP4_Box_data_stts_t *stts = p_track->p_stts;
+    const MP4_Box_data_ctts_t *ctts = p_track->p_ctts;
+    uint32_t i_index;
+
+    memset( ck, 0, sizeof( *ck ) );
+    ck->i_offset = p_track->p_co64->i_chunk_offset[i_chunk];
+
+    /* chunks before the first stsc entry have no samples */
+    if( stsc->i_entry_count > 0 && stsc->i_first_chunk[0] <= i_chunk + 1 )
+    {
+        i_index = TableLookup( stsc->i_first_chunk, stsc->i_entry_count,
+                               i_chunk + 1 );
+        ck->i_sample_description_index =
+                stsc->i_sample_description_index[i_index];
+        ck->i_sample_count = stsc->i_samples_per_chunk[i_index];
+        ck->i_sample_first = __MIN( p_track->p_stsc_sample_first[i_index] +
+                (uint64_t)( i_chunk + 1 - stsc->i_first_chunk[i_index] ) *
+                ck->i_sample_count, UINT32_MAX );
+    }
+
+    if( stts == NULL )
+        return;
+
+    /* the stts entry holding the first sample, or the end of the table */
+    i_index = TableLookup( p_track->p_stts_sample_first,
+                           stts->i_entry_count + 1, ck->i_sample_first );
+    ck->i_first_dts = p_track->p_stts_dts_first[i_index];
+    ck->i_entries_dts = stts->i_entry_count - i_index;
+    ck->p_sample_count_dts = &stts->pi_sample_count[i_index];
+    /* negative deltas are invalid, read them as unsigned */
+    ck->p_sample_delta_dts = (uint32_t *)&stts->pi_sample_delta[i_index];
+    if( ck->i_entries_dts > 0 )
+    {
+        ck->i_skip_dts = ck->i_sample_first -
+                         p_track->p_stts_sample_first[i_index];
+        ck->i_first_dts += (uint64_t)ck->i_skip_dts * ck->p_sample_delta_dts[0];
+    }
+
+    /* DTS of the first sample of the last stts run of the chunk */
+    ck->i_last_dts = ck->i_first_dts;
+    const uint32_t i_stts_samples =
+            p_track->p_stts_sample_first[stts->i_entry_count];
+    if( ck->i_sample_count > 0 && ck->i_sample_first < i_stts_samples )
+    {
+        uint32_t i_last = __MIN( (uint64_t)ck->i_sample_first +
+                                 ck->i_sample_count, i_stts_samples ) - 1;
+        i_index = TableLookup( p_track->p_stts_sample_first,
+                               stts->i_entry_count, i_last );
+        uint32_t i_run = __MAX( p_track->p_stts_sample_first[i_index],
+                                ck->i_sample_first );
+        ck->i_last_dts = p_track->p_stts_dts_first[i_index] +
+                (uint64_t)( i_run - p_track->p_stts_sample_first[i_index] ) *
+                (uint32_t)stts->pi_sample_delta[i_index];
+    }
+
+    if( ctts == NULL )
+        return;
+
+    i_index = TableLookup( p_track->p_ctts_sample_first,
+                           ctts->i_entry_count + 1, ck->i_sample_first );
+    ck->i_entries_pts = ctts->i_entry_count - i_index;
+    ck->p_sample_count_pts = &ctts->pi_sample_count[i_index];
+    ck->p_sample_offset_pts = &ctts->pi_sample_offset[i_index];
+    if( ck->i_entries_pts > 0 )
+        ck->i_skip_pts = ck->i_sample_first -
+                         p_track->p_ctts_sample_first[i_index];
+}
+
+/* Index the first sample, and its dts if pi_sample_delta is given, of each
+ * run-length entry of a stts or ctts table */
+static int TrackIndexSampleTable( uint32_t i_entry_count,
+                                  const uint32_t *pi_sample_count,
+                                  const int32_t *pi_sample_delta,
+                                  uint32_t **pp_sample_first,
+                                  uint64_t **pp_dts_first )
+{
+    uint32_t *p_sample_first;
+    uint64_t *p_dts_first = NULL;
+
+    p_sample_first = malloc( ( (size_t)i_entry_count + 1 ) * sizeof( uint32_t ) );
+    if( pi_sample_delta )
+        p_dts_first = malloc( ( (size_t)i_entry_count + 1 ) * sizeof( uint64_t ) );
+    if( !p_sample_first || ( pi_sample_delta && !p_dts_first ) )
+    {
+        free( p_sample_first );
+        free( p_dts_first );
+        return VLC_ENOMEM;
+    }
+
+    uint64_t i_sample = 0;
+    uint64_t i_dts = 0;
+    for( uint32_t i = 0; i < i_entry_count; i++ )
+    {
+        p_sample_first[i] = __MIN( i_sample, UINT32_MAX );
+        i_sample += pi_sample_count[i];
+        if( p_dts_first )
+        {
+            p_dts_first[i] = i_dts;
+            i_dts += (uint64_t)pi_sample_count[i] * (uint32_t)pi_sample_delta[i];
+        }
+    }
+    p_sample_first[i_entry_count] = __MIN( i_sample, UINT32_MAX );
+    if( p_dts_first )
+        p_dts_first[i_entry_count] = i_dts;
+
+    *pp_sample_first = p_sample_first;
+    if( pp_dts_first )
+        *pp_dts_first = p_dts_first;
+    return VLC_SUCCESS;
+}
+
+/* now check the chunk table: the chunks are decoded from it by TrackGetChunk
+ * when they are needed, once MP4_CreateSamplesIndex has run */
 static int TrackCreateChunksIndex( demux_t *p_demux,
                                    mp4_track_t *p_demux_track )
 {
@@ -1878,9 +2031,6 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
     MP4_Box_t *p_co64; /* give offset for each chunk, same for stco and co64 */
     MP4_Box_t *p_stsc;
 
-    unsigned int i_chunk;
-    unsigned int i_index, i_last;
-
     if( ( !(p_co64 = MP4_BoxGet( p_demux_track->p_stbl, "stco" ) )&&
           !(p_co64 = MP4_BoxGet( p_demux_track->p_stbl, "co64" ) ) )||
         ( !(p_stsc = MP4_BoxGet( p_demux_track->p_stbl, "stsc" ) ) ))
@@ -1888,126 +2038,61 @@ static int TrackCreateChunksIndex( demux_t *p_demux,
         return( VLC_EGENERIC );
     }
 
-    p_demux_track->i_chunk_count = BOXDATA(p_co64)->i_entry_count;
-    if( !p_demux_track->i_chunk_count )
+    const MP4_Box_data_co64_t *co64 = BOXDATA(p_co64);
+    const MP4_Box_data_stsc_t *stsc = BOXDATA(p_stsc);
+    const uint64_t i_chunk_end = (uint64_t)co64->i_entry_count + 1;
+
+    if( !co64->i_entry_count )
     {
         msg_Warn( p_demux, "no chunk defined" );
     }
-    p_demux_track->chunk = calloc( p_demux_track->i_chunk_count,
-                                   sizeof( mp4_chunk_t ) );
-    if( p_demux_track->chunk == NULL )
+
+    /* the index for SampleEntry( soun vide mp4a mp4v ...) and the samples
+       count are given for runs of chunks, from their first one XXX begin
+       to 1 */
+    for( uint32_t i = 0; i < stsc->i_entry_count; i++ )
     {
-        return VLC_ENOMEM;
+        if( stsc->i_first_chunk[i] == 0 ||
+            ( i > 0 && stsc->i_first_chunk[i] < stsc->i_first_chunk[i - 1] ) )
+        {
+            msg_Warn( p_demux, "corrupted chunk table" );
+            return VLC_EGENERIC;
+        }
     }
 
-    /* first we read chunk offset */
-    for( i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
+    uint32_t *p_sample_first =
+        malloc( ( (size_t)stsc->i_entry_count + 1 ) * sizeof( uint32_t ) );
+    if( p_sample_first == NULL )
     {
-        mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-
-        ck->i_offset = BOXDATA(p_co64)->i_chunk_offset[i_chunk];
-
-        ck->i_first_dts = 0;
-        ck->i_entries_dts = 0;
-        ck->p_sample_count_dts = NULL;
-        ck->p_sample_delta_dts = NULL;
-        ck->i_entries_pts = 0;
-        ck->p_sample_count_pts = NULL;
-        ck->p_sample_offset_pts = NULL;
+        return VLC_ENOMEM;
     }
 
-    /* now we read index for SampleEntry( soun vide mp4a mp4v ...)
-        to be used for the sample XXX begin to 1
-        We construct it begining at the end */
-    i_last = p_demux_track->i_chunk_count; /* last chunk proceded */
-    i_index = BOXDATA(p_stsc)->i_entry_count;
-
-    while( i_index-- > 0 )
+    uint64_t i_sample = 0;
+    for( uint32_t i = 0; i < stsc->i_entry_count; i++ )
     {
-        for( i_chunk = BOXDATA(p_stsc)->i_first_chunk[i_index] - 1;
-             i_chunk < i_last; i_chunk++ )
-        {
-            if( i_chunk >= p_demux_track->i_chunk_count )
-            {
-                msg_Warn( p_demux, "corrupted chunk table" );
-                return VLC_EGENERIC;
-            }
+        uint64_t i_first = __MIN( stsc->i_first_chunk[i], i_chunk_end );
+        uint64_t i_next = i + 1 < stsc->i_entry_count ?
+                          __MIN( stsc->i_first_chunk[i + 1], i_chunk_end ) :
+                          i_chunk_end;
 
-            p_demux_track->chunk[i_chunk].i_sample_description_index =
-                    BOXDATA(p_stsc)->i_sample_description_index[i_index];
-            p_demux_track->chunk[i_chunk].i_sample_count =
-                    BOXDATA(p_stsc)->i_samples_per_chunk[i_index];
-        }
-        i_last = BOXDATA(p_stsc)->i_first_chunk[i_index] - 1;
+        p_sample_first[i] = __MIN( i_sample, UINT32_MAX );
+        i_sample += ( i_next - i_first ) * stsc->i_samples_per_chunk[i];
     }
+    p_sample_first[stsc->i_entry_count] = __MIN( i_sample, UINT32_MAX );
 
-    if ( p_demux_track->i_chunk_count )
-    {
-        p_demux_track->chunk[0].i_sample_first = 0;
-        for( i_chunk = 1; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
-        {
-            p_demux_track->chunk[i_chunk].i_sample_first =
-                p_demux_track->chunk[i_chunk-1].i_sample_first +
-                    p_demux_track->chunk[i_chunk-1].i_sample_count;
-        }
-    }
+    p_demux_track->p_co64 = co64;
+    p_demux_track->p_stsc = stsc;
+    p_demux_track->p_stsc_sample_first = p_sample_first;
+    p_demux_track->i_chunk_count = co64->i_entry_count;
 
     msg_Dbg( p_demux, "track[Id 0x%x] read %d chunk",
              p_demux_track->i_track_ID, p_demux_track->i_chunk_count );
 
     if ( p_demux_track->i_chunk_count && (
              p_sys->moovfragment.i_chunk_range_min_offset == 0 ||
-             p_sys->moovfragment.i_chunk_range_min_offset > p_demux_track->chunk[0].i_offset
+             p_sys->moovfragment.i_chunk_range_min_offset > co64->i_chunk_offset[0]
              ) )
-        p_sys->moovfragment.i_chunk_range_min_offset = p_demux_track->chunk[0].i_offset;
-
-    return VLC_SUCCESS;
-}
-
-static int xTTS_CountEntries( demux_t *p_demux, uint32_t *pi_entry /* out */,
-                              const uint32_t i_index,
-                              uint32_t i_index_samples_left,
-                              uint32_t i_sample_count,
-                              const uint32_t *pi_index_sample_count,
-                              const uint32_t i_table_count )
-{
-    uint32_t i_array_offset;
-    while( i_sample_count > 0 )
-    {
-        if ( likely((UINT32_MAX - i_index) >= *pi_entry) )
-            i_array_offset = i_index + *pi_entry;
-        else
-            return VLC_EGENERIC;
-
-        if ( i_array_offset >= i_table_count )
-        {
-            msg_Err( p_demux, "invalid index counting total samples %u %u", i_array_offset,  i_table_count );
-            return VLC_ENOVAR;
-        }
-
-        if ( i_index_samples_left )
-        {
-            if ( i_index_samples_left > i_sample_count )
-            {
-                i_index_samples_left -= i_sample_count;
-                i_sample_count = 0;
-                *pi_entry +=1; /* No samples left, go copy */
-                break;
-            }
-            else
-            {
-                i_sample_count -= i_index_samples_left;
-                i_index_samples_left = 0;
-                *pi_entry += 1;
-                continue;
-            }
-        }
-        else
-        {
-            i_sample_count -= __MIN( i_sample_count, pi_index_sample_count[i_array_offset] );
-            *pi_entry += 1;
-        }
-    }
+        p_sys->moovfragment.i_chunk_range_min_offset = co64->i_chunk_offset[0];
 
     return VLC_SUCCESS;
 }
@@ -2034,7 +2119,8 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
     }
     stsz = p_box->data.p_stsz;
 
-    /* Use stsz table to create a sample number -> sample size table */
+    /* The sample number -> sample size table is the stsz box itself, which
+     * lives as long as the track */
     p_demux_track->i_sample_count = stsz->i_sample_count;
     if( stsz->i_sample_size )
     {
@@ -2046,56 +2132,16 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
     {
         /* 2: each sample can have a different size */
         p_demux_track->i_sample_size = 0;
-        p_demux_track->p_sample_size =
-            calloc( p_demux_track->i_sample_count, sizeof( uint32_t ) );
-        if( p_demux_track->p_sample_size == NULL )
-            return VLC_ENOMEM;
-
-        for( uint32_t i_sample = 0; i_sample < p_demux_track->i_sample_count; i_sample++ )
-        {
-            p_demux_track->p_sample_size[i_sample] =
-                    stsz->i_entry_size[i_sample];
-        }
-    }
-
-    if ( p_demux_track->i_chunk_count )
-    {
-        mp4_chunk_t *lastchunk = &p_demux_track->chunk[p_demux_track->i_chunk_count - 1];
-        uint64_t i_total_size = lastchunk->i_offset;
-
-        if ( p_demux_track->i_sample_size != 0 ) /* all samples have same size */
-        {
-            i_total_size += (uint64_t)p_demux_track->i_sample_size * lastchunk->i_sample_count;
-        }
-        else
-        {
-            if( (uint64_t)lastchunk->i_sample_count + p_demux_track->i_chunk_count - 1 > stsz->i_sample_count )
-            {
-                msg_Err( p_demux, "invalid samples table: stsz table is too small" );
-                return VLC_EGENERIC;
-            }
-
-            for( uint32_t i=stsz->i_sample_count - lastchunk->i_sample_count;
-                 i<stsz->i_sample_count; i++)
-            {
-                i_total_size += stsz->i_entry_size[i];
-            }
-        }
-
-        if ( i_total_size > p_sys->moovfragment.i_chunk_range_max_offset )
-            p_sys->moovfragment.i_chunk_range_max_offset = i_total_size;
+        p_demux_track->p_sample_size = stsz->i_entry_size;
     }
 
     /* Use stts table to create a sample number -> dts table.
      * XXX: if we don't want to waste too much memory, we can't expand
-     *  the box! so each chunk will contain an "extract" of this table
-     *  for fast research (problem with raw stream where a sample is sometime
-     *  just channels*bits_per_sample/8 */
-
-     /* FIXME: refactor STTS & CTTS, STTS having now only few extra lines and
-      *        differing in 2/2 fields and 1 signedness */
+     *  the box! so only the first sample and dts of each of its run-length
+     *  entries are kept, to find the entries of a chunk or a time, and the
+     *  entries are walked when needed (problem with raw stream where a
+     *  sample is sometime just channels*bits_per_sample/8 */
 
-    mtime_t i_next_dts = 0;
     /* Find stts
      *  Gives mapping between sample and decoding time
      */
@@ -2111,101 +2157,14 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
 
         msg_Warn( p_demux, "STTS table of %"PRIu32" entries", stts->i_entry_count );
 
-        /* Create sample -> dts table per chunk */
-        uint32_t i_index = 0;
-        uint32_t i_current_index_samples_left = 0;
-
-        for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
-        {
-            mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-            uint32_t i_sample_count;
-
-            /* save first dts */
-            ck->i_first_dts = i_next_dts;
-            ck->i_last_dts  = i_next_dts;
-
-            /* count how many entries are needed for this chunk
-             * for p_sample_delta_dts and p_sample_count_dts */
-            ck->i_entries_dts = 0;
-
-            int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_dts, i_index,
-                                           i_current_index_samples_left,
-                                           ck->i_sample_count,
-                                           stts->pi_sample_count,
-                                           stts->i_entry_count );
-            if ( i_ret == VLC_EGENERIC )
-                return i_ret;
-
-            /* allocate them */
-            ck->p_sample_count_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            ck->p_sample_delta_dts = calloc( ck->i_entries_dts, sizeof( uint32_t ) );
-            if( !ck->p_sample_count_dts || !ck->p_sample_delta_dts )
-            {
-                free( ck->p_sample_count_dts );
-                free( ck->p_sample_delta_dts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_dts );
-                ck->i_entries_dts = 0;
-                return VLC_ENOMEM;
-            }
-
-            /* now copy */
-            i_sample_count = ck->i_sample_count;
-
-            for( uint32_t i = 0; i < ck->i_entries_dts; i++ )
-            {
-                if ( i_current_index_samples_left )
-                {
-                    if ( i_current_index_samples_left > i_sample_count )
-                    {
-                        if ( i_sample_count ) ck->i_last_dts = i_next_dts;
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        i_current_index_samples_left -= i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_dts - 1 );
-                        break;
-                    }
-                    else
-                    {
-                        if ( i_current_index_samples_left ) ck->i_last_dts = i_next_dts;
-                        ck->p_sample_count_dts[i] = i_current_index_samples_left;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        i_sample_count -= i_current_index_samples_left;
-                        i_current_index_samples_left = 0;
-                        i_index++;
-                    }
-                }
-                else
-                {
-                    if ( stts->pi_sample_count[i_index] > i_sample_count )
-                    {
-                        if ( i_sample_count ) ck->i_last_dts = i_next_dts;
-                        ck->p_sample_count_dts[i] = i_sample_count;
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        i_current_index_samples_left = stts->pi_sample_count[i_index] - i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_dts - 1 );
-                        // keep building from same index
-                    }
-                    else
-                    {
-                        if ( stts->pi_sample_count[i_index] ) ck->i_last_dts = i_next_dts;
-                        ck->p_sample_count_dts[i] = stts->pi_sample_count[i_index];
-                        ck->p_sample_delta_dts[i] = stts->pi_sample_delta[i_index];
-                        i_next_dts += ck->p_sample_count_dts[i] * stts->pi_sample_delta[i_index];
-                        i_sample_count -= stts->pi_sample_count[i_index];
-                        i_index++;
-                    }
-                }
-
-            }
-        }
+        if( TrackIndexSampleTable( stts->i_entry_count, stts->pi_sample_count,
+                                   stts->pi_sample_delta,
+                                   &p_demux_track->p_stts_sample_first,
+                                   &p_demux_track->p_stts_dts_first ) )
+            return VLC_ENOMEM;
+        p_demux_track->p_stts = stts;
     }
 
-
     /* Find ctts
      *  Gives the delta between decoding time (dts) and composition table (pts)
      */
@@ -2216,91 +2175,47 @@ static int TrackCreateSamplesIndex( demux_t *p_demux,
 
         msg_Warn( p_demux, "CTTS table of %"PRIu32" entries", ctts->i_entry_count );
 
-        /* Create pts-dts table per chunk */
-        uint32_t i_index = 0;
-        uint32_t i_current_index_samples_left = 0;
-
-        for( uint32_t i_chunk = 0; i_chunk < p_demux_track->i_chunk_count; i_chunk++ )
-        {
-            mp4_chunk_t *ck = &p_demux_track->chunk[i_chunk];
-            uint32_t i_sample_count;
-
-            /* count how many entries are needed for this chunk
-             * for p_sample_offset_pts and p_sample_count_pts */
-            ck->i_entries_pts = 0;
-            int i_ret = xTTS_CountEntries( p_demux, &ck->i_entries_pts, i_index,
-                                           i_current_index_samples_left,
-                                           ck->i_sample_count,
-                                           ctts->pi_sample_count,
-                                           ctts->i_entry_count );
-            if ( i_ret == VLC_EGENERIC )
-                return i_ret;
-
-            /* allocate them */
-            ck->p_sample_count_pts = calloc( ck->i_entries_pts, sizeof( uint32_t ) );
-            ck->p_sample_offset_pts = calloc( ck->i_entries_pts, sizeof( int32_t ) );
-            if( !ck->p_sample_count_pts || !ck->p_sample_offset_pts )
-            {
-                free( ck->p_sample_count_pts );
-                free( ck->p_sample_offset_pts );
-                msg_Err( p_demux, "can't allocate memory for i_entry=%"PRIu32, ck->i_entries_pts );
-                ck->i_entries_pts = 0;
-                return VLC_ENOMEM;
-            }
+        if( TrackIndexSampleTable( ctts->i_entry_count, ctts->pi_sample_count,
+                                   NULL, &p_demux_track->p_ctts_sample_first,
+                                   NULL ) )
+            return VLC_ENOMEM;
+        p_demux_track->p_ctts = ctts;
+    }
 
-            /* now copy */
-            i_sample_count = ck->i_sample_count;
+    if ( p_demux_track->i_chunk_count )
+    {
+        mp4_chunk_t lastchunk;
+        TrackGetChunk( p_demux_track, p_demux_track->i_chunk_count - 1,
+                       &lastchunk );
+        uint64_t i_total_size = lastchunk.i_offset;
 
-            for( uint32_t i = 0; i < ck->i_entries_pts; i++ )
+        if ( p_demux_track->i_sample_size != 0 ) /* all samples have same size */
+        {
+            i_total_size += (uint64_t)p_demux_track->i_sample_size * lastchunk.i_sample_count;
+        }
+        else
+        {
+            if( (uint64_t)lastchunk.i_sample_count + p_demux_track->i_chunk_count - 1 > stsz->i_sample_count )
             {
-                if ( i_current_index_samples_left )
-                {
-                    if ( i_current_index_samples_left > i_sample_count )
-                    {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_current_index_samples_left -= i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_pts - 1 );
-                        break;
-                    }
-                    else
-                    {
-                        ck->p_sample_count_pts[i] = i_current_index_samples_left;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_sample_count -= i_current_index_samples_left;
-                        i_current_index_samples_left = 0;
-                        i_index++;
-                    }
-                }
-                else
-                {
-                    if ( ctts->pi_sample_count[i_index] > i_sample_count )
-                    {
-                        ck->p_sample_count_pts[i] = i_sample_count;
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_current_index_samples_left = ctts->pi_sample_count[i_index] - i_sample_count;
-                        i_sample_count = 0;
-                        assert( i == ck->i_entries_pts - 1 );
-                        // keep building from same index
-                    }
-                    else
-                    {
-                        ck->p_sample_count_pts[i] = ctts->pi_sample_count[i_index];
-                        ck->p_sample_offset_pts[i] = ctts->pi_sample_offset[i_index];
-                        i_sample_count -= ctts->pi_sample_count[i_index];
-                        i_index++;
-                    }
-                }
-
+                msg_Err( p_demux, "invalid samples table: stsz table is too small" );
+                return VLC_EGENERIC;
+            }
 
+            for( uint32_t i=stsz->i_sample_count - lastchunk.i_sample_count;
+                 i<stsz->i_sample_count; i++)
+            {
+                i_total_size += stsz->i_entry_size[i];
             }
         }
+
+        if ( i_total_size > p_sys->moovfragment.i_chunk_range_max_offset )
+            p_sys->moovfragment.i_chunk_range_max_offset = i_total_size;
     }
 
     msg_Dbg( p_demux, "track[Id 0x%x] read %"PRIu32" samples length:%"PRId64"s",
              p_demux_track->i_track_ID, p_demux_track->i_sample_count,
-             i_next_dts / p_demux_track->i_timescale );
+             p_demux_track->p_stts_dts_first[p_demux_track->p_stts->i_entry_count] /
+             p_demux_track->i_timescale );
 
     return VLC_SUCCESS;
 }
@@ -2331,28 +2246,39 @@ static void TrackGetESSampleRate( demux_t *p_demux,
         return;
     }
 
-    if( p_track->i_chunk_count == 0 )
+    const MP4_Box_data_stsc_t *stsc = p_track->p_stsc;
+    if( p_track->i_chunk_count == 0 || stsc->i_entry_count == 0 ||
+        stsc->i_first_chunk[0] > i_chunk + 1 )
         return;
 
-    /* */
-    const mp4_chunk_t *p_chunk = &p_track->chunk[i_chunk];
-    while( p_chunk > &p_track->chunk[0] &&
-           p_chunk[-1].i_sample_description_index == i_sd_index )
+    /* the stsc entries around the chunk with the same SampleEntry */
+    uint32_t i_begin = TableLookup( stsc->i_first_chunk, stsc->i_entry_count,
+                                    i_chunk + 1 );
+    uint32_t i_end = i_begin;
+    while( i_begin > 0 &&
+           stsc->i_sample_description_index[i_begin - 1] == i_sd_index )
     {
-        p_chunk--;
+        i_begin--;
     }
-
-    uint64_t i_sample = 0;
-    uint64_t i_first_dts = p_chunk->i_first_dts;
-    uint64_t i_last_dts;
-    do
+    while( i_end + 1 < stsc->i_entry_count &&
+           stsc->i_first_chunk[i_end + 1] <= p_track->i_chunk_count &&
+           stsc->i_sample_description_index[i_end + 1] == i_sd_index )
     {
-        i_sample += p_chunk->i_sample_count;
-        i_last_dts = p_chunk->i_last_dts;
-        p_chunk++;
+        i_end++;
     }
-    while( p_chunk < &p_track->chunk[p_track->i_chunk_count] &&
-           p_chunk->i_sample_description_index == i_sd_index );
+    uint32_t i_chunk_last = p_track->i_chunk_count - 1;
+    if( i_end + 1 < stsc->i_entry_count &&
+        stsc->i_first_chunk[i_end + 1] <= p_track->i_chunk_count )
+        i_chunk_last = stsc->i_first_chunk[i_end + 1] - 2;
+
+    mp4_chunk_t first, last;
+    TrackGetChunk( p_track, stsc->i_first_chunk[i_begin] - 1, &first );
+    TrackGetChunk( p_track, i_chunk_last, &last );
+
+    uint64_t i_sample = (uint64_t)last.i_sample_first + last.i_sample_count -
+                        first.i_sample_first;
+    uint64_t i_first_dts = first.i_first_dts;
+    uint64_t i_last_dts = last.i_last_dts;
 
     if( i_sample > 1 && i_first_dts < i_last_dts )
         vlc_ureduce( pi_num, pi_den,
@@ -2374,8 +2300,11 @@ static int TrackCreateES( demux_t *p_demux, mp4_track_t *p_track,
     if( p_sys->b_fragmented || p_track->i_chunk_count == 0 )
         i_sample_description_index = 1; /* XXX */
     else
-        i_sample_description_index =
-                p_track->chunk[i_chunk].i_sample_description_index;
+    {
+        mp4_chunk_t chunk;
+        TrackGetChunk( p_track, i_chunk, &chunk );
+        i_sample_description_index = chunk.i_sample_description_index;
+    }
 
     if( pp_es )
         *pp_es = NULL;
@@ -2453,6 +2382,25 @@ static int TrackCreateES( demux_t *p_demux, mp4_track_t *p_track,
     return VLC_SUCCESS;
 }
 
+/* given a sample it returns the chunk holding it */
+static uint32_t TrackSampleToChunk( const mp4_track_t *p_track,
+                                    uint32_t i_sample )
+{
+    const MP4_Box_data_stsc_t *stsc = p_track->p_stsc;
+    if( p_track->i_chunk_count == 0 || stsc->i_entry_count == 0 )
+        return 0;
+
+    /* last stsc entry starting at or before the sample, then its chunk */
+    uint32_t i_index = TableLookup( p_track->p_stsc_sample_first,
+                                    stsc->i_entry_count, i_sample );
+    uint64_t i_chunk = p_track->i_chunk_count - 1;
+    if( stsc->i_samples_per_chunk[i_index] )
+        i_chunk = stsc->i_first_chunk[i_index] - 1 +
+                  ( i_sample - p_track->p_stsc_sample_first[i_index] ) /
+                  stsc->i_samples_per_chunk[i_index];
+    return __MIN( i_chunk, p_track->i_chunk_count - 1 );
+}
+
 /* given a time it return sample/chunk
  * it also update elst field of the track
  */
@@ -2465,7 +2413,7 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
     uint64_t     i_dts;
     unsigned int i_sample;
     unsigned int i_chunk;
-    int          i_index;
+    unsigned int i_index;
 
     /* FIXME see if it's needed to check p_track->i_chunk_count */
     if( p_track->i_chunk_count == 0 )
@@ -2509,53 +2457,34 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
         i_start = i_start * p_track->i_timescale / CLOCK_FREQ;
     }
 
-    /* we start from sample 0/chunk 0, hope it won't take too much time */
-    /* *** find good chunk *** */
-    for( i_chunk = 0; ; i_chunk++ )
+    /* *** find good sample *** */
+    /* stts entries are sorted by dts: look for the first one ending at or
+       after i_start. If there is none, i_sample is past the last one and
+       will be checked below */
+    const MP4_Box_data_stts_t *stts = p_track->p_stts;
+    uint32_t i_low = 0, i_high = stts->i_entry_count;
+    while( i_low < i_high )
     {
-        if( i_chunk + 1 >= p_track->i_chunk_count )
-        {
-            /* at the end and can't check if i_start in this chunk,
-               it will be check while searching i_sample */
-            i_chunk = p_track->i_chunk_count - 1;
-            break;
-        }
-
-        if( (uint64_t)i_start >= p_track->chunk[i_chunk].i_first_dts &&
-            (uint64_t)i_start <  p_track->chunk[i_chunk + 1].i_first_dts )
-        {
-            break;
-        }
+        uint32_t i_mid = i_low + ( i_high - i_low ) / 2;
+        if( p_track->p_stts_dts_first[i_mid + 1] < (uint64_t)i_start )
+            i_low = i_mid + 1;
+        else
+            i_high = i_mid;
     }
-
-    /* *** find sample in the chunk *** */
-    i_sample = p_track->chunk[i_chunk].i_sample_first;
-    i_dts    = p_track->chunk[i_chunk].i_first_dts;
-    for( i_index = 0; i_sample < p_track->chunk[i_chunk].i_sample_count; )
+    i_index  = i_low;
+    i_sample = p_track->p_stts_sample_first[i_index];
+    if( i_index < stts->i_entry_count &&
+        (uint32_t)stts->pi_sample_delta[i_index] > 0 )
     {
-        if( i_dts +
-            p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-            p_track->chunk[i_chunk].p_sample_delta_dts[i_index] < (uint64_t)i_start )
-        {
-            i_dts    +=
-                p_track->chunk[i_chunk].p_sample_count_dts[i_index] *
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
-
-            i_sample += p_track->chunk[i_chunk].p_sample_count_dts[i_index];
-            i_index++;
-        }
-        else
-        {
-            if( p_track->chunk[i_chunk].p_sample_delta_dts[i_index] <= 0 )
-            {
-                break;
-            }
-            i_sample += ( i_start - i_dts ) /
-                p_track->chunk[i_chunk].p_sample_delta_dts[i_index];
-            break;
-        }
+        i_dts = p_track->p_stts_dts_first[i_index];
+        i_sample += __MIN( ( (uint64_t)i_start - i_dts ) /
+                           (uint32_t)stts->pi_sample_delta[i_index],
+                           stts->pi_sample_count[i_index] );
     }
 
+    /* *** find the chunk holding it *** */
+    i_chunk = TrackSampleToChunk( p_track, i_sample );
+
     if( i_sample >= p_track->i_sample_count )
     {
         msg_Warn( p_demux, "track[Id 0x%x] will be disabled "
@@ -2571,31 +2500,26 @@ static int TrackTimeToSampleChunk( demux_t *p_demux, mp4_track_t *p_track,
         MP4_Box_data_stss_t *p_stss = p_box_stss->data.p_stss;
         msg_Dbg( p_demux, "track[Id 0x%x] using Sync Sample Box (stss)",
                  p_track->i_track_ID );
-        for( unsigned i_index = 0; i_index < p_stss->i_entry_count; i_index++ )
+        if( p_stss->i_entry_count > 0 )
         {
-            if( i_index >= p_stss->i_entry_count - 1 ||
-                i_sample < p_stss->i_sample_number[i_index+1] )
+            /* last sync sample at or before i_sample, or the first one */
+            i_low = 0;
+            i_high = p_stss->i_entry_count;
+            while( i_high - i_low > 1 )
             {
-                unsigned i_sync_sample = p_stss->i_sample_number[i_index];
-                msg_Dbg( p_demux, "stss gives %d --> %d (sample number)",
-                         i_sample, i_sync_sample );
-
-                if( i_sync_sample <= i_sample )
-                {
-                    while( i_chunk > 0 &&
-                           i_sync_sample < p_track->chunk[i_chunk].i_sample_first )
-                        i_chunk--;
-                }
+                uint32_t i_mid = i_low + ( i_high - i_low ) / 2;
+                if( p_stss->i_sample_number[i_mid] <= i_sample )
+                    i_low = i_mid;
                 else
-                {
-                    while( i_chunk < p_track->i_chunk_count - 1 &&
-                           i_sync_sample >= p_track->chunk[i_chunk].i_sample_first +
-                                            p_track->chunk[i_chunk].i_sample_count )
-                        i_chunk++;
-                }
-                i_sample = i_sync_sample;
-                break;
+                    i_high = i_mid;
             }
+
+            unsigned i_sync_sample = p_stss->i_sample_number[i_low];
+            msg_Dbg( p_demux, "stss gives %d --> %d (sample number)",
+                     i_sample, i_sync_sample );
+
+            i_chunk = TrackSampleToChunk( p_track, i_sync_sample );
+            i_sample = i_sync_sample;
         }
     }
     else
@@ -2614,11 +2538,16 @@ static int TrackGotoChunkSample( demux_t *p_demux, mp4_track_t *p_track,
                                  unsigned int i_chunk, unsigned int i_sample )
 {
     bool b_reselect = false;
+    mp4_chunk_t chunk;
+
+    if( i_chunk >= p_track->i_chunk_count )
+        return VLC_EGENERIC;
+    TrackGetChunk( p_track, i_chunk, &chunk );
 
     /* now see if actual es is ok */
     if( p_track->i_chunk >= p_track->i_chunk_count ||
-        p_track->chunk[p_track->i_chunk].i_sample_description_index !=
-            p_track->chunk[i_chunk].i_sample_description_index )
+        p_track->chunk.i_sample_description_index !=
+            chunk.i_sample_description_index )
     {
         msg_Warn( p_demux, "recreate ES for track[Id 0x%x]",
                   p_track->i_track_ID );
@@ -2648,7 +2577,8 @@ static int TrackGotoChunkSample( demux_t *p_demux, mp4_track_t *p_track,
     }
 
     p_track->i_chunk    = i_chunk;
-    p_track->chunk[i_chunk].i_sample = i_sample - p_track->chunk[i_chunk].i_sample_first;
+    p_track->chunk      = chunk;
+    p_track->chunk.i_sample = i_sample - chunk.i_sample_first;
     p_track->i_sample   = i_sample;
 
     return p_track->b_selected ? VLC_SUCCESS : VLC_EGENERIC;
@@ -2889,6 +2819,8 @@ static void MP4_TrackCreate( demux_t *p_demux, mp4_track_t *p_track,
 
     p_track->i_chunk  = 0;
     p_track->i_sample = 0;
+    if( p_track->i_chunk_count > 0 )
+        TrackGetChunk( p_track, 0, &p_track->chunk );
 
     /* Mark chapter only track */
     if( p_sys->p_tref_chap )
@@ -2998,12 +2930,11 @@ static void MP4_TrackDestroy( demux_t *p_demux, mp4_track_t *p_track )
     if( p_track->p_es )
         es_out_Del( p_demux->out, p_track->p_es );
 
-    if( p_track->chunk )
-    {
-        for( unsigned int i_chunk = 0; i_chunk < p_track->i_chunk_count; i_chunk++ )
-            DestroyChunk( &p_track->chunk[i_chunk] );
-    }
-    free( p_track->chunk );
+    /* moov chunks only reference the sample tables boxes */
+    free( p_track->p_stsc_sample_first );
+    free( p_track->p_stts_sample_first );
+    free( p_track->p_stts_dts_first );
+    free( p_track->p_ctts_sample_first );
 
     if( p_track->cchunk )
     {
@@ -3012,9 +2943,6 @@ static void MP4_TrackDestroy( demux_t *p_demux, mp4_track_t *p_track )
         free( p_track->cchunk );
     }
 
-    if( !p_track->i_sample_size )
-        free( p_track->p_sample_size );
-
     if ( p_track->asfinfo.p_frame )
         block_ChainRelease( p_track->asfinfo.p_frame );
 }
@@ -3144,7 +3072,7 @@ static uint32_t MP4_TrackGetReadSize( mp4_track_t *p_track, uint32_t *pi_nb_samp
     else
     {
         const MP4_Box_data_sample_soun_t *p_soun = p_track->p_sample->data.p_sample_soun;
-        const mp4_chunk_t *p_chunk = &p_track->chunk[p_track->i_chunk];
+        const mp4_chunk_t *p_chunk = &p_track->chunk;
         uint32_t i_max_samples = p_chunk->i_sample_count - p_chunk->i_sample;
 
         /* Group audio packets so we don't call demux for single sample unit */
@@ -3181,7 +3109,7 @@ static uint32_t MP4_TrackGetReadSize( mp4_track_t *p_track, uint32_t *pi_nb_samp
             {
                 /* in this case we are dealing with compressed data
                    -2 in V1: additional fields are meaningless (VBR and such) */
-                *pi_nb_samples = i_max_samples;//p_track->chunk[p_track->i_chunk].i_sample_count;
+                *pi_nb_samples = i_max_samples;//p_track->chunk.i_sample_count;
                 if( p_track->fmt.audio.i_blockalign > 1 )
                     *pi_nb_samples = p_soun->i_sample_per_packet;
                 i_size = *pi_nb_samples / p_soun->i_sample_per_packet * p_soun->i_bytes_per_frame;
@@ -3271,7 +3199,7 @@ static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
     unsigned int i_sample;
     uint64_t i_pos;
 
-    i_pos = p_track->chunk[p_track->i_chunk].i_offset;
+    i_pos = p_track->chunk.i_offset;
 
     if( p_track->i_sample_size )
     {
@@ -3286,7 +3214,7 @@ static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
             {
             case VLC_CODEC_GSM: /* # Samples > data size */
                 i_pos += ( p_track->i_sample -
-                           p_track->chunk[p_track->i_chunk].i_sample_first ) / 160 * 33;
+                           p_track->chunk.i_sample_first ) / 160 * 33;
                 return i_pos;
             default:
                 break;
@@ -3298,19 +3226,19 @@ static uint64_t MP4_TrackGetPos( mp4_track_t *p_track )
             p_soun->i_sample_per_packet * p_soun->i_bytes_per_frame == 0 )
         {
             i_pos += ( p_track->i_sample -
-                       p_track->chunk[p_track->i_chunk].i_sample_first ) *
+                       p_track->chunk.i_sample_first ) *
                      MP4_GetFixedSampleSize( p_track, p_soun );
         }
         else
         {
             /* we read chunk by chunk unless a blockalign is requested */
-            i_pos += ( p_track->i_sample - p_track->chunk[p_track->i_chunk].i_sample_first ) /
+            i_pos += ( p_track->i_sample - p_track->chunk.i_sample_first ) /
                         p_soun->i_sample_per_packet * p_soun->i_bytes_per_frame;
         }
     }
     else
     {
-        for( i_sample = p_track->chunk[p_track->i_chunk].i_sample_first;
+        for( i_sample = p_track->chunk.i_sample_first;
              i_sample < p_track->i_sample; i_sample++ )
         {
             i_pos += p_track->p_sample_size[i_sample];
@@ -3335,8 +3263,8 @@ static int MP4_TrackNextSample( demux_t *p_demux, mp4_track_t *p_track, uint32_t
 
     /* Have we changed chunk ? */
     if( p_track->i_sample >=
-            p_track->chunk[p_track->i_chunk].i_sample_first +
-            p_track->chunk[p_track->i_chunk].i_sample_count )
+            p_track->chunk.i_sample_first +
+            p_track->chunk.i_sample_count )
     {
         if( TrackGotoChunkSample( p_demux, p_track, p_track->i_chunk + 1,
                                   p_track->i_sample ) )
@@ -4694,14 +4622,16 @@ static int LeafGetTrackAndChunkByMOOVPos( demux_t *p_demux, uint64_t *pi_pos,
     {
         for( unsigned int i_chunk = 0; i_chunk < p_sys->track[i_track].i_chunk_count; i_chunk++ )
         {
-            if ( p_sys->track[i_track].chunk[i_chunk].i_offset > *pi_pos )
+            const uint64_t i_offset =
+                    p_sys->track[i_track].p_co64->i_chunk_offset[i_chunk];
+            if ( i_offset > *pi_pos )
             {
-                i_closest = __MIN( i_closest, p_sys->track[i_track].chunk[i_chunk].i_offset );
+                i_closest = __MIN( i_closest, i_offset );
                 p_tk_closest = &p_sys->track[i_track];
                 i_chunk_closest = i_chunk;
             }
 
-            if ( *pi_pos == p_sys->track[i_track].chunk[i_chunk].i_offset )
+            if ( *pi_pos == i_offset )
             {
                 *pp_tk = &p_sys->track[i_track];
                 *pi_chunk = i_chunk;
@@ -4773,18 +4703,18 @@ static inline mtime_t LeafGetMOOVTimeInChunk( const mp4_chunk_t *p_chunk, uint32
     mtime_t i_time = 0;
     uint32_t i_index = 0;
 
-    while( i_sample > 0 )
+    while( i_sample > 0 && i_index < p_chunk->i_entries_dts )
     {
-        if( i_sample > p_chunk->p_sample_count_dts[i_index] )
+        const uint32_t i_count = MP4_ChunkGetDTSCount( p_chunk, i_index );
+        if( i_sample > i_count )
         {
-            i_time += p_chunk->p_sample_count_dts[i_index] *
-                p_chunk->p_sample_delta_dts[i_index];
-            i_sample -= p_chunk->p_sample_count_dts[i_index];
+            i_time += (uint64_t)i_count * p_chunk->p_sample_delta_dts[i_index];
+            i_sample -= i_count;
             i_index++;
         }
         else
         {
-            i_time += i_sample * p_chunk->p_sample_delta_dts[i_index];
+            i_time += (uint64_t)i_sample * p_chunk->p_sample_delta_dts[i_index];
             break;
         }
     }
@@ -4845,7 +4775,9 @@ static int LeafParseMDATwithMOOV( demux_t *p_demux )
         }
         /**/
 
-        mp4_chunk_t *p_chunk = &p_track->chunk[i_chunk];
+        mp4_chunk_t chunk;
+        TrackGetChunk( p_track, i_chunk, &chunk );
+        const mp4_chunk_t *p_chunk = &chunk;
 
         uint32_t i_nb_samples_at_chunk_start = p_chunk->i_sample_first;
         uint32_t i_nb_samples_in_chunk = p_chunk->i_sample_count;
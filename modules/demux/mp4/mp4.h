@@ -49,11 +49,17 @@ typedef struct
     uint64_t     i_first_dts;   /* DTS of the first sample */
     uint64_t     i_last_dts;    /* DTS of the last sample */
 
+    /* For moov tracks, these point into the stts/ctts boxes rather than
+     * copies: the run-length entries are decoded on demand, and the first
+     * entry may be shared with the previous chunks. The i_skip_* fields count
+     * its samples which belong to those chunks. Fragments own their tables. */
     uint32_t     i_entries_dts;
+    uint32_t     i_skip_dts;
     uint32_t     *p_sample_count_dts;
     uint32_t     *p_sample_delta_dts;   /* dts delta */
 
     uint32_t     i_entries_pts;
+    uint32_t     i_skip_pts;
     uint32_t     *p_sample_count_pts;
     int32_t      *p_sample_offset_pts;  /* pts-dts */
 
@@ -104,14 +110,26 @@ typedef struct
     uint32_t         i_chunk_count;
     uint32_t         i_sample_count;
 
-    mp4_chunk_t    *chunk; /* always defined  for each chunk */
+    mp4_chunk_t     chunk;  /* current chunk (i_chunk) if b_fragmented is false,
+                               decoded from the sample tables on demand */
     mp4_chunk_t    *cchunk; /* current chunk if b_fragmented is true */
 
+    /* Sample tables of the moov, and the first sample (and dts) of each of
+     * their run-length entries, for chunk and time lookups in O(log n).
+     * Each array has a trailing entry for the end of the table. */
+    const MP4_Box_data_co64_t *p_co64;
+    const MP4_Box_data_stsc_t *p_stsc;
+    uint32_t        *p_stsc_sample_first;
+    const MP4_Box_data_stts_t *p_stts;
+    uint32_t        *p_stts_sample_first;
+    uint64_t        *p_stts_dts_first;
+    const MP4_Box_data_ctts_t *p_ctts; /* NULL if no ctts */
+    uint32_t        *p_ctts_sample_first;
+
     /* sample size, p_sample_size defined only if i_sample_size == 0
         else i_sample_size is size for all sample */
     uint32_t         i_sample_size;
-    uint32_t         *p_sample_size; /* XXX perhaps add file offset if take
-                                    too much time to do sumations each time*/
+    const uint32_t   *p_sample_size; /* points into the stsz box */
 
     uint32_t     i_sample_first; /* i_sample_first value
                                                    of the next chunk */
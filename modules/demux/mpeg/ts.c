@@ -42,6 +42,7 @@
 #include <vlc_epg.h>
 #include <vlc_charset.h>   /* FromCharset, for EIT */
 #include <vlc_bits.h>
+#include <vlc_md5.h>
 
 #include "../../mux/mpeg/csa.h"
 
@@ -72,6 +73,7 @@
 
 #include "pes.h"
 #include "mpeg4_iod.h"
+#include "ts_index.h"
 
 #ifdef HAVE_ARIBB24
  #include <aribb24/aribb24.h>
@@ -134,6 +136,13 @@ static void Close ( vlc_object_t * );
     "Seek and position based on a percent byte position, not a PCR generated " \
     "time position. If seeking doesn't work property, turn on this option." )
 
+#define SEEK_INDEX_TEXT N_("Seek index")
+#define SEEK_INDEX_LONGTEXT N_( \
+    "Remember the position of PCRs while playing local files, and keep " \
+    "them in the cache directory. This makes later seeks and duration " \
+    "lookups on the same file almost free. The least recently used indexes " \
+    "are deleted once they take more than 16 MB." )
+
 #define PCR_TEXT N_("Trust in-stream PCR")
 #define PCR_LONGTEXT N_("Use the stream PCR as a reference.")
 
@@ -169,6 +178,7 @@ vlc_module_begin ()
 
     add_bool( "ts-split-es", true, SPLIT_ES_TEXT, SPLIT_ES_LONGTEXT, false )
     add_bool( "ts-seek-percent", false, SEEK_PERCENT_TEXT, SEEK_PERCENT_LONGTEXT, true )
+    add_bool( "ts-seek-index", false, SEEK_INDEX_TEXT, SEEK_INDEX_LONGTEXT, true )
 
     add_integer( "ts-arib", ARIBMODE_AUTO, SUPPORT_ARIB_TEXT, SUPPORT_ARIB_LONGTEXT, false )
         change_integer_list( arib_mode_list, arib_mode_list_text )
@@ -363,6 +373,10 @@ struct demux_sys_t
 
     bool        b_force_seek_per_percent;
 
+    /* PCR seek index, NULL if disabled */
+    ts_index_t *p_index;
+    char       *psz_index_key;
+
     struct
     {
         arib_modes_e e_mode;
@@ -381,9 +395,8 @@ struct demux_sys_t
         ts_pid_t **pp_all;
         int        i_all;
         int        i_all_alloc;
-        /* last recently used */
-        uint16_t   i_last_pid;
-        ts_pid_t  *p_last;
+        /* the same ones, indexed by pid */
+        ts_pid_t  *p_map[0x2000];
     } pids;
 
     bool        b_user_pmt;
@@ -478,6 +491,7 @@ static void AddAndCreateES( demux_t *p_demux, ts_pid_t *pid, bool );
 static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_prg, mtime_t i_pcr );
 
 static block_t* ReadTSPacket( demux_t *p_demux );
+static unsigned SkipUnselectedPackets( demux_t *p_demux, unsigned i_max );
 static int ProbeStart( demux_t *p_demux, int i_program );
 static int ProbeEnd( demux_t *p_demux, int i_program );
 static int SeekToTime( demux_t *p_demux, ts_pmt_t *, int64_t time );
@@ -485,6 +499,8 @@ static void ReadyQueuesPostSeek( demux_t *p_demux );
 static void PCRHandle( demux_t *p_demux, ts_pid_t *, block_t * );
 static void PCRFixHandle( demux_t *, ts_pmt_t *, block_t * );
 static int64_t TimeStampWrapAround( ts_pmt_t *, int64_t );
+static void SeekIndexOpen( demux_t *p_demux );
+static void SeekIndexAdd( demux_t *p_demux, ts_pmt_t *, int64_t i_pcr );
 
 /* MPEG4 related */
 static const es_mpeg4_descriptor_t * GetMPEG4DescByEsId( const ts_pmt_t *, uint16_t );
@@ -1135,6 +1151,10 @@ static int Open( vlc_object_t *p_this )
     stream_Control( p_sys->stream, STREAM_CAN_SEEK, &p_sys->b_canseek );
     stream_Control( p_sys->stream, STREAM_CAN_FASTSEEK, &p_sys->b_canfastseek );
 
+    if( p_sys->b_canseek && !strcmp( p_demux->psz_access, "file" ) &&
+        var_InheritBool( p_demux, "ts-seek-index" ) )
+        SeekIndexOpen( p_demux );
+
     /* Preparse time */
     if( p_sys->b_canseek )
     {
@@ -1160,6 +1180,13 @@ static void Close( vlc_object_t *p_this )
 
     PIDRelease( p_demux, GetPID(p_sys, 0) );
 
+    if( p_sys->p_index )
+    {
+        ts_index_Save( p_this, p_sys->p_index, p_sys->psz_index_key );
+        ts_index_Delete( p_sys->p_index );
+        free( p_sys->psz_index_key );
+    }
+
     if( p_sys->b_dvb_meta )
     {
         PIDRelease( p_demux, GetPID(p_sys, 0x11) );
@@ -1245,6 +1272,14 @@ static int Demux( demux_t *p_demux )
     {
         bool         b_frame = false;
         block_t     *p_pkt;
+
+        if( !p_sys->b_start_record )
+        {
+            i_pkt += SkipUnselectedPackets( p_demux, p_sys->i_ts_read - i_pkt );
+            if( i_pkt >= p_sys->i_ts_read )
+                break;
+        }
+
         if( !(p_pkt = ReadTSPacket( p_demux )) )
         {
             return VLC_DEMUXER_EOF;
@@ -2544,11 +2579,18 @@ static block_t* ReadTSPacket( demux_t *p_demux )
 
             while( i_skip < i_peek - p_sys->i_packet_size )
             {
-                if( p_peek[i_skip + p_sys->i_packet_header_size] == 0x47 &&
-                        p_peek[i_skip + p_sys->i_packet_header_size + p_sys->i_packet_size] == 0x47 )
+                /* Let memchr() scan for the candidate sync bytes */
+                const uint8_t *p_sync = memchr( &p_peek[i_skip + p_sys->i_packet_header_size],
+                                                0x47, i_peek - p_sys->i_packet_size - i_skip );
+                if( p_sync == NULL )
                 {
+                    i_skip = i_peek - p_sys->i_packet_size;
                     break;
                 }
+                i_skip = p_sync - p_peek - p_sys->i_packet_header_size;
+
+                if( p_peek[i_skip + p_sys->i_packet_header_size + p_sys->i_packet_size] == 0x47 )
+                    break;
                 i_skip++;
             }
             msg_Dbg( p_demux, "skipping %d bytes of garbage", i_skip );
@@ -2568,6 +2610,55 @@ static block_t* ReadTSPacket( demux_t *p_demux )
     return p_pkt;
 }
 
+/* Drops the next packets, up to i_max, as long as they belong to PES pids
+ * which are not selected: Demux() would release them without looking at
+ * them anyway. Only the packet headers are peeked at, no block is allocated.
+ * Returns the number of dropped packets. */
+static unsigned SkipUnselectedPackets( demux_t *p_demux, unsigned i_max )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const unsigned i_size = p_sys->i_packet_size;
+    const unsigned i_header = p_sys->i_packet_header_size;
+    const uint8_t *p_peek;
+    unsigned i_skip = 0;
+
+    /* Otherwise, all packets need processing */
+    if( p_sys->b_access_control || p_sys->es_creation == DELAY_ES ||
+        !SEEN( &p_sys->pids.pat ) || i_max == 0 )
+        return 0;
+
+    /* Check the first packet before peeking at a whole run */
+    ssize_t i_peek = stream_Peek( p_sys->stream, &p_peek, i_header + 4 );
+    for( unsigned i_count = 1; i_skip < i_count; )
+    {
+        if( i_peek < (ssize_t)(i_skip * i_size + i_header + 4) )
+            break;
+
+        const uint8_t *p = &p_peek[i_skip * i_size + i_header];
+        if( p[0] != 0x47 || (p[3] & 0x80) ) /* lost sync or scrambled */
+            break;
+
+        const ts_pid_t *pid = p_sys->pids.p_map[((p[1] & 0x1f) << 8) | p[2]];
+        if( pid == NULL || pid->type != TYPE_PES || !SEEN(pid) ||
+            (pid->i_flags & (FLAG_FILTERED | FLAG_SCRAMBLED)) )
+            break;
+
+        if( ++i_skip == 1 && i_max > 1 )
+        {
+            i_peek = stream_Peek( p_sys->stream, &p_peek, i_size * i_max );
+            if( i_peek > 0 )
+                i_count = __MIN( i_max, (size_t)i_peek / i_size );
+        }
+    }
+
+    if( i_skip > 0 )
+    {
+        stream_Read( p_sys->stream, NULL, i_skip * i_size );
+        p_sys->b_end_preparse = true;
+    }
+    return i_skip;
+}
+
 static int64_t TimeStampWrapAround( ts_pmt_t *p_pmt, int64_t i_time )
 {
     int64_t i_adjust = 0;
@@ -2684,11 +2775,24 @@ static void ReadyQueuesPostSeek( demux_t *p_demux )
 static int SeekToTime( demux_t *p_demux, ts_pmt_t *p_pmt, int64_t i_scaledtime )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
+    const int64_t i_tolerance = TO_SCALE(VLC_TS_0 + CLOCK_FREQ / 2); // 500ms
 
     /* Deal with common but worst binary search case */
     if( p_pmt->pcr.i_first == i_scaledtime && p_sys->b_canseek )
         return stream_Seek( p_sys->stream, 0 );
 
+    const ts_index_entry_t *p_before = NULL, *p_after = NULL;
+    if( p_sys->p_index )
+    {
+        ts_index_Lookup( p_sys->p_index, p_pmt->i_number, i_scaledtime,
+                         &p_before, &p_after );
+
+        /* Close enough to an indexed PCR, no need to read */
+        if( p_before && i_scaledtime - p_before->i_pcr < i_tolerance &&
+            stream_Seek( p_sys->stream, p_before->i_offset ) == VLC_SUCCESS )
+            return VLC_SUCCESS;
+    }
+
     if( !p_sys->b_canfastseek )
         return VLC_EGENERIC;
 
@@ -2700,6 +2804,12 @@ static int SeekToTime( demux_t *p_demux, ts_pmt_t *p_pmt, int64_t i_scaledtime )
     if( i_head_pos >= i_tail_pos )
         return VLC_EGENERIC;
 
+    /* Narrow down the search to the indexed PCRs around the requested time */
+    if( p_before )
+        i_head_pos = p_before->i_offset;
+    if( p_after && (int64_t)p_after->i_offset < i_tail_pos )
+        i_tail_pos = p_after->i_offset;
+
     bool b_found = false;
     while( (i_head_pos + p_sys->i_packet_size) <= i_tail_pos && !b_found )
     {
@@ -2761,7 +2871,7 @@ static int SeekToTime( demux_t *p_demux, ts_pmt_t *p_pmt, int64_t i_scaledtime )
                 int64_t i_diff = i_scaledtime - TimeStampWrapAround( p_pmt, i_pcr );
                 if ( i_diff < 0 )
                     i_tail_pos = i_splitpos - p_sys->i_packet_size;
-                else if( i_diff < TO_SCALE(VLC_TS_0 + CLOCK_FREQ / 2) ) // 500ms
+                else if( i_diff < i_tolerance )
                     b_found = true;
                 else
                     i_head_pos = i_pos;
@@ -2782,6 +2892,59 @@ static int SeekToTime( demux_t *p_demux, ts_pmt_t *p_pmt, int64_t i_scaledtime )
     return VLC_SUCCESS;
 }
 
+static void SeekIndexOpen( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const uint8_t *p_peek;
+
+    int64_t i_size = stream_Size( p_sys->stream );
+    if( i_size <= 0 )
+        return;
+
+    /* Identify the file by its location, size and first bytes */
+    int i_peek = stream_Peek( p_sys->stream, &p_peek, 4096 );
+    if( i_peek <= 0 )
+        return;
+
+    struct md5_s md5;
+    uint8_t size[8];
+    SetQWBE( size, i_size );
+    InitMD5( &md5 );
+    AddMD5( &md5, p_demux->psz_access, strlen( p_demux->psz_access ) );
+    AddMD5( &md5, "://", 3 );
+    AddMD5( &md5, p_demux->psz_location, strlen( p_demux->psz_location ) );
+    AddMD5( &md5, size, sizeof(size) );
+    AddMD5( &md5, p_peek, i_peek );
+    EndMD5( &md5 );
+
+    p_sys->psz_index_key = psz_md5_hash( &md5 );
+    p_sys->p_index = ts_index_New( p_sys->i_packet_size, i_size );
+    if( !p_sys->psz_index_key || !p_sys->p_index )
+    {
+        if( p_sys->p_index )
+            ts_index_Delete( p_sys->p_index );
+        free( p_sys->psz_index_key );
+        p_sys->p_index = NULL;
+        p_sys->psz_index_key = NULL;
+        return;
+    }
+
+    ts_index_Load( VLC_OBJECT(p_demux), p_sys->p_index, p_sys->psz_index_key );
+}
+
+static void SeekIndexAdd( demux_t *p_demux, ts_pmt_t *p_pmt, int64_t i_pcr )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( !p_sys->p_index || p_pmt->pcr.b_disable || p_pmt->pcr.i_first == -1 )
+        return;
+
+    /* PCRs are handled right after their packet was read */
+    int64_t i_offset = stream_Tell( p_sys->stream ) - p_sys->i_packet_size;
+    if( i_offset >= 0 )
+        ts_index_Add( p_sys->p_index, p_pmt->i_number, i_pcr, i_offset );
+}
+
 static ts_pid_t *GetPID( demux_sys_t *p_sys, uint16_t i_pid )
 {
     switch( i_pid )
@@ -2791,21 +2954,22 @@ static ts_pid_t *GetPID( demux_sys_t *p_sys, uint16_t i_pid )
         case 0x1FFF:
             return &p_sys->pids.dummy;
         default:
-            if( p_sys->pids.i_last_pid == i_pid )
-                return p_sys->pids.p_last;
+            if( i_pid < ARRAY_SIZE(p_sys->pids.p_map) )
+            {
+                if( p_sys->pids.p_map[i_pid] )
+                    return p_sys->pids.p_map[i_pid];
+            }
+            else
+            {
+                for( int i=0; i < p_sys->pids.i_all; i++ )
+                {
+                    if( p_sys->pids.pp_all[i]->i_pid == i_pid )
+                        return p_sys->pids.pp_all[i];
+                }
+            }
         break;
     }
 
-    for( int i=0; i < p_sys->pids.i_all; i++ )
-    {
-        if( p_sys->pids.pp_all[i]->i_pid == i_pid )
-        {
-            p_sys->pids.p_last = p_sys->pids.pp_all[i];
-            p_sys->pids.i_last_pid = i_pid;
-            return p_sys->pids.p_last;
-        }
-    }
-
     if( p_sys->pids.i_all >= p_sys->pids.i_all_alloc )
     {
         ts_pid_t **p_realloc = realloc( p_sys->pids.pp_all,
@@ -2825,9 +2989,8 @@ static ts_pid_t *GetPID( demux_sys_t *p_sys, uint16_t i_pid )
 
     p_pid->i_pid = i_pid;
     p_sys->pids.pp_all[p_sys->pids.i_all++] = p_pid;
-
-    p_sys->pids.p_last = p_pid;
-    p_sys->pids.i_last_pid = i_pid;
+    if( i_pid < ARRAY_SIZE(p_sys->pids.p_map) )
+        p_sys->pids.p_map[i_pid] = p_pid;
 
     return p_pid;
 }
@@ -3076,6 +3239,7 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
             {
                 /* ? update PCR for the whole group program ? */
                 ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
+                SeekIndexAdd( p_demux, p_pmt, i_program_pcr );
             }
         }
         else /* set PCR provided by current pid to program(s) referencing it */
@@ -3085,6 +3249,7 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, block_t *p_bk )
             {
                 /* We've found a target group for update */
                 ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
+                SeekIndexAdd( p_demux, p_pmt, i_program_pcr );
             }
         }
 
@@ -5062,6 +5227,8 @@ static void PMTCallBack( void *data, dvbpsi_pmt_t *p_dvbpsipmt )
 
     msg_Dbg( p_demux, "new PMT program number=%d version=%d pid_pcr=%d",
              p_dvbpsipmt->i_program_number, p_dvbpsipmt->i_version, p_dvbpsipmt->i_pcr_pid );
+    /* Version updates keep the timeline of the program */
+    const bool b_new_program = ( p_pmt->i_version == -1 );
     p_pmt->i_pid_pcr = p_dvbpsipmt->i_pcr_pid;
     p_pmt->i_version = p_dvbpsipmt->i_version;
 
@@ -5419,11 +5586,23 @@ static void PMTCallBack( void *data, dvbpsi_pmt_t *p_dvbpsipmt )
     }
 
     /* Probe Boundaries */
-    if( p_sys->b_canfastseek && p_pmt->i_last_dts == -1 )
+    if( (p_sys->b_canfastseek || p_sys->p_index) && b_new_program &&
+        p_pmt->i_last_dts == -1 )
     {
         p_pmt->i_last_dts = 0;
-        ProbeStart( p_demux, p_pmt->i_number );
-        ProbeEnd( p_demux, p_pmt->i_number );
+        /* Boundaries from a previous session spare reading the file tail */
+        if( p_sys->p_index &&
+            ts_index_GetBounds( p_sys->p_index, p_pmt->i_number,
+                                &p_pmt->pcr.i_first, &p_pmt->i_last_dts ) )
+            msg_Dbg( p_demux, "program %d boundaries from seek index", p_pmt->i_number );
+        else if( p_sys->b_canfastseek )
+        {
+            ProbeStart( p_demux, p_pmt->i_number );
+            ProbeEnd( p_demux, p_pmt->i_number );
+            if( p_sys->p_index && p_pmt->pcr.i_first > -1 && p_pmt->i_last_dts > 0 )
+                ts_index_SetBounds( p_sys->p_index, p_pmt->i_number,
+                                    p_pmt->pcr.i_first, p_pmt->i_last_dts );
+        }
     }
 }
 
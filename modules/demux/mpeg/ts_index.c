@@ -0,0 +1,501 @@
+/*****************************************************************************
+ * ts_index.c: MPEG-TS PCR to byte offset seek index
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include <vlc_common.h>
+#include <vlc_fs.h>
+#include <vlc_configuration.h>
+
+#include "ts_index.h"
+
+/* On disk layout, all integers big endian:
+ *  magic[8] packet_size(32) file_size(64) program_count(32)
+ *  then for each program:
+ *  number(32) first(64) last(64) entry_count(32) { pcr(64) offset(64) }...
+ */
+#define TS_INDEX_MAGIC   "VLCTSIX1"
+#define TS_INDEX_MAX     (1 << 20) /* entries per program, ~145h */
+/* Total size of the index directory, least recently used files go first.
+ * An hour of a single program takes about 115 kB. */
+#define TS_INDEX_CACHE_SIZE (16 * 1024 * 1024)
+
+typedef struct
+{
+    int               i_number;
+    int64_t           i_first;
+    int64_t           i_last;
+    size_t            i_count;
+    size_t            i_alloc;
+    ts_index_entry_t *p_entries;
+} ts_index_program_t;
+
+struct ts_index_t
+{
+    unsigned            i_packet_size;
+    uint64_t            i_size;
+    bool                b_dirty;
+    bool                b_loaded;
+    int                 i_programs;
+    ts_index_program_t *p_programs;
+};
+
+ts_index_t * ts_index_New( unsigned i_packet_size, uint64_t i_size )
+{
+    ts_index_t *p_index = calloc( 1, sizeof(*p_index) );
+    if( !p_index )
+        return NULL;
+    p_index->i_packet_size = i_packet_size;
+    p_index->i_size = i_size;
+    return p_index;
+}
+
+void ts_index_Delete( ts_index_t *p_index )
+{
+    for( int i = 0; i < p_index->i_programs; i++ )
+        free( p_index->p_programs[i].p_entries );
+    free( p_index->p_programs );
+    free( p_index );
+}
+
+static ts_index_program_t * GetProgram( const ts_index_t *p_index, int i_number )
+{
+    for( int i = 0; i < p_index->i_programs; i++ )
+        if( p_index->p_programs[i].i_number == i_number )
+            return &p_index->p_programs[i];
+    return NULL;
+}
+
+static ts_index_program_t * AddProgram( ts_index_t *p_index, int i_number )
+{
+    ts_index_program_t *p_prog = GetProgram( p_index, i_number );
+    if( p_prog )
+        return p_prog;
+
+    p_prog = realloc( p_index->p_programs,
+                      (p_index->i_programs + 1) * sizeof(*p_prog) );
+    if( !p_prog )
+        return NULL;
+    p_index->p_programs = p_prog;
+    p_prog = &p_prog[p_index->i_programs++];
+    p_prog->i_number = i_number;
+    p_prog->i_first = -1;
+    p_prog->i_last = -1;
+    p_prog->i_count = 0;
+    p_prog->i_alloc = 0;
+    p_prog->p_entries = NULL;
+    return p_prog;
+}
+
+/* Returns the index of the first entry located after i_offset */
+static size_t UpperBoundOffset( const ts_index_program_t *p_prog, uint64_t i_offset )
+{
+    size_t lo = 0, hi = p_prog->i_count;
+    while( lo < hi )
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if( p_prog->p_entries[mid].i_offset <= i_offset )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Returns the index of the first entry with a PCR after i_pcr.
+ * Entries are sorted by offset, and Add() keeps PCRs increasing with them. */
+static size_t UpperBoundPCR( const ts_index_program_t *p_prog, int64_t i_pcr )
+{
+    size_t lo = 0, hi = p_prog->i_count;
+    while( lo < hi )
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if( p_prog->p_entries[mid].i_pcr <= i_pcr )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void ts_index_Add( ts_index_t *p_index, int i_program, int64_t i_pcr, uint64_t i_offset )
+{
+    ts_index_program_t *p_prog = AddProgram( p_index, i_program );
+    if( !p_prog )
+        return;
+
+    size_t i_pos = UpperBoundOffset( p_prog, i_offset );
+
+    /* Keep entries sparse, and drop any PCR going backwards (discontinuity,
+     * broken stream) since it would break the ordering */
+    if( i_pos > 0 &&
+        i_pcr < p_prog->p_entries[i_pos - 1].i_pcr + TS_INDEX_INTERVAL )
+        return;
+    if( i_pos < p_prog->i_count &&
+        i_pcr + TS_INDEX_INTERVAL > p_prog->p_entries[i_pos].i_pcr )
+        return;
+
+    if( p_prog->i_count == p_prog->i_alloc )
+    {
+        if( p_prog->i_alloc >= TS_INDEX_MAX )
+            return;
+        size_t i_alloc = p_prog->i_alloc ? p_prog->i_alloc * 2 : 256;
+        ts_index_entry_t *p_entries = realloc( p_prog->p_entries,
+                                               i_alloc * sizeof(*p_entries) );
+        if( !p_entries )
+            return;
+        p_prog->p_entries = p_entries;
+        p_prog->i_alloc = i_alloc;
+    }
+
+    memmove( &p_prog->p_entries[i_pos + 1], &p_prog->p_entries[i_pos],
+             (p_prog->i_count - i_pos) * sizeof(*p_prog->p_entries) );
+    p_prog->p_entries[i_pos].i_pcr = i_pcr;
+    p_prog->p_entries[i_pos].i_offset = i_offset;
+    p_prog->i_count++;
+    p_index->b_dirty = true;
+}
+
+void ts_index_Lookup( const ts_index_t *p_index, int i_program, int64_t i_pcr,
+                      const ts_index_entry_t **pp_before,
+                      const ts_index_entry_t **pp_after )
+{
+    *pp_before = *pp_after = NULL;
+
+    const ts_index_program_t *p_prog = GetProgram( p_index, i_program );
+    if( !p_prog )
+        return;
+
+    size_t i_pos = UpperBoundPCR( p_prog, i_pcr );
+    if( i_pos > 0 )
+        *pp_before = &p_prog->p_entries[i_pos - 1];
+    if( i_pos < p_prog->i_count )
+        *pp_after = &p_prog->p_entries[i_pos];
+}
+
+void ts_index_SetBounds( ts_index_t *p_index, int i_program, int64_t i_first, int64_t i_last )
+{
+    ts_index_program_t *p_prog = AddProgram( p_index, i_program );
+    if( !p_prog || (p_prog->i_first == i_first && p_prog->i_last == i_last) )
+        return;
+    p_prog->i_first = i_first;
+    p_prog->i_last = i_last;
+    p_index->b_dirty = true;
+}
+
+bool ts_index_GetBounds( const ts_index_t *p_index, int i_program, int64_t *pi_first, int64_t *pi_last )
+{
+    const ts_index_program_t *p_prog = GetProgram( p_index, i_program );
+    if( !p_prog || p_prog->i_first < 0 || p_prog->i_last <= 0 )
+        return false;
+    *pi_first = p_prog->i_first;
+    *pi_last = p_prog->i_last;
+    return true;
+}
+
+/*****************************************************************************
+ * Persistence
+ *****************************************************************************/
+static char * GetIndexDir( void )
+{
+    char *psz_cachedir = config_GetUserDir( VLC_CACHE_DIR );
+    char *psz_dir;
+
+    if( !psz_cachedir )
+        return NULL;
+    if( asprintf( &psz_dir, "%s" DIR_SEP "ts-index", psz_cachedir ) == -1 )
+        psz_dir = NULL;
+    free( psz_cachedir );
+    return psz_dir;
+}
+
+static char * GetIndexPath( const char *psz_key )
+{
+    char *psz_dir = GetIndexDir();
+    char *psz_path;
+
+    if( !psz_dir )
+        return NULL;
+    if( asprintf( &psz_path, "%s" DIR_SEP "%s", psz_dir, psz_key ) == -1 )
+        psz_path = NULL;
+    free( psz_dir );
+    return psz_path;
+}
+
+int ts_index_Load( vlc_object_t *p_obj, ts_index_t *p_index, const char *psz_key )
+{
+    char *psz_path = GetIndexPath( psz_key );
+    if( !psz_path )
+        return VLC_ENOMEM;
+
+    FILE *file = vlc_fopen( psz_path, "rb" );
+    free( psz_path );
+    if( !file )
+        return VLC_EGENERIC;
+
+    uint8_t hdr[8 + 4 + 8 + 4];
+    if( fread( hdr, sizeof(hdr), 1, file ) != 1 ||
+        memcmp( hdr, TS_INDEX_MAGIC, 8 ) ||
+        GetDWBE( &hdr[8] ) != p_index->i_packet_size ||
+        GetQWBE( &hdr[12] ) != p_index->i_size )
+        goto error;
+
+    for( uint32_t i_programs = GetDWBE( &hdr[20] ); i_programs > 0; i_programs-- )
+    {
+        uint8_t prog[4 + 8 + 8 + 4];
+        if( fread( prog, sizeof(prog), 1, file ) != 1 )
+            goto error;
+
+        uint32_t i_count = GetDWBE( &prog[20] );
+        if( i_count > TS_INDEX_MAX )
+            goto error;
+
+        ts_index_program_t *p_prog = AddProgram( p_index, GetDWBE( &prog[0] ) );
+        if( !p_prog || p_prog->i_count )
+            goto error;
+        p_prog->i_first = GetQWBE( &prog[4] );
+        p_prog->i_last = GetQWBE( &prog[12] );
+        if( i_count == 0 )
+            continue;
+
+        p_prog->p_entries = malloc( i_count * sizeof(*p_prog->p_entries) );
+        if( !p_prog->p_entries )
+            goto error;
+        p_prog->i_alloc = i_count;
+
+        for( uint32_t i = 0; i < i_count; i++ )
+        {
+            uint8_t entry[16];
+            if( fread( entry, sizeof(entry), 1, file ) != 1 )
+                goto error;
+
+            ts_index_entry_t *p_entry = &p_prog->p_entries[i];
+            p_entry->i_pcr = GetQWBE( &entry[0] );
+            p_entry->i_offset = GetQWBE( &entry[8] );
+            if( p_entry->i_offset >= p_index->i_size ||
+                (i > 0 && (p_entry->i_offset <= p_entry[-1].i_offset ||
+                           p_entry->i_pcr <= p_entry[-1].i_pcr)) )
+                goto error;
+            p_prog->i_count++;
+        }
+    }
+    fclose( file );
+
+    for( int i = 0; i < p_index->i_programs; i++ )
+        msg_Dbg( p_obj, "loaded seek index for program %d: %zu entries",
+                 p_index->p_programs[i].i_number, p_index->p_programs[i].i_count );
+    p_index->b_dirty = false;
+    p_index->b_loaded = true;
+    return VLC_SUCCESS;
+
+error:
+    msg_Warn( p_obj, "ignoring invalid seek index %s", psz_key );
+    fclose( file );
+    for( int i = 0; i < p_index->i_programs; i++ )
+        free( p_index->p_programs[i].p_entries );
+    free( p_index->p_programs );
+    p_index->p_programs = NULL;
+    p_index->i_programs = 0;
+    return VLC_EGENERIC;
+}
+
+typedef struct
+{
+    char  *psz_name;
+    time_t i_mtime;
+    off_t  i_size;
+} ts_index_file_t;
+
+static int CompareFiles( const void *a, const void *b )
+{
+    const ts_index_file_t *p_a = a, *p_b = b;
+
+    return (p_a->i_mtime > p_b->i_mtime) - (p_a->i_mtime < p_b->i_mtime);
+}
+
+/* Deletes the least recently written indexes until the directory fits in
+ * TS_INDEX_CACHE_SIZE, but never the one named psz_keep */
+static void Prune( vlc_object_t *p_obj, const char *psz_dir, const char *psz_keep )
+{
+    DIR *dir = vlc_opendir( psz_dir );
+    if( !dir )
+        return;
+
+    ts_index_file_t *p_files = NULL;
+    size_t i_files = 0, i_alloc = 0;
+    uint64_t i_total = 0;
+    const char *psz_name;
+
+    while( (psz_name = vlc_readdir( dir )) != NULL )
+    {
+        char *psz_path;
+        struct stat st;
+
+        if( psz_name[0] == '.' || !strcmp( psz_name, psz_keep ) )
+            continue;
+        if( asprintf( &psz_path, "%s" DIR_SEP "%s", psz_dir, psz_name ) == -1 )
+            break;
+        bool b_ok = !vlc_stat( psz_path, &st ) && S_ISREG( st.st_mode );
+        free( psz_path );
+        if( !b_ok )
+            continue;
+
+        if( i_files == i_alloc )
+        {
+            size_t i_new = i_alloc ? i_alloc * 2 : 64;
+            ts_index_file_t *p_new = realloc( p_files, i_new * sizeof(*p_new) );
+            if( !p_new )
+                break;
+            p_files = p_new;
+            i_alloc = i_new;
+        }
+        p_files[i_files].psz_name = strdup( psz_name );
+        if( !p_files[i_files].psz_name )
+            break;
+        p_files[i_files].i_mtime = st.st_mtime;
+        p_files[i_files].i_size = st.st_size;
+        i_total += st.st_size;
+        i_files++;
+    }
+    closedir( dir );
+
+    qsort( p_files, i_files, sizeof(*p_files), CompareFiles );
+
+    for( size_t i = 0; i < i_files; i++ )
+    {
+        if( i_total > TS_INDEX_CACHE_SIZE )
+        {
+            char *psz_path;
+            if( asprintf( &psz_path, "%s" DIR_SEP "%s", psz_dir,
+                          p_files[i].psz_name ) != -1 )
+            {
+                msg_Dbg( p_obj, "evicting seek index %s", p_files[i].psz_name );
+                if( !vlc_unlink( psz_path ) )
+                    i_total -= p_files[i].i_size;
+                free( psz_path );
+            }
+        }
+        free( p_files[i].psz_name );
+    }
+    free( p_files );
+}
+
+int ts_index_Save( vlc_object_t *p_obj, ts_index_t *p_index, const char *psz_key )
+{
+    /* An index that was used is written again, so that its date tells which
+     * ones were used least recently */
+    if( !p_index->b_dirty && !p_index->b_loaded )
+        return VLC_SUCCESS;
+
+    char *psz_dir = GetIndexDir();
+    if( !psz_dir )
+        return VLC_ENOMEM;
+
+    /* The cache directory itself may not exist yet */
+    for( char *psz = strchr( psz_dir + 1, DIR_SEP_CHAR ); psz;
+         psz = strchr( psz + 1, DIR_SEP_CHAR ) )
+    {
+        *psz = '\0';
+        vlc_mkdir( psz_dir, 0700 );
+        *psz = DIR_SEP_CHAR;
+    }
+    vlc_mkdir( psz_dir, 0700 );
+
+    char *psz_path, *psz_tmp;
+    if( asprintf( &psz_path, "%s" DIR_SEP "%s", psz_dir, psz_key ) == -1 )
+    {
+        free( psz_dir );
+        return VLC_ENOMEM;
+    }
+    if( asprintf( &psz_tmp, "%s.tmp", psz_path ) == -1 )
+    {
+        free( psz_path );
+        free( psz_dir );
+        return VLC_ENOMEM;
+    }
+
+    FILE *file = vlc_fopen( psz_tmp, "wb" );
+    if( !file )
+    {
+        msg_Dbg( p_obj, "cannot create %s: %s", psz_tmp, vlc_strerror_c(errno) );
+        goto error;
+    }
+
+    uint8_t hdr[8 + 4 + 8 + 4];
+    memcpy( hdr, TS_INDEX_MAGIC, 8 );
+    SetDWBE( &hdr[8], p_index->i_packet_size );
+    SetQWBE( &hdr[12], p_index->i_size );
+    SetDWBE( &hdr[20], p_index->i_programs );
+    bool b_ok = fwrite( hdr, sizeof(hdr), 1, file ) == 1;
+
+    for( int i = 0; b_ok && i < p_index->i_programs; i++ )
+    {
+        const ts_index_program_t *p_prog = &p_index->p_programs[i];
+        uint8_t prog[4 + 8 + 8 + 4];
+
+        SetDWBE( &prog[0], p_prog->i_number );
+        SetQWBE( &prog[4], p_prog->i_first );
+        SetQWBE( &prog[12], p_prog->i_last );
+        SetDWBE( &prog[20], p_prog->i_count );
+        b_ok = fwrite( prog, sizeof(prog), 1, file ) == 1;
+
+        for( size_t j = 0; b_ok && j < p_prog->i_count; j++ )
+        {
+            uint8_t entry[16];
+            SetQWBE( &entry[0], p_prog->p_entries[j].i_pcr );
+            SetQWBE( &entry[8], p_prog->p_entries[j].i_offset );
+            b_ok = fwrite( entry, sizeof(entry), 1, file ) == 1;
+        }
+    }
+
+    if( fclose( file ) || !b_ok || vlc_rename( psz_tmp, psz_path ) )
+    {
+        msg_Dbg( p_obj, "cannot write seek index %s", psz_path );
+        vlc_unlink( psz_tmp );
+        goto error;
+    }
+
+    p_index->b_dirty = false;
+    p_index->b_loaded = false;
+    Prune( p_obj, psz_dir, psz_key );
+    free( psz_dir );
+    free( psz_tmp );
+    free( psz_path );
+    return VLC_SUCCESS;
+
+error:
+    free( psz_dir );
+    free( psz_tmp );
+    free( psz_path );
+    return VLC_EGENERIC;
+}
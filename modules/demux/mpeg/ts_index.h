@@ -0,0 +1,57 @@
+/*****************************************************************************
+ * ts_index.h: MPEG-TS PCR to byte offset seek index
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_TS_INDEX_H
+#define VLC_TS_INDEX_H
+
+/* Minimum PCR distance between two entries of a program (90kHz units).
+ * Matches the SeekToTime() precision, so that any time falling inside an
+ * indexed range resolves without reading the stream. */
+#define TS_INDEX_INTERVAL 45000
+
+typedef struct
+{
+    int64_t  i_pcr;    /* wrapped around, 90kHz */
+    uint64_t i_offset; /* start of the TS packet carrying the PCR */
+} ts_index_entry_t;
+
+typedef struct ts_index_t ts_index_t;
+
+ts_index_t * ts_index_New( unsigned i_packet_size, uint64_t i_size );
+void ts_index_Delete( ts_index_t * );
+
+/* Records a PCR seen at a given packet offset */
+void ts_index_Add( ts_index_t *, int i_program, int64_t i_pcr, uint64_t i_offset );
+
+/* Finds the entries surrounding i_pcr. Either can be NULL if the time is
+ * before the first or after the last indexed PCR. */
+void ts_index_Lookup( const ts_index_t *, int i_program, int64_t i_pcr,
+                      const ts_index_entry_t **pp_before,
+                      const ts_index_entry_t **pp_after );
+
+/* Stream boundaries, as found by ProbeStart()/ProbeEnd() (-1 if unknown) */
+void ts_index_SetBounds( ts_index_t *, int i_program, int64_t i_first, int64_t i_last );
+bool ts_index_GetBounds( const ts_index_t *, int i_program, int64_t *pi_first, int64_t *pi_last );
+
+/* Persistence in the user cache directory, keyed on psz_key */
+int ts_index_Load( vlc_object_t *, ts_index_t *, const char *psz_key );
+int ts_index_Save( vlc_object_t *, ts_index_t *, const char *psz_key );
+
+#endif
@@ -746,6 +746,10 @@ static int Mux(sout_mux_t *p_mux)
  *****************************************************************************/
 static block_t *ConvertSUBT(block_t *p_block)
 {
+    /* The payload may be shared with other outputs (see block_Share()) */
+    p_block = block_Unshare(p_block);
+    if( !p_block )
+        return NULL;
     p_block = block_Realloc(p_block, 2, p_block->i_buffer);
     if( !p_block )
         return NULL;
@@ -767,6 +771,11 @@ static block_t *ConvertFromAnnexB(block_t *p_block)
         return NULL;
     }
 
+    /* Start codes are rewritten in place */
+    p_block = block_Unshare(p_block);
+    if( !p_block )
+        return NULL;
+
     if(memcmp(p_block->p_buffer, avc1_start_code, 4))
     {
         if(!memcmp(p_block->p_buffer, avc1_short_start_code, 3))
@@ -350,6 +350,7 @@ void EStoPES ( block_t **pp_pes,
     {
         /* For MPEG4 video, add VOL before I-frames,
            for H264 add SPS/PPS before keyframes*/
+        p_es = block_Unshare( p_es );
         p_es = block_Realloc( p_es, p_fmt->i_extra, p_es->i_buffer );
 
         memcpy( p_es->p_buffer, p_fmt->p_extra, p_fmt->i_extra );
@@ -371,6 +372,7 @@ void EStoPES ( block_t **pp_pes,
             ((p_es->p_buffer[offset] & 0x1f) != 9) ) /* Not AUD */
         {
             /* Make similar AUD as libavformat does */
+            p_es = block_Unshare( p_es );
             p_es = block_Realloc( p_es, 6, p_es->i_buffer );
             p_es->p_buffer[0] = 0x00;
             p_es->p_buffer[1] = 0x00;
@@ -0,0 +1,534 @@
+/*****************************************************************************
+ * cache_page.c: random access page cache stream filter
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_plugin.h>
+#include <vlc_stream.h>
+
+/*
+ * The source is split in fixed size pages, indexed by offset. Pages are kept
+ * in memory in LRU order, up to a configurable size. Evicted pages can be
+ * spilled to an anonymous temporary file, in LRU order as well, instead of
+ * being dropped. Demuxers jumping back and forth between an index and the
+ * payload (MP4, MKV...) thus only fetch each page once from the source.
+ */
+#define CACHE_PAGE_SIZE   65536
+#define CACHE_HASH_SIZE   4096 /* power of two */
+#define CACHE_MIN_PAGES   4
+
+typedef struct cache_page cache_page_t;
+
+struct cache_page
+{
+    uint64_t      index;  /* offset / CACHE_PAGE_SIZE */
+    size_t        length; /* valid bytes, less than a page at end of stream */
+    uint8_t      *data;   /* NULL if spilled to disk */
+    uint32_t      slot;   /* page number in the spill file */
+    cache_page_t *hash_next;
+    cache_page_t *prev;
+    cache_page_t *next;
+};
+
+typedef struct
+{
+    cache_page_t *first; /* most recently used */
+    cache_page_t *last;
+    unsigned      count;
+    unsigned      max;
+} cache_lru_t;
+
+struct stream_sys_t
+{
+    uint64_t      pos;        /* current reading offset */
+    uint64_t      source_pos; /* current offset of the source */
+    uint64_t      size;       /* 0 if unknown */
+
+    cache_page_t *hash[CACHE_HASH_SIZE];
+    cache_lru_t   mem;
+    cache_lru_t   disk;
+
+    FILE         *spill;
+    uint32_t     *free_slots;
+    unsigned      free_count;
+    uint32_t      next_slot;
+
+    struct
+    {
+        uint64_t hits;       /* pages found in memory */
+        uint64_t spill_hits; /* pages read back from the spill file */
+        uint64_t misses;     /* pages read from the source */
+        uint64_t evictions;  /* pages dropped */
+    } stat;
+};
+
+/****************************************************************************
+ * LRU lists and hash table
+ ****************************************************************************/
+static void LruRemove(cache_lru_t *lru, cache_page_t *page)
+{
+    if (page->prev != NULL)
+        page->prev->next = page->next;
+    else
+        lru->first = page->next;
+    if (page->next != NULL)
+        page->next->prev = page->prev;
+    else
+        lru->last = page->prev;
+    lru->count--;
+}
+
+static void LruPush(cache_lru_t *lru, cache_page_t *page)
+{
+    page->prev = NULL;
+    page->next = lru->first;
+    if (lru->first != NULL)
+        lru->first->prev = page;
+    else
+        lru->last = page;
+    lru->first = page;
+    lru->count++;
+}
+
+static cache_page_t **HashBucket(stream_sys_t *sys, uint64_t index)
+{
+    return &sys->hash[index & (CACHE_HASH_SIZE - 1)];
+}
+
+static cache_page_t *HashFind(stream_sys_t *sys, uint64_t index)
+{
+    for (cache_page_t *page = *HashBucket(sys, index);
+         page != NULL; page = page->hash_next)
+        if (page->index == index)
+            return page;
+    return NULL;
+}
+
+static void HashRemove(stream_sys_t *sys, cache_page_t *page)
+{
+    cache_page_t **pp = HashBucket(sys, page->index);
+
+    while (*pp != page)
+        pp = &(*pp)->hash_next;
+    *pp = page->hash_next;
+}
+
+/****************************************************************************
+ * Spill file
+ ****************************************************************************/
+static void SlotRelease(stream_sys_t *sys, uint32_t slot)
+{
+    /* free_slots has room for every slot ever handed out (disk.max) */
+    sys->free_slots[sys->free_count++] = slot;
+}
+
+static void PageDrop(stream_sys_t *sys, cache_page_t *page)
+{
+    HashRemove(sys, page);
+    if (page->data != NULL)
+        free(page->data);
+    else
+        SlotRelease(sys, page->slot);
+    free(page);
+    sys->stat.evictions++;
+}
+
+static bool PageSpill(stream_t *s, cache_page_t *page)
+{
+    stream_sys_t *sys = s->p_sys;
+
+    if (sys->disk.count >= sys->disk.max)
+    {   /* Make room in the spill file */
+        cache_page_t *old = sys->disk.last;
+
+        LruRemove(&sys->disk, old);
+        PageDrop(sys, old);
+    }
+
+    uint32_t slot = sys->free_count > 0 ? sys->free_slots[--sys->free_count]
+                                        : sys->next_slot++;
+
+    if (fseeko(sys->spill, (off_t)slot * CACHE_PAGE_SIZE, SEEK_SET)
+     || fwrite(page->data, page->length, 1, sys->spill) != 1)
+    {
+        msg_Warn(s, "cannot spill page %"PRIu64, page->index);
+        SlotRelease(sys, slot);
+        return false;
+    }
+
+    free(page->data);
+    page->data = NULL;
+    page->slot = slot;
+    LruPush(&sys->disk, page);
+    return true;
+}
+
+static bool PageUnspill(stream_t *s, cache_page_t *page)
+{
+    stream_sys_t *sys = s->p_sys;
+    uint8_t *data = malloc(CACHE_PAGE_SIZE);
+
+    if (unlikely(data == NULL))
+        return false;
+
+    if (fseeko(sys->spill, (off_t)page->slot * CACHE_PAGE_SIZE, SEEK_SET)
+     || fread(data, page->length, 1, sys->spill) != 1)
+    {
+        msg_Warn(s, "cannot read back page %"PRIu64, page->index);
+        free(data);
+        return false;
+    }
+
+    LruRemove(&sys->disk, page);
+    SlotRelease(sys, page->slot);
+    page->data = data;
+    return true;
+}
+
+/****************************************************************************
+ * Pages
+ ****************************************************************************/
+static void PageMakeRoom(stream_t *s)
+{
+    stream_sys_t *sys = s->p_sys;
+
+    while (sys->mem.count >= sys->mem.max)
+    {
+        cache_page_t *page = sys->mem.last;
+
+        LruRemove(&sys->mem, page);
+        if (sys->spill == NULL || !PageSpill(s, page))
+            PageDrop(sys, page);
+    }
+}
+
+/**
+ * Returns the page with the given index in memory, reading it if needed.
+ *
+ * A short read is only a complete page at the known end of the stream.
+ * Otherwise (I/O error, interruption), the data is returned in a page which
+ * is not cached, and which the caller must free after use. So is the empty
+ * page returned at end of stream.
+ *
+ * @param uncached set to true if the page is not cached
+ * @return the page, or NULL on error
+ */
+static cache_page_t *PageGet(stream_t *s, uint64_t index, bool *uncached)
+{
+    stream_sys_t *sys = s->p_sys;
+    cache_page_t *page = HashFind(sys, index);
+
+    *uncached = false;
+    if (page != NULL)
+    {
+        if (page->data != NULL)
+        {
+            LruRemove(&sys->mem, page);
+            LruPush(&sys->mem, page);
+            sys->stat.hits++;
+            return page;
+        }
+
+        if (PageUnspill(s, page))
+        {
+            PageMakeRoom(s);
+            LruPush(&sys->mem, page);
+            sys->stat.spill_hits++;
+            return page;
+        }
+
+        /* Unreadable, fetch it again */
+        LruRemove(&sys->disk, page);
+        PageDrop(sys, page);
+    }
+
+    sys->stat.misses++;
+
+    page = malloc(sizeof (*page));
+    if (unlikely(page == NULL))
+        return NULL;
+    page->data = malloc(CACHE_PAGE_SIZE);
+    if (unlikely(page->data == NULL))
+    {
+        free(page);
+        return NULL;
+    }
+
+    uint64_t offset = index * CACHE_PAGE_SIZE;
+    if (sys->source_pos != offset)
+    {
+        if (stream_Seek(s->p_source, offset))
+            goto error;
+        sys->source_pos = offset;
+    }
+
+    ssize_t val = stream_Read(s->p_source, page->data, CACHE_PAGE_SIZE);
+    if (val < 0)
+        goto error;
+    sys->source_pos += val;
+
+    page->index = index;
+    page->length = val;
+
+    if (val == 0)
+    {   /* End of stream */
+        page->hash_next = NULL;
+        *uncached = true;
+        return page;
+    }
+
+    if (val < CACHE_PAGE_SIZE && (sys->size == 0 || offset + val < sys->size))
+    {
+        msg_Dbg(s, "short read at %"PRIu64", not caching", offset);
+        page->hash_next = NULL;
+        *uncached = true;
+        return page;
+    }
+
+    PageMakeRoom(s);
+    cache_page_t **bucket = HashBucket(sys, index);
+    page->hash_next = *bucket;
+    *bucket = page;
+    LruPush(&sys->mem, page);
+    return page;
+
+error:
+    free(page->data);
+    free(page);
+    return NULL;
+}
+
+static void PageFlush(stream_sys_t *sys)
+{
+    for (unsigned i = 0; i < CACHE_HASH_SIZE; i++)
+    {
+        cache_page_t *page = sys->hash[i];
+
+        while (page != NULL)
+        {
+            cache_page_t *next = page->hash_next;
+
+            free(page->data);
+            free(page);
+            page = next;
+        }
+        sys->hash[i] = NULL;
+    }
+
+    sys->mem.first = sys->mem.last = NULL;
+    sys->mem.count = 0;
+    sys->disk.first = sys->disk.last = NULL;
+    sys->disk.count = 0;
+    sys->free_count = 0;
+    sys->next_slot = 0;
+}
+
+/****************************************************************************
+ * Stream callbacks
+ ****************************************************************************/
+static ssize_t Read(stream_t *s, void *buf, size_t len)
+{
+    stream_sys_t *sys = s->p_sys;
+
+    if (buf == NULL && sys->size > 0)
+    {   /* Skipping: no need to fetch anything */
+        if (sys->pos >= sys->size)
+            return 0;
+        if (len > sys->size - sys->pos)
+            len = sys->size - sys->pos;
+        sys->pos += len;
+        return len;
+    }
+
+    bool uncached;
+    cache_page_t *page = PageGet(s, sys->pos / CACHE_PAGE_SIZE, &uncached);
+    if (page == NULL)
+        return -1;
+
+    size_t offset = sys->pos % CACHE_PAGE_SIZE;
+    size_t copy = 0;
+
+    if (offset < page->length) /* otherwise EOF */
+    {
+        copy = page->length - offset;
+        if (copy > len)
+            copy = len;
+        if (buf != NULL)
+            memcpy(buf, page->data + offset, copy);
+        sys->pos += copy;
+    }
+
+    if (uncached)
+    {
+        free(page->data);
+        free(page);
+    }
+    return copy;
+}
+
+static int Seek(stream_t *s, uint64_t offset)
+{
+    stream_sys_t *sys = s->p_sys;
+
+    sys->pos = offset;
+    return VLC_SUCCESS;
+}
+
+static int Control(stream_t *s, int query, va_list args)
+{
+    stream_sys_t *sys = s->p_sys;
+
+    switch (query)
+    {
+        case STREAM_CAN_SEEK:
+        case STREAM_CAN_FASTSEEK:
+        case STREAM_CAN_PAUSE:
+        case STREAM_CAN_CONTROL_PACE:
+        case STREAM_IS_DIRECTORY:
+        case STREAM_GET_SIZE:
+        case STREAM_GET_PTS_DELAY:
+        case STREAM_GET_TITLE_INFO:
+        case STREAM_GET_TITLE:
+        case STREAM_GET_SEEKPOINT:
+        case STREAM_GET_META:
+        case STREAM_GET_CONTENT_TYPE:
+        case STREAM_GET_SIGNAL:
+        case STREAM_GET_RECV_STATS:
+        case STREAM_SET_PAUSE_STATE:
+        case STREAM_SET_PRIVATE_ID_STATE:
+        case STREAM_SET_PRIVATE_ID_CA:
+        case STREAM_GET_PRIVATE_ID_STATE:
+            return stream_vaControl(s->p_source, query, args);
+
+        case STREAM_SET_TITLE:
+        case STREAM_SET_SEEKPOINT:
+        {
+            /* Offsets now refer to other data */
+            int ret = stream_vaControl(s->p_source, query, args);
+            if (ret == VLC_SUCCESS)
+            {
+                PageFlush(sys);
+                sys->pos = sys->source_pos = stream_Tell(s->p_source);
+                if (stream_GetSize(s->p_source, &sys->size))
+                    sys->size = 0;
+            }
+            return ret;
+        }
+
+        default:
+            msg_Err(s, "invalid stream_vaControl query=0x%x", query);
+            return VLC_EGENERIC;
+    }
+}
+
+static int Open(vlc_object_t *obj)
+{
+    stream_t *s = (stream_t *)obj;
+    bool can_seek;
+
+    /* Nothing to gain on streams that can only be read once */
+    if (stream_Control(s->p_source, STREAM_CAN_SEEK, &can_seek) || !can_seek)
+        return VLC_EGENERIC;
+
+    stream_sys_t *sys = calloc(1, sizeof (*sys));
+    if (unlikely(sys == NULL))
+        return VLC_ENOMEM;
+
+    sys->pos = sys->source_pos = stream_Tell(s->p_source);
+    if (stream_GetSize(s->p_source, &sys->size))
+        sys->size = 0;
+
+    sys->mem.max = (var_InheritInteger(s, "page-cache-size") << 10)
+                   / CACHE_PAGE_SIZE;
+    if (sys->mem.max < CACHE_MIN_PAGES)
+        sys->mem.max = CACHE_MIN_PAGES;
+
+    sys->disk.max = (var_InheritInteger(s, "page-cache-spill") << 20)
+                    / CACHE_PAGE_SIZE;
+    if (sys->disk.max > 0)
+    {
+        sys->free_slots = malloc(sys->disk.max * sizeof (*sys->free_slots));
+        sys->spill = tmpfile();
+        if (sys->free_slots == NULL || sys->spill == NULL)
+        {
+            msg_Warn(s, "cannot create spill file, using memory only");
+            if (sys->spill != NULL)
+                fclose(sys->spill);
+            free(sys->free_slots);
+            sys->spill = NULL;
+            sys->free_slots = NULL;
+            sys->disk.max = 0;
+        }
+    }
+
+    msg_Dbg(s, "caching up to %u pages of %u bytes in memory, %u on disk",
+            sys->mem.max, CACHE_PAGE_SIZE, sys->disk.max);
+
+    s->p_sys = sys;
+    s->pf_read = Read;
+    s->pf_seek = Seek;
+    s->pf_control = Control;
+    return VLC_SUCCESS;
+}
+
+static void Close(vlc_object_t *obj)
+{
+    stream_t *s = (stream_t *)obj;
+    stream_sys_t *sys = s->p_sys;
+    uint64_t total = sys->stat.hits + sys->stat.spill_hits + sys->stat.misses;
+
+    if (total > 0)
+        msg_Dbg(s, "%"PRIu64" page lookups, %"PRIu64" hits (%.1f%%), %"PRIu64
+                " from disk, %"PRIu64" misses, %"PRIu64" evictions", total,
+                sys->stat.hits, 100. * sys->stat.hits / total,
+                sys->stat.spill_hits, sys->stat.misses, sys->stat.evictions);
+
+    PageFlush(sys);
+    if (sys->spill != NULL)
+        fclose(sys->spill);
+    free(sys->free_slots);
+    free(sys);
+}
+
+vlc_module_begin()
+    set_category(CAT_INPUT)
+    set_subcategory(SUBCAT_INPUT_STREAM_FILTER)
+    set_capability("stream_filter", 0)
+
+    set_description(N_("Random access page cache"))
+    set_callbacks(Open, Close)
+
+    add_integer("page-cache-size", 1 << 16, N_("Memory cache size"),
+                N_("Maximum amount of memory used to cache the stream (KiB)"),
+                true)
+        change_integer_range(256, 1 << 22)
+    add_integer("page-cache-spill", 0, N_("Disk cache size"),
+                N_("Maximum size of the temporary file receiving pages evicted "
+                   "from memory (MiB, 0 disables)"), true)
+        change_integer_range(0, 1 << 20)
+vlc_module_end()
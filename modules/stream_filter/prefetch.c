@@ -51,6 +51,28 @@
 #include <vlc_stream.h>
 #include <vlc_fs.h>
 #include <vlc_interrupt.h>
+#include <vlc_access.h>
+
+#define MAX_CHUNKS 64
+#define MIN_CHUNK_SIZE 65536
+
+/* One of the concurrent ranged readers (parallel mode) */
+struct prefetch_reader
+{
+    stream_t        *stream;
+    access_t        *access;
+    vlc_thread_t     thread;
+    vlc_interrupt_t *interrupt;
+    char            *buffer; /* landing area, read_size bytes */
+};
+
+/* A range of the source scheduled to a reader (parallel mode) */
+struct prefetch_chunk
+{
+    uint64_t     offset;
+    size_t       length;
+    size_t       done;
+};
 
 struct stream_sys_t
 {
@@ -78,6 +100,28 @@ struct stream_sys_t
     char        *buffer;
     size_t       read_size;
     size_t       seek_threshold;
+
+    /* Parallel mode: ranges are scheduled up to fetch_offset, and committed
+     * to the buffer in order as the readers complete them. */
+    struct prefetch_reader *readers;
+    unsigned     reader_count;
+    uint64_t     fetch_offset;
+    uint64_t     end_offset;
+    unsigned     generation; /* bumped whenever scheduled ranges are dropped */
+    struct prefetch_chunk chunks[MAX_CHUNKS];
+    unsigned     chunk_head;
+    unsigned     chunk_count;
+    size_t       chunk_size;
+    mtime_t      latency; /* mean time to first byte of a range */
+    uint64_t     rate;    /* mean throughput of a single reader (bytes/s) */
+
+    struct
+    {
+        uint64_t hits;   /* reads served without waiting */
+        uint64_t misses; /* reads that had to wait for data */
+        mtime_t  stall;  /* total time spent waiting */
+        uint64_t chunks; /* ranges fetched (parallel mode) */
+    } stats;
 };
 
 static int ThreadRead(stream_t *stream, size_t length)
@@ -269,6 +313,270 @@ static void *Thread(void *data)
     return NULL;
 }
 
+/**
+ * Moves completed data at the head of the scheduled ranges into the buffer.
+ */
+static void ParallelCommit(stream_sys_t *sys)
+{
+    while (sys->chunk_count > 0)
+    {
+        struct prefetch_chunk *chunk = &sys->chunks[sys->chunk_head];
+        uint64_t end = chunk->offset + chunk->done;
+
+        assert(chunk->offset <= sys->buffer_offset + sys->buffer_length);
+        if (end > sys->buffer_offset + sys->buffer_length)
+            sys->buffer_length = end - sys->buffer_offset;
+        if (chunk->done < chunk->length)
+            break;
+
+        sys->chunk_head = (sys->chunk_head + 1) % MAX_CHUNKS;
+        sys->chunk_count--;
+    }
+
+    assert(sys->buffer_length <= sys->buffer_size);
+    sys->eof = sys->buffer_offset + sys->buffer_length >= sys->end_offset;
+}
+
+/**
+ * Picks the next range to fetch, if any.
+ * @return the chunk index, or -1 if the reader shall wait.
+ */
+static int ParallelSchedule(stream_sys_t *sys)
+{
+    /* Drop everything on seeks outside the buffered and scheduled data */
+    if (sys->stream_offset < sys->buffer_offset
+     || sys->stream_offset > sys->fetch_offset + sys->seek_threshold)
+    {
+        sys->buffer_offset = sys->stream_offset;
+        sys->buffer_length = 0;
+        sys->fetch_offset = sys->stream_offset;
+        sys->chunk_count = 0;
+        sys->generation++;
+        sys->eof = sys->stream_offset >= sys->end_offset;
+    }
+
+    if (sys->fetch_offset >= sys->end_offset || sys->chunk_count >= MAX_CHUNKS)
+        return -1;
+
+    size_t length = __MIN(sys->chunk_size, sys->buffer_size);
+    if (length > sys->end_offset - sys->fetch_offset)
+        length = sys->end_offset - sys->fetch_offset;
+
+    /* Do not run further ahead of the reader than the buffer allows,
+     * discarding already read data if needed */
+    size_t window = sys->fetch_offset - sys->buffer_offset;
+    if (window + length > sys->buffer_size)
+    {
+        uint64_t end = sys->buffer_offset + sys->buffer_length;
+        uint64_t history = __MIN(sys->stream_offset, end) - sys->buffer_offset;
+        size_t discard = window + length - sys->buffer_size;
+
+        if (history < discard)
+            return -1;
+        sys->buffer_offset += discard;
+        sys->buffer_length -= discard;
+    }
+
+    unsigned index = (sys->chunk_head + sys->chunk_count++) % MAX_CHUNKS;
+    struct prefetch_chunk *chunk = &sys->chunks[index];
+
+    chunk->offset = sys->fetch_offset;
+    chunk->length = length;
+    chunk->done = 0;
+    sys->fetch_offset += length;
+    return index;
+}
+
+/**
+ * Adapts the range size to the measured latency and throughput, so that the
+ * request round trip stays small compared to the transfer time.
+ */
+static void ParallelAdapt(stream_sys_t *sys, mtime_t latency,
+                          size_t length, mtime_t duration)
+{
+    if (duration <= 0)
+        duration = 1;
+
+    sys->latency = (7 * sys->latency + latency) / 8;
+    sys->rate = (7 * sys->rate + length * CLOCK_FREQ / duration) / 8;
+
+    uint64_t size = 4 * sys->rate * sys->latency / CLOCK_FREQ;
+    uint64_t max = sys->buffer_size / (2 * sys->reader_count);
+
+    if (size > max)
+        size = max;
+    if (size < MIN_CHUNK_SIZE)
+        size = MIN_CHUNK_SIZE;
+    sys->chunk_size = size;
+}
+
+static void *ReaderThread(void *data)
+{
+    struct prefetch_reader *reader = data;
+    stream_t *stream = reader->stream;
+    stream_sys_t *sys = stream->p_sys;
+
+    vlc_interrupt_set(reader->interrupt);
+
+    vlc_mutex_lock(&sys->lock);
+    mutex_cleanup_push(&sys->lock);
+    for (;;)
+    {
+        int index = ParallelSchedule(sys);
+        if (index < 0)
+        {
+            vlc_cond_wait(&sys->wait_space, &sys->lock);
+            continue;
+        }
+
+        struct prefetch_chunk *chunk = &sys->chunks[index];
+        unsigned generation = sys->generation;
+        uint64_t offset = chunk->offset;
+        size_t length = chunk->length;
+        size_t done = 0;
+        unsigned failures = 0;
+        mtime_t start = mdate(), first = 0;
+        bool error = false;
+
+        int canc = vlc_savecancel();
+        vlc_mutex_unlock(&sys->lock);
+
+        if (vlc_access_Seek(reader->access, offset))
+        {
+            msg_Err(stream, "cannot seek (to offset %"PRIu64")", offset);
+            error = true;
+        }
+
+        while (!error && done < length)
+        {
+            size_t size = __MIN(length - done, sys->read_size);
+            ssize_t val = vlc_access_Read(reader->access, reader->buffer, size);
+
+            if (val < 0)
+            {   /* Transient errors are to be ignored */
+                if (vlc_killed() || ++failures > 10)
+                    error = true;
+                continue;
+            }
+            failures = 0;
+            if (first == 0)
+                first = mdate();
+
+            vlc_mutex_lock(&sys->lock);
+            if (sys->generation != generation)
+            {   /* Range was dropped by a seek */
+                vlc_mutex_unlock(&sys->lock);
+                break;
+            }
+
+            if (val == 0)
+            {   /* Shorter source than advertised */
+                msg_Dbg(stream, "end of stream at %"PRIu64, offset + done);
+                chunk->length = chunk->done;
+                if (sys->end_offset > offset + done)
+                    sys->end_offset = offset + done;
+                length = done;
+            }
+            else
+            {
+                memcpy(sys->buffer + ((offset + done) % sys->buffer_size),
+                       reader->buffer, val);
+                done += val;
+                chunk->done = done;
+            }
+            ParallelCommit(sys);
+            vlc_cond_signal(&sys->wait_data);
+            vlc_mutex_unlock(&sys->lock);
+        }
+
+        vlc_mutex_lock(&sys->lock);
+        vlc_restorecancel(canc);
+
+        if (error)
+            break;
+        if (done == length && done > 0)
+        {
+            ParallelAdapt(sys, first - start, length, mdate() - first);
+            sys->stats.chunks++;
+        }
+        /* Space may have been freed for other readers */
+        vlc_cond_broadcast(&sys->wait_space);
+    }
+    vlc_cleanup_pop();
+
+    sys->error = true;
+    vlc_cond_signal(&sys->wait_data);
+    vlc_mutex_unlock(&sys->lock);
+    return NULL;
+}
+
+static void ParallelStop(stream_t *stream, unsigned count)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        vlc_cancel(sys->readers[i].thread);
+        vlc_interrupt_kill(sys->readers[i].interrupt);
+    }
+    for (unsigned i = 0; i < count; i++)
+        vlc_join(sys->readers[i].thread, NULL);
+}
+
+static void ParallelRelease(stream_t *stream, unsigned count)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        struct prefetch_reader *reader = &sys->readers[i];
+
+        if (reader->interrupt != NULL)
+            vlc_interrupt_destroy(reader->interrupt);
+        if (reader->access != NULL)
+            vlc_access_Delete(reader->access);
+        free(reader->buffer);
+    }
+    free(sys->readers);
+    sys->readers = NULL;
+}
+
+/**
+ * Opens one extra connection per reader to the source.
+ * @return the number of readers set up (0 if parallel mode is not usable)
+ */
+static unsigned ParallelSetup(stream_t *stream, unsigned count)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    if (count < 2 || !sys->can_seek || sys->size == 0
+     || stream->psz_url == NULL)
+        return 0;
+
+    sys->readers = calloc(count, sizeof (*sys->readers));
+    if (unlikely(sys->readers == NULL))
+        return 0;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        struct prefetch_reader *reader = &sys->readers[i];
+
+        reader->stream = stream;
+        reader->access = vlc_access_NewMRL(VLC_OBJECT(stream), stream->psz_url);
+        reader->interrupt = vlc_interrupt_create();
+        reader->buffer = malloc(sys->read_size);
+        if (reader->access == NULL || reader->access->pf_read == NULL
+         || reader->access->pf_seek == NULL || reader->interrupt == NULL
+         || reader->buffer == NULL)
+        {
+            msg_Dbg(stream, "cannot set up range reader %u", i);
+            ParallelRelease(stream, count);
+            return 0;
+        }
+    }
+    return count;
+}
+
 static int Seek(stream_t *stream, uint64_t offset)
 {
     stream_sys_t *sys = stream->p_sys;
@@ -277,7 +585,7 @@ static int Seek(stream_t *stream, uint64_t offset)
     if (sys->stream_offset != offset)
     {
         sys->stream_offset = offset;
-        vlc_cond_signal(&sys->wait_space);
+        vlc_cond_broadcast(&sys->wait_space);
     }
     vlc_mutex_unlock(&sys->lock);
     return 0;
@@ -316,9 +624,11 @@ static ssize_t Read(stream_t *stream, void *buf, size_t buflen)
     {
         msg_Err(stream, "reading while paused (buggy demux?)");
         sys->paused = false;
-        vlc_cond_signal(&sys->wait_space);
+        vlc_cond_broadcast(&sys->wait_space);
     }
 
+    mtime_t stall = 0;
+
     while ((copy = BufferLevel(stream, &eof)) == 0 && !eof)
     {
         void *data[2];
@@ -329,11 +639,21 @@ static ssize_t Read(stream_t *stream, void *buf, size_t buflen)
             return -1;
         }
 
+        if (stall == 0)
+            stall = mdate();
         vlc_interrupt_forward_start(sys->interrupt, data);
         vlc_cond_wait(&sys->wait_data, &sys->lock);
         vlc_interrupt_forward_stop(data);
     }
 
+    if (stall != 0)
+    {
+        sys->stats.misses++;
+        sys->stats.stall += mdate() - stall;
+    }
+    else
+        sys->stats.hits++;
+
     char *p = sys->buffer + (sys->stream_offset % sys->buffer_size);
     if (copy > buflen)
         copy = buflen;
@@ -341,7 +661,7 @@ static ssize_t Read(stream_t *stream, void *buf, size_t buflen)
     {
         memcpy(buf, p, copy);
         sys->stream_offset += copy;
-        vlc_cond_signal(&sys->wait_space);
+        vlc_cond_broadcast(&sys->wait_space);
     }
     vlc_mutex_unlock(&sys->lock);
     return copy;
@@ -390,6 +710,7 @@ static int Control(stream_t *stream, int query, va_list args)
             *va_arg(args, char **) = strdup(sys->content_type);
             return VLC_SUCCESS;
         case STREAM_GET_SIGNAL:
+        case STREAM_GET_RECV_STATS:
             return VLC_EGENERIC;
         case STREAM_SET_PAUSE_STATE:
         {
@@ -397,7 +718,7 @@ static int Control(stream_t *stream, int query, va_list args)
 
             vlc_mutex_lock(&sys->lock);
             sys->paused = paused;
-            vlc_cond_signal(&sys->wait_space);
+            vlc_cond_broadcast(&sys->wait_space);
             vlc_mutex_unlock (&sys->lock);
             break;
         }
@@ -461,6 +782,17 @@ static int Open(vlc_object_t *obj)
     sys->buffer_size = var_InheritInteger(obj, "prefetch-buffer-size") << 10u;
     sys->read_size = var_InheritInteger(obj, "prefetch-read-size");
     sys->seek_threshold = var_InheritInteger(obj, "prefetch-seek-threshold");
+    sys->readers = NULL;
+    sys->reader_count = 0;
+    sys->fetch_offset = 0;
+    sys->end_offset = sys->size;
+    sys->generation = 0;
+    sys->chunk_head = 0;
+    sys->chunk_count = 0;
+    sys->chunk_size = MIN_CHUNK_SIZE;
+    sys->latency = 0;
+    sys->rate = 0;
+    memset(&sys->stats, 0, sizeof (sys->stats));
 
     uint64_t size = stream_Size(stream->p_source);
     if (size > 0)
@@ -554,7 +886,21 @@ static int Open(vlc_object_t *obj)
 
     stream->p_sys = sys;
 
-    if (vlc_clone(&sys->thread, Thread, stream, VLC_THREAD_PRIORITY_LOW))
+    unsigned count = ParallelSetup(stream,
+                                   var_InheritInteger(obj, "prefetch-readers"));
+    for (unsigned i = 0; i < count; i++)
+        if (vlc_clone(&sys->readers[i].thread, ReaderThread,
+                      &sys->readers[i], VLC_THREAD_PRIORITY_LOW))
+        {
+            ParallelStop(stream, i);
+            ParallelRelease(stream, count);
+            count = 0;
+            break;
+        }
+    sys->reader_count = count;
+
+    if (count == 0
+     && vlc_clone(&sys->thread, Thread, stream, VLC_THREAD_PRIORITY_LOW))
     {
         vlc_cond_destroy(&sys->wait_space);
         vlc_cond_destroy(&sys->wait_data);
@@ -563,8 +909,8 @@ static int Open(vlc_object_t *obj)
         goto error;
     }
 
-    msg_Dbg(stream, "using %zu bytes buffer, %zu bytes read",
-            sys->buffer_size, sys->read_size);
+    msg_Dbg(stream, "using %zu bytes buffer, %zu bytes read, %u range readers",
+            sys->buffer_size, sys->read_size, count);
     stream->pf_read = Read;
     stream->pf_readdir = ReadDir;
     stream->pf_control = Control;
@@ -594,9 +940,22 @@ static void Close (vlc_object_t *obj)
     stream_t *stream = (stream_t *)obj;
     stream_sys_t *sys = stream->p_sys;
 
-    vlc_cancel(sys->thread);
-    vlc_interrupt_kill(sys->interrupt);
-    vlc_join(sys->thread, NULL);
+    if (sys->reader_count > 0)
+    {
+        ParallelStop(stream, sys->reader_count);
+        msg_Dbg(stream, "%"PRIu64" ranges of %zu bytes, latency %"PRId64" us, "
+                "%"PRIu64" bytes/s per reader", sys->stats.chunks,
+                sys->chunk_size, sys->latency, sys->rate);
+        ParallelRelease(stream, sys->reader_count);
+    }
+    else
+    {
+        vlc_cancel(sys->thread);
+        vlc_interrupt_kill(sys->interrupt);
+        vlc_join(sys->thread, NULL);
+    }
+    msg_Dbg(stream, "%"PRIu64" reads hit, %"PRIu64" missed, stalled %"PRId64
+            " ms", sys->stats.hits, sys->stats.misses, sys->stats.stall / 1000);
     vlc_interrupt_destroy(sys->interrupt);
     vlc_cond_destroy(&sys->wait_space);
     vlc_cond_destroy(&sys->wait_data);
@@ -629,4 +988,8 @@ vlc_module_begin()
     add_integer("prefetch-seek-threshold", 1 << 14, N_("Seek threshold"),
                 N_("Prefetch forward seek threshold (bytes)"), true)
         change_integer_range(0, UINT64_C(1) << 60)
+    add_integer("prefetch-readers", 1, N_("Range readers"),
+                N_("Concurrent ranged reads on seekable sources (1 disables)"),
+                true)
+        change_integer_range(1, 16)
 vlc_module_end()
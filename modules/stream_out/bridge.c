@@ -595,6 +595,9 @@ static int SendIn( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
         if ( p_bridge->pp_es[i]->id != NULL || p_sys->b_placeholder)
         {
             block_t *p_block = p_bridge->pp_es[i]->p_block;
+            /* Only the block headers are modified here: the payloads may be
+             * shared with other outputs (see block_Share()), and are passed
+             * along without copies. */
             while ( p_block != NULL )
             {
                 p_bridge->pp_es[i]->i_last = p_block->i_dts;
@@ -186,7 +186,11 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
             else
                 p_buffer->i_pts += p_sys->i_delay;
 
-            input_DecoderDecode( (decoder_t *)id, p_buffer, false );
+            /* Decoders may work in place on a payload shared with other
+             * outputs */
+            p_buffer = block_Unshare( p_buffer );
+            if( likely(p_buffer != NULL) )
+                input_DecoderDecode( (decoder_t *)id, p_buffer, false );
         }
 
         p_buffer = p_next;
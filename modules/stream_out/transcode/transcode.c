@@ -640,6 +640,11 @@ static int Send( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
         return VLC_EGENERIC;
     }
 
+    /* Decoders may work in place on a payload shared with other outputs */
+    p_buffer = block_Unshare( p_buffer );
+    if( unlikely(p_buffer == NULL) )
+        return VLC_ENOMEM;
+
     switch( id->p_decoder->fmt_in.i_cat )
     {
     case AUDIO_ES:
@@ -42,12 +42,182 @@
 #include <libvlc.h>
 #include "aout_internal.h"
 
+/*
+ * Output buffers of the filters are recycled, so that the pipeline does not
+ * hit the heap in steady state. A few buffers are allocated up-front, and
+ * more on demand when the audio output holds on to them, up to a limit.
+ * Buffers are returned to the pool when released, from any thread, even
+ * after the filters are destroyed.
+ */
+#define AOUT_BUFFERS_INIT 4
+#define AOUT_BUFFERS_MAX 32
+
+/** Initial payload duration of the buffers */
+#define AOUT_BUFFERS_LENGTH (CLOCK_FREQ / 25)
+
+#define AOUT_BUFFER_ALIGN 32
+#define AOUT_BUFFER_PADDING 32
+
+typedef struct aout_buffer aout_buffer_t;
+typedef struct aout_buffers aout_buffers_t;
+
+struct aout_buffer
+{
+    block_t self;
+    aout_buffers_t *pool;
+    aout_buffer_t *next;
+    size_t size; /**< Payload capacity */
+};
+
+struct aout_buffers
+{
+    vlc_mutex_t lock;
+    unsigned refs; /**< The filters, plus one per buffer in use */
+    unsigned count; /**< Allocated buffers */
+    aout_buffer_t *first; /**< Free buffers */
+};
+
+static aout_buffer_t *aout_BufferResize (aout_buffer_t *buf, size_t size)
+{
+    size_t alloc = sizeof (*buf) + AOUT_BUFFER_ALIGN
+                 + (2 * AOUT_BUFFER_PADDING) + size;
+    if (unlikely(alloc <= size))
+        return NULL;
+
+    buf = realloc (buf, alloc);
+    if (likely(buf != NULL))
+        buf->size = size;
+    return buf;
+}
+
+static void aout_BuffersDestroy (aout_buffers_t *pool)
+{
+    for (aout_buffer_t *buf = pool->first, *next; buf != NULL; buf = next)
+    {
+        next = buf->next;
+        free (buf);
+    }
+    vlc_mutex_destroy (&pool->lock);
+    free (pool);
+}
+
+static aout_buffers_t *aout_BuffersNew (size_t size)
+{
+    aout_buffers_t *pool = malloc (sizeof (*pool));
+    if (unlikely(pool == NULL))
+        return NULL;
+
+    vlc_mutex_init (&pool->lock);
+    pool->refs = 1;
+    pool->count = 0;
+    pool->first = NULL;
+
+    while (pool->count < AOUT_BUFFERS_INIT)
+    {
+        aout_buffer_t *buf = aout_BufferResize (NULL, size);
+        if (unlikely(buf == NULL))
+        {
+            aout_BuffersDestroy (pool);
+            return NULL;
+        }
+        buf->pool = pool;
+        buf->next = pool->first;
+        pool->first = buf;
+        pool->count++;
+    }
+    return pool;
+}
+
+static void aout_BuffersRelease (aout_buffers_t *pool)
+{
+    vlc_mutex_lock (&pool->lock);
+    bool last = --pool->refs == 0;
+    vlc_mutex_unlock (&pool->lock);
+
+    if (last)
+        aout_BuffersDestroy (pool);
+}
+
+static void aout_BufferRelease (block_t *block)
+{
+    aout_buffer_t *buf = (aout_buffer_t *)block;
+    aout_buffers_t *pool = buf->pool;
+
+    vlc_mutex_lock (&pool->lock);
+    buf->next = pool->first;
+    pool->first = buf;
+    vlc_mutex_unlock (&pool->lock);
+
+    aout_BuffersRelease (pool);
+}
+
+static block_t *aout_BuffersAlloc (aout_buffers_t *pool, size_t size)
+{
+    vlc_mutex_lock (&pool->lock);
+    aout_buffer_t *buf = pool->first;
+    if (buf != NULL)
+        pool->first = buf->next;
+    else
+    if (pool->count < AOUT_BUFFERS_MAX)
+        pool->count++;
+    else
+    {   /* The audio output is holding too many buffers */
+        vlc_mutex_unlock (&pool->lock);
+        return block_Alloc (size);
+    }
+    pool->refs++;
+    vlc_mutex_unlock (&pool->lock);
+
+    if (buf == NULL || buf->size < size)
+    {
+        aout_buffer_t *nbuf = aout_BufferResize (buf, size);
+        if (unlikely(nbuf == NULL))
+        {
+            vlc_mutex_lock (&pool->lock);
+            if (buf != NULL)
+            {
+                buf->next = pool->first;
+                pool->first = buf;
+            }
+            else
+                pool->count--;
+            vlc_mutex_unlock (&pool->lock);
+            aout_BuffersRelease (pool);
+            return NULL;
+        }
+        buf = nbuf;
+        buf->pool = pool;
+    }
+
+    block_t *block = &buf->self;
+    block_Init (block, buf + 1, buf->size + AOUT_BUFFER_ALIGN
+                                + (2 * AOUT_BUFFER_PADDING));
+    block->p_buffer += AOUT_BUFFER_PADDING + AOUT_BUFFER_ALIGN - 1;
+    block->p_buffer = (void *)(((uintptr_t)block->p_buffer)
+                               & ~(AOUT_BUFFER_ALIGN - 1));
+    block->i_buffer = size;
+    block->pf_release = aout_BufferRelease;
+    return block;
+}
+
+/** Filter with the pipeline buffers */
+typedef struct
+{
+    filter_t filter;
+    aout_buffers_t *buffers;
+} aout_filter_t;
+
+static block_t *aout_FilterBufferNew (filter_t *filter, size_t size)
+{
+    return aout_BuffersAlloc (((aout_filter_t *)filter)->buffers, size);
+}
+
 static filter_t *CreateFilter (vlc_object_t *obj, const char *type,
                                const char *name, filter_owner_sys_t *owner,
                                const audio_sample_format_t *infmt,
                                const audio_sample_format_t *outfmt)
 {
-    filter_t *filter = vlc_custom_create (obj, sizeof (*filter), type);
+    filter_t *filter = vlc_custom_create (obj, sizeof (aout_filter_t), type);
     if (unlikely(filter == NULL))
         return NULL;
 
@@ -281,8 +451,51 @@ struct aout_filters
     unsigned count; /**< Number of filters */
     filter_t *tab[AOUT_MAX_FILTERS]; /**< Configured user filters
         (e.g. equalization) and their conversions */
+    aout_buffers_t *buffers; /**< Output buffers of the filters */
 };
 
+static void aout_FilterSetBuffers (filter_t *filter, aout_buffers_t *buffers)
+{
+    ((aout_filter_t *)filter)->buffers = buffers;
+    filter->owner.audio.buffer_new = aout_FilterBufferNew;
+}
+
+/**
+ * Allocates the buffers recycled by the filters.
+ * If that fails, the filters allocate their own buffers.
+ */
+static void aout_FiltersSetBuffers (aout_filters_t *filters)
+{
+    size_t size = 0;
+
+    for (unsigned i = 0; i <= filters->count; i++)
+    {
+        filter_t *filter = (i < filters->count) ? filters->tab[i]
+                                                : filters->resampler;
+        if (filter == NULL)
+            continue;
+
+        const audio_sample_format_t *fmt = &filter->fmt_out.audio;
+        if (fmt->i_frame_length == 0)
+            continue;
+        size = __MAX(size, (uint64_t)fmt->i_rate * fmt->i_bytes_per_frame
+                           * AOUT_BUFFERS_LENGTH
+                           / (fmt->i_frame_length * CLOCK_FREQ));
+    }
+
+    if (size == 0)
+        return;
+
+    filters->buffers = aout_BuffersNew (size);
+    if (unlikely(filters->buffers == NULL))
+        return;
+
+    for (unsigned i = 0; i < filters->count; i++)
+        aout_FilterSetBuffers (filters->tab[i], filters->buffers);
+    if (filters->resampler != NULL)
+        aout_FilterSetBuffers (filters->resampler, filters->buffers);
+}
+
 /** Callback for visualization selection */
 static int VisualizationCallback (vlc_object_t *obj, const char *var,
                                   vlc_value_t oldval, vlc_value_t newval,
@@ -392,6 +605,7 @@ aout_filters_t *aout_FiltersNew (vlc_object_t *obj,
     filters->resampler = NULL;
     filters->resampling = 0;
     filters->count = 0;
+    filters->buffers = NULL;
 
     /* Prepare format structure */
     aout_FormatPrint (obj, "input", infmt);
@@ -415,6 +629,7 @@ aout_filters_t *aout_FiltersNew (vlc_object_t *obj,
                 goto error;
             }
             filters->count++;
+            aout_FiltersSetBuffers (filters);
         }
         return filters;
     }
@@ -471,6 +686,7 @@ aout_filters_t *aout_FiltersNew (vlc_object_t *obj,
     if (filters->rate_filter == NULL)
         filters->rate_filter = filters->resampler;
 
+    aout_FiltersSetBuffers (filters);
     return filters;
 
 error:
@@ -495,6 +711,8 @@ void aout_FiltersDelete (vlc_object_t *obj, aout_filters_t *filters)
     if (filters->resampler != NULL)
         aout_FiltersPipelineDestroy (&filters->resampler, 1);
     aout_FiltersPipelineDestroy (filters->tab, filters->count);
+    if (filters->buffers != NULL)
+        aout_BuffersRelease (filters->buffers);
     if (obj != NULL)
         var_DelCallback (obj, "visual", VisualizationCallback, NULL);
     free (filters);
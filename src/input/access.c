@@ -288,6 +288,7 @@ static int AStreamControl(stream_t *s, int cmd, va_list args)
     static_control_match(GET_META);
     static_control_match(GET_CONTENT_TYPE);
     static_control_match(GET_SIGNAL);
+    static_control_match(GET_RECV_STATS);
     static_control_match(SET_PAUSE_STATE);
     static_control_match(SET_TITLE);
     static_control_match(SET_SEEKPOINT);
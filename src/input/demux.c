@@ -32,6 +32,10 @@
 #include <vlc_url.h>
 #include <vlc_modules.h>
 #include <vlc_strings.h>
+#include "../modules/modules.h"
+
+/* Amount of data made available at once to the probed demuxers */
+#define DEMUX_PROBE_SIZE 16384
 
 static bool SkipID3Tag( demux_t * );
 static bool SkipAPETag( demux_t *p_demux );
@@ -195,16 +199,34 @@ demux_t *demux_New( vlc_object_t *p_obj, input_thread_t *p_parent_input,
             }
         }
 
+        /* Read the probe window at once when the source has a known size
+         * (i.e. is not live): the candidates below then peek, and seek back
+         * within it, from memory instead of issuing many small reads. */
+        const uint8_t *p_probe;
+        ssize_t i_probe = 0;
+
+        if( stream_Size( s ) > 0 )
+            i_probe = stream_Peek( s, &p_probe, DEMUX_PROBE_SIZE );
+
         /* ID3/APE tags will mess-up demuxer probing so we skip it here.
          * ID3/APE parsers will called later on in the demuxer to access the
          * skipped info. */
+        bool b_tag = false;
         while (SkipID3Tag( p_demux ))
-          ;
-        SkipAPETag( p_demux );
+            b_tag = true;
+        b_tag |= SkipAPETag( p_demux );
+
+        if( i_probe > 0 && b_tag )
+            i_probe = stream_Peek( s, &p_probe, DEMUX_PROBE_SIZE );
 
+        /* Slow probes (e.g. of a remote file) show up here, along with the
+         * time each rejected demuxer took */
+        const mtime_t i_start = mdate();
         p_demux->p_module =
-            module_need( p_demux, "demux", psz_module,
-                         !strcmp( psz_module, p_demux->psz_demux ) );
+            module_need_timed( p_demux, "demux", psz_module,
+                               !strcmp( psz_module, p_demux->psz_demux ) );
+        msg_Dbg( p_demux, "demux probing took %"PRId64" us",
+                 mdate() - i_start );
     }
     else
     {
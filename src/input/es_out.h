@@ -65,7 +65,8 @@ enum es_out_query_private_e
     /* Set rate */
     ES_OUT_SET_RATE,                                /* arg1=int i_source_rate arg2=int i_rate                  res=can fail */
 
-    /* Set a new time */
+    /* Set a new time: -1 resets the output, a time seeks within the
+     * timeshift buffer */
     ES_OUT_SET_TIME,                                /* arg1=mtime_t             res=can fail */
 
     /* Set next frame */
@@ -32,11 +32,15 @@
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #if defined (_WIN32)
 #  include <direct.h>
 #endif
 #include <sys/stat.h>
 #include <unistd.h>
+#ifdef HAVE_MMAP
+#   include <sys/mman.h>
+#endif
 
 #include <vlc_common.h>
 #include <vlc_fs.h>
@@ -69,6 +73,13 @@ enum
     C_CONTROL,
 };
 
+/* Flags of the commands passed over by a seek within the buffer */
+enum
+{
+    C_FLAG_SKIP  = 0x01,    /* Dropped without being executed */
+    C_FLAG_RESET = 0x02,    /* Reset the output before */
+};
+
 typedef struct attribute_packed
 {
     es_out_id_t *p_es;
@@ -141,6 +152,7 @@ typedef struct attribute_packed
 typedef struct attribute_packed
 {
     int8_t  i_type;
+    int8_t  i_flags;
     mtime_t i_date;
     union
     {
@@ -151,27 +163,63 @@ typedef struct attribute_packed
     } u;
 } ts_cmd_t;
 
+/* Index entry of a storage */
+typedef struct
+{
+    mtime_t  i_pts;
+    uint64_t i_cmd;     /* Sequence number of the command */
+} ts_storage_index_t;
+
 typedef struct ts_storage_t ts_storage_t;
 struct ts_storage_t
 {
     ts_storage_t *p_next;
 
-    /* */
+    /* Block data, read in the order it was written, wrapping around */
 #ifdef _WIN32
     char    *psz_file;  /* Filename */
 #endif
-    size_t  i_file_max; /* Max size in bytes */
-    int64_t i_file_size;/* Current size in bytes */
-    FILE    *p_filew;   /* FILE handle for data writing */
-    FILE    *p_filer;   /* FILE handle for data reading */
+    size_t  i_file_max; /* Size in bytes, allocated once */
+    size_t  i_file_r;   /* Offset of the oldest data kept */
+    size_t  i_file_w;   /* Offset after the last data written */
+#ifdef HAVE_MMAP
+    uint8_t *p_map;     /* Mapping of the whole file */
+#else
+    FILE    *p_file;    /* FILE handle for data writing and reading */
+#endif
 
-    /* */
+    /* Ring of commands, ordered by date. The i_cmd_played commands before
+     * i_cmd_r were already read, and are kept to seek back to until their
+     * space is needed. */
     int      i_cmd_r;
-    int      i_cmd_w;
+    int      i_cmd_count;
+    int      i_cmd_played;
     int      i_cmd_max;
+    uint64_t i_cmd_next; /* Sequence number of the next command pushed */
     ts_cmd_t *p_cmd;
+
+    /* Ring of the blocks to seek to, by increasing PTS: every block with a
+     * higher PTS than the previous ones, only the keyframes once one was
+     * pushed. The data offset is in the command, the entries are dropped
+     * along with it. */
+    int      i_index_r;
+    int      i_index_count;
+    int      i_index_max;
+    bool     b_index_keyframes;
+    ts_storage_index_t *p_index;
 };
 
+/* Header of a block in the storage file, followed by the block data */
+typedef struct
+{
+    mtime_t  i_dts;
+    mtime_t  i_pts;
+    mtime_t  i_length;
+    uint32_t i_flags;
+    unsigned i_nb_samples;
+    size_t   i_buffer;
+} ts_storage_block_t;
+
 typedef struct
 {
     vlc_thread_t   thread;
@@ -198,11 +246,18 @@ typedef struct
     mtime_t        i_buffering_delay;
 
     /* */
+    ts_storage_t   *p_storage_p; /* Storage read before p_storage_r, if kept */
     ts_storage_t   *p_storage_r;
     ts_storage_t   *p_storage_w;
 
     mtime_t        i_cmd_delay;
 
+    /* To seek within the buffer: the difference between the input time and
+     * the PTS when last pushed */
+    mtime_t        i_push_pts;
+    mtime_t        i_time_delta;
+    bool           b_time_delta;
+
 } ts_thread_t;
 
 struct es_out_id_t
@@ -253,16 +308,22 @@ static bool         TsHasCmd( ts_thread_t * );
 static bool         TsIsUnused( ts_thread_t * );
 static int          TsChangePause( ts_thread_t *, bool b_source_paused, bool b_paused, mtime_t i_date );
 static int          TsChangeRate( ts_thread_t *, int i_src_rate, int i_rate );
+static int          TsSeek( ts_thread_t *, mtime_t i_time );
 
 static void         *TsRun( void * );
 
-static ts_storage_t *TsStorageNew( const char *psz_path, int64_t i_tmp_size_max );
+static ts_storage_t *TsStorageNew( const char *psz_path, size_t i_size );
 static void         TsStorageDelete( ts_storage_t * );
 static void         TsStoragePack( ts_storage_t *p_storage );
 static bool         TsStorageIsFull( ts_storage_t *, const ts_cmd_t *p_cmd );
 static bool         TsStorageIsEmpty( ts_storage_t * );
-static void         TsStoragePushCmd( ts_storage_t *, const ts_cmd_t *p_cmd, bool b_flush );
+static size_t       TsStorageCmdSize( const ts_cmd_t *p_cmd );
+static void         TsStoragePushCmd( ts_storage_t *, const ts_cmd_t *p_cmd );
 static void         TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush );
+static void         TsStorageForget( ts_storage_t *, int i_count );
+static void         TsStorageRewind( ts_storage_t *, int i_count );
+static ts_cmd_t     *TsStorageCmdAt( ts_storage_t *, int i_cmd );
+static int          TsStorageFind( ts_storage_t *, mtime_t i_pts, uint64_t *pi_cmd );
 
 static void CmdClean( ts_cmd_t * );
 static void cmd_cleanup_routine( void *p ) { CmdClean( p ); }
@@ -599,7 +660,14 @@ static int ControlLockedSetTime( es_out_t *p_out, mtime_t i_date )
     es_out_sys_t *p_sys = p_out->p_sys;
 
     if( !p_sys->b_delayed )
+    {
+        /* Nothing is buffered to seek into */
+        if( i_date >= 0 )
+            return VLC_EGENERIC;
         return es_out_SetTime( p_sys->p_out, i_date );
+    }
+    if( i_date >= 0 )
+        return TsSeek( p_sys->p_ts, i_date );
 
     /* TODO */
     msg_Err( p_sys->p_input, "EsOutTimeshift does not yet support time change" );
@@ -793,6 +861,9 @@ static int TsStart( es_out_t *p_out )
     p_ts->i_rate_delay = 0;
     p_ts->i_buffering_delay = 0;
     p_ts->i_cmd_delay = 0;
+    p_ts->i_push_pts = VLC_TS_INVALID;
+    p_ts->b_time_delta = false;
+    p_ts->p_storage_p = NULL;
     p_ts->p_storage_r = NULL;
     p_ts->p_storage_w = NULL;
 
@@ -837,19 +908,46 @@ static void TsStop( ts_thread_t *p_ts )
         CmdClean( &cmd );
     }
     assert( !p_ts->p_storage_r || !p_ts->p_storage_r->p_next );
+    if( p_ts->p_storage_p )
+        TsStorageDelete( p_ts->p_storage_p );
     if( p_ts->p_storage_r )
         TsStorageDelete( p_ts->p_storage_r );
     vlc_mutex_unlock( &p_ts->lock );
 
     TsDestroy( p_ts );
 }
+/* The storage read before is only of use while the current one is kept
+ * from its first command on */
+static void TsCleanPlayed( ts_thread_t *p_ts )
+{
+    ts_storage_t *p_storage = p_ts->p_storage_r;
+
+    if( p_ts->p_storage_p && p_storage &&
+        p_storage->i_cmd_next > (uint64_t)( p_storage->i_cmd_count + p_storage->i_cmd_played ) )
+    {
+        TsStorageDelete( p_ts->p_storage_p );
+        p_ts->p_storage_p = NULL;
+    }
+}
 static void TsPushCmd( ts_thread_t *p_ts, ts_cmd_t *p_cmd )
 {
     vlc_mutex_lock( &p_ts->lock );
 
+    /* Make room by forgetting the oldest commands already played */
+    if( p_ts->p_storage_w )
+    {
+        while( p_ts->p_storage_w->i_cmd_played > 0 &&
+               TsStorageIsFull( p_ts->p_storage_w, p_cmd ) )
+            TsStorageForget( p_ts->p_storage_w, 1 );
+        TsCleanPlayed( p_ts );
+    }
+
     if( !p_ts->p_storage_w || TsStorageIsFull( p_ts->p_storage_w, p_cmd ) )
     {
-        ts_storage_t *p_storage = TsStorageNew( p_ts->psz_tmp_path, p_ts->i_tmp_size_max );
+        /* A block bigger than the granularity gets a storage of its own */
+        size_t i_size = __MAX( (size_t)p_ts->i_tmp_size_max,
+                               TsStorageCmdSize( p_cmd ) );
+        ts_storage_t *p_storage = TsStorageNew( p_ts->psz_tmp_path, i_size );
 
         if( !p_storage )
         {
@@ -871,8 +969,18 @@ static void TsPushCmd( ts_thread_t *p_ts, ts_cmd_t *p_cmd )
         }
     }
 
+    if( p_cmd->i_type == C_SEND && p_cmd->u.send.p_block->i_pts > VLC_TS_INVALID )
+        p_ts->i_push_pts = p_cmd->u.send.p_block->i_pts;
+    else if( p_cmd->i_type == C_CONTROL &&
+             p_cmd->u.control.i_query == ES_OUT_SET_TIMES &&
+             p_ts->i_push_pts > VLC_TS_INVALID )
+    {
+        p_ts->i_time_delta = p_cmd->u.control.u.times.i_time - p_ts->i_push_pts;
+        p_ts->b_time_delta = true;
+    }
+
     /* TODO return error and warn the user (but only once) */
-    TsStoragePushCmd( p_ts->p_storage_w, p_cmd, p_ts->p_storage_r == p_ts->p_storage_w );
+    TsStoragePushCmd( p_ts->p_storage_w, p_cmd );
 
     vlc_cond_signal( &p_ts->wait );
 
@@ -893,9 +1001,17 @@ static int TsPopCmdLocked( ts_thread_t *p_ts, ts_cmd_t *p_cmd, bool b_flush )
         if( !p_next )
             break;
 
-        TsStorageDelete( p_ts->p_storage_r );
+        /* Keep the storage just read to seek back into */
+        if( p_ts->p_storage_p )
+            TsStorageDelete( p_ts->p_storage_p );
+        p_ts->p_storage_p = NULL;
+        if( p_ts->p_storage_r->i_cmd_played > 0 && !b_flush )
+            p_ts->p_storage_p = p_ts->p_storage_r;
+        else
+            TsStorageDelete( p_ts->p_storage_r );
         p_ts->p_storage_r = p_next;
     }
+    TsCleanPlayed( p_ts );
 
     return VLC_SUCCESS;
 }
@@ -970,6 +1086,107 @@ static int TsChangeRate( ts_thread_t *p_ts, int i_src_rate, int i_rate )
 
     return i_ret;
 }
+static int TsSeek( ts_thread_t *p_ts, mtime_t i_time )
+{
+    vlc_mutex_lock( &p_ts->lock );
+
+    /* Find the first storage with an indexed block at or after the time,
+     * from the oldest one kept */
+    ts_storage_t *p_storage = p_ts->p_storage_p ? p_ts->p_storage_p
+                                                : p_ts->p_storage_r;
+    uint64_t i_cmd = 0;
+
+    while( p_storage != NULL && p_storage->i_index_count <= 0 )
+        p_storage = p_storage->p_next;
+
+    if( p_storage != NULL && p_ts->b_time_delta )
+    {
+        const mtime_t i_pts = i_time - p_ts->i_time_delta;
+
+        /* Nothing is kept before the first indexed block */
+        if( i_pts < p_storage->p_index[p_storage->i_index_r].i_pts )
+            p_storage = NULL;
+        while( p_storage != NULL && TsStorageFind( p_storage, i_pts, &i_cmd ) )
+            p_storage = p_storage->p_next;
+    }
+    else
+    {
+        p_storage = NULL;
+    }
+    if( p_storage == NULL )
+    {
+        vlc_mutex_unlock( &p_ts->lock );
+        return VLC_EGENERIC;
+    }
+
+    /* Seeking back: read the commands played again, from the block found */
+    if( p_storage == p_ts->p_storage_p )
+    {
+        TsStorageRewind( p_ts->p_storage_r, p_ts->p_storage_r->i_cmd_played );
+        p_ts->p_storage_r = p_storage;
+        p_ts->p_storage_p = NULL;
+    }
+    if( p_storage == p_ts->p_storage_r )
+    {
+        const uint64_t i_read = p_storage->i_cmd_next - p_storage->i_cmd_count;
+        if( i_cmd < i_read )
+            TsStorageRewind( p_storage, (int)( i_read - i_cmd ) );
+    }
+
+    /* Play everything from the block on, even what an earlier seek skipped */
+    for( ts_storage_t *p = p_storage; p != NULL; p = p->p_next )
+    {
+        const uint64_t i_read = p->i_cmd_next - p->i_cmd_count;
+        for( int i = ( p == p_storage ) ? (int)( i_cmd - i_read ) : 0;
+             i < p->i_cmd_count; i++ )
+            TsStorageCmdAt( p, i )->i_flags = 0;
+    }
+
+    /* Seeking forward: skip the data and clock references up to there. The
+     * other commands change the state of the output and are still executed,
+     * in order. */
+    bool b_reset = true;
+    for( ts_storage_t *p = p_ts->p_storage_r; ; p = p->p_next )
+    {
+        const uint64_t i_read = p->i_cmd_next - p->i_cmd_count;
+        const int i_count = ( p == p_storage ) ? (int)( i_cmd - i_read )
+                                               : p->i_cmd_count;
+        for( int i = 0; i < i_count; i++ )
+        {
+            ts_cmd_t *p_cmd = TsStorageCmdAt( p, i );
+
+            if( p_cmd->i_type == C_SEND ||
+                ( p_cmd->i_type == C_CONTROL &&
+                  ( p_cmd->u.control.i_query == ES_OUT_SET_PCR ||
+                    p_cmd->u.control.i_query == ES_OUT_SET_GROUP_PCR ) ) )
+            {
+                p_cmd->i_flags |= C_FLAG_SKIP;
+                if( b_reset )
+                    p_cmd->i_flags |= C_FLAG_RESET;
+                b_reset = false;
+            }
+        }
+        if( p == p_storage )
+            break;
+    }
+
+    /* Play the block found now, or when the playback resumes */
+    ts_cmd_t *p_target = TsStorageCmdAt( p_storage,
+        (int)( i_cmd - ( p_storage->i_cmd_next - p_storage->i_cmd_count ) ) );
+    if( b_reset )
+        p_target->i_flags |= C_FLAG_RESET;
+
+    const mtime_t i_now = p_ts->b_paused ? p_ts->i_pause_date : mdate();
+    p_ts->i_cmd_delay = i_now - p_target->i_date - p_ts->i_buffering_delay;
+    p_ts->i_rate_date = -1;
+    p_ts->i_rate_delay = 0;
+
+    msg_Dbg( p_ts->p_input, "seeking within the timeshift buffer to %"PRId64,
+             i_time );
+    vlc_cond_signal( &p_ts->wait );
+    vlc_mutex_unlock( &p_ts->lock );
+    return VLC_SUCCESS;
+}
 
 static void *TsRun( void *p_data )
 {
@@ -993,6 +1210,19 @@ static void *TsRun( void *p_data )
 
             if( ( !p_ts->b_paused || b_buffering ) && !TsPopCmdLocked( p_ts, &cmd, false ) )
             {
+                /* Seek within the buffer: reset the decoders and clock,
+                 * and drop what was passed over */
+                if( cmd.i_flags & C_FLAG_RESET )
+                {
+                    es_out_SetTime( p_ts->p_out, -1 );
+                    i_buffering_date = -1;
+                }
+                if( cmd.i_flags & C_FLAG_SKIP )
+                {
+                    CmdClean( &cmd );
+                    vlc_restorecancel( canc );
+                    continue;
+                }
                 vlc_restorecancel( canc );
                 break;
             }
@@ -1093,7 +1323,7 @@ static void *TsRun( void *p_data )
 /*****************************************************************************
  *
  *****************************************************************************/
-static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_max )
+static ts_storage_t *TsStorageNew( const char *psz_tmp_path, size_t i_size )
 {
     ts_storage_t *p_storage = malloc( sizeof (*p_storage) );
     if( unlikely(p_storage == NULL) )
@@ -1107,21 +1337,33 @@ static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_
         return NULL;
     }
 
-    p_storage->p_filew = fdopen( fd, "w+b" );
-    if( p_storage->p_filew == NULL )
+#ifdef HAVE_MMAP
+    /* Allocate the whole file up front (where possible), so that writing
+     * through the mapping does not fault later on a full disk */
+# ifdef HAVE_POSIX_FALLOCATE
+    int i_err = posix_fallocate( fd, 0, i_size );
+# else
+    int i_err = ftruncate( fd, i_size ) ? errno : 0;
+# endif
+    p_storage->p_map = MAP_FAILED;
+    if( i_err == 0 )
+        p_storage->p_map = mmap( NULL, i_size, PROT_READ|PROT_WRITE,
+                                 MAP_SHARED, fd, 0 );
+    close( fd );
+    if( p_storage->p_map == MAP_FAILED )
     {
-        close( fd );
         vlc_unlink( psz_file );
         goto error;
     }
-
-    p_storage->p_filer = vlc_fopen( psz_file, "rb" );
-    if( p_storage->p_filer == NULL )
+#else
+    p_storage->p_file = fdopen( fd, "w+b" );
+    if( p_storage->p_file == NULL )
     {
-        fclose( p_storage->p_filew );
+        close( fd );
         vlc_unlink( psz_file );
         goto error;
     }
+#endif
 
 #ifndef _WIN32
     vlc_unlink( psz_file );
@@ -1132,17 +1374,27 @@ static ts_storage_t *TsStorageNew( const char *psz_tmp_path, int64_t i_tmp_size_
     p_storage->p_next = NULL;
 
     /* */
-    p_storage->i_file_max = i_tmp_size_max;
-    p_storage->i_file_size = 0;
+    p_storage->i_file_max = i_size;
+    p_storage->i_file_r = 0;
+    p_storage->i_file_w = 0;
 
     /* */
-    p_storage->i_cmd_w = 0;
     p_storage->i_cmd_r = 0;
+    p_storage->i_cmd_count = 0;
+    p_storage->i_cmd_played = 0;
     p_storage->i_cmd_max = 30000;
+    p_storage->i_cmd_next = 0;
     p_storage->p_cmd = malloc( p_storage->i_cmd_max * sizeof(*p_storage->p_cmd) );
     //fprintf( stderr, "\nSTORAGE name=%s size=%d KiB\n", p_storage->psz_file, p_storage->i_cmd_max * sizeof(*p_storage->p_cmd) /1024 );
 
-    if( !p_storage->p_cmd )
+    /* There is at most one entry per command */
+    p_storage->i_index_r = 0;
+    p_storage->i_index_count = 0;
+    p_storage->i_index_max = p_storage->i_cmd_max;
+    p_storage->b_index_keyframes = false;
+    p_storage->p_index = malloc( p_storage->i_index_max * sizeof(*p_storage->p_index) );
+
+    if( !p_storage->p_cmd || !p_storage->p_index )
     {
         TsStorageDelete( p_storage );
         return NULL;
@@ -1156,7 +1408,7 @@ error:
 
 static void TsStorageDelete( ts_storage_t *p_storage )
 {
-    while( p_storage->i_cmd_r < p_storage->i_cmd_w )
+    while( !TsStorageIsEmpty( p_storage ) )
     {
         ts_cmd_t cmd;
 
@@ -1165,9 +1417,13 @@ static void TsStorageDelete( ts_storage_t *p_storage )
         CmdClean( &cmd );
     }
     free( p_storage->p_cmd );
+    free( p_storage->p_index );
 
-    fclose( p_storage->p_filer );
-    fclose( p_storage->p_filew );
+#ifdef HAVE_MMAP
+    munmap( p_storage->p_map, p_storage->i_file_max );
+#else
+    fclose( p_storage->p_file );
+#endif
 #ifdef _WIN32
     vlc_unlink( p_storage->psz_file );
     free( p_storage->psz_file );
@@ -1177,80 +1433,196 @@ static void TsStorageDelete( ts_storage_t *p_storage )
 
 static void TsStoragePack( ts_storage_t *p_storage )
 {
-    /* Try to release a bit of memory */
-    if( p_storage->i_cmd_w >= p_storage->i_cmd_max )
+    /* Try to release a bit of memory, unless the ring has wrapped around */
+    const int i_first = ( p_storage->i_cmd_r - p_storage->i_cmd_played +
+                          p_storage->i_cmd_max ) % p_storage->i_cmd_max;
+    const int i_kept = p_storage->i_cmd_played + p_storage->i_cmd_count;
+    if( i_kept >= p_storage->i_cmd_max ||
+        i_first + i_kept > p_storage->i_cmd_max )
         return;
 
-    p_storage->i_cmd_max = __MAX( p_storage->i_cmd_w, 1 );
+    memmove( p_storage->p_cmd, &p_storage->p_cmd[i_first],
+             i_kept * sizeof(*p_storage->p_cmd) );
+    p_storage->i_cmd_r = p_storage->i_cmd_played;
+    p_storage->i_cmd_max = __MAX( i_kept, 1 );
 
     ts_cmd_t *p_new = realloc( p_storage->p_cmd, p_storage->i_cmd_max * sizeof(*p_storage->p_cmd) );
     if( p_new )
         p_storage->p_cmd = p_new;
+
+    /* Nothing is pushed anymore, the index can be packed too */
+    if( p_storage->i_index_r + p_storage->i_index_count > p_storage->i_index_max )
+        return;
+
+    memmove( p_storage->p_index, &p_storage->p_index[p_storage->i_index_r],
+             p_storage->i_index_count * sizeof(*p_storage->p_index) );
+    p_storage->i_index_r = 0;
+    p_storage->i_index_max = __MAX( p_storage->i_index_count, 1 );
+
+    ts_storage_index_t *p_index = realloc( p_storage->p_index, p_storage->i_index_max * sizeof(*p_storage->p_index) );
+    if( p_index )
+        p_storage->p_index = p_index;
 }
-static bool TsStorageIsFull( ts_storage_t *p_storage, const ts_cmd_t *p_cmd )
+static size_t TsStorageCmdSize( const ts_cmd_t *p_cmd )
 {
-    if( p_cmd && p_cmd->i_type == C_SEND && p_storage->i_cmd_w > 0 )
-    {
-        size_t i_size = sizeof(*p_cmd->u.send.p_block) + p_cmd->u.send.p_block->i_buffer;
+    if( p_cmd->i_type != C_SEND )
+        return 0;
+    return sizeof(ts_storage_block_t) + p_cmd->u.send.p_block->i_buffer;
+}
+/* Finds where i_size bytes can be written without overwriting kept data.
+ * Data is read and forgotten in the order it was written, so the kept data
+ * always lies between i_file_r and i_file_w, possibly wrapping around the
+ * end. */
+static bool TsStorageGetOffset( const ts_storage_t *p_storage, size_t i_size, size_t *pi_offset )
+{
+    const size_t i_r = p_storage->i_file_r;
+    const size_t i_w = p_storage->i_file_w;
 
-        if( p_storage->i_file_size + i_size >= p_storage->i_file_max )
+    if( i_w >= i_r )
+    {
+        if( p_storage->i_file_max - i_w >= i_size )
+        {
+            *pi_offset = i_w;
             return true;
+        }
+        /* Wrap around, leaving the end of the file unused */
+        if( i_r > i_size )
+        {
+            *pi_offset = 0;
+            return true;
+        }
+        return false;
+    }
+    if( i_r - i_w > i_size )
+    {
+        *pi_offset = i_w;
+        return true;
     }
-    return p_storage->i_cmd_w >= p_storage->i_cmd_max;
+    return false;
+}
+static bool TsStorageIsFull( ts_storage_t *p_storage, const ts_cmd_t *p_cmd )
+{
+    if( p_storage->i_cmd_played + p_storage->i_cmd_count >= p_storage->i_cmd_max )
+        return true;
+
+    size_t i_offset;
+    return p_cmd && p_cmd->i_type == C_SEND &&
+           !TsStorageGetOffset( p_storage, TsStorageCmdSize( p_cmd ), &i_offset );
 }
 static bool TsStorageIsEmpty( ts_storage_t *p_storage )
 {
-    return !p_storage || p_storage->i_cmd_r >= p_storage->i_cmd_w;
+    return !p_storage || p_storage->i_cmd_count <= 0;
 }
-static void TsStoragePushCmd( ts_storage_t *p_storage, const ts_cmd_t *p_cmd, bool b_flush )
+static int TsStorageWrite( ts_storage_t *p_storage, size_t i_offset, const void *p_data, size_t i_size )
+{
+#ifdef HAVE_MMAP
+    memcpy( &p_storage->p_map[i_offset], p_data, i_size );
+#else
+    if( i_size > 0 &&
+        ( fseek( p_storage->p_file, i_offset, SEEK_SET ) ||
+          fwrite( p_data, i_size, 1, p_storage->p_file ) != 1 ) )
+        return VLC_EGENERIC;
+#endif
+    return VLC_SUCCESS;
+}
+static int TsStorageRead( ts_storage_t *p_storage, size_t i_offset, void *p_data, size_t i_size )
+{
+#ifdef HAVE_MMAP
+    memcpy( p_data, &p_storage->p_map[i_offset], i_size );
+#else
+    if( i_size > 0 &&
+        ( fseek( p_storage->p_file, i_offset, SEEK_SET ) ||
+          fread( p_data, i_size, 1, p_storage->p_file ) != 1 ) )
+        return VLC_EGENERIC;
+#endif
+    return VLC_SUCCESS;
+}
+static void TsStorageIndex( ts_storage_t *p_storage, const block_t *p_block )
+{
+    const bool b_keyframe = p_block->i_flags & BLOCK_FLAG_TYPE_I;
+
+    if( p_block->i_pts <= VLC_TS_INVALID ||
+        ( p_storage->b_index_keyframes && !b_keyframe ) )
+        return;
+    if( p_storage->i_index_count > 0 )
+    {
+        const int i_last = ( p_storage->i_index_r + p_storage->i_index_count - 1 )
+                           % p_storage->i_index_max;
+        if( p_storage->p_index[i_last].i_pts >= p_block->i_pts )
+            return;
+    }
+    assert( p_storage->i_index_count < p_storage->i_index_max );
+
+    const int i_w = ( p_storage->i_index_r + p_storage->i_index_count )
+                    % p_storage->i_index_max;
+    p_storage->p_index[i_w].i_pts = p_block->i_pts;
+    p_storage->p_index[i_w].i_cmd = p_storage->i_cmd_next;
+    p_storage->i_index_count++;
+    if( b_keyframe )
+        p_storage->b_index_keyframes = true;
+}
+static void TsStoragePushCmd( ts_storage_t *p_storage, const ts_cmd_t *p_cmd )
 {
     ts_cmd_t cmd = *p_cmd;
 
     assert( !TsStorageIsFull( p_storage, p_cmd ) );
 
+    cmd.i_flags = 0;
     if( cmd.i_type == C_SEND )
     {
         block_t *p_block = cmd.u.send.p_block;
+        const ts_storage_block_t block = {
+            .i_dts        = p_block->i_dts,
+            .i_pts        = p_block->i_pts,
+            .i_length     = p_block->i_length,
+            .i_flags      = p_block->i_flags,
+            .i_nb_samples = p_block->i_nb_samples,
+            .i_buffer     = p_block->i_buffer,
+        };
+        size_t i_offset = 0;
+
+        TsStorageGetOffset( p_storage, TsStorageCmdSize( &cmd ), &i_offset );
 
         cmd.u.send.p_block = NULL;
-        cmd.u.send.i_offset = ftell( p_storage->p_filew );
-
-        if( fwrite( p_block, sizeof(*p_block), 1, p_storage->p_filew ) != 1 )
-        {
-            block_Release( p_block );
-            return;
-        }
-        p_storage->i_file_size += sizeof(*p_block);
-        if( p_block->i_buffer > 0 )
-        {
-            if( fwrite( p_block->p_buffer, p_block->i_buffer, 1, p_storage->p_filew ) != 1 )
-            {
-                block_Release( p_block );
-                return;
-            }
-        }
-        p_storage->i_file_size += p_block->i_buffer;
+        cmd.u.send.i_offset = i_offset;
+
+        int i_ret = TsStorageWrite( p_storage, i_offset, &block, sizeof(block) );
+        if( !i_ret )
+            i_ret = TsStorageWrite( p_storage, i_offset + sizeof(block),
+                                    p_block->p_buffer, p_block->i_buffer );
+        if( !i_ret )
+            TsStorageIndex( p_storage, p_block );
         block_Release( p_block );
+        if( i_ret )
+            return;
 
-        if( b_flush )
-            fflush( p_storage->p_filew );
+        p_storage->i_file_w = i_offset + sizeof(block) + block.i_buffer;
     }
-    p_storage->p_cmd[p_storage->i_cmd_w++] = cmd;
+
+    const int i_cmd_w = ( p_storage->i_cmd_r + p_storage->i_cmd_count ) % p_storage->i_cmd_max;
+    p_storage->p_cmd[i_cmd_w] = cmd;
+    p_storage->i_cmd_count++;
+    p_storage->i_cmd_next++;
 }
 static void TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_flush )
 {
     assert( !TsStorageIsEmpty( p_storage ) );
 
-    *p_cmd = p_storage->p_cmd[p_storage->i_cmd_r++];
+    *p_cmd = p_storage->p_cmd[p_storage->i_cmd_r];
+    p_storage->i_cmd_r = ( p_storage->i_cmd_r + 1 ) % p_storage->i_cmd_max;
+    p_storage->i_cmd_count--;
+    p_storage->i_cmd_played++;
+
     if( p_cmd->i_type == C_SEND )
     {
-        block_t block;
+        const size_t i_offset = p_cmd->u.send.i_offset;
+        ts_storage_block_t block;
+        block_t *p_block = NULL;
 
-        if( !b_flush &&
-            !fseek( p_storage->p_filer, p_cmd->u.send.i_offset, SEEK_SET ) &&
-            fread( &block, sizeof(block), 1, p_storage->p_filer ) == 1 )
+        if( !TsStorageRead( p_storage, i_offset, &block, sizeof(block) ) )
         {
-            block_t *p_block = block_Alloc( block.i_buffer );
+            if( !b_flush && !( p_cmd->i_flags & C_FLAG_SKIP ) )
+                p_block = block_Alloc( block.i_buffer );
             if( p_block )
             {
                 p_block->i_dts      = block.i_dts;
@@ -1258,17 +1630,101 @@ static void TsStoragePopCmd( ts_storage_t *p_storage, ts_cmd_t *p_cmd, bool b_fl
                 p_block->i_flags    = block.i_flags;
                 p_block->i_length   = block.i_length;
                 p_block->i_nb_samples = block.i_nb_samples;
-                p_block->i_buffer = fread( p_block->p_buffer, 1, block.i_buffer, p_storage->p_filer );
+                if( TsStorageRead( p_storage, i_offset + sizeof(block),
+                                   p_block->p_buffer, block.i_buffer ) )
+                    p_block->i_buffer = 0;
             }
-            p_cmd->u.send.p_block = p_block;
         }
-        else
+
+        p_cmd->u.send.p_block = p_block ? p_block : block_Alloc( 1 );
+    }
+
+    /* The blocks and the clock references can be read again from the
+     * storage. The other commands carry data that is released once they are
+     * executed, and the state they set must not be undone: nothing before
+     * them can be played again. */
+    if( b_flush ||
+        ( p_cmd->i_type != C_SEND &&
+          ( p_cmd->i_type != C_CONTROL ||
+            ( p_cmd->u.control.i_query != ES_OUT_SET_PCR &&
+              p_cmd->u.control.i_query != ES_OUT_SET_GROUP_PCR &&
+              p_cmd->u.control.i_query != ES_OUT_SET_TIMES ) ) ) )
+        TsStorageForget( p_storage, p_storage->i_cmd_played );
+}
+/* Forgets the i_count oldest commands played, and the data they refer to */
+static void TsStorageForget( ts_storage_t *p_storage, int i_count )
+{
+    assert( i_count <= p_storage->i_cmd_played );
+    p_storage->i_cmd_played -= i_count;
+
+    const int i_kept = p_storage->i_cmd_played + p_storage->i_cmd_count;
+    const uint64_t i_first = p_storage->i_cmd_next - i_kept;
+    while( p_storage->i_index_count > 0 &&
+           p_storage->p_index[p_storage->i_index_r].i_cmd < i_first )
+    {
+        p_storage->i_index_r = ( p_storage->i_index_r + 1 ) % p_storage->i_index_max;
+        p_storage->i_index_count--;
+    }
+
+    /* Nothing is kept: start again from the beginning of the file */
+    if( i_kept == 0 )
+    {
+        p_storage->i_file_r = p_storage->i_file_w = 0;
+        return;
+    }
+
+    p_storage->i_file_r = p_storage->i_file_w;
+    for( int i = -p_storage->i_cmd_played; i < p_storage->i_cmd_count; i++ )
+    {
+        const ts_cmd_t *p_cmd = TsStorageCmdAt( p_storage, i );
+        if( p_cmd->i_type == C_SEND )
         {
-            //perror( "TsStoragePopCmd" );
-            p_cmd->u.send.p_block = block_Alloc( 1 );
+            p_storage->i_file_r = p_cmd->u.send.i_offset;
+            break;
         }
     }
 }
+/* Moves the reading back by i_count commands played */
+static void TsStorageRewind( ts_storage_t *p_storage, int i_count )
+{
+    assert( i_count <= p_storage->i_cmd_played );
+    p_storage->i_cmd_r = ( p_storage->i_cmd_r - i_count + p_storage->i_cmd_max )
+                         % p_storage->i_cmd_max;
+    p_storage->i_cmd_played -= i_count;
+    p_storage->i_cmd_count += i_count;
+}
+/* Returns the command i_cmd places after the next one to read (before it,
+ * among the ones played, if negative) */
+static ts_cmd_t *TsStorageCmdAt( ts_storage_t *p_storage, int i_cmd )
+{
+    assert( i_cmd >= -p_storage->i_cmd_played && i_cmd < p_storage->i_cmd_count );
+    return &p_storage->p_cmd[( p_storage->i_cmd_r + i_cmd + p_storage->i_cmd_max )
+                             % p_storage->i_cmd_max];
+}
+/* Finds the first indexed command with a PTS at or after i_pts, played or
+ * not, by binary search in the index */
+static int TsStorageFind( ts_storage_t *p_storage, mtime_t i_pts, uint64_t *pi_cmd )
+{
+    int i_low = 0;
+    int i_high = p_storage->i_index_count;
+
+    while( i_low < i_high )
+    {
+        const int i_mid = i_low + ( i_high - i_low ) / 2;
+        const ts_storage_index_t *p_entry =
+            &p_storage->p_index[( p_storage->i_index_r + i_mid ) % p_storage->i_index_max];
+
+        if( p_entry->i_pts < i_pts )
+            i_low = i_mid + 1;
+        else
+            i_high = i_mid;
+    }
+    if( i_low >= p_storage->i_index_count )
+        return VLC_EGENERIC;
+
+    *pi_cmd = p_storage->p_index[( p_storage->i_index_r + i_low ) % p_storage->i_index_max].i_cmd;
+    return VLC_SUCCESS;
+}
 
 /*****************************************************************************
  *
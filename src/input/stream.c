@@ -46,6 +46,7 @@ typedef struct stream_priv_t
     stream_t stream;
     void (*destroy)(stream_t *);
     block_t *peek;
+    size_t peek_read; /* bytes of the peek buffer already read */
     uint64_t offset;
 
     /* UTF-16 and UTF-32 file reading */
@@ -77,6 +78,7 @@ stream_t *stream_CommonNew(vlc_object_t *parent, void (*destroy)(stream_t *))
     assert(destroy != NULL);
     priv->destroy = destroy;
     priv->peek = NULL;
+    priv->peek_read = 0;
     priv->offset = 0;
 
     /* UTF16 and UTF32 text file conversion */
@@ -366,10 +368,12 @@ ssize_t stream_Read(stream_t *s, void *buf, size_t len)
 
         peek->p_buffer += copy;
         peek->i_buffer -= copy;
+        priv->peek_read += copy;
         if (peek->i_buffer == 0)
         {
             block_Release(peek);
             priv->peek = NULL;
+            priv->peek_read = 0;
         }
 
         if (buf != NULL)
@@ -396,6 +400,7 @@ ssize_t stream_Peek(stream_t *s, const uint8_t **restrict bufp, size_t len)
             return VLC_ENOMEM;
 
         *bufp = peek->p_buffer;
+        priv->peek_read = 0;
 
         if (unlikely(len == 0))
         {
@@ -417,19 +422,29 @@ ssize_t stream_Peek(stream_t *s, const uint8_t **restrict bufp, size_t len)
 
     if (peek->i_buffer < len)
     {
-        size_t avail = peek->i_buffer;
+        /* Keep the data already read, so that seeking back stays in memory */
+        size_t back = priv->peek_read;
+        size_t avail = back + peek->i_buffer;
 
-        peek = block_TryRealloc(peek, 0, len);
+        peek->p_buffer -= back;
+        peek->i_buffer = avail;
+        peek = block_TryRealloc(peek, 0, back + len);
         if (unlikely(peek == NULL))
+        {
+            priv->peek->p_buffer += back;
+            priv->peek->i_buffer -= back;
             return VLC_ENOMEM;
+        }
 
         priv->peek = peek;
         peek->i_buffer = avail;
 
-        ssize_t ret = stream_ReadRaw(s, peek->p_buffer + avail, len - avail);
-        *bufp = peek->p_buffer;
+        ssize_t ret = stream_ReadRaw(s, peek->p_buffer + avail, back + len - avail);
         if (ret >= 0)
             peek->i_buffer += ret;
+        peek->p_buffer += back;
+        peek->i_buffer -= back;
+        *bufp = peek->p_buffer;
         return peek->i_buffer;
     }
 
@@ -459,6 +474,19 @@ int stream_Seek(stream_t *s, uint64_t offset)
     block_t *peek = priv->peek;
     if (peek != NULL)
     {
+        const uint64_t pos = priv->offset - peek->i_buffer;
+        if (offset < pos && pos - offset <= priv->peek_read)
+        {   /* Seeking back within the peek buffer */
+            size_t back = pos - offset;
+
+            peek->p_buffer -= back;
+            peek->i_buffer += back;
+            priv->peek_read -= back;
+
+            assert(stream_Tell(s) == offset);
+            return VLC_SUCCESS;
+        }
+
         if ((priv->offset - peek->i_buffer) <= offset
          && offset <= priv->offset)
         {
@@ -467,10 +495,12 @@ int stream_Seek(stream_t *s, uint64_t offset)
             {   /* Seeking within the peek buffer */
                 peek->p_buffer += fwd;
                 peek->i_buffer -= fwd;
+                priv->peek_read += fwd;
 
                 if (peek->i_buffer == 0)
                 {
                     priv->peek = NULL;
+                    priv->peek_read = 0;
                     block_Release(peek);
                 }
 
@@ -500,6 +530,7 @@ int stream_Seek(stream_t *s, uint64_t offset)
     if (peek != NULL)
     {
         priv->peek = NULL;
+        priv->peek_read = 0;
         block_Release(peek);
     }
 
@@ -542,6 +573,7 @@ int stream_vaControl(stream_t *s, int cmd, va_list args)
             {
                 block_Release(priv->peek);
                 priv->peek = NULL;
+                priv->peek_read = 0;
             }
             return VLC_SUCCESS;
         }
@@ -555,6 +587,7 @@ int stream_vaControl(stream_t *s, int cmd, va_list args)
             {
                 *b = priv->peek;
                 priv->peek = NULL;
+                priv->peek_read = 0;
                 *eof = false;
                 return VLC_SUCCESS;
             }
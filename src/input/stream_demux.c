@@ -226,6 +226,7 @@ static int DStreamControl( stream_t *s, int i_query, va_list args )
         case STREAM_GET_META:
         case STREAM_GET_CONTENT_TYPE:
         case STREAM_GET_SIGNAL:
+        case STREAM_GET_RECV_STATS:
         case STREAM_SET_PAUSE_STATE:
         case STREAM_SET_TITLE:
         case STREAM_SET_SEEKPOINT:
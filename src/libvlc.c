@@ -60,6 +60,7 @@
 #include <vlc_playlist.h>
 #include <vlc_interface.h>
 
+#include <vlc_block.h>
 #include <vlc_charset.h>
 #include <vlc_fs.h>
 #include <vlc_cpu.h>
@@ -353,6 +354,9 @@ dbus_out:
 
     priv->b_stats = var_InheritBool( p_libvlc, "stats" );
 
+    if( var_InheritBool( p_libvlc, "block-pool" ) )
+        block_pool_Enable( true );
+
     /*
      * Initialize hotkey handling
      */
@@ -503,6 +507,19 @@ void libvlc_InternalCleanup( libvlc_int_t *p_libvlc )
     libvlc_Quit( p_libvlc );
     intf_DestroyAll( p_libvlc );
 
+    if( var_InheritBool( p_libvlc, "block-pool" ) )
+    {
+        block_pool_stats_t st;
+
+        block_pool_GetStats( &st );
+        msg_Dbg( p_libvlc, "block cache: %"PRIu64" hits, %"PRIu64" misses, "
+                 "%"PRIu64" cross-thread releases, %zu bytes cached",
+                 st.hits, st.misses, st.remote, st.bytes );
+        for( unsigned i = 0; i < BLOCK_POOL_CLASSES; i++ )
+            msg_Dbg( p_libvlc, " %zu bytes class: %zu blocks cached",
+                     st.size[i], st.count[i] );
+    }
+
 #ifdef ENABLE_VLM
     /* Destroy VLM if created in libvlc_InternalInit */
     if( priv->p_vlm )
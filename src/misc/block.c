@@ -36,6 +36,7 @@
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
 #include <vlc_fs.h>
 
 /**
@@ -123,8 +124,347 @@ static void BlockMetaCopy( block_t *restrict out, const block_t *in )
 /** Initial reserved header and footer size. */
 #define BLOCK_PADDING      32
 
+/**
+ * @section Block allocation cache
+ *
+ * When enabled with block_pool_Enable(), block_Alloc() rounds payload sizes
+ * up to one of a few size classes, and released blocks are kept in
+ * per-thread free lists for reuse by later allocations of the same class.
+ * This avoids most malloc() and free() calls for the packet-sized blocks that
+ * are allocated and released continuously, and the heap fragmentation they
+ * cause.
+ *
+ * Blocks usually flow from one thread to another (e.g. demux to decoder), so
+ * each block remembers the cache of the thread that allocated it. A block
+ * released by another thread is pushed on a lock-free return list of that
+ * cache, which its owner drains when its own free list runs empty.
+ *
+ * A cache outlives its thread until all the blocks it lent are back: at
+ * thread exit, the return list is closed and the blocks still out are
+ * counted; the last of them to come back frees the cache.
+ */
+
+static const size_t block_pool_sizes[BLOCK_POOL_CLASSES] = {
+    256, 1536, 4096, 16384, 65536,
+};
+
+/** Cached bytes per class and thread (at least 4 blocks are cached) */
+#define BLOCK_POOL_CLASS_BYTES (256 * 1024)
+/** Number of operations after which a thread updates the global statistics */
+#define BLOCK_POOL_FLUSH 64
+
+#define BLOCK_OVERHEAD (BLOCK_ALIGN + (2 * BLOCK_PADDING))
+
+typedef struct block_cache_t block_cache_t;
+
+typedef struct
+{
+    block_t self;
+    block_cache_t *owner;
+} pool_block_t;
+
+/** Return list value once the owner thread has exited */
+#define BLOCK_POOL_CLOSED ((pool_block_t *)(uintptr_t)1)
+
+struct block_cache_t
+{
+    pool_block_t *free[BLOCK_POOL_CLASSES];
+    unsigned count[BLOCK_POOL_CLASSES];
+    size_t lent; /**< Blocks allocated and not back yet */
+
+    /* Blocks released by other threads */
+    _Atomic(pool_block_t *) returned;
+    /* Blocks still out after the thread exit, minus those since returned */
+    atomic_long orphans;
+
+    /* Statistics not accounted globally yet */
+    unsigned ops;
+    unsigned hits;
+    unsigned misses;
+    unsigned remote;
+    int delta[BLOCK_POOL_CLASSES];
+};
+
+static struct
+{
+    vlc_mutex_t lock;
+    bool initialized;
+    vlc_threadvar_t key;
+    atomic_bool enabled;
+
+    atomic_ullong hits;
+    atomic_ullong misses;
+    atomic_ullong remote;
+    atomic_long count[BLOCK_POOL_CLASSES];
+} block_pool = {
+    .lock = VLC_STATIC_MUTEX,
+    .initialized = false,
+};
+
+static unsigned block_pool_Limit (unsigned cls)
+{
+    size_t limit = BLOCK_POOL_CLASS_BYTES / block_pool_sizes[cls];
+    return (limit > 4) ? limit : 4;
+}
+
+static unsigned block_pool_Class (const pool_block_t *pb)
+{
+    const size_t size = pb->self.i_size - BLOCK_OVERHEAD;
+    unsigned cls = 0;
+
+    while (block_pool_sizes[cls] != size)
+    {
+        cls++;
+        assert (cls < BLOCK_POOL_CLASSES);
+    }
+    return cls;
+}
+
+static void block_cache_Account (block_cache_t *cache)
+{
+    atomic_fetch_add_explicit (&block_pool.hits, cache->hits,
+                               memory_order_relaxed);
+    atomic_fetch_add_explicit (&block_pool.misses, cache->misses,
+                               memory_order_relaxed);
+    atomic_fetch_add_explicit (&block_pool.remote, cache->remote,
+                               memory_order_relaxed);
+    for (unsigned i = 0; i < BLOCK_POOL_CLASSES; i++)
+    {
+        atomic_fetch_add_explicit (&block_pool.count[i], cache->delta[i],
+                                   memory_order_relaxed);
+        cache->delta[i] = 0;
+    }
+    cache->ops = cache->hits = cache->misses = cache->remote = 0;
+}
+
+/** Puts a block back in the free list of its owner (owner thread only) */
+static void block_cache_Put (block_cache_t *cache, pool_block_t *pb)
+{
+    unsigned cls = block_pool_Class (pb);
+
+    assert (cache->lent > 0);
+    cache->lent--;
+
+    if (cache->count[cls] >= block_pool_Limit (cls))
+    {
+        free (pb);
+        return;
+    }
+
+    pb->self.p_next = (block_t *)cache->free[cls];
+    cache->free[cls] = pb;
+    cache->count[cls]++;
+    cache->delta[cls]++;
+}
+
+/** Takes back the blocks released by other threads (owner thread only) */
+static void block_cache_Drain (block_cache_t *cache, pool_block_t *list)
+{
+    while (list != NULL)
+    {
+        pool_block_t *next = (pool_block_t *)list->self.p_next;
+
+        block_cache_Put (cache, list);
+        list = next;
+    }
+}
+
+static void block_cache_Destroy (void *data)
+{
+    block_cache_t *cache = data;
+
+    /* Close the return list: later returns are freed by their thread */
+    block_cache_Drain (cache, atomic_exchange (&cache->returned,
+                                               BLOCK_POOL_CLOSED));
+
+    for (unsigned i = 0; i < BLOCK_POOL_CLASSES; i++)
+    {
+        pool_block_t *pb = cache->free[i];
+
+        while (pb != NULL)
+        {
+            pool_block_t *next = (pool_block_t *)pb->self.p_next;
+
+            free (pb);
+            pb = next;
+        }
+        cache->delta[i] -= cache->count[i];
+    }
+    block_cache_Account (cache);
+
+    /* Blocks returned after the list was closed were subtracted already */
+    long lent = cache->lent;
+    if (atomic_fetch_add (&cache->orphans, lent) + lent == 0)
+        free (cache);
+}
+
+static block_cache_t *block_cache_Get (void)
+{
+    block_cache_t *cache = vlc_threadvar_get (block_pool.key);
+
+    if (unlikely(cache == NULL))
+    {
+        cache = calloc (1, sizeof (*cache));
+        if (unlikely(cache == NULL))
+            return NULL;
+        atomic_init (&cache->returned, NULL);
+        atomic_init (&cache->orphans, 0);
+        if (unlikely(vlc_threadvar_set (block_pool.key, cache)))
+        {
+            free (cache);
+            return NULL;
+        }
+    }
+    return cache;
+}
+
+/** Hands a block back to its owner from another thread */
+static void block_cache_Return (block_cache_t *owner, pool_block_t *pb)
+{
+    pool_block_t *head = atomic_load_explicit (&owner->returned,
+                                               memory_order_relaxed);
+    do
+    {
+        if (head == BLOCK_POOL_CLOSED)
+        {   /* The owner thread is gone */
+            free (pb);
+            if (atomic_fetch_sub (&owner->orphans, 1) - 1 == 0)
+                free (owner);
+            return;
+        }
+        pb->self.p_next = (block_t *)head;
+    }
+    while (!atomic_compare_exchange_weak_explicit (&owner->returned, &head,
+                                                   pb, memory_order_release,
+                                                   memory_order_relaxed));
+}
+
+static void block_pool_Release (block_t *block)
+{
+    pool_block_t *pb = (pool_block_t *)block;
+
+    assert (block->p_start == (unsigned char *)(pb + 1));
+    block_Invalidate (block);
+
+    /* The thread may have no cache (yet): do not create one to compare */
+    block_cache_t *cache = vlc_threadvar_get (block_pool.key);
+
+    if (cache != pb->owner)
+    {
+        if (cache != NULL)
+        {
+            cache->remote++;
+            if (++cache->ops >= BLOCK_POOL_FLUSH)
+                block_cache_Account (cache);
+        }
+        block_cache_Return (pb->owner, pb);
+        return;
+    }
+
+    block_cache_Put (cache, pb);
+    if (++cache->ops >= BLOCK_POOL_FLUSH)
+        block_cache_Account (cache);
+}
+
+static block_t *block_pool_Alloc (size_t size)
+{
+    unsigned cls = 0;
+
+    while (block_pool_sizes[cls] < size)
+        if (++cls >= BLOCK_POOL_CLASSES)
+            return NULL; /* too large to be cached */
+
+    block_cache_t *cache = block_cache_Get ();
+    if (unlikely(cache == NULL))
+        return NULL;
+
+    if (cache->free[cls] == NULL
+     && atomic_load_explicit (&cache->returned, memory_order_relaxed) != NULL)
+        block_cache_Drain (cache, atomic_exchange_explicit (&cache->returned,
+                                               NULL, memory_order_acquire));
+
+    const size_t alloc = sizeof (pool_block_t) + BLOCK_OVERHEAD
+                       + block_pool_sizes[cls];
+    pool_block_t *pb = cache->free[cls];
+
+    if (pb != NULL)
+    {
+        cache->free[cls] = (pool_block_t *)pb->self.p_next;
+        cache->count[cls]--;
+        cache->delta[cls]--;
+        cache->hits++;
+    }
+    else
+    {
+        pb = malloc (alloc);
+        if (unlikely(pb == NULL))
+            return NULL;
+        pb->owner = cache;
+        cache->misses++;
+    }
+    cache->lent++;
+    if (++cache->ops >= BLOCK_POOL_FLUSH)
+        block_cache_Account (cache);
+
+    block_t *b = &pb->self;
+    block_Init (b, pb + 1, alloc - sizeof (*pb));
+    b->p_buffer += BLOCK_PADDING + BLOCK_ALIGN - 1;
+    b->p_buffer = (void *)(((uintptr_t)b->p_buffer) & ~(BLOCK_ALIGN - 1));
+    b->i_buffer = size;
+    b->pf_release = block_pool_Release;
+    return b;
+}
+
+/**
+ * Enables or disables the block allocation cache.
+ *
+ * Disabling the cache does not flush the blocks already cached; they are
+ * freed when their thread exits.
+ */
+void block_pool_Enable (bool enable)
+{
+    vlc_mutex_lock (&block_pool.lock);
+    if (enable && !block_pool.initialized)
+        block_pool.initialized =
+            !vlc_threadvar_create (&block_pool.key, block_cache_Destroy);
+    atomic_store (&block_pool.enabled, enable && block_pool.initialized);
+    vlc_mutex_unlock (&block_pool.lock);
+}
+
+/**
+ * Reads the block allocation cache statistics.
+ *
+ * @note Each thread accounts its activity in batches, so that the values can
+ * lag behind by a few operations per thread.
+ */
+void block_pool_GetStats (block_pool_stats_t *st)
+{
+    st->hits = atomic_load_explicit (&block_pool.hits, memory_order_relaxed);
+    st->misses = atomic_load_explicit (&block_pool.misses,
+                                       memory_order_relaxed);
+    st->remote = atomic_load_explicit (&block_pool.remote,
+                                       memory_order_relaxed);
+    st->bytes = 0;
+    for (unsigned i = 0; i < BLOCK_POOL_CLASSES; i++)
+    {
+        long count = atomic_load_explicit (&block_pool.count[i],
+                                           memory_order_relaxed);
+
+        st->size[i] = block_pool_sizes[i];
+        st->count[i] = (count > 0) ? count : 0;
+        st->bytes += st->count[i] * block_pool_sizes[i];
+    }
+}
+
 block_t *block_Alloc (size_t size)
 {
+    if (atomic_load_explicit (&block_pool.enabled, memory_order_relaxed))
+    {
+        block_t *b = block_pool_Alloc (size);
+        if (b != NULL)
+            return b;
+    }
+
     /* 2 * BLOCK_PADDING: pre + post padding */
     const size_t alloc = sizeof (block_t) + BLOCK_ALIGN + (2 * BLOCK_PADDING)
                        + size;
@@ -145,6 +485,143 @@ block_t *block_Alloc (size_t size)
     return b;
 }
 
+/**
+ * @section Shared payloads
+ *
+ * A shareable block is a lightweight header referencing a payload owned by
+ * an origin block. Headers are allocated separately, so that each holder of
+ * a reference can trim the payload, and change its flags and timestamps
+ * independently. The origin block is released with the last reference.
+ */
+
+typedef struct
+{
+    atomic_uint refs;
+    block_t *origin;
+} block_payload_t;
+
+typedef struct
+{
+    block_t self;
+    block_payload_t *payload;
+} block_shared_t;
+
+static void block_shared_Release (block_t *block)
+{
+    block_payload_t *payload = ((block_shared_t *)block)->payload;
+
+    block_Invalidate (block);
+    free (block);
+
+    if (atomic_fetch_sub (&payload->refs, 1) == 1)
+    {
+        block_Release (payload->origin);
+        free (payload);
+    }
+}
+
+static block_t *block_shared_New (block_payload_t *payload, block_t *in)
+{
+    block_shared_t *sh = malloc (sizeof (*sh));
+    if (unlikely(sh == NULL))
+        return NULL;
+
+    block_Init (&sh->self, in->p_start, in->i_size);
+    sh->self.p_buffer = in->p_buffer;
+    sh->self.i_buffer = in->i_buffer;
+    block_CopyProperties (&sh->self, in);
+    sh->self.pf_release = block_shared_Release;
+    sh->payload = payload;
+    return &sh->self;
+}
+
+/** Whether other blocks reference the same payload */
+static bool block_shared_IsBusy (const block_t *block)
+{
+    if (block->pf_release != block_shared_Release)
+        return false;
+
+    const block_payload_t *payload = ((const block_shared_t *)block)->payload;
+    return atomic_load (&payload->refs) > 1;
+}
+
+/**
+ * Converts a block into a shareable block.
+ *
+ * @note The block is consumed. This is a no-op if it is already shareable.
+ * @return the shareable block, or NULL on error (the block is released then)
+ */
+block_t *block_Shareable (block_t *block)
+{
+    block_Check (block);
+
+    if (block->pf_release == block_shared_Release)
+        return block;
+
+    block_payload_t *payload = malloc (sizeof (*payload));
+    if (unlikely(payload == NULL))
+        goto error;
+
+    block_t *sh = block_shared_New (payload, block);
+    if (unlikely(sh == NULL))
+    {
+        free (payload);
+        goto error;
+    }
+
+    atomic_init (&payload->refs, 1);
+    payload->origin = block;
+    sh->p_next = block->p_next;
+    block->p_next = NULL;
+    return sh;
+
+error:
+    block_Release (block);
+    return NULL;
+}
+
+/**
+ * Creates a new reference to the payload of a block.
+ *
+ * This only allocates a block header if the block is shareable, and falls
+ * back to block_Duplicate() otherwise. Properties are copied, but not the
+ * chaining pointer.
+ */
+block_t *block_Share (block_t *block)
+{
+    block_Check (block);
+
+    if (block->pf_release != block_shared_Release)
+        return block_Duplicate (block);
+
+    block_payload_t *payload = ((block_shared_t *)block)->payload;
+    block_t *sh = block_shared_New (payload, block);
+    if (likely(sh != NULL))
+        atomic_fetch_add (&payload->refs, 1);
+    return sh;
+}
+
+/**
+ * Ensures that the payload of a block can be modified.
+ *
+ * If the payload is shared with other blocks, it is copied to a new block.
+ *
+ * @note The block is consumed.
+ * @return a block with a private payload, or NULL on error (the block is
+ * released then)
+ */
+block_t *block_Unshare (block_t *block)
+{
+    if (!block_shared_IsBusy (block))
+        return block;
+
+    block_t *dup = block_Duplicate (block);
+    if (likely(dup != NULL))
+        dup->p_next = block->p_next;
+    block_Release (block);
+    return dup;
+}
+
 block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
 {
     block_Check( p_block );
@@ -178,10 +655,13 @@ block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
         p_block->i_buffer = i_body;
 
     size_t requested = i_prebody + i_body;
+    /* A payload shared with other blocks is never expanded in place, as the
+     * caller would overwrite data that the other blocks can see. */
+    const bool exclusive = !block_shared_IsBusy( p_block );
 
     if( p_block->i_buffer == 0 )
     {   /* Corner case: nothing to preserve */
-        if( requested <= p_block->i_size )
+        if( requested <= p_block->i_size && exclusive )
         {   /* Enough room: recycle buffer */
             size_t extra = p_block->i_size - requested;
 
@@ -206,7 +686,8 @@ block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
     /* Second, reallocate the buffer if we lack space. */
     assert( i_prebody >= 0 );
     if( (size_t)(p_block->p_buffer - p_start) < (size_t)i_prebody
-     || (size_t)(p_end - p_block->p_buffer) < i_body )
+     || (size_t)(p_end - p_block->p_buffer) < i_body
+     || (!exclusive && (i_prebody > 0 || i_body > p_block->i_buffer)) )
     {
         block_t *p_rea = block_Alloc( requested );
         if( p_rea == NULL )
@@ -30,6 +30,8 @@
 
 #include <vlc_common.h>
 #include <vlc_block.h>
+#include <vlc_atomic.h>
+#include <vlc_interrupt.h>
 #include "libvlc.h"
 
 /**
@@ -359,3 +361,246 @@ size_t block_FifoCount (block_fifo_t *fifo)
     vlc_mutex_unlock (&fifo->lock);
     return depth;
 }
+
+/**
+ * @section Single-producer single-consumer block queue functions
+ */
+
+#define SPSC_CACHE_LINE 64
+
+/**
+ * Internal state for SPSC block queues
+ *
+ * The head index is only written by the consumer and the tail index only by
+ * the producer. Each side keeps a cached copy of the other side's index, so
+ * that the shared cache lines are only touched when the ring looks full
+ * (producer) or empty (consumer).
+ *
+ * Likewise, each side counts the bytes it moved on its own cache line; the
+ * queued size is the difference. The first line is only written when the
+ * consumer goes to sleep.
+ */
+struct vlc_spsc_t
+{
+    size_t              mask;
+    vlc_sem_t           wake; /**< Posted when the consumer is waiting */
+    atomic_bool         waiting;
+
+    char pad0[SPSC_CACHE_LINE];
+    atomic_size_t       head; /**< Next slot to dequeue */
+    atomic_size_t       bytes_out; /**< Bytes dequeued so far */
+    size_t              tail_cache;
+
+    char pad1[SPSC_CACHE_LINE];
+    atomic_size_t       tail; /**< Next slot to queue */
+    atomic_size_t       bytes_in; /**< Bytes queued so far */
+    size_t              head_cache;
+
+    char pad2[SPSC_CACHE_LINE];
+    block_t            *ring[];
+};
+
+/**
+ * Creates a single-producer single-consumer queue of blocks.
+ *
+ * @param capacity maximum number of queued blocks
+ *                 (rounded up to a power of two)
+ * @return the queue or NULL on memory error
+ */
+vlc_spsc_t *vlc_spsc_New(size_t capacity)
+{
+    size_t size = 2;
+
+    while (size < capacity)
+        size <<= 1;
+
+    vlc_spsc_t *q = malloc(sizeof (*q) + size * sizeof (q->ring[0]));
+    if (unlikely(q == NULL))
+        return NULL;
+
+    q->mask = size - 1;
+    vlc_sem_init(&q->wake, 0);
+    atomic_init(&q->waiting, false);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->bytes_out, 0);
+    q->tail_cache = 0;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->bytes_in, 0);
+    q->head_cache = 0;
+    return q;
+}
+
+/**
+ * Destroys a queue created by vlc_spsc_New().
+ * Any queued blocks are also destroyed.
+ *
+ * @warning Neither the producer nor the consumer may use the queue anymore.
+ */
+void vlc_spsc_Delete(vlc_spsc_t *q)
+{
+    block_t *block;
+
+    while ((block = vlc_spsc_TryDequeue(q)) != NULL)
+        block_Release(block);
+    vlc_sem_destroy(&q->wake);
+    free(q);
+}
+
+/**
+ * Queues one block. This function can only be called from the producer
+ * thread. It never blocks.
+ *
+ * @return VLC_SUCCESS, or VLC_EGENERIC if the queue is full (the block is
+ * then left to the caller).
+ */
+int vlc_spsc_Queue(vlc_spsc_t *q, block_t *block)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if (tail - q->head_cache > q->mask)
+    {
+        q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail - q->head_cache > q->mask)
+            return VLC_EGENERIC;
+    }
+
+    q->ring[tail & q->mask] = block;
+    /* Only the producer writes this: no need for a read-modify-write */
+    atomic_store_explicit(&q->bytes_in,
+        atomic_load_explicit(&q->bytes_in, memory_order_relaxed)
+        + block->i_buffer, memory_order_relaxed);
+    /* Sequentially consistent: must not be reordered with the load below */
+    atomic_store(&q->tail, tail + 1);
+
+    if (atomic_load(&q->waiting) && atomic_exchange(&q->waiting, false))
+        vlc_sem_post(&q->wake);
+    return VLC_SUCCESS;
+}
+
+/**
+ * Dequeues the first block, if any. This function can only be called from
+ * the consumer thread. It never blocks.
+ *
+ * @return the first block in the queue or NULL if the queue is empty
+ */
+block_t *vlc_spsc_TryDequeue(vlc_spsc_t *q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    if (head == q->tail_cache)
+    {
+        q->tail_cache = atomic_load(&q->tail);
+        if (head == q->tail_cache)
+            return NULL;
+    }
+
+    block_t *block = q->ring[head & q->mask];
+
+    /* Only the consumer writes this: no need for a read-modify-write */
+    atomic_store_explicit(&q->bytes_out,
+        atomic_load_explicit(&q->bytes_out, memory_order_relaxed)
+        + block->i_buffer, memory_order_release);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return block;
+}
+
+/**
+ * Announces that the consumer is about to sleep, and checks the queue again.
+ * @return a block if one was queued in the mean time, NULL otherwise
+ */
+static block_t *vlc_spsc_PrepareWait(vlc_spsc_t *q)
+{
+    atomic_store(&q->waiting, true);
+
+    block_t *block = vlc_spsc_TryDequeue(q);
+    if (block != NULL && !atomic_exchange(&q->waiting, false))
+    {   /* The producer woke us up already: consume the token (no wait) */
+        int canc = vlc_savecancel();
+        vlc_sem_wait(&q->wake);
+        vlc_restorecancel(canc);
+    }
+    return block;
+}
+
+/**
+ * Dequeues the first block, waiting for one if the queue is empty.
+ * This function can only be called from the consumer thread.
+ *
+ * @note This function is a cancellation point.
+ *
+ * @return a valid block
+ */
+block_t *vlc_spsc_Dequeue(vlc_spsc_t *q)
+{
+    block_t *block;
+
+    vlc_testcancel();
+
+    while ((block = vlc_spsc_TryDequeue(q)) == NULL)
+    {
+        block = vlc_spsc_PrepareWait(q);
+        if (block != NULL)
+            break;
+        vlc_sem_wait(&q->wake);
+    }
+    return block;
+}
+
+/**
+ * Dequeues the first block, waiting for one if the queue is empty, unless
+ * the calling thread is interrupted (see vlc_interrupt_raise()).
+ * This function can only be called from the consumer thread.
+ *
+ * @return a valid block, or NULL if interrupted while the queue was empty
+ */
+block_t *vlc_spsc_Dequeue_i11e(vlc_spsc_t *q)
+{
+    block_t *block;
+
+    while ((block = vlc_spsc_TryDequeue(q)) == NULL)
+    {
+        block = vlc_spsc_PrepareWait(q);
+        if (block != NULL)
+            break;
+
+        if (vlc_sem_wait_i11e(&q->wake))
+        {
+            if (!atomic_exchange(&q->waiting, false))
+            {   /* Consume the token posted in the mean time (no wait) */
+                int canc = vlc_savecancel();
+                vlc_sem_wait(&q->wake);
+                vlc_restorecancel(canc);
+            }
+            return vlc_spsc_TryDequeue(q);
+        }
+    }
+    return block;
+}
+
+/**
+ * Checks how many blocks are queued.
+ *
+ * @note The value may be outdated by the time it is returned if the other
+ * side of the queue is active.
+ */
+size_t vlc_spsc_GetCount(vlc_spsc_t *q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    return atomic_load_explicit(&q->tail, memory_order_acquire) - head;
+}
+
+/**
+ * Checks how many bytes are queued.
+ *
+ * @note The value may be outdated by the time it is returned if the other
+ * side of the queue is active.
+ */
+size_t vlc_spsc_GetBytes(vlc_spsc_t *q)
+{
+    /* Load the consumer count first, so that it cannot exceed the other:
+     * the matching bytes_in store happened before the bytes_out release. */
+    size_t out = atomic_load_explicit(&q->bytes_out, memory_order_acquire);
+
+    return atomic_load_explicit(&q->bytes_in, memory_order_relaxed) - out;
+}
@@ -34,20 +34,42 @@
 #include <vlc_atomic.h>
 #include "picture.h"
 
-static const uintptr_t pool_max = CHAR_BIT * sizeof (unsigned long long);
+#define POOL_WORD_BITS (CHAR_BIT * sizeof (unsigned long long))
 
+typedef struct {
+    picture_pool_t *pool;
+    picture_t      *picture;
+} picture_pool_slot_t;
+
+/* Free pictures are tracked in a bitmap of atomic words, one bit per picture.
+ * Pictures are claimed and returned with lock-free atomic operations; the
+ * mutex and condition variable are only used to wake threads sleeping in
+ * picture_pool_Wait(). */
 struct picture_pool_t {
     int       (*pic_lock)(picture_t *);
     void      (*pic_unlock)(picture_t *);
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
-    unsigned long long available;
-    atomic_ushort      refs;
-    unsigned short     picture_count;
-    picture_t  *picture[];
+    atomic_uint  refs;
+    atomic_uint  waiters;
+    unsigned     picture_count;
+    unsigned     word_count;
+    picture_pool_slot_t *slot;
+    atomic_ullong available[];
 };
 
+/** Bits of the given bitmap word that map to pictures of the pool */
+static unsigned long long picture_pool_WordMask(const picture_pool_t *pool,
+                                                unsigned word)
+{
+    unsigned bits = pool->picture_count - word * POOL_WORD_BITS;
+
+    if (bits >= POOL_WORD_BITS)
+        return ~0ULL;
+    return (1ULL << bits) - 1;
+}
+
 static void picture_pool_Destroy(picture_pool_t *pool)
 {
     if (atomic_fetch_sub(&pool->refs, 1) != 1)
@@ -55,23 +77,70 @@ static void picture_pool_Destroy(picture_pool_t *pool)
 
     vlc_cond_destroy(&pool->wait);
     vlc_mutex_destroy(&pool->lock);
-    vlc_free(pool);
+    free(pool);
 }
 
 void picture_pool_Release(picture_pool_t *pool)
 {
     for (unsigned i = 0; i < pool->picture_count; i++)
-        picture_Release(pool->picture[i]);
+        picture_Release(pool->slot[i].picture);
     picture_pool_Destroy(pool);
 }
 
+/**
+ * Claims the first free picture at or after the given offset.
+ * @return the picture offset, or -1 if none is free
+ */
+static int picture_pool_Claim(picture_pool_t *pool, unsigned start)
+{
+    for (unsigned w = start / POOL_WORD_BITS; w < pool->word_count; w++) {
+        unsigned long long mask = ~0ULL;
+
+        if (w == start / POOL_WORD_BITS)
+            mask <<= start % POOL_WORD_BITS;
+
+        unsigned long long word = atomic_load_explicit(&pool->available[w],
+                                                       memory_order_relaxed);
+        while (word & mask) {
+            unsigned long long bit = (word & mask) & -(word & mask);
+
+            if (atomic_compare_exchange_weak_explicit(&pool->available[w],
+                    &word, word & ~bit, memory_order_acquire,
+                    memory_order_relaxed))
+                return w * POOL_WORD_BITS + ffsll(bit) - 1;
+        }
+    }
+    return -1;
+}
+
+/** Returns a picture to the free bitmap and wakes up any waiting thread. */
+static void picture_pool_Unclaim(picture_pool_t *pool, unsigned offset)
+{
+    unsigned long long bit = 1ULL << (offset % POOL_WORD_BITS);
+    unsigned long long old;
+
+    old = atomic_fetch_or(&pool->available[offset / POOL_WORD_BITS], bit);
+    assert(!(old & bit));
+    (void) old;
+
+    /* Pairs with the fence in picture_pool_Wait(): either the waiter sees
+     * the free bit, or this sees the waiter. Without both fences, each load
+     * could be ordered before the other side's store on weakly ordered CPUs,
+     * and the wake-up would be lost. */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pool->waiters, memory_order_relaxed) > 0) {
+        vlc_mutex_lock(&pool->lock);
+        vlc_cond_signal(&pool->wait);
+        vlc_mutex_unlock(&pool->lock);
+    }
+}
+
 static void picture_pool_ReleasePicture(picture_t *clone)
 {
     picture_priv_t *priv = (picture_priv_t *)clone;
-    uintptr_t sys = (uintptr_t)priv->gc.opaque;
-    picture_pool_t *pool = (void *)(sys & ~(pool_max - 1));
-    unsigned offset = sys & (pool_max - 1);
-    picture_t *picture = pool->picture[offset];
+    picture_pool_slot_t *slot = priv->gc.opaque;
+    picture_pool_t *pool = slot->pool;
+    picture_t *picture = slot->picture;
 
     free(clone);
 
@@ -79,20 +148,15 @@ static void picture_pool_ReleasePicture(picture_t *clone)
         pool->pic_unlock(picture);
     picture_Release(picture);
 
-    vlc_mutex_lock(&pool->lock);
-    assert(!(pool->available & (1ULL << offset)));
-    pool->available |= 1ULL << offset;
-    vlc_cond_signal(&pool->wait);
-    vlc_mutex_unlock(&pool->lock);
-
+    picture_pool_Unclaim(pool, slot - pool->slot);
     picture_pool_Destroy(pool);
 }
 
 static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
                                             unsigned offset)
 {
-    picture_t *picture = pool->picture[offset];
-    uintptr_t sys = ((uintptr_t)pool) + offset;
+    picture_pool_slot_t *slot = &pool->slot[offset];
+    picture_t *picture = slot->picture;
     picture_resource_t res = {
         .p_sys = picture->p_sys,
         .pf_destroy = picture_pool_ReleasePicture,
@@ -106,7 +170,7 @@ static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
 
     picture_t *clone = picture_NewFromResource(&picture->format, &res);
     if (likely(clone != NULL)) {
-        ((picture_priv_t *)clone)->gc.opaque = (void *)sys;
+        ((picture_priv_t *)clone)->gc.opaque = slot;
         picture_Hold(picture);
     }
     return clone;
@@ -114,11 +178,15 @@ static picture_t *picture_pool_ClonePicture(picture_pool_t *pool,
 
 picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg)
 {
-    if (unlikely(cfg->picture_count > pool_max))
+    unsigned count = cfg->picture_count;
+    unsigned words = (count + POOL_WORD_BITS - 1) / POOL_WORD_BITS;
+
+    if (unlikely(count > INT_MAX))
         return NULL;
 
-    picture_pool_t *pool = vlc_memalign(pool_max,
-        sizeof (*pool) + cfg->picture_count * sizeof (picture_t *));
+    size_t size = sizeof (picture_pool_t)
+                + words * sizeof (atomic_ullong);
+    picture_pool_t *pool = malloc(size + count * sizeof (picture_pool_slot_t));
     if (unlikely(pool == NULL))
         return NULL;
 
@@ -126,11 +194,18 @@ picture_pool_t *picture_pool_NewExtended(const picture_pool_configuration_t *cfg
     pool->pic_unlock = cfg->unlock;
     vlc_mutex_init(&pool->lock);
     vlc_cond_init(&pool->wait);
-    pool->available = (1ULL << cfg->picture_count) - 1;
-    atomic_init(&pool->refs,  1);
-    pool->picture_count = cfg->picture_count;
-    memcpy(pool->picture, cfg->picture,
-           cfg->picture_count * sizeof (picture_t *));
+    atomic_init(&pool->refs, 1);
+    atomic_init(&pool->waiters, 0);
+    pool->picture_count = count;
+    pool->word_count = words;
+    pool->slot = (picture_pool_slot_t *)(((char *)pool) + size);
+
+    for (unsigned i = 0; i < words; i++)
+        atomic_init(&pool->available[i], picture_pool_WordMask(pool, i));
+    for (unsigned i = 0; i < count; i++) {
+        pool->slot[i].pool = pool;
+        pool->slot[i].picture = cfg->picture[i];
+    }
     return pool;
 }
 
@@ -191,87 +266,76 @@ error:
     return NULL;
 }
 
-/** Find next (bit) set */
-static int fnsll(unsigned long long x, unsigned i)
+static picture_t *picture_pool_Take(picture_pool_t *pool, unsigned offset)
 {
-    if (i >= CHAR_BIT * sizeof (x))
-        return 0;
-    return ffsll(x & ~((1ULL << i) - 1));
+    picture_t *clone = picture_pool_ClonePicture(pool, offset);
+    if (clone != NULL) {
+        assert(clone->p_next == NULL);
+        atomic_fetch_add(&pool->refs, 1);
+    }
+    return clone;
 }
 
 picture_t *picture_pool_Get(picture_pool_t *pool)
 {
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    assert(atomic_load(&pool->refs) > 0);
 
-    for (unsigned i = ffsll(pool->available); i; i = fnsll(pool->available, i))
+    for (int i = picture_pool_Claim(pool, 0); i >= 0;
+         i = picture_pool_Claim(pool, i + 1))
     {
-        pool->available &= ~(1ULL << (i - 1));
-        vlc_mutex_unlock(&pool->lock);
-
-        picture_t *picture = pool->picture[i - 1];
+        picture_t *picture = pool->slot[i].picture;
 
         if (pool->pic_lock != NULL && pool->pic_lock(picture) != 0) {
-            vlc_mutex_lock(&pool->lock);
-            pool->available |= 1ULL << (i - 1);
+            picture_pool_Unclaim(pool, i);
             continue;
         }
-
-        picture_t *clone = picture_pool_ClonePicture(pool, i - 1);
-        if (clone != NULL) {
-            assert(clone->p_next == NULL);
-            atomic_fetch_add(&pool->refs, 1);
-        }
-        return clone;
+        return picture_pool_Take(pool, i);
     }
-
-    vlc_mutex_unlock(&pool->lock);
     return NULL;
 }
 
 picture_t *picture_pool_Wait(picture_pool_t *pool)
 {
-    unsigned i;
-
-    vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
+    int i;
 
-    while (pool->available == 0)
-        vlc_cond_wait(&pool->wait, &pool->lock);
+    assert(atomic_load(&pool->refs) > 0);
 
-    i = ffsll(pool->available);
-    assert(i > 0);
-    pool->available &= ~(1ULL << (i - 1));
-    vlc_mutex_unlock(&pool->lock);
-
-    picture_t *picture = pool->picture[i - 1];
-
-    if (pool->pic_lock != NULL && pool->pic_lock(picture) != 0) {
+    i = picture_pool_Claim(pool, 0);
+    if (i < 0) {
         vlc_mutex_lock(&pool->lock);
-        pool->available |= 1ULL << (i - 1);
-        vlc_cond_signal(&pool->wait);
+        atomic_fetch_add(&pool->waiters, 1);
+        /* See picture_pool_Unclaim() */
+        atomic_thread_fence(memory_order_seq_cst);
+        while ((i = picture_pool_Claim(pool, 0)) < 0)
+            vlc_cond_wait(&pool->wait, &pool->lock);
+        atomic_fetch_sub(&pool->waiters, 1);
         vlc_mutex_unlock(&pool->lock);
-        return NULL;
     }
 
-    picture_t *clone = picture_pool_ClonePicture(pool, i - 1);
-    if (clone != NULL) {
-        assert(clone->p_next == NULL);
-        atomic_fetch_add(&pool->refs, 1);
+    picture_t *picture = pool->slot[i].picture;
+
+    if (pool->pic_lock != NULL && pool->pic_lock(picture) != 0) {
+        picture_pool_Unclaim(pool, i);
+        return NULL;
     }
-    return clone;
+    return picture_pool_Take(pool, i);
 }
 
 unsigned picture_pool_Reset(picture_pool_t *pool)
 {
-    unsigned ret;
+    unsigned ret = 0;
+
+    assert(atomic_load(&pool->refs) > 0);
+
+    for (unsigned i = 0; i < pool->word_count; i++) {
+        unsigned long long mask = picture_pool_WordMask(pool, i);
+
+        ret += popcountll(mask & ~atomic_exchange(&pool->available[i], mask));
+    }
 
     vlc_mutex_lock(&pool->lock);
-    assert(pool->refs > 0);
-    ret = pool->picture_count - popcountll(pool->available);
-    pool->available = (1ULL << pool->picture_count) - 1;
+    vlc_cond_broadcast(&pool->wait);
     vlc_mutex_unlock(&pool->lock);
-
     return ret;
 }
 
@@ -286,5 +350,5 @@ void picture_pool_Enum(picture_pool_t *pool, void (*cb)(void *, picture_t *),
     /* NOTE: So far, the pictures table cannot change after the pool is created
      * so there is no need to lock the pool mutex here. */
     for (unsigned i = 0; i < pool->picture_count; i++)
-        cb(opaque, pool->picture[i]);
+        cb(opaque, pool->slot[i].picture);
 }
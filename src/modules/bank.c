@@ -45,12 +45,21 @@
 #include "config/configuration.h"
 #include "modules/modules.h"
 
+typedef struct
+{
+    const char *cap;
+    module_t *module;
+    size_t rank; /* position in the bank, to keep the order of equals */
+} module_cap_t;
+
 static struct
 {
     vlc_mutex_t lock;
     module_t *head;
     unsigned usage;
-} modules = { VLC_STATIC_MUTEX, NULL, 0 };
+    module_cap_t *caps; /* all modules, sorted by capability */
+    size_t caps_count;
+} modules = { VLC_STATIC_MUTEX, NULL, 0, NULL, 0 };
 
 /*****************************************************************************
  * Local prototypes
@@ -59,6 +68,7 @@ static struct
 static void AllocateAllPlugins (vlc_object_t *);
 #endif
 static module_t *module_InitStatic (vlc_plugin_cb);
+static void module_IndexBank (void);
 
 static void module_StoreBank (module_t *module)
 {
@@ -143,6 +153,9 @@ void module_EndBank (bool b_plugins)
     if (--modules.usage == 0)
     {
         config_UnsortConfig ();
+        free (modules.caps);
+        modules.caps = NULL;
+        modules.caps_count = 0;
         head = modules.head;
         modules.head = NULL;
     }
@@ -185,6 +198,7 @@ size_t module_LoadPlugins (vlc_object_t *obj)
 #endif
         config_UnsortConfig ();
         config_SortConfig ();
+        module_IndexBank ();
     }
     vlc_mutex_unlock (&modules.lock);
 
@@ -257,11 +271,38 @@ static int modulecmp (const void *a, const void *b)
  */
 ssize_t module_list_cap (module_t ***restrict list, const char *cap)
 {
-    /* TODO: This is quite inefficient. List should be sorted by capability. */
     ssize_t n = 0;
 
     assert (list != NULL);
 
+    if (modules.caps != NULL)
+    {
+        /* Find the first module with the capability */
+        size_t lo = 0, hi = modules.caps_count;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (strcmp (modules.caps[mid].cap, cap) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        while (lo + n < modules.caps_count
+            && !strcmp (modules.caps[lo + n].cap, cap))
+            n++;
+
+        module_t **tab = malloc (sizeof (*tab) * n);
+        *list = tab;
+        if (unlikely(tab == NULL))
+            return -1;
+
+        for (ssize_t i = 0; i < n; i++)
+            tab[i] = modules.caps[lo + i].module;
+        qsort (tab, n, sizeof (*tab), modulecmp);
+        return n;
+    }
+
+    /* The bank is not indexed until the plugins are loaded */
     for (module_t *mod = modules.head; mod != NULL; mod = mod->next)
     {
          if (module_provides (mod, cap))
@@ -290,6 +331,46 @@ ssize_t module_list_cap (module_t ***restrict list, const char *cap)
     return n;
 }
 
+static int capcmp (const void *a, const void *b)
+{
+    const module_cap_t *ca = a, *cb = b;
+    int ret = strcmp (ca->cap, cb->cap);
+
+    if (ret == 0)
+        ret = (ca->rank > cb->rank) - (ca->rank < cb->rank);
+    return ret;
+}
+
+/**
+ * Indexes all the modules of the bank by capability, for module_list_cap().
+ */
+static void module_IndexBank (void)
+{
+    size_t count;
+    module_t **list = module_list_get (&count);
+
+    free (modules.caps);
+    modules.caps = NULL;
+    modules.caps_count = 0;
+    if (list == NULL)
+        return;
+
+    module_cap_t *caps = malloc (sizeof (*caps) * count);
+    if (likely(caps != NULL))
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            caps[i].cap = module_get_capability (list[i]);
+            caps[i].module = list[i];
+            caps[i].rank = i;
+        }
+        qsort (caps, count, sizeof (*caps), capcmp);
+        modules.caps = caps;
+        modules.caps_count = count;
+    }
+    module_list_free (list);
+}
+
 #ifdef HAVE_DYNAMIC_PLUGINS
 typedef enum { CACHE_USE, CACHE_RESET, CACHE_IGNORE } cache_mode_t;
 
@@ -411,9 +492,6 @@ static void AllocatePluginPath (vlc_object_t *p_this, const char *path,
                 free (cache[i].path);
             }
             free( cache );
-            for (size_t i = 0; i < bank.i_cache; i++)
-                free (bank.cache[i].path);
-            free (bank.cache);
             break;
         case CACHE_RESET:
             CacheSave (p_this, path, bank.cache, bank.i_cache);
@@ -558,7 +636,7 @@ static int AllocatePluginFile (module_bank_t *bank, const char *abspath,
 
     module_StoreBank (module);
 
-    if (bank->mode != CACHE_IGNORE) /* Add entry to cache */
+    if (bank->mode == CACHE_RESET) /* Add entry to the cache to be saved */
         CacheAdd (&bank->cache, &bank->i_cache, relpath, st, module);
     /* TODO: deal with errors */
     return  0;
@@ -40,6 +40,7 @@
 #include "libvlc.h"
 
 #include <vlc_plugin.h>
+#include <vlc_block.h>
 #include <errno.h>
 
 #include "config/configuration.h"
@@ -76,8 +77,21 @@ void CacheDelete( vlc_object_t *obj, const char *dir )
     free( path );
 }
 
+/* The whole cache file is in memory, and consumed from the front of the
+ * block as it is parsed */
+static int CacheLoadData (void *buf, size_t size, block_t *file)
+{
+    if (file->i_buffer < size)
+        return -1;
+
+    memcpy (buf, file->p_buffer, size);
+    file->p_buffer += size;
+    file->i_buffer -= size;
+    return 0;
+}
+
 #define LOAD_IMMEDIATE(a) \
-    if (fread (&(a), sizeof (char), sizeof (a), file) != sizeof (a)) \
+    if (CacheLoadData (&(a), sizeof (a), file)) \
         goto error
 #define LOAD_FLAG(a) \
     do { \
@@ -88,7 +102,7 @@ void CacheDelete( vlc_object_t *obj, const char *dir )
         (a) = b; \
     } while (0)
 
-static int CacheLoadString (char **p, FILE *file)
+static int CacheLoadString (char **p, block_t *file)
 {
     char *psz = NULL;
     uint16_t size;
@@ -105,7 +119,7 @@ error:
         psz = malloc (size+1);
         if (unlikely(psz == NULL))
             goto error;
-        if (fread (psz, 1, size, file) != size)
+        if (CacheLoadData (psz, size, file))
         {
             free (psz);
             goto error;
@@ -119,7 +133,7 @@ error:
 #define LOAD_STRING(a) \
     if (CacheLoadString (&(a), file)) goto error
 
-static int CacheLoadConfig (module_config_t *cfg, FILE *file)
+static int CacheLoadConfig (module_config_t *cfg, block_t *file)
 {
     LOAD_IMMEDIATE (cfg->i_type);
     LOAD_IMMEDIATE (cfg->i_short);
@@ -182,7 +196,7 @@ error:
     return -1; /* FIXME: leaks */
 }
 
-static int CacheLoadModuleConfig (module_t *module, FILE *file)
+static int CacheLoadModuleConfig (module_t *module, block_t *file)
 {
     uint16_t lines;
 
@@ -214,7 +228,7 @@ error:
     return -1; /* FIXME: leaks */
 }
 
-static module_t *CacheLoadModule (FILE *file)
+static module_t *CacheLoadModule (block_t *file)
 {
     module_t *module = vlc_module_create (NULL);
     if (unlikely(module == NULL))
@@ -280,6 +294,13 @@ error:
     return NULL;
 }
 
+static int CacheCompare (const void *a, const void *b)
+{
+    const module_cache_t *ca = a, *cb = b;
+
+    return strcmp (ca->path ? ca->path : "", cb->path ? cb->path : "");
+}
+
 /**
  * Loads a plugins cache file.
  *
@@ -291,9 +312,8 @@ error:
 size_t CacheLoad( vlc_object_t *p_this, const char *dir, module_cache_t **r )
 {
     char *psz_filename;
-    FILE *file;
-    int i_size, i_read;
-    char p_cachestring[sizeof(CACHE_STRING)];
+    block_t *file;
+    size_t i_size;
     int32_t i_marker;
 
     assert( dir != NULL );
@@ -304,7 +324,8 @@ size_t CacheLoad( vlc_object_t *p_this, const char *dir, module_cache_t **r )
 
     msg_Dbg( p_this, "loading plugins cache file %s", psz_filename );
 
-    file = vlc_fopen( psz_filename, "rb" );
+    /* Map the whole file at once rather than reading it piecewise */
+    file = block_FilePath( psz_filename );
     if( !file )
     {
         msg_Warn( p_this, "cannot read %s: %s", psz_filename,
@@ -314,64 +335,63 @@ size_t CacheLoad( vlc_object_t *p_this, const char *dir, module_cache_t **r )
     }
     free( psz_filename );
 
+    const uint8_t *p_start = file->p_buffer;
+
     /* Check the file is a plugins cache */
     i_size = sizeof(CACHE_STRING) - 1;
-    i_read = fread( p_cachestring, 1, i_size, file );
-    if( i_read != i_size ||
-        memcmp( p_cachestring, CACHE_STRING, i_size ) )
+    if( file->i_buffer < i_size ||
+        memcmp( file->p_buffer, CACHE_STRING, i_size ) )
     {
         msg_Warn( p_this, "This doesn't look like a valid plugins cache" );
-        fclose( file );
+        block_Release( file );
         return 0;
     }
+    file->p_buffer += i_size;
+    file->i_buffer -= i_size;
 
 #ifdef DISTRO_VERSION
     /* Check for distribution specific version */
-    char p_distrostring[sizeof( DISTRO_VERSION )];
     i_size = sizeof( DISTRO_VERSION ) - 1;
-    i_read = fread( p_distrostring, 1, i_size, file );
-    if( i_read != i_size ||
-        memcmp( p_distrostring, DISTRO_VERSION, i_size ) )
+    if( file->i_buffer < i_size ||
+        memcmp( file->p_buffer, DISTRO_VERSION, i_size ) )
     {
         msg_Warn( p_this, "This doesn't look like a valid plugins cache" );
-        fclose( file );
+        block_Release( file );
         return 0;
     }
+    file->p_buffer += i_size;
+    file->i_buffer -= i_size;
 #endif
 
     /* Check sub-version number */
-    i_read = fread( &i_marker, 1, sizeof(i_marker), file );
-    if( i_read != sizeof(i_marker) || i_marker != CACHE_SUBVERSION_NUM )
+    if( CacheLoadData( &i_marker, sizeof(i_marker), file ) ||
+        i_marker != CACHE_SUBVERSION_NUM )
     {
         msg_Warn( p_this, "This doesn't look like a valid plugins cache "
                   "(corrupted header)" );
-        fclose( file );
+        block_Release( file );
         return 0;
     }
 
     /* Check header marker */
-    i_read = fread( &i_marker, 1, sizeof(i_marker), file );
-    if( i_read != sizeof(i_marker) ||
-        i_marker != ftell( file ) - (int)sizeof(i_marker) )
+    i_size = file->p_buffer - p_start;
+    if( CacheLoadData( &i_marker, sizeof(i_marker), file ) ||
+        i_marker != (int32_t)i_size )
     {
         msg_Warn( p_this, "This doesn't look like a valid plugins cache "
                   "(corrupted header)" );
-        fclose( file );
+        block_Release( file );
         return 0;
     }
 
     module_cache_t *cache = NULL;
     size_t count = 0;
 
-    for (;;)
+    while (file->i_buffer > 0)
     {
         module_t *module = CacheLoadModule (file);
         if (module == NULL)
-        {
-            if (feof (file))
-                break;
             goto error;
-        }
 
         char *path;
         struct stat st;
@@ -388,18 +408,18 @@ size_t CacheLoad( vlc_object_t *p_this, const char *dir, module_cache_t **r )
         /* TODO: deal with errors */
     }
 
-    fclose( file );
+    block_Release( file );
 
+    /* Sort by path for CacheFind() */
+    qsort (cache, count, sizeof (*cache), CacheCompare);
     *r = cache;
     return count;
 
 error:
-    if (ferror (file))
-        msg_Err(p_this, "plugins cache read error: %s", vlc_strerror_c(errno));
     msg_Warn( p_this, "plugins cache not loaded (corrupted)" );
 
     /* TODO: cleanup */
-    fclose( file );
+    block_Release( file );
     return 0;
 }
 
@@ -658,27 +678,23 @@ void CacheMerge( vlc_object_t *p_this, module_t *p_cache, module_t *p_module )
 }
 
 /**
- * Looks up a plugin file in a table of cached plugins.
+ * Looks up a plugin file in a table of cached plugins, as sorted by
+ * CacheLoad().
  */
 module_t *CacheFind (module_cache_t *cache, size_t count,
                      const char *path, const struct stat *st)
 {
-    while (count > 0)
-    {
-        if (cache->path != NULL
-         && !strcmp (cache->path, path)
-         && cache->mtime == st->st_mtime
-         && cache->size == st->st_size)
-       {
-            module_t *module = cache->p_module;
-            cache->p_module = NULL;
-            return module;
-       }
-       cache++;
-       count--;
-    }
+    const module_cache_t key = { .path = (char *)path };
 
-    return NULL;
+    cache = bsearch (&key, cache, count, sizeof (*cache), CacheCompare);
+    if (cache == NULL
+     || cache->mtime != st->st_mtime
+     || cache->size != st->st_size)
+        return NULL;
+
+    module_t *module = cache->p_module;
+    cache->p_module = NULL;
+    return module;
 }
 
 /** Adds entry to the cache */
@@ -170,7 +170,7 @@ static bool module_match_name (const module_t *m, const char *name)
 }
 
 static int module_load (vlc_object_t *obj, module_t *m,
-                        vlc_activate_t init, va_list args)
+                        vlc_activate_t init, bool timed, va_list args)
 {
     int ret = VLC_SUCCESS;
 
@@ -179,15 +179,24 @@ static int module_load (vlc_object_t *obj, module_t *m,
 
     if (m->pf_activate != NULL)
     {
+        const mtime_t start = timed ? mdate () : 0;
         va_list ap;
 
         va_copy (ap, args);
         ret = init (m->pf_activate, ap);
         va_end (ap);
+
+        if (timed && ret != VLC_SUCCESS)
+            msg_Dbg (obj, "%s module \"%s\" rejected in %"PRId64" us",
+                     m->psz_capability, module_get_object (m),
+                     mdate () - start);
     }
     return ret;
 }
 
+static module_t *module_load_va (vlc_object_t *, const char *, const char *,
+                                 bool, bool, vlc_activate_t, va_list);
+
 #undef vlc_module_load
 /**
  * Finds and instantiates the best module of a certain type.
@@ -212,6 +221,32 @@ static int module_load (vlc_object_t *obj, module_t *m,
 module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
                           const char *name, bool strict,
                           vlc_activate_t probe, ...)
+{
+    va_list args;
+
+    va_start (args, probe);
+    module_t *module = module_load_va (obj, capability, name, strict, false,
+                                       probe, args);
+    va_end (args);
+    return module;
+}
+
+static module_t *module_load_timed (vlc_object_t *obj, const char *capability,
+                                    const char *name, bool strict,
+                                    vlc_activate_t probe, ...)
+{
+    va_list args;
+
+    va_start (args, probe);
+    module_t *module = module_load_va (obj, capability, name, strict, true,
+                                       probe, args);
+    va_end (args);
+    return module;
+}
+
+static module_t *module_load_va (vlc_object_t *obj, const char *capability,
+                                 const char *name, bool strict, bool timed,
+                                 vlc_activate_t probe, va_list args)
 {
     char *var = NULL;
 
@@ -240,9 +275,7 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
 
     module_t *module = NULL;
     const bool b_force_backup = obj->b_force; /* FIXME: remove this */
-    va_list args;
 
-    va_start(args, probe);
     while (*name)
     {
         char buf[32];
@@ -274,7 +307,7 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
                 continue;
             mods[i] = NULL; // only try each module once at most...
 
-            int ret = module_load (obj, cand, probe, args);
+            int ret = module_load (obj, cand, probe, timed, args);
             switch (ret)
             {
                 case VLC_SUCCESS:
@@ -296,7 +329,7 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
             if (cand == NULL || module_get_score (cand) <= 0)
                 continue;
 
-            int ret = module_load (obj, cand, probe, args);
+            int ret = module_load (obj, cand, probe, timed, args);
             switch (ret)
             {
                 case VLC_SUCCESS:
@@ -308,7 +341,6 @@ module_t *vlc_module_load(vlc_object_t *obj, const char *capability,
         }
     }
 done:
-    va_end (args);
     obj->b_force = b_force_backup;
     module_list_free (mods);
     free (var);
@@ -366,6 +398,17 @@ module_t *module_need(vlc_object_t *obj, const char *cap, const char *name,
     return vlc_module_load(obj, cap, name, strict, generic_start, obj);
 }
 
+#undef module_need_timed
+/**
+ * Same as module_need(), but also logs how long each candidate module that
+ * failed to initialize took to do so, e.g. to find slow demuxer probes.
+ */
+module_t *module_need_timed(vlc_object_t *obj, const char *cap,
+                            const char *name, bool strict)
+{
+    return module_load_timed(obj, cap, name, strict, generic_start, obj);
+}
+
 #undef module_unneed
 void module_unneed(vlc_object_t *obj, module_t *module)
 {
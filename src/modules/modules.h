@@ -112,6 +112,9 @@ int module_Map (vlc_object_t *, module_t *);
 
 ssize_t module_list_cap (module_t ***, const char *);
 
+module_t *module_need_timed (vlc_object_t *, const char *, const char *, bool);
+#define module_need_timed(a,b,c,d) module_need_timed(VLC_OBJECT(a),b,c,d)
+
 int vlc_bindtextdomain (const char *);
 
 /* Low-level OS-dependent handler */
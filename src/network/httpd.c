@@ -40,6 +40,7 @@
 #include <vlc_url.h>
 #include <vlc_mime.h>
 #include <vlc_block.h>
+#include <vlc_fs.h>
 #include "../libvlc.h"
 
 #include <string.h>
@@ -49,6 +50,10 @@
 #ifdef HAVE_POLL
 # include <poll.h>
 #endif
+#ifdef __linux__
+# include <sys/epoll.h>
+#endif
+#include <fcntl.h>
 
 #if defined(_WIN32)
 #   include <winsock2.h>
@@ -66,7 +71,37 @@
 static void httpd_ClientClean(httpd_client_t *cl);
 static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data);
 
-/* each host run in his own thread */
+/* each worker thread serves a share of the connections of a host */
+typedef struct httpd_worker_t
+{
+    httpd_host_t *host;
+    vlc_thread_t  thread;
+
+    /* Protects the pending connections, and the streaming connections from
+     * httpd_UrlDelete(): those are served without the host lock. */
+    vlc_mutex_t   lock;
+    int           wake[2]; /* self-pipe, to notify pending connections */
+
+    /* connections served by this thread, only modified by this thread with
+     * the host lock held */
+    int             i_client;
+    httpd_client_t **client;
+
+    /* connections assigned by another thread but not served yet */
+    int             i_pending;
+    httpd_client_t **pending;
+
+    unsigned        i_load; /* assigned connections, under the host lock */
+
+#ifdef __linux__
+    int             epfd;
+#else
+    struct pollfd  *ufd;
+    unsigned        i_ufd;
+#endif
+} httpd_worker_t;
+
+/* each host run in his own threads */
 struct httpd_host_t
 {
     VLC_COMMON_MEMBERS
@@ -79,7 +114,6 @@ struct httpd_host_t
     unsigned     nfd;
     unsigned     port;
 
-    vlc_thread_t thread;
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
@@ -90,8 +124,9 @@ struct httpd_host_t
     int         i_url;
     httpd_url_t **url;
 
-    int            i_client;
-    httpd_client_t **client;
+    /* the first worker also accepts new connections */
+    unsigned        i_worker;
+    httpd_worker_t *worker;
 
     /* TLS data */
     vlc_tls_creds_t *p_tls;
@@ -125,6 +160,7 @@ enum
     HTTPD_CLIENT_SEND_DONE,
 
     HTTPD_CLIENT_WAITING,
+    HTTPD_CLIENT_STREAMING, /* sending from a httpd_stream_t buffer */
 
     HTTPD_CLIENT_DEAD,
 
@@ -171,6 +207,24 @@ struct httpd_client_t
 
     /* TLS data */
     vlc_tls_t *p_tls;
+
+    /* Stream sent straight from its circular buffer, and whether the socket
+     * was full on the last attempt */
+    httpd_stream_t *stream;
+    bool    b_stream_blocked;
+
+    /* Stream data overwritten in the circular buffer before it could be
+     * sent (HTTPD_STREAM_LAG_SPILL), and what this client lost so far.
+     * All protected by the stream lock. */
+    block_t  *p_spill;
+    block_t **pp_spill_last;
+    size_t   i_spill;
+    unsigned i_drops;
+    uint64_t i_dropped;
+
+    /* poll events: watched, and received by the last wait */
+    short   i_events;
+    short   i_revents;
 };
 
 
@@ -617,6 +671,20 @@ struct httpd_stream_t
     int64_t     i_buffer_pos;       /* absolute position from begining */
     int64_t     i_buffer_last_pos;  /* a new connection will start with that */
 
+    /* clients sent from the buffer, see httpd_ClientStream() */
+    int             i_client;
+    httpd_client_t  **client;
+
+    /* see httpd_StreamSetPolicy() */
+    bool        b_burst;
+    int         i_lag_policy;
+    size_t      i_spill_max;
+
+    /* lag statistics, including the clients already gone */
+    unsigned    i_drops;
+    uint64_t    i_dropped;
+    unsigned    i_disconnects;
+
     /* custom headers */
     size_t        i_http_headers;
     httpd_header * p_http_headers;
@@ -632,47 +700,8 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         return VLC_SUCCESS;
 
     if (answer->i_body_offset > 0) {
-        int     i_pos;
-
-        if (answer->i_body_offset >= stream->i_buffer_pos)
-            return VLC_EGENERIC;    /* wait, no data available */
-
-        if (cl->i_keyframe_wait_to_pass >= 0) {
-            if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
-                /* still waiting for the next keyframe */
-                return VLC_EGENERIC;
-
-            /* seek to the new keyframe */
-            answer->i_body_offset = stream->i_last_keyframe_seen_pos;
-            cl->i_keyframe_wait_to_pass = -1;
-        }
-
-        if (answer->i_body_offset + stream->i_buffer_size < stream->i_buffer_pos)
-            answer->i_body_offset = stream->i_buffer_last_pos; /* this client isn't fast enough */
-
-        i_pos   = answer->i_body_offset % stream->i_buffer_size;
-        int64_t i_write = stream->i_buffer_pos - answer->i_body_offset;
-
-        if (i_write > HTTPD_CL_BUFSIZE)
-            i_write = HTTPD_CL_BUFSIZE;
-        else if (i_write <= 0)
-            return VLC_EGENERIC;    /* wait, no data available */
-
-        /* Don't go past the end of the circular buffer */
-        i_write = __MIN(i_write, stream->i_buffer_size - i_pos);
-
-        /* using HTTPD_MSG_ANSWER -> data available */
-        answer->i_proto  = HTTPD_PROTO_HTTP;
-        answer->i_version= 0;
-        answer->i_type   = HTTPD_MSG_ANSWER;
-
-        answer->i_body = i_write;
-        answer->p_body = xmalloc(i_write);
-        memcpy(answer->p_body, &stream->p_buffer[i_pos], i_write);
-
-        answer->i_body_offset += i_write;
-
-        return VLC_SUCCESS;
+        /* Data is sent straight from the buffer by httpd_ClientStream() */
+        return VLC_EGENERIC;
     } else {
         answer->i_proto  = HTTPD_PROTO_HTTP;
         answer->i_version= 0;
@@ -698,6 +727,7 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
 
         if (query->i_type != HTTPD_MSG_HEAD) {
             cl->b_stream_mode = true;
+            cl->stream = stream;
             vlc_mutex_lock(&stream->lock);
             /* Send the header */
             if (stream->i_header > 0) {
@@ -705,11 +735,19 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
                 answer->p_body = xmalloc(stream->i_header);
                 memcpy(answer->p_body, stream->p_header, stream->i_header);
             }
-            answer->i_body_offset = stream->i_buffer_last_pos;
-            if (stream->b_has_keyframes)
-                cl->i_keyframe_wait_to_pass = stream->i_last_keyframe_seen_pos;
-            else
+            if (stream->b_burst && stream->b_has_keyframes &&
+                stream->i_last_keyframe_seen_pos + stream->i_buffer_size
+                    >= stream->i_buffer_pos) {
+                /* Start from the last keyframe, still in the buffer */
+                answer->i_body_offset = stream->i_last_keyframe_seen_pos;
                 cl->i_keyframe_wait_to_pass = -1;
+            } else {
+                answer->i_body_offset = stream->i_buffer_last_pos;
+                if (stream->b_has_keyframes)
+                    cl->i_keyframe_wait_to_pass = stream->i_last_keyframe_seen_pos;
+                else
+                    cl->i_keyframe_wait_to_pass = -1;
+            }
             vlc_mutex_unlock(&stream->lock);
         } else {
             httpd_MsgAdd(answer, "Content-Length", "0");
@@ -775,6 +813,13 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
     stream->i_last_keyframe_seen_pos = 0;
     stream->i_http_headers = 0;
     stream->p_http_headers = NULL;
+    TAB_INIT(stream->i_client, stream->client);
+    stream->b_burst = false;
+    stream->i_lag_policy = HTTPD_STREAM_LAG_KEYFRAME;
+    stream->i_spill_max = 0;
+    stream->i_drops = 0;
+    stream->i_dropped = 0;
+    stream->i_disconnects = 0;
 
     httpd_UrlCatch(stream->url, HTTPD_MSG_HEAD, httpd_StreamCallBack,
                     (httpd_callback_sys_t*)stream);
@@ -802,8 +847,172 @@ int httpd_StreamHeader(httpd_stream_t *stream, uint8_t *p_data, int i_data)
     return VLC_SUCCESS;
 }
 
+void httpd_StreamSetPolicy(httpd_stream_t *stream, bool b_burst,
+                           int i_lag_policy, size_t i_spill_max)
+{
+    vlc_mutex_lock(&stream->lock);
+    stream->b_burst = b_burst;
+    stream->i_lag_policy = i_lag_policy;
+    stream->i_spill_max = i_spill_max;
+    vlc_mutex_unlock(&stream->lock);
+}
+
+static void httpd_StreamDropSpill(httpd_stream_t *stream, httpd_client_t *cl)
+{
+    block_ChainRelease(cl->p_spill);
+    cl->p_spill = NULL;
+    cl->pp_spill_last = &cl->p_spill;
+    cl->i_dropped += cl->i_spill;
+    stream->i_dropped += cl->i_spill;
+    cl->i_spill = 0;
+}
+
+/* Applies the lag policy to a client whose unsent data is being overwritten.
+ * Returns false if the client must be disconnected. */
+static bool httpd_StreamLag(httpd_stream_t *stream, httpd_client_t *cl)
+{
+    httpd_StreamDropSpill(stream, cl);
+    cl->i_drops++;
+    stream->i_drops++;
+
+    if (stream->i_lag_policy == HTTPD_STREAM_LAG_DISCONNECT) {
+        stream->i_disconnects++;
+        return false;
+    }
+
+    if (stream->b_has_keyframes) {
+        /* Resume from the first keyframe past the lost data */
+        cl->i_keyframe_wait_to_pass = cl->answer.i_body_offset;
+    } else {
+        /* No keyframes: resume from the last block */
+        int64_t i_skip = stream->i_buffer_last_pos - cl->answer.i_body_offset;
+
+        cl->i_dropped += i_skip;
+        stream->i_dropped += i_skip;
+        cl->answer.i_body_offset = stream->i_buffer_last_pos;
+    }
+    return true;
+}
+
+/* Copies the data about to be overwritten by i_data new bytes to the spill
+ * buffers of the clients that have not sent it yet */
+static void httpd_StreamSpill(httpd_stream_t *stream, int i_data)
+{
+    int64_t i_end = stream->i_buffer_pos + i_data - stream->i_buffer_size;
+
+    for (int i = 0; i < stream->i_client; i++) {
+        httpd_client_t *cl = stream->client[i];
+        int64_t i_offset = cl->answer.i_body_offset;
+
+        if (cl->i_keyframe_wait_to_pass >= 0 || i_offset >= i_end)
+            continue;
+        if (i_offset + stream->i_buffer_size < stream->i_buffer_pos)
+            continue; /* already lost, see httpd_ClientStream() */
+
+        int64_t i_len = __MIN(i_end, stream->i_buffer_pos) - i_offset;
+        block_t *p_spill = NULL;
+
+        if (cl->i_spill + i_len <= stream->i_spill_max)
+            p_spill = block_Alloc(i_len);
+        if (p_spill == NULL) {
+            httpd_StreamLag(stream, cl);
+            continue;
+        }
+
+        int i_pos = i_offset % stream->i_buffer_size;
+        int i_copy = __MIN(i_len, stream->i_buffer_size - i_pos);
+
+        memcpy(p_spill->p_buffer, &stream->p_buffer[i_pos], i_copy);
+        memcpy(p_spill->p_buffer + i_copy, stream->p_buffer, i_len - i_copy);
+
+        *cl->pp_spill_last = p_spill;
+        cl->pp_spill_last = &p_spill->p_next;
+        cl->i_spill += i_len;
+        cl->answer.i_body_offset = i_offset + i_len;
+    }
+}
+
+static void httpd_StreamAttach(httpd_client_t *cl)
+{
+    httpd_stream_t *stream = cl->stream;
+
+    vlc_mutex_lock(&stream->lock);
+    TAB_APPEND(stream->i_client, stream->client, cl);
+    vlc_mutex_unlock(&stream->lock);
+}
+
+static void httpd_StreamDetach(httpd_client_t *cl)
+{
+    httpd_stream_t *stream = cl->stream;
+
+    vlc_mutex_lock(&stream->lock);
+    TAB_REMOVE(stream->i_client, stream->client, cl);
+    block_ChainRelease(cl->p_spill);
+    cl->p_spill = NULL;
+    cl->pp_spill_last = &cl->p_spill;
+    cl->i_spill = 0;
+    vlc_mutex_unlock(&stream->lock);
+    cl->stream = NULL;
+}
+
+int httpd_StreamGetStats(httpd_stream_t *stream, httpd_stream_stats_t *stats,
+                         httpd_client_stats_t **pp_clients)
+{
+    httpd_client_stats_t *clients = NULL;
+
+    vlc_mutex_lock(&stream->lock);
+    if (pp_clients != NULL && stream->i_client > 0) {
+        clients = malloc(stream->i_client * sizeof (*clients));
+        if (unlikely(clients == NULL)) {
+            vlc_mutex_unlock(&stream->lock);
+            return VLC_ENOMEM;
+        }
+    }
+
+    stats->i_clients = stream->i_client;
+    stats->i_max_lag = 0;
+    stats->i_spill = 0;
+    stats->i_drops = stream->i_drops;
+    stats->i_dropped = stream->i_dropped;
+    stats->i_disconnects = stream->i_disconnects;
+
+    for (int i = 0; i < stream->i_client; i++) {
+        httpd_client_t *cl = stream->client[i];
+        uint64_t i_lag = cl->i_spill;
+
+        if (cl->i_keyframe_wait_to_pass < 0 &&
+            cl->answer.i_body_offset < stream->i_buffer_pos)
+            i_lag += stream->i_buffer_pos - cl->answer.i_body_offset;
+
+        if (i_lag > stats->i_max_lag)
+            stats->i_max_lag = i_lag;
+        stats->i_spill += cl->i_spill;
+
+        if (clients != NULL) {
+            httpd_client_stats_t *cs = &clients[i];
+
+            if (httpd_ClientIP(cl, cs->psz_ip, &cs->i_port) == NULL) {
+                cs->psz_ip[0] = '\0';
+                cs->i_port = 0;
+            }
+            cs->i_lag = i_lag;
+            cs->i_spill = cl->i_spill;
+            cs->i_drops = cl->i_drops;
+            cs->i_dropped = cl->i_dropped;
+        }
+    }
+    vlc_mutex_unlock(&stream->lock);
+
+    if (pp_clients != NULL)
+        *pp_clients = clients;
+    return VLC_SUCCESS;
+}
+
 static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data)
 {
+    if (stream->i_lag_policy == HTTPD_STREAM_LAG_SPILL)
+        httpd_StreamSpill(stream, i_data);
+
     int i_pos = stream->i_buffer_pos % stream->i_buffer_size;
     int i_count = i_data;
     while (i_count > 0) {
@@ -849,6 +1058,7 @@ void httpd_StreamDelete(httpd_stream_t *stream)
         free(stream->p_http_headers[i].value);
     }
     free(stream->p_http_headers);
+    TAB_CLEAN(stream->i_client, stream->client);
     vlc_mutex_destroy(&stream->lock);
     free(stream->psz_mime);
     free(stream->p_header);
@@ -862,6 +1072,8 @@ void httpd_StreamDelete(httpd_stream_t *stream)
 static void* httpd_HostThread(void *);
 static httpd_host_t *httpd_HostCreate(vlc_object_t *, const char *,
                                        const char *, vlc_tls_creds_t *);
+static int httpd_WorkerInit(httpd_host_t *, httpd_worker_t *);
+static void httpd_WorkerClean(httpd_worker_t *);
 
 /* create a new host */
 httpd_host_t *vlc_http_HostNew(vlc_object_t *p_this)
@@ -970,16 +1182,45 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
     host->port     = port;
     host->i_url    = 0;
     host->url      = NULL;
-    host->i_client = 0;
-    host->client   = NULL;
     host->p_tls    = p_tls;
 
-    /* create the thread */
-    if (vlc_clone(&host->thread, httpd_HostThread, host,
-                   VLC_THREAD_PRIORITY_LOW)) {
-        msg_Err(p_this, "cannot spawn http host thread");
+    /* create the threads */
+#ifdef _WIN32
+    host->i_worker = 1; /* pipes cannot be polled along with sockets */
+#else
+    host->i_worker = var_InheritInteger(p_this, "http-threads");
+    if (host->i_worker < 1)
+        host->i_worker = 1;
+#endif
+    host->worker = malloc(host->i_worker * sizeof (*host->worker));
+    if (unlikely(host->worker == NULL))
         goto error;
-    }
+
+    for (unsigned i = 0; i < host->i_worker; i++)
+        if (httpd_WorkerInit(host, &host->worker[i])) {
+            while (i > 0)
+                httpd_WorkerClean(&host->worker[--i]);
+            free(host->worker);
+            msg_Err(p_this, "cannot initialize http host polling");
+            goto error;
+        }
+
+    for (unsigned i = 0; i < host->i_worker; i++)
+        if (vlc_clone(&host->worker[i].thread, httpd_HostThread,
+                      &host->worker[i], VLC_THREAD_PRIORITY_LOW)) {
+            msg_Err(p_this, "cannot spawn http host thread");
+            vlc_mutex_lock(&host->lock);
+            host->i_ref = 0;
+            vlc_mutex_unlock(&host->lock);
+            while (i > 0) {
+                vlc_cancel(host->worker[--i].thread);
+                vlc_join(host->worker[i].thread, NULL);
+            }
+            for (i = 0; i < host->i_worker; i++)
+                httpd_WorkerClean(&host->worker[i]);
+            free(host->worker);
+            goto error;
+        }
 
     /* now add it to httpd */
     TAB_APPEND(httpd.i_host, httpd.host, host);
@@ -1024,23 +1265,19 @@ void httpd_HostDelete(httpd_host_t *host)
     }
     TAB_REMOVE(httpd.i_host, httpd.host, host);
 
-    vlc_cancel(host->thread);
-    vlc_join(host->thread, NULL);
+    for (unsigned i = 0; i < host->i_worker; i++)
+        vlc_cancel(host->worker[i].thread);
+    for (unsigned i = 0; i < host->i_worker; i++)
+        vlc_join(host->worker[i].thread, NULL);
 
     msg_Dbg(host, "HTTP host removed");
 
     for (int i = 0; i < host->i_url; i++)
         msg_Err(host, "url still registered: %s", host->url[i]->psz_url);
 
-    for (int i = 0; i < host->i_client; i++) {
-        httpd_client_t *cl = host->client[i];
-        msg_Warn(host, "client still connected");
-        httpd_ClientClean(cl);
-        TAB_REMOVE(host->i_client, host->client, cl);
-        free(cl);
-        i--;
-        /* TODO */
-    }
+    for (unsigned i = 0; i < host->i_worker; i++)
+        httpd_WorkerClean(&host->worker[i]);
+    free(host->worker);
 
     vlc_tls_Delete(host->p_tls);
     net_ListenClose(host->fds);
@@ -1079,7 +1316,7 @@ httpd_url_t *httpd_UrlNew(httpd_host_t *host, const char *psz_url,
     }
 
     TAB_APPEND(host->i_url, host->url, url);
-    vlc_cond_signal(&host->wait);
+    vlc_cond_broadcast(&host->wait);
     vlc_mutex_unlock(&host->lock);
 
     return url;
@@ -1110,18 +1347,26 @@ void httpd_UrlDelete(httpd_url_t *url)
     free(url->psz_user);
     free(url->psz_password);
 
-    for (int i = 0; i < host->i_client; i++) {
-        httpd_client_t *client = host->client[i];
+    for (unsigned i = 0; i < host->i_worker; i++) {
+        httpd_worker_t *w = &host->worker[i];
 
-        if (client->url != url)
-            continue;
+        vlc_mutex_lock(&w->lock);
+        for (int j = 0; j < w->i_client; j++) {
+            httpd_client_t *client = w->client[j];
+
+            if (client->url != url)
+                continue;
 
-        /* TODO complete it */
-        msg_Warn(host, "force closing connections");
-        httpd_ClientClean(client);
-        TAB_REMOVE(host->i_client, host->client, client);
-        free(client);
-        i--;
+            /* TODO complete it */
+            msg_Warn(host, "force closing connections");
+            /* The worker thread releases the connection when it wakes up */
+            client->url = NULL;
+            if (client->stream != NULL)
+                httpd_StreamDetach(client);
+            client->i_state = HTTPD_CLIENT_DEAD;
+            shutdown(client->fd, SHUT_RDWR);
+        }
+        vlc_mutex_unlock(&w->lock);
     }
     free(url);
     vlc_mutex_unlock(&host->lock);
@@ -1230,6 +1475,9 @@ static void httpd_ClientClean(httpd_client_t *cl)
         cl->fd = -1;
     }
 
+    if (cl->stream != NULL)
+        httpd_StreamDetach(cl);
+
     httpd_MsgClean(&cl->answer);
     httpd_MsgClean(&cl->query);
 
@@ -1247,6 +1495,15 @@ static httpd_client_t *httpd_ClientNew(int fd, vlc_tls_t *p_tls, mtime_t now)
     cl->fd      = fd;
     cl->url     = NULL;
     cl->p_tls = p_tls;
+    cl->stream  = NULL;
+    cl->b_stream_blocked = false;
+    cl->p_spill = NULL;
+    cl->pp_spill_last = &cl->p_spill;
+    cl->i_spill = 0;
+    cl->i_drops = 0;
+    cl->i_dropped = 0;
+    cl->i_events = 0;
+    cl->i_revents = 0;
 
     httpd_ClientInit(cl, now);
     if (p_tls)
@@ -1283,6 +1540,39 @@ ssize_t httpd_NetSend (httpd_client_t *cl, const uint8_t *p, size_t i_len)
     return val;
 }
 
+static
+ssize_t httpd_NetSendv (httpd_client_t *cl, const struct iovec *iov,
+                        unsigned count)
+{
+#ifndef _WIN32
+    if (cl->p_tls == NULL) {
+        struct msghdr hdr = {
+            .msg_iov = (struct iovec *)iov,
+            .msg_iovlen = count,
+        };
+        ssize_t val;
+
+        do
+            val = sendmsg (cl->fd, &hdr, MSG_NOSIGNAL);
+        while (val == -1 && errno == EINTR);
+        return val;
+    }
+#endif
+
+    /* TLS records are built from one buffer at a time */
+    ssize_t total = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        ssize_t val = httpd_NetSend (cl, iov[i].iov_base, iov[i].iov_len);
+
+        if (val < 0)
+            return total ? total : val;
+        total += val;
+        if ((size_t)val < iov[i].iov_len)
+            break;
+    }
+    return total;
+}
 
 static const struct
 {
@@ -1665,6 +1955,128 @@ static void httpd_ClientSend(httpd_client_t *cl)
     }
 }
 
+/* Sends stream data straight from the stream circular buffer */
+#define HTTPD_STREAM_IOV 16
+
+static void httpd_ClientStream(httpd_client_t *cl, mtime_t now)
+{
+    httpd_stream_t *stream = cl->stream;
+    short revents = cl->i_revents;
+
+    cl->i_revents = 0;
+    if (cl->b_stream_blocked && revents == 0)
+        return; /* the socket is still full */
+
+    vlc_mutex_lock(&stream->lock);
+
+    int64_t i_offset = cl->answer.i_body_offset;
+
+    if (cl->p_spill == NULL && i_offset >= stream->i_buffer_pos)
+        goto idle;  /* wait, no data available */
+
+    if (cl->i_keyframe_wait_to_pass < 0 &&
+        i_offset + stream->i_buffer_size < stream->i_buffer_pos) {
+        /* this client isn't fast enough */
+        if (!httpd_StreamLag(stream, cl)) {
+            vlc_mutex_unlock(&stream->lock);
+            cl->i_state = HTTPD_CLIENT_DEAD;
+            return;
+        }
+        i_offset = cl->answer.i_body_offset;
+    }
+
+    if (cl->i_keyframe_wait_to_pass >= 0) {
+        int64_t i_keyframe = stream->i_last_keyframe_seen_pos;
+
+        if (i_keyframe + stream->i_buffer_size < stream->i_buffer_pos)
+            /* overwritten already, wait for the next one */
+            cl->i_keyframe_wait_to_pass = i_keyframe;
+        if (i_keyframe <= cl->i_keyframe_wait_to_pass)
+            /* still waiting for the next keyframe */
+            goto idle;
+
+        /* seek to the new keyframe (on connection, nothing was lost) */
+        if (cl->i_drops > 0) {
+            cl->i_dropped += i_keyframe - i_offset;
+            stream->i_dropped += i_keyframe - i_offset;
+        }
+        i_offset = i_keyframe;
+        cl->i_keyframe_wait_to_pass = -1;
+    }
+
+    /* Send the spilled data first, then up to the write position, wrapping
+     * around the end of the buffer */
+    struct iovec iov[HTTPD_STREAM_IOV];
+    unsigned count = 0;
+    size_t i_write = 0;
+    block_t *p_spill = cl->p_spill;
+
+    for (; p_spill != NULL && count < HTTPD_STREAM_IOV - 2;
+         p_spill = p_spill->p_next) {
+        iov[count].iov_base = p_spill->p_buffer;
+        iov[count].iov_len = p_spill->i_buffer;
+        i_write += p_spill->i_buffer;
+        count++;
+    }
+
+    if (p_spill == NULL && i_offset < stream->i_buffer_pos) {
+        int     i_pos = i_offset % stream->i_buffer_size;
+        int64_t i_data = stream->i_buffer_pos - i_offset;
+
+        iov[count].iov_base = stream->p_buffer + i_pos;
+        iov[count].iov_len = __MIN(i_data, stream->i_buffer_size - i_pos);
+        if ((int64_t)iov[count].iov_len < i_data) {
+            count++;
+            iov[count].iov_base = stream->p_buffer;
+            iov[count].iov_len = i_data - iov[count - 1].iov_len;
+        }
+        count++;
+        i_write += i_data;
+    }
+
+    ssize_t val = httpd_NetSendv(cl, iov, count);
+
+    if (val >= 0) {
+        size_t i_sent = val;
+
+        while (i_sent > 0 && cl->p_spill != NULL) {
+            block_t *p_block = cl->p_spill;
+            size_t i_copy = __MIN(i_sent, p_block->i_buffer);
+
+            p_block->p_buffer += i_copy;
+            p_block->i_buffer -= i_copy;
+            cl->i_spill -= i_copy;
+            i_sent -= i_copy;
+            if (p_block->i_buffer == 0) {
+                cl->p_spill = p_block->p_next;
+                if (cl->p_spill == NULL)
+                    cl->pp_spill_last = &cl->p_spill;
+                block_Release(p_block);
+            }
+        }
+        i_offset += i_sent;
+        cl->i_activity_date = now;
+        cl->b_stream_blocked = (size_t)val < i_write;
+    }
+#if defined(_WIN32)
+    else if (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+    else if (errno == EAGAIN)
+#endif
+        cl->b_stream_blocked = true;
+    else
+        cl->i_state = HTTPD_CLIENT_DEAD;
+
+    cl->answer.i_body_offset = i_offset;
+    vlc_mutex_unlock(&stream->lock);
+    return;
+
+idle:
+    cl->answer.i_body_offset = i_offset;
+    vlc_mutex_unlock(&stream->lock);
+    cl->b_stream_blocked = false;
+}
+
 static void httpd_ClientTlsHandshake(httpd_client_t *cl)
 {
     switch (vlc_tls_SessionHandshake(cl->p_tls, NULL, NULL, NULL))
@@ -1716,15 +2128,148 @@ auth_failed:
     return false;
 }
 
-static void httpdLoop(httpd_host_t *host)
+static void httpd_WorkerWake(httpd_worker_t *w)
+{
+    if (w->wake[1] != -1)
+        (void) vlc_write(w->wake[1], &(char){ 0 }, 1);
+}
+
+static int httpd_WorkerInit(httpd_host_t *host, httpd_worker_t *w)
 {
-    struct pollfd ufd[host->nfd + host->i_client];
-    unsigned nfd;
-    for (nfd = 0; nfd < host->nfd; nfd++) {
-        ufd[nfd].fd = host->fds[nfd];
-        ufd[nfd].events = POLLIN;
-        ufd[nfd].revents = 0;
+    w->host = host;
+    w->i_client = 0;
+    w->client = NULL;
+    w->i_pending = 0;
+    w->pending = NULL;
+    w->i_load = 0;
+    w->wake[0] = w->wake[1] = -1;
+
+#ifndef _WIN32
+    if (vlc_pipe(w->wake))
+        return VLC_EGENERIC;
+    for (unsigned i = 0; i < 2; i++)
+        fcntl(w->wake[i], F_SETFL, fcntl(w->wake[i], F_GETFL) | O_NONBLOCK);
+#endif
+
+#ifdef __linux__
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epfd == -1) {
+        close(w->wake[0]);
+        close(w->wake[1]);
+        return VLC_EGENERIC;
+    }
+
+    /* Listening sockets are tagged with a NULL pointer */
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = w };
+
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wake[0], &ev);
+    if (w == host->worker) {
+        ev.data.ptr = NULL;
+        for (unsigned i = 0; i < host->nfd; i++)
+            epoll_ctl(w->epfd, EPOLL_CTL_ADD, host->fds[i], &ev);
+    }
+#else
+    w->ufd = NULL;
+    w->i_ufd = 0;
+#endif
+    vlc_mutex_init(&w->lock);
+    return VLC_SUCCESS;
+}
+
+static void httpd_WorkerClean(httpd_worker_t *w)
+{
+    for (int i = 0; i < w->i_pending; i++)
+        TAB_APPEND(w->i_client, w->client, w->pending[i]);
+    TAB_CLEAN(w->i_pending, w->pending);
+
+    for (int i = 0; i < w->i_client; i++) {
+        msg_Warn(w->host, "client still connected");
+        httpd_ClientClean(w->client[i]);
+        free(w->client[i]);
+        /* TODO */
+    }
+    TAB_CLEAN(w->i_client, w->client);
+
+#ifdef __linux__
+    close(w->epfd);
+#else
+    free(w->ufd);
+#endif
+    if (w->wake[0] != -1) {
+        close(w->wake[0]);
+        close(w->wake[1]);
     }
+    vlc_mutex_destroy(&w->lock);
+}
+
+/* Starts serving the connections assigned by other threads */
+static void httpd_WorkerAdopt(httpd_worker_t *w)
+{
+    vlc_mutex_lock(&w->lock);
+    for (int i = 0; i < w->i_pending; i++) {
+        httpd_client_t *cl = w->pending[i];
+
+#ifdef __linux__
+        struct epoll_event ev = { .events = 0, .data.ptr = cl };
+
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, cl->fd, &ev))
+            cl->i_state = HTTPD_CLIENT_DEAD;
+#endif
+        TAB_APPEND(w->i_client, w->client, cl);
+    }
+    TAB_CLEAN(w->i_pending, w->pending);
+    vlc_mutex_unlock(&w->lock);
+}
+
+/* Accepts new connections, and assigns them to the least loaded worker */
+static void httpd_HostAccept(httpd_worker_t *self, mtime_t now)
+{
+    httpd_host_t *host = self->host;
+
+    for (unsigned i = 0; i < host->nfd; i++) {
+        int fd;
+
+        while ((fd = vlc_accept(host->fds[i], NULL, NULL, true)) != -1) {
+            setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
+                    &(int){ 1 }, sizeof(int));
+
+            vlc_tls_t *p_tls;
+
+            if (host->p_tls != NULL)
+            {
+                const char *alpn[] = { "http/1.1", NULL };
+
+                p_tls = vlc_tls_SessionCreate(host->p_tls, fd, NULL, alpn);
+            }
+            else
+                p_tls = NULL;
+
+            httpd_client_t *cl = httpd_ClientNew(fd, p_tls, now);
+            if (unlikely(cl == NULL)) {
+                if (p_tls != NULL)
+                    vlc_tls_SessionDelete(p_tls);
+                net_Close(fd);
+                continue;
+            }
+
+            httpd_worker_t *w = &host->worker[0];
+            for (unsigned j = 1; j < host->i_worker; j++)
+                if (host->worker[j].i_load < w->i_load)
+                    w = &host->worker[j];
+            w->i_load++;
+
+            vlc_mutex_lock(&w->lock);
+            TAB_APPEND(w->i_pending, w->pending, cl);
+            vlc_mutex_unlock(&w->lock);
+            if (w != self)
+                httpd_WorkerWake(w);
+        }
+    }
+}
+
+static void httpdLoop(httpd_worker_t *w)
+{
+    httpd_host_t *host = w->host;
 
     /* add all socket that should be read/write and close dead connection */
     while (host->i_url <= 0) {
@@ -1737,35 +2282,74 @@ static void httpdLoop(httpd_host_t *host)
     bool b_low_delay = false;
 
     int canc = vlc_savecancel();
-    for (int i_client = 0; i_client < host->i_client; i_client++) {
+    httpd_WorkerAdopt(w);
+
+#ifndef __linux__
+    unsigned nfd = 0;
+    size_t i_ufd = host->nfd + 1 + w->i_client;
+
+    if (i_ufd > w->i_ufd) {
+        struct pollfd *ufd = realloc(w->ufd, i_ufd * sizeof (*ufd));
+        if (unlikely(ufd == NULL)) {
+            vlc_mutex_unlock(&host->lock);
+            vlc_restorecancel(canc);
+            msleep(100000);
+            vlc_mutex_lock(&host->lock);
+            return;
+        }
+        w->ufd = ufd;
+        w->i_ufd = i_ufd;
+    }
+
+    if (w == host->worker)
+        for (; nfd < host->nfd; nfd++) {
+            w->ufd[nfd].fd = host->fds[nfd];
+            w->ufd[nfd].events = POLLIN;
+            w->ufd[nfd].revents = 0;
+        }
+    if (w->wake[0] != -1) {
+        w->ufd[nfd].fd = w->wake[0];
+        w->ufd[nfd].events = POLLIN;
+        w->ufd[nfd].revents = 0;
+        nfd++;
+    }
+    const unsigned i_client_fd = nfd;
+#endif
+
+    for (int i_client = 0; i_client < w->i_client; i_client++) {
         int64_t i_offset;
-        httpd_client_t *cl = host->client[i_client];
+        httpd_client_t *cl = w->client[i_client];
         if (cl->i_ref < 0 || (cl->i_ref == 0 &&
                     (cl->i_state == HTTPD_CLIENT_DEAD ||
                       (cl->i_activity_timeout > 0 &&
                         cl->i_activity_date+cl->i_activity_timeout < now)))) {
+#ifdef __linux__
+            epoll_ctl(w->epfd, EPOLL_CTL_DEL, cl->fd, NULL);
+#endif
             httpd_ClientClean(cl);
-            TAB_REMOVE(host->i_client, host->client, cl);
+            TAB_REMOVE(w->i_client, w->client, cl);
             free(cl);
+            w->i_load--;
             i_client--;
             continue;
         }
 
-        struct pollfd *pufd = ufd + nfd;
-        assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
-
-        pufd->fd = cl->fd;
-        pufd->events = pufd->revents = 0;
+        short events = 0;
 
         switch (cl->i_state) {
             case HTTPD_CLIENT_RECEIVING:
             case HTTPD_CLIENT_TLS_HS_IN:
-                pufd->events = POLLIN;
+                events = POLLIN;
                 break;
 
             case HTTPD_CLIENT_SENDING:
             case HTTPD_CLIENT_TLS_HS_OUT:
-                pufd->events = POLLOUT;
+                events = POLLOUT;
+                break;
+
+            case HTTPD_CLIENT_STREAMING:
+                if (cl->b_stream_blocked)
+                    events = POLLOUT;
                 break;
 
             case HTTPD_CLIENT_RECEIVE_DONE: {
@@ -1916,6 +2500,7 @@ static void httpdLoop(httpd_host_t *host)
                     bool b_query = false;
 
                     cl->url = NULL;
+                    cl->stream = NULL;
                     if (psz_connection) {
                         b_connection = (strcasecmp(psz_connection, "Close") == 0);
                         b_keepalive = (strcasecmp(psz_connection, "Keep-Alive") == 0);
@@ -1950,7 +2535,12 @@ static void httpdLoop(httpd_host_t *host)
                     cl->i_buffer = 0;
                     cl->i_buffer_size = 0;
 
-                    cl->i_state = HTTPD_CLIENT_WAITING;
+                    if (cl->stream != NULL) {
+                        cl->b_stream_blocked = false;
+                        cl->i_state = HTTPD_CLIENT_STREAMING;
+                        httpd_StreamAttach(cl);
+                    } else
+                        cl->i_state = HTTPD_CLIENT_WAITING;
                 }
                 break;
 
@@ -1974,45 +2564,113 @@ static void httpdLoop(httpd_host_t *host)
                 }
         }
 
-        if (pufd->events != 0)
+#ifdef __linux__
+        if (events != cl->i_events) {
+            struct epoll_event ev = { .events = 0, .data.ptr = cl };
+
+            if (events & POLLIN)
+                ev.events |= EPOLLIN;
+            if (events & POLLOUT)
+                ev.events |= EPOLLOUT;
+            epoll_ctl(w->epfd, EPOLL_CTL_MOD, cl->fd, &ev);
+            cl->i_events = events;
+        }
+#else
+        if (events != 0) {
+            w->ufd[nfd].fd = cl->fd;
+            w->ufd[nfd].events = events;
+            w->ufd[nfd].revents = 0;
             nfd++;
-        else
+        }
+#endif
+        if (events == 0)
             b_low_delay = true;
     }
     vlc_mutex_unlock(&host->lock);
     vlc_restorecancel(canc);
 
     /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
-    int ret = poll(ufd, nfd, b_low_delay ? 20 : -1);
+#ifdef __linux__
+    struct epoll_event ev[64];
+    int ret = epoll_wait(w->epfd, ev, ARRAY_SIZE(ev), b_low_delay ? 20 : -1);
+#else
+    int ret = poll(w->ufd, nfd, b_low_delay ? 20 : -1);
+#endif
 
     canc = vlc_savecancel();
-    vlc_mutex_lock(&host->lock);
-    switch(ret) {
-        case -1:
-            if (errno != EINTR) {
-                /* Kernel on low memory or a bug: pace */
-                msg_Err(host, "polling error: %s", vlc_strerror_c(errno));
-                msleep(100000);
+    if (ret == -1) {
+        if (errno != EINTR) {
+            /* Kernel on low memory or a bug: pace */
+            msg_Err(host, "polling error: %s", vlc_strerror_c(errno));
+            msleep(100000);
+        }
+        ret = 0;
+    }
+
+    /* Dispatch events to client sockets */
+    bool b_accept = false, b_wake = false;
+#ifdef __linux__
+    for (int i = 0; i < ret; i++) {
+        httpd_client_t *cl = ev[i].data.ptr;
+
+        if (cl == NULL)
+            b_accept = true;
+        else if (ev[i].data.ptr == w)
+            b_wake = true;
+        else {
+            cl->i_revents = 0;
+            if (ev[i].events & EPOLLIN)
+                cl->i_revents |= POLLIN;
+            if (ev[i].events & EPOLLOUT)
+                cl->i_revents |= POLLOUT;
+            if (ev[i].events & (EPOLLERR|EPOLLHUP))
+                cl->i_revents |= POLLERR;
+        }
+    }
+#else
+    if (ret > 0) {
+        for (unsigned i = 0; i < i_client_fd; i++)
+            if (w->ufd[i].revents != 0) {
+                if (w->ufd[i].fd == w->wake[0])
+                    b_wake = true;
+                else
+                    b_accept = true;
             }
-        case 0:
-            vlc_restorecancel(canc);
-            return;
+
+        unsigned n = i_client_fd;
+        for (int i = 0; i < w->i_client && n < nfd; i++) {
+            httpd_client_t *cl = w->client[i];
+
+            if (cl->fd == w->ufd[n].fd) // we were waiting for this client
+                cl->i_revents = w->ufd[n++].revents;
+        }
+    }
+#endif
+    if (b_wake) {
+        char dummy[64];
+
+        while (read(w->wake[0], dummy, sizeof (dummy)) > 0);
     }
 
-    /* Handle client sockets */
+    /* Handle streaming clients, without the host lock */
     now = mdate();
-    nfd = host->nfd;
+    vlc_mutex_lock(&w->lock);
+    for (int i = 0; i < w->i_client; i++) {
+        httpd_client_t *cl = w->client[i];
 
-    for (int i_client = 0; i_client < host->i_client; i_client++) {
-        httpd_client_t *cl = host->client[i_client];
-        const struct pollfd *pufd = &ufd[nfd];
+        if (cl->i_state == HTTPD_CLIENT_STREAMING)
+            httpd_ClientStream(cl, now);
+    }
+    vlc_mutex_unlock(&w->lock);
 
-        assert(pufd < &ufd[sizeof(ufd) / sizeof(ufd[0])]);
+    /* Handle other client sockets */
+    vlc_mutex_lock(&host->lock);
+    for (int i = 0; i < w->i_client; i++) {
+        httpd_client_t *cl = w->client[i];
+        short revents = cl->i_revents;
 
-        if (cl->fd != pufd->fd)
-            continue; // we were not waiting for this client
-        ++nfd;
-        if (pufd->revents == 0)
+        cl->i_revents = 0;
+        if (revents == 0)
             continue; // no event received
 
         cl->i_activity_date = now;
@@ -2026,48 +2684,20 @@ static void httpdLoop(httpd_host_t *host)
     }
 
     /* Handle server sockets (accept new connections) */
-    for (nfd = 0; nfd < host->nfd; nfd++) {
-        httpd_client_t *cl;
-        int fd = ufd[nfd].fd;
-
-        assert (fd == host->fds[nfd]);
-
-        if (ufd[nfd].revents == 0)
-            continue;
-
-        /* */
-        fd = vlc_accept (fd, NULL, NULL, true);
-        if (fd == -1)
-            continue;
-        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
-                &(int){ 1 }, sizeof(int));
-
-        vlc_tls_t *p_tls;
-
-        if (host->p_tls != NULL)
-        {
-            const char *alpn[] = { "http/1.1", NULL };
-
-            p_tls = vlc_tls_SessionCreate(host->p_tls, fd, NULL, alpn);
-        }
-        else
-            p_tls = NULL;
-
-        cl = httpd_ClientNew(fd, p_tls, now);
-
-        TAB_APPEND(host->i_client, host->client, cl);
-    }
+    if (b_accept)
+        httpd_HostAccept(w, now);
 
     vlc_restorecancel(canc);
 }
 
 static void* httpd_HostThread(void *data)
 {
-    httpd_host_t *host = data;
+    httpd_worker_t *w = data;
+    httpd_host_t *host = w->host;
 
     vlc_mutex_lock(&host->lock);
     while (host->i_ref > 0)
-        httpdLoop(host);
+        httpdLoop(w);
     vlc_mutex_unlock(&host->lock);
     return NULL;
 }
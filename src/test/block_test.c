@@ -84,10 +84,214 @@ static void test_block (void)
     //assert (block == NULL);
 }
 
+static void test_block_Share (void)
+{
+    block_t *block = block_Alloc (sizeof (text));
+    assert (block != NULL);
+    memcpy (block->p_buffer, text, sizeof (text));
+    block->i_pts = 42;
+
+    /* Not shareable yet: copied */
+    block_t *copy = block_Share (block);
+    assert (copy != NULL);
+    assert (copy->p_buffer != block->p_buffer);
+    block_Release (copy);
+
+    block = block_Shareable (block);
+    assert (block != NULL);
+    assert (block_Shareable (block) == block);
+
+    block_t *a = block_Share (block);
+    block_t *b = block_Share (block);
+    assert (a != NULL && b != NULL);
+    assert (a->p_buffer == block->p_buffer && b->p_buffer == block->p_buffer);
+    assert (a->i_pts == 42 && a->i_buffer == sizeof (text));
+
+    /* Headers are independent */
+    a->p_buffer += 5;
+    a->i_buffer -= 5;
+    a->i_pts = 0;
+    assert (block->i_buffer == sizeof (text) && block->i_pts == 42);
+
+    /* Expanding a shared payload copies it */
+    uint8_t *payload = block->p_buffer;
+    a = block_Realloc (a, 5, sizeof (text));
+    assert (a != NULL);
+    assert (a->p_buffer != payload);
+    memset (a->p_buffer, 'x', 5);
+    assert (!memcmp (block->p_buffer, text, sizeof (text)));
+    assert (!memcmp (a->p_buffer + 5, text + 5, sizeof (text) - 5));
+    block_Release (a);
+
+    /* Copy on write */
+    b = block_Unshare (b);
+    assert (b != NULL);
+    assert (b->p_buffer != payload);
+    assert (!memcmp (b->p_buffer, text, sizeof (text)));
+    b->p_buffer[0] = 't';
+    assert (block->p_buffer[0] == 'T');
+    block_Release (b);
+
+    /* Last reference: writable in place */
+    block = block_Unshare (block);
+    assert (block != NULL);
+    assert (block->p_buffer == payload);
+    block = block_Realloc (block, 0, sizeof (text) + 16);
+    assert (block != NULL);
+    assert (!memcmp (block->p_buffer, text, sizeof (text)));
+    block_Release (block);
+
+    /* Chaining is preserved by the conversion */
+    block = block_Alloc (16);
+    assert (block != NULL);
+    block->p_next = block_Alloc (16);
+    assert (block->p_next != NULL);
+    block = block_Shareable (block);
+    assert (block != NULL && block->p_next != NULL);
+    block_ChainRelease (block);
+}
+
+#define BENCH_BLOCKS 16
+#define BENCH_ROUNDS 100000
+
+static void bench_block_Alloc (const char *name)
+{
+    static const size_t sizes[] = { 188, 1316, 1500, 4096, 65535 };
+    block_t *blocks[BENCH_BLOCKS];
+    mtime_t start = mdate ();
+
+    for (unsigned i = 0; i < BENCH_ROUNDS; i++)
+    {
+        for (unsigned j = 0; j < BENCH_BLOCKS; j++)
+        {
+            blocks[j] = block_Alloc (sizes[(i + j) % ARRAY_SIZE(sizes)]);
+            assert (blocks[j] != NULL);
+            blocks[j]->p_buffer[0] = j;
+        }
+        for (unsigned j = 0; j < BENCH_BLOCKS; j++)
+            block_Release (blocks[j]);
+    }
+
+    mtime_t duration = mdate () - start;
+
+    printf ("%-6s: %6.1f ns per allocation\n", name,
+            1000. * duration / (BENCH_ROUNDS * BENCH_BLOCKS));
+}
+
+#define PIPE_BLOCKS 1000000
+#define PIPE_DEPTH 64
+
+typedef struct
+{
+    vlc_spsc_t *queue;
+    vlc_sem_t credits; /* blocks the producer may have in flight */
+} pipe_t;
+
+/* Allocates blocks, like a demuxer */
+static void *pipe_Producer (void *data)
+{
+    static const size_t sizes[] = { 188, 1316, 1500, 4096, 15000 };
+    pipe_t *pipe = data;
+
+    for (unsigned i = 0; i < PIPE_BLOCKS; i++)
+    {
+        vlc_sem_wait (&pipe->credits);
+
+        block_t *block = block_Alloc (sizes[i % ARRAY_SIZE(sizes)]);
+        assert (block != NULL);
+        block->p_buffer[0] = i;
+        if (vlc_spsc_Queue (pipe->queue, block))
+            abort ();
+    }
+    return NULL;
+}
+
+/* Releases the blocks allocated by another thread, like a decoder */
+static void bench_block_Pipeline (const char *name)
+{
+    block_pool_stats_t before, after;
+    pipe_t pipe;
+    vlc_thread_t th;
+
+    pipe.queue = vlc_spsc_New (PIPE_DEPTH);
+    assert (pipe.queue != NULL);
+    vlc_sem_init (&pipe.credits, PIPE_DEPTH);
+    block_pool_GetStats (&before);
+
+    mtime_t start = mdate ();
+    if (vlc_clone (&th, pipe_Producer, &pipe, VLC_THREAD_PRIORITY_LOW))
+        abort ();
+    for (unsigned i = 0; i < PIPE_BLOCKS; i++)
+    {
+        block_Release (vlc_spsc_Dequeue (pipe.queue));
+        vlc_sem_post (&pipe.credits);
+    }
+    vlc_join (th, NULL);
+    mtime_t duration = mdate () - start;
+
+    block_pool_GetStats (&after);
+    vlc_sem_destroy (&pipe.credits);
+    vlc_spsc_Delete (pipe.queue);
+
+    uint64_t hits = after.hits - before.hits;
+    uint64_t misses = after.misses - before.misses;
+
+    printf ("%-6s: %6.1f ns per block across threads", name,
+            1000. * duration / PIPE_BLOCKS);
+    if (hits + misses > 0)
+        printf (", %.1f%% hit rate", 100. * hits / (hits + misses));
+    printf ("\n");
+}
+
+static void test_block_pool (void)
+{
+    block_pool_stats_t st;
+
+    bench_block_Alloc ("malloc");
+    bench_block_Pipeline ("malloc");
+
+    block_pool_Enable (true);
+    test_block ();
+
+    block_t *block = block_Alloc (188);
+    assert (block != NULL);
+    assert (block->i_buffer == 188);
+    block_Release (block);
+
+    /* The cached block is reused */
+    block_t *again = block_Alloc (100);
+    assert (again == block);
+    assert (again->i_buffer == 100);
+    assert (again->i_pts == VLC_TS_INVALID && again->i_flags == 0);
+    block_Release (again);
+
+    /* Too large for any class */
+    block = block_Alloc (1 << 20);
+    assert (block != NULL);
+    block_Release (block);
+
+    bench_block_Alloc ("pool");
+    bench_block_Pipeline ("pool");
+
+    block_pool_GetStats (&st);
+    assert (st.hits > 0);
+    assert (st.remote > 0);
+    printf ("pool  : %"PRIu64" hits, %"PRIu64" misses, %"PRIu64" cross-thread"
+            " releases, %zu bytes cached\n",
+            st.hits, st.misses, st.remote, st.bytes);
+
+    block_pool_Enable (false);
+    block = block_Alloc (188);
+    assert (block != NULL);
+    block_Release (block);
+}
+
 int main (void)
 {
     test_block_File ();
     test_block ();
+    test_block_Share ();
+    test_block_pool ();
     return 0;
 }
 
@@ -1,5 +1,5 @@
 /*****************************************************************************
- * picture_pool.c: test cases for picture_poo_t
+ * picture_pool.c: test cases and stress benchmark for picture_pool_t
  *****************************************************************************
  * Copyright (C) 2014 Rémi Denis-Courmont
  *
@@ -23,14 +23,20 @@
 #endif
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 #undef NDEBUG
 #include <assert.h>
+#include <unistd.h>
 
 #include <vlc_common.h>
 #include <vlc_es.h>
 #include <vlc_picture_pool.h>
 
 #define PICTURES 10
+#define LARGE_PICTURES 300
+#define THREADS 8
+#define ITERATIONS 50000
 
 static video_format_t fmt;
 static picture_pool_t *pool, *reserve;
@@ -106,8 +112,98 @@ static void test(bool zombie)
             picture_Release(pics[i]);
 }
 
+static void test_large(void)
+{
+    static picture_t *pics[LARGE_PICTURES];
+
+    pool = picture_pool_NewFromFormat(&fmt, LARGE_PICTURES);
+    assert(pool != NULL);
+    assert(picture_pool_GetSize(pool) == LARGE_PICTURES);
+
+    for (unsigned i = 0; i < LARGE_PICTURES; i++) {
+        pics[i] = picture_pool_Get(pool);
+        assert(pics[i] != NULL);
+        for (unsigned j = 0; j < i; j++)
+            assert(pics[j]->p[0].p_pixels != pics[i]->p[0].p_pixels);
+    }
+    assert(picture_pool_Get(pool) == NULL);
+
+    /* Free pictures spread across several bitmap words */
+    for (unsigned i = 1; i < LARGE_PICTURES; i += 67) {
+        void *plane = pics[i]->p[0].p_pixels;
+
+        picture_Release(pics[i]);
+        pics[i] = picture_pool_Wait(pool);
+        assert(pics[i] != NULL);
+        assert(pics[i]->p[0].p_pixels == plane);
+    }
+
+    for (unsigned i = 0; i < LARGE_PICTURES; i++)
+        picture_Release(pics[i]);
+
+    reserve = picture_pool_Reserve(pool, LARGE_PICTURES - 1);
+    assert(reserve != NULL);
+    pics[0] = picture_pool_Get(pool);
+    assert(pics[0] != NULL);
+    assert(picture_pool_Get(pool) == NULL);
+    picture_Release(pics[0]);
+    picture_pool_Release(reserve);
+    picture_pool_Release(pool);
+}
+
+/* Each thread holds a few pictures at once, so that the pool is mostly empty
+ * and threads contend for the same free pictures. */
+static void *Worker(void *data)
+{
+    picture_t *held[4];
+    unsigned count = 0;
+
+    for (unsigned i = 0; i < ITERATIONS; i++) {
+        picture_t *pic = (i & 1) ? picture_pool_Get(pool)
+                                 : picture_pool_Wait(pool);
+        if (pic != NULL) {
+            memset(pic->p[0].p_pixels, i, 1);
+            held[count++] = pic;
+        }
+        if (count == 4 || (pic == NULL && count > 0))
+            while (count > 0)
+                picture_Release(held[--count]);
+    }
+    while (count > 0)
+        picture_Release(held[--count]);
+    (void) data;
+    return NULL;
+}
+
+static void bench(unsigned pictures)
+{
+    vlc_thread_t th[THREADS];
+
+    pool = picture_pool_NewFromFormat(&fmt, pictures);
+    assert(pool != NULL);
+
+    mtime_t start = mdate();
+    for (unsigned i = 0; i < THREADS; i++)
+        assert(!vlc_clone(&th[i], Worker, NULL, VLC_THREAD_PRIORITY_LOW));
+    for (unsigned i = 0; i < THREADS; i++)
+        vlc_join(th[i], NULL);
+    mtime_t duration = mdate() - start;
+
+    /* All pictures must have been returned */
+    reserve = picture_pool_Reserve(pool, pictures);
+    assert(reserve != NULL);
+    picture_pool_Release(reserve);
+    picture_pool_Release(pool);
+
+    printf("%u threads, %3u pictures: %6.1f ns/picture, %5.2f Mpictures/s\n",
+           THREADS, pictures, 1000. * duration / (THREADS * ITERATIONS),
+           (double)(THREADS * ITERATIONS) / duration);
+}
+
 int main(void)
 {
+    alarm(60);
+
     video_format_Setup(&fmt, VLC_CODEC_I420, 320, 200, 320, 200, 1, 1);
 
     pool = picture_pool_NewFromFormat(&fmt, PICTURES);
@@ -122,6 +218,11 @@ int main(void)
 
     test(false);
     test(true);
+    test_large();
+
+    video_format_Setup(&fmt, VLC_CODEC_I420, 16, 16, 16, 16, 1, 1);
+    bench(THREADS * 4);
+    bench(256);
 
     return 0;
 }
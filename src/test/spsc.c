@@ -0,0 +1,183 @@
+/*****************************************************************************
+ * spsc.c: test cases and benchmark for vlc_spsc_t
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#undef NDEBUG
+#include <assert.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_interrupt.h>
+
+#define BLOCKS 64
+#define TRANSFERS 200000
+
+/* Blocks are recycled rather than allocated, so as to measure the queues. */
+static block_t blocks[BLOCKS];
+static uint8_t payload[BLOCKS][188];
+
+static void NoRelease(block_t *block)
+{
+    (void) block;
+}
+
+static void test_basic(void)
+{
+    vlc_spsc_t *q = vlc_spsc_New(5);
+    assert(q != NULL);
+    assert(vlc_spsc_GetCount(q) == 0);
+    assert(vlc_spsc_TryDequeue(q) == NULL);
+
+    /* Capacity is rounded up to 8 */
+    for (unsigned i = 0; i < 8; i++)
+        assert(vlc_spsc_Queue(q, &blocks[i]) == VLC_SUCCESS);
+    assert(vlc_spsc_Queue(q, &blocks[8]) != VLC_SUCCESS);
+    assert(vlc_spsc_GetCount(q) == 8);
+    assert(vlc_spsc_GetBytes(q) == 8 * sizeof (payload[0]));
+
+    for (unsigned i = 0; i < 8; i++)
+        assert(vlc_spsc_Dequeue(q) == &blocks[i]);
+    assert(vlc_spsc_GetCount(q) == 0);
+    assert(vlc_spsc_GetBytes(q) == 0);
+
+    /* Wrap around */
+    for (unsigned i = 0; i < 20; i++)
+    {
+        assert(vlc_spsc_Queue(q, &blocks[i]) == VLC_SUCCESS);
+        assert(vlc_spsc_TryDequeue(q) == &blocks[i]);
+    }
+
+    /* Interrupted wait on an empty queue */
+    vlc_interrupt_t *ctx = vlc_interrupt_create();
+    assert(ctx != NULL);
+    vlc_interrupt_set(ctx);
+    vlc_interrupt_raise(ctx);
+    assert(vlc_spsc_Dequeue_i11e(q) == NULL);
+    assert(vlc_spsc_Queue(q, &blocks[0]) == VLC_SUCCESS);
+    assert(vlc_spsc_Dequeue_i11e(q) == &blocks[0]);
+    vlc_interrupt_set(NULL);
+    vlc_interrupt_destroy(ctx);
+
+    assert(vlc_spsc_Queue(q, &blocks[1]) == VLC_SUCCESS);
+    vlc_spsc_Delete(q);
+}
+
+static vlc_spsc_t *spsc;
+static block_fifo_t *fifo;
+
+static void *SpscProducer(void *data)
+{
+    for (unsigned i = 0; i < TRANSFERS; i++)
+    {
+        block_t *block = &blocks[i % BLOCKS];
+
+        block->i_dts = mdate();
+        block->i_pts = i;
+        while (vlc_spsc_Queue(spsc, block))
+            sched_yield(); /* full */
+    }
+    (void) data;
+    return NULL;
+}
+
+static void *FifoProducer(void *data)
+{
+    for (unsigned i = 0; i < TRANSFERS; i++)
+    {
+        block_t *block = &blocks[i % BLOCKS];
+
+        block->i_dts = mdate();
+        block->i_pts = i;
+        /* Same bound as the SPSC ring */
+        while (block_FifoCount(fifo) >= BLOCKS / 2)
+            sched_yield();
+        block_FifoPut(fifo, block);
+    }
+    (void) data;
+    return NULL;
+}
+
+static void bench(const char *name, void *(*producer)(void *),
+                  block_t *(*consume)(void))
+{
+    vlc_thread_t th;
+    mtime_t latency = 0;
+    mtime_t start = mdate();
+
+    assert(!vlc_clone(&th, producer, NULL, VLC_THREAD_PRIORITY_LOW));
+    for (unsigned i = 0; i < TRANSFERS; i++)
+    {
+        block_t *block = consume();
+
+        assert(block->i_pts == i);
+        latency += mdate() - block->i_dts;
+    }
+    vlc_join(th, NULL);
+
+    mtime_t duration = mdate() - start;
+
+    printf("%-6s: %6.1f ns/block, %6.2f Mblocks/s, mean latency %5.2f us\n",
+           name, 1000. * duration / TRANSFERS,
+           (double)TRANSFERS / duration, (double)latency / TRANSFERS);
+}
+
+static block_t *SpscConsume(void)
+{
+    return vlc_spsc_Dequeue(spsc);
+}
+
+static block_t *FifoConsume(void)
+{
+    return block_FifoGet(fifo);
+}
+
+int main(void)
+{
+    alarm(30);
+
+    for (unsigned i = 0; i < BLOCKS; i++)
+    {
+        block_Init(&blocks[i], payload[i], sizeof (payload[i]));
+        blocks[i].pf_release = NoRelease;
+    }
+
+    test_basic();
+
+    /* Half the blocks in flight at most: the producer must not reuse a block
+     * the consumer has not seen yet. */
+    spsc = vlc_spsc_New(BLOCKS / 2);
+    assert(spsc != NULL);
+    fifo = block_FifoNew();
+    assert(fifo != NULL);
+
+    bench("fifo", FifoProducer, FifoConsume);
+    bench("spsc", SpscProducer, SpscConsume);
+
+    block_FifoRelease(fifo);
+    vlc_spsc_Delete(spsc);
+    return 0;
+}
@@ -0,0 +1,250 @@
+/*****************************************************************************
+ * scaletempo.c: scaletempo audio filter tests and benchmark
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: test_modules_audio_filter_scaletempo [file [channels [rate]]]
+ *
+ * Feeds PCM through the filter at several playback rates, with each search
+ * mode, and reports the time spent per input sample. The file holds raw
+ * interleaved 32-bit float samples, by default stereo at 48 kHz.
+ *
+ * Without a file, synthetic tones are used and the quality of the output is
+ * checked: when the overlap search works, blending two strides doesn't
+ * attenuate a periodic signal. */
+
+#include <math.h>
+#include <string.h>
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_aout.h>
+#include <vlc_filter.h>
+#include <vlc_modules.h>
+
+#define BLOCK_FRAMES 1024
+
+typedef struct
+{
+    const float *p_samples;
+    size_t       i_frames;
+    unsigned     i_channels;
+    unsigned     i_rate;
+} pcm_t;
+
+static const char *const modes[] = { "exhaustive", "coarse" };
+
+static uint32_t ChannelMask( unsigned i_channels )
+{
+    switch( i_channels )
+    {
+        case 1: return AOUT_CHAN_CENTER;
+        case 2: return AOUT_CHANS_STEREO;
+        case 6: return AOUT_CHANS_5_1;
+        case 8: return AOUT_CHANS_7_1;
+    }
+    fprintf( stderr, "unsupported channels count: %u\n", i_channels );
+    exit( 1 );
+}
+
+/* Lowest power over 20 ms windows, skipping the first 100 ms */
+static double MinPower( const float *p_samples, size_t i_frames,
+                        unsigned i_channels, unsigned i_rate )
+{
+    const size_t i_window = i_rate / 50;
+    double min = INFINITY;
+
+    for( size_t i = i_rate / 10; i + i_window <= i_frames; i += i_window / 4 )
+    {
+        double power = 0.;
+        for( size_t j = i * i_channels; j < (i + i_window) * i_channels; j++ )
+            power += p_samples[j] * p_samples[j];
+        min = __MIN(min, power / (i_window * i_channels));
+    }
+    return min;
+}
+
+/* Lowest level of the output relative to the input */
+static double MinLevel( const float *p_out, size_t i_frames,
+                        const pcm_t *p_pcm )
+{
+    double in = MinPower( p_pcm->p_samples, p_pcm->i_frames,
+                          p_pcm->i_channels, p_pcm->i_rate );
+    double out = MinPower( p_out, i_frames, p_pcm->i_channels, p_pcm->i_rate );
+    return sqrt( out / in );
+}
+
+/* Returns the lowest output level, see MinLevel() */
+static double Run( const pcm_t *p_pcm, const char *psz_mode, double rate )
+{
+    char modearg[64];
+    const char *args[test_defaults_nargs + 1];
+
+    snprintf( modearg, sizeof (modearg), "--scaletempo-search-mode=%s",
+              psz_mode );
+    memcpy( args, test_defaults_args, sizeof (test_defaults_args) );
+    args[test_defaults_nargs] = modearg;
+
+    libvlc_instance_t *vlc = libvlc_new( ARRAY_SIZE(args), args );
+    assert( vlc != NULL );
+
+    filter_t *filter = vlc_object_create( vlc->p_libvlc_int,
+                                          sizeof (*filter) );
+    assert( filter != NULL );
+
+    es_format_Init( &filter->fmt_in, AUDIO_ES, VLC_CODEC_FL32 );
+    filter->fmt_in.audio.i_format = VLC_CODEC_FL32;
+    filter->fmt_in.audio.i_rate = p_pcm->i_rate;
+    filter->fmt_in.audio.i_physical_channels =
+    filter->fmt_in.audio.i_original_channels =
+        ChannelMask( p_pcm->i_channels );
+    aout_FormatPrepare( &filter->fmt_in.audio );
+    filter->fmt_out = filter->fmt_in;
+
+    filter->p_module = module_need( filter, "audio filter", "scaletempo",
+                                    true );
+    assert( filter->p_module != NULL );
+
+    /* The playback rate is applied to the input sample rate */
+    filter->fmt_in.audio.i_rate = p_pcm->i_rate * rate;
+
+    const unsigned i_channels = p_pcm->i_channels;
+    const size_t i_out_max = p_pcm->i_frames / rate + 2 * p_pcm->i_rate;
+    float *p_out = malloc( i_out_max * i_channels * sizeof (float) );
+    size_t i_out = 0;
+    assert( p_out != NULL );
+
+    mtime_t i_time = 0;
+    for( size_t i = 0; i < p_pcm->i_frames; i += BLOCK_FRAMES )
+    {
+        size_t i_frames = __MIN(BLOCK_FRAMES, p_pcm->i_frames - i);
+        block_t *block = block_Alloc( i_frames * i_channels * sizeof (float) );
+        assert( block != NULL );
+        memcpy( block->p_buffer, p_pcm->p_samples + i * i_channels,
+                block->i_buffer );
+        block->i_nb_samples = i_frames;
+        block->i_pts = block->i_dts = VLC_TS_0 + i * CLOCK_FREQ / p_pcm->i_rate;
+
+        mtime_t i_start = mdate();
+        block = filter->pf_audio_filter( filter, block );
+        i_time += mdate() - i_start;
+
+        if( block == NULL )
+            continue;
+        size_t i_copy = __MIN(block->i_nb_samples, i_out_max - i_out);
+        memcpy( p_out + i_out * i_channels, block->p_buffer,
+                i_copy * i_channels * sizeof (float) );
+        i_out += i_copy;
+        block_Release( block );
+    }
+
+    double level = MinLevel( p_out, i_out, p_pcm );
+    printf( "%-10s %u ch, %5u Hz, x%.2f: %6.2f ns/sample, %5.3f min level\n",
+            psz_mode, i_channels, p_pcm->i_rate, rate,
+            i_time * 1000. / (p_pcm->i_frames * i_channels), level );
+
+    free( p_out );
+    module_unneed( filter, filter->p_module );
+    vlc_object_release( filter );
+    libvlc_release( vlc );
+    return level;
+}
+
+static float *Tones( size_t i_frames, unsigned i_channels, unsigned i_rate )
+{
+    float *p_samples = malloc( i_frames * i_channels * sizeof (float) );
+    assert( p_samples != NULL );
+
+    for( size_t i = 0; i < i_frames; i++ )
+        for( unsigned c = 0; c < i_channels; c++ )
+        {
+            double t = (double)i / i_rate;
+            p_samples[i * i_channels + c] = .3 * sin( 2. * M_PI * 220. * t + c )
+                                          + .2 * sin( 2. * M_PI * 330. * t );
+        }
+    return p_samples;
+}
+
+static float *Load( const char *psz_path, size_t *pi_frames,
+                    unsigned i_channels )
+{
+    FILE *file = fopen( psz_path, "rb" );
+    if( file == NULL )
+    {
+        perror( psz_path );
+        exit( 1 );
+    }
+    fseek( file, 0, SEEK_END );
+    long i_size = ftell( file );
+    rewind( file );
+
+    *pi_frames = i_size / (i_channels * sizeof (float));
+    float *p_samples = malloc( *pi_frames * i_channels * sizeof (float) );
+    assert( p_samples != NULL );
+    if( fread( p_samples, i_channels * sizeof (float), *pi_frames, file )
+            != *pi_frames )
+    {
+        perror( psz_path );
+        exit( 1 );
+    }
+    fclose( file );
+    return p_samples;
+}
+
+int main( int argc, char **argv )
+{
+    static const double rates[] = { 1.5, 2. };
+    pcm_t pcm;
+
+    test_init();
+
+    if( argc > 1 )
+    {
+        alarm( 0 );
+        pcm.i_channels = (argc > 2) ? atoi( argv[2] ) : 2;
+        pcm.i_rate = (argc > 3) ? atoi( argv[3] ) : 48000;
+        pcm.p_samples = Load( argv[1], &pcm.i_frames, pcm.i_channels );
+
+        for( size_t r = 0; r < ARRAY_SIZE(rates); r++ )
+            for( size_t m = 0; m < ARRAY_SIZE(modes); m++ )
+                Run( &pcm, modes[m], rates[r] );
+        free( (float *)pcm.p_samples );
+        return 0;
+    }
+
+    static const unsigned channels[] = { 2, 8 };
+    int ret = 0;
+
+    pcm.i_rate = 48000;
+    pcm.i_frames = 4 * pcm.i_rate;
+
+    for( size_t c = 0; c < ARRAY_SIZE(channels); c++ )
+    {
+        pcm.i_channels = channels[c];
+        pcm.p_samples = Tones( pcm.i_frames, pcm.i_channels, pcm.i_rate );
+
+        for( size_t r = 0; r < ARRAY_SIZE(rates); r++ )
+            for( size_t m = 0; m < ARRAY_SIZE(modes); m++ )
+                if( Run( &pcm, modes[m], rates[r] ) < .98 )
+                    ret = 1;
+        free( (float *)pcm.p_samples );
+    }
+    return ret;
+}
@@ -0,0 +1,532 @@
+/*****************************************************************************
+ * mp4.c: MP4 demuxer sample tables tests and benchmark
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Usage: test_modules_demux_mp4 [samples]
+ *
+ * Builds a long synthetic MP4 file in memory, with one video track whose
+ * sample tables have as many entries as a recording of several hours, then
+ * reports the time and the memory taken to open it. The timestamps and the
+ * data of the samples read after seeking are checked against the tables. */
+
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_modules.h>
+#include <vlc_stream.h>
+
+#define TIMESCALE 90000
+
+/* Sample timing: runs of 1000 samples of 25 Hz frames with a slight drift,
+ * and the pattern of I, P and B frames in the composition offsets. */
+static uint32_t SampleDuration( uint32_t i_sample )
+{
+    return 3600 + ((i_sample / 1000) & 1) * 3;
+}
+
+static uint32_t SampleOffset( uint32_t i_sample )
+{
+    static const uint32_t offsets[] = { 7200, 10800, 0 };
+    return offsets[i_sample % 3];
+}
+
+static uint32_t SampleSize( uint32_t i_sample )
+{
+    return 1 + i_sample % 4;
+}
+
+/* About the first half of the samples are alone in their chunk, the others
+ * are grouped by three. */
+static uint32_t ChunkCount( uint32_t i_samples, uint32_t *pi_small )
+{
+    *pi_small = i_samples / 2 + (i_samples - i_samples / 2) % 3;
+    return *pi_small + (i_samples - *pi_small) / 3;
+}
+
+/*****************************************************************************
+ * Writer
+ *****************************************************************************/
+typedef struct
+{
+    uint8_t *p;
+    size_t   i_size;
+    size_t   i_max;
+} buffer_t;
+
+static void Need( buffer_t *b, size_t i_size )
+{
+    if( b->i_size + i_size <= b->i_max )
+        return;
+    b->i_max = 2 * (b->i_size + i_size);
+    b->p = realloc( b->p, b->i_max );
+    assert( b->p != NULL );
+}
+
+static void Put8( buffer_t *b, uint8_t v )
+{
+    Need( b, 1 );
+    b->p[b->i_size++] = v;
+}
+
+static void Put16( buffer_t *b, uint16_t v )
+{
+    Put8( b, v >> 8 );
+    Put8( b, v );
+}
+
+static void Put32( buffer_t *b, uint32_t v )
+{
+    Need( b, 4 );
+    SetDWBE( b->p + b->i_size, v );
+    b->i_size += 4;
+}
+
+static void PutZero( buffer_t *b, size_t i_size )
+{
+    Need( b, i_size );
+    memset( b->p + b->i_size, 0, i_size );
+    b->i_size += i_size;
+}
+
+static void PutFourCC( buffer_t *b, const char *psz )
+{
+    Need( b, 4 );
+    memcpy( b->p + b->i_size, psz, 4 );
+    b->i_size += 4;
+}
+
+static size_t BoxStart( buffer_t *b, const char *psz_type )
+{
+    size_t i_start = b->i_size;
+    Put32( b, 0 );
+    PutFourCC( b, psz_type );
+    return i_start;
+}
+
+static size_t FullBoxStart( buffer_t *b, const char *psz_type,
+                            uint32_t i_flags )
+{
+    size_t i_start = BoxStart( b, psz_type );
+    Put32( b, i_flags );
+    return i_start;
+}
+
+static void BoxEnd( buffer_t *b, size_t i_start )
+{
+    SetDWBE( b->p + i_start, b->i_size - i_start );
+}
+
+static void PutMatrix( buffer_t *b )
+{
+    static const uint32_t matrix[9] = {
+        0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000
+    };
+    for( unsigned i = 0; i < 9; i++ )
+        Put32( b, matrix[i] );
+}
+
+static void PutSampleTables( buffer_t *b, uint32_t i_samples,
+                             uint32_t i_data_offset )
+{
+    uint32_t i_small;
+    uint32_t i_chunks = ChunkCount( i_samples, &i_small );
+    size_t box;
+
+    box = FullBoxStart( b, "stsd", 0 );
+    Put32( b, 1 );
+    size_t entry = BoxStart( b, "mp4v" );
+    PutZero( b, 6 );
+    Put16( b, 1 );          /* data reference index */
+    PutZero( b, 16 );
+    Put16( b, 320 );
+    Put16( b, 240 );
+    Put32( b, 0x480000 );
+    Put32( b, 0x480000 );
+    Put32( b, 0 );
+    Put16( b, 1 );          /* frame count */
+    PutZero( b, 32 );
+    Put16( b, 24 );
+    Put16( b, 0xffff );
+    BoxEnd( b, entry );
+    BoxEnd( b, box );
+
+    /* Run-length coded durations */
+    box = FullBoxStart( b, "stts", 0 );
+    size_t count = b->i_size;
+    uint32_t i_entries = 0;
+    Put32( b, 0 );
+    for( uint32_t i = 0; i < i_samples; )
+    {
+        uint32_t i_run = 1;
+        while( i + i_run < i_samples &&
+               SampleDuration( i + i_run ) == SampleDuration( i ) )
+            i_run++;
+        Put32( b, i_run );
+        Put32( b, SampleDuration( i ) );
+        i_entries++;
+        i += i_run;
+    }
+    SetDWBE( b->p + count, i_entries );
+    BoxEnd( b, box );
+
+    /* One entry per sample */
+    box = FullBoxStart( b, "ctts", 0 );
+    Put32( b, i_samples );
+    for( uint32_t i = 0; i < i_samples; i++ )
+    {
+        Put32( b, 1 );
+        Put32( b, SampleOffset( i ) );
+    }
+    BoxEnd( b, box );
+
+    box = FullBoxStart( b, "stsc", 0 );
+    Put32( b, 2 );
+    Put32( b, 1 );
+    Put32( b, 1 );
+    Put32( b, 1 );
+    Put32( b, i_small + 1 );
+    Put32( b, 3 );
+    Put32( b, 1 );
+    BoxEnd( b, box );
+
+    box = FullBoxStart( b, "stsz", 0 );
+    Put32( b, 0 );
+    Put32( b, i_samples );
+    for( uint32_t i = 0; i < i_samples; i++ )
+        Put32( b, SampleSize( i ) );
+    BoxEnd( b, box );
+
+    box = FullBoxStart( b, "stco", 0 );
+    Put32( b, i_chunks );
+    uint32_t i_offset = i_data_offset;
+    for( uint32_t i_chunk = 0, i = 0; i_chunk < i_chunks; i_chunk++ )
+    {
+        Put32( b, i_offset );
+        for( uint32_t j = 0; j < (i_chunk < i_small ? 1 : 3); j++ )
+            i_offset += SampleSize( i++ );
+    }
+    BoxEnd( b, box );
+}
+
+static void PutMoov( buffer_t *b, uint32_t i_samples, uint64_t i_duration,
+                     uint32_t i_data_offset )
+{
+    size_t moov = BoxStart( b, "moov" );
+
+    size_t box = FullBoxStart( b, "mvhd", 0 );
+    Put32( b, 0 );
+    Put32( b, 0 );
+    Put32( b, 1000 );
+    Put32( b, i_duration * 1000 / TIMESCALE );
+    Put32( b, 0x10000 );
+    Put16( b, 0x100 );
+    PutZero( b, 10 );
+    PutMatrix( b );
+    PutZero( b, 24 );
+    Put32( b, 2 );
+    BoxEnd( b, box );
+
+    size_t trak = BoxStart( b, "trak" );
+    box = FullBoxStart( b, "tkhd", 3 );
+    Put32( b, 0 );
+    Put32( b, 0 );
+    Put32( b, 1 );          /* track ID */
+    Put32( b, 0 );
+    Put32( b, i_duration * 1000 / TIMESCALE );
+    PutZero( b, 8 );
+    Put16( b, 0 );
+    Put16( b, 0 );
+    Put16( b, 0 );
+    Put16( b, 0 );
+    PutMatrix( b );
+    Put32( b, 320 << 16 );
+    Put32( b, 240 << 16 );
+    BoxEnd( b, box );
+
+    size_t mdia = BoxStart( b, "mdia" );
+    box = FullBoxStart( b, "mdhd", 0 );
+    Put32( b, 0 );
+    Put32( b, 0 );
+    Put32( b, TIMESCALE );
+    Put32( b, i_duration );
+    Put16( b, 0x55c4 );     /* undetermined language */
+    Put16( b, 0 );
+    BoxEnd( b, box );
+
+    box = FullBoxStart( b, "hdlr", 0 );
+    Put32( b, 0 );
+    PutFourCC( b, "vide" );
+    PutZero( b, 12 );
+    Put8( b, 0 );
+    BoxEnd( b, box );
+
+    size_t minf = BoxStart( b, "minf" );
+    box = FullBoxStart( b, "vmhd", 1 );
+    PutZero( b, 8 );
+    BoxEnd( b, box );
+
+    size_t dinf = BoxStart( b, "dinf" );
+    box = FullBoxStart( b, "dref", 0 );
+    Put32( b, 1 );
+    BoxEnd( b, FullBoxStart( b, "url ", 1 ) );
+    BoxEnd( b, box );
+    BoxEnd( b, dinf );
+
+    size_t stbl = BoxStart( b, "stbl" );
+    PutSampleTables( b, i_samples, i_data_offset );
+    BoxEnd( b, stbl );
+    BoxEnd( b, minf );
+    BoxEnd( b, mdia );
+    BoxEnd( b, trak );
+    BoxEnd( b, moov );
+}
+
+/* Returns the file, with the DTS of every sample in pi_dts */
+static buffer_t Generate( uint32_t i_samples, uint64_t *pi_dts )
+{
+    buffer_t b = { NULL, 0, 0 };
+    uint64_t i_dts = 0;
+    uint64_t i_data = 0;
+
+    for( uint32_t i = 0; i < i_samples; i++ )
+    {
+        pi_dts[i] = i_dts;
+        i_dts += SampleDuration( i );
+        i_data += SampleSize( i );
+    }
+    pi_dts[i_samples] = i_dts;
+
+    size_t box = BoxStart( &b, "ftyp" );
+    PutFourCC( &b, "isom" );
+    Put32( &b, 0 );
+    PutFourCC( &b, "isom" );
+    BoxEnd( &b, box );
+
+    /* Once to know where the data starts, once with the right offsets */
+    size_t i_header = b.i_size;
+    PutMoov( &b, i_samples, i_dts, 0 );
+    uint32_t i_data_offset = b.i_size + 8;
+    b.i_size = i_header;
+    PutMoov( &b, i_samples, i_dts, i_data_offset );
+    assert( b.i_size + 8 == i_data_offset );
+
+    box = BoxStart( &b, "mdat" );
+    for( uint32_t i = 0; i < i_samples; i++ )
+        for( uint32_t j = 0; j < SampleSize( i ); j++ )
+            Put8( &b, i );
+    BoxEnd( &b, box );
+    assert( b.i_size == i_data_offset + i_data );
+    return b;
+}
+
+/*****************************************************************************
+ * Output
+ *****************************************************************************/
+struct es_out_sys_t
+{
+    unsigned i_blocks;
+    mtime_t  i_dts;
+    mtime_t  i_pts;
+    uint8_t  i_data;
+};
+
+static es_out_id_t *EsOutAdd( es_out_t *out, const es_format_t *fmt )
+{
+    (void) fmt;
+    return (es_out_id_t *)out;
+}
+
+static int EsOutSend( es_out_t *out, es_out_id_t *id, block_t *block )
+{
+    es_out_sys_t *sys = out->p_sys;
+
+    sys->i_blocks++;
+    sys->i_dts = block->i_dts;
+    sys->i_pts = block->i_pts;
+    sys->i_data = block->i_buffer ? block->p_buffer[0] : 0;
+    block_Release( block );
+    (void) id;
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel( es_out_t *out, es_out_id_t *id )
+{
+    (void) out; (void) id;
+}
+
+static int EsOutControl( es_out_t *out, int i_query, va_list args )
+{
+    if( i_query == ES_OUT_GET_ES_STATE )
+    {
+        (void) va_arg( args, es_out_id_t * );
+        *va_arg( args, bool * ) = true;
+        return VLC_SUCCESS;
+    }
+    (void) out;
+    return VLC_EGENERIC;
+}
+
+static int DemuxControl( demux_t *p_demux, int i_query, ... )
+{
+    va_list args;
+    va_start( args, i_query );
+    int i_ret = p_demux->pf_control( p_demux, i_query, args );
+    va_end( args );
+    return i_ret;
+}
+
+/* Resident memory, in kiB */
+static long Resident( void )
+{
+    FILE *file = fopen( "/proc/self/statm", "r" );
+    long i_size = 0, i_resident = 0;
+
+    if( file == NULL )
+        return 0;
+    if( fscanf( file, "%ld %ld", &i_size, &i_resident ) != 2 )
+        i_resident = 0;
+    fclose( file );
+    return i_resident * (sysconf( _SC_PAGESIZE ) / 1024);
+}
+
+/*****************************************************************************
+ * Test
+ *****************************************************************************/
+/* Reads a few samples after seeking to i_time, and checks them */
+static int CheckSeek( demux_t *p_demux, es_out_sys_t *p_out,
+                      const uint64_t *pi_dts, uint32_t i_samples,
+                      mtime_t i_time )
+{
+    uint64_t i_target = i_time * TIMESCALE / CLOCK_FREQ;
+    uint32_t lo = 0, hi = i_samples;
+
+    /* The sample being displayed at i_time */
+    while( hi - lo > 1 )
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if( pi_dts[mid] <= i_target )
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    if( DemuxControl( p_demux, DEMUX_SET_TIME, i_time ) )
+        return 1;
+
+    for( uint32_t i = lo; i < __MIN(lo + 8, i_samples); i++ )
+    {
+        mtime_t i_dts = VLC_TS_0 + CLOCK_FREQ * pi_dts[i] / TIMESCALE;
+        mtime_t i_pts = i_dts + CLOCK_FREQ * (int64_t)SampleOffset( i ) /
+                                TIMESCALE;
+        unsigned i_blocks = p_out->i_blocks;
+
+        while( p_out->i_blocks == i_blocks )
+            if( p_demux->pf_demux( p_demux ) <= 0 )
+                return 1;
+
+        if( p_out->i_dts != i_dts || p_out->i_pts != i_pts ||
+            p_out->i_data != (uint8_t)i )
+        {
+            fprintf( stderr, "FAILED: seek to %"PRId64" us, sample %"PRIu32
+                     ": dts %"PRId64"/%"PRId64", pts %"PRId64"/%"PRId64
+                     ", data %u/%u\n", i_time, i, p_out->i_dts, i_dts,
+                     p_out->i_pts, i_pts, p_out->i_data, (uint8_t)i );
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    uint32_t i_samples = 1 << 20;
+
+    test_init();
+    if( argc > 1 )
+    {
+        alarm( 0 );
+        i_samples = strtoul( argv[1], NULL, 0 );
+    }
+    assert( i_samples > 0 );
+
+    uint64_t *pi_dts = malloc( (i_samples + 1) * sizeof (*pi_dts) );
+    assert( pi_dts != NULL );
+    buffer_t file = Generate( i_samples, pi_dts );
+
+    libvlc_instance_t *vlc = libvlc_new( test_defaults_nargs,
+                                         test_defaults_args );
+    assert( vlc != NULL );
+
+    demux_t *p_demux = vlc_object_create( vlc->p_libvlc_int,
+                                          sizeof (*p_demux) );
+    assert( p_demux != NULL );
+
+    es_out_sys_t out_sys = { 0, 0, 0, 0 };
+    es_out_t out = {
+        .pf_add = EsOutAdd,
+        .pf_send = EsOutSend,
+        .pf_del = EsOutDel,
+        .pf_control = EsOutControl,
+        .p_sys = &out_sys,
+    };
+
+    p_demux->psz_access = (char *)"memory";
+    p_demux->psz_demux = (char *)"mp4";
+    p_demux->psz_location = (char *)"";
+    p_demux->out = &out;
+    p_demux->s = stream_MemoryNew( p_demux, file.p, file.i_size, true );
+    assert( p_demux->s != NULL );
+
+    long i_resident = Resident();
+    mtime_t i_start = mdate();
+    p_demux->p_module = module_need( p_demux, "demux", "mp4", true );
+    mtime_t i_time = mdate() - i_start;
+    i_resident = Resident() - i_resident;
+    assert( p_demux->p_module != NULL );
+
+    printf( "%"PRIu32" samples, %zu bytes of tables: opened in %"PRId64
+            " ms, %ld kiB\n", i_samples, file.i_size,
+            i_time / 1000, i_resident );
+
+    /* From the start, at random places, and at the end */
+    int i_ret = CheckSeek( p_demux, &out_sys, pi_dts, i_samples, 0 );
+    uint64_t i_length = CLOCK_FREQ * pi_dts[i_samples] / TIMESCALE;
+    srand( 42 );
+    for( unsigned i = 0; i < 100 && i_ret == 0; i++ )
+        i_ret = CheckSeek( p_demux, &out_sys, pi_dts, i_samples,
+                           rand() * (i_length / (double)RAND_MAX) );
+    if( i_ret == 0 )
+        i_ret = CheckSeek( p_demux, &out_sys, pi_dts, i_samples,
+                           CLOCK_FREQ * pi_dts[i_samples - 1] / TIMESCALE );
+
+    module_unneed( p_demux, p_demux->p_module );
+    stream_Delete( p_demux->s );
+    vlc_object_release( p_demux );
+    libvlc_release( vlc );
+    free( file.p );
+    free( pi_dts );
+    return i_ret;
+}
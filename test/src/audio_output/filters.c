@@ -0,0 +1,172 @@
+/*****************************************************************************
+ * filters.c: audio filters pipeline allocation test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks that the audio filters pipeline does not allocate memory in steady
+ * state. Heap allocations are counted by overriding the C library allocator,
+ * which is only possible with glibc. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <string.h>
+#include <errno.h>
+
+#include <vlc_common.h>
+#include <vlc_atomic.h>
+#include <vlc_aout.h>
+#include <vlc_input.h>
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void *__libc_memalign(size_t, size_t);
+
+static atomic_bool counting = ATOMIC_VAR_INIT(false);
+static atomic_uint allocations = ATOMIC_VAR_INIT(0);
+
+static void Count(void)
+{
+    if (atomic_load(&counting))
+        atomic_fetch_add(&allocations, 1);
+}
+
+VLC_EXPORT void *malloc(size_t size)
+{
+    Count();
+    return __libc_malloc(size);
+}
+
+VLC_EXPORT void *calloc(size_t n, size_t size)
+{
+    Count();
+    return __libc_calloc(n, size);
+}
+
+VLC_EXPORT void *realloc(void *ptr, size_t size)
+{
+    Count();
+    return __libc_realloc(ptr, size);
+}
+
+VLC_EXPORT int posix_memalign(void **pp, size_t align, size_t size)
+{
+    Count();
+    *pp = __libc_memalign(align, size);
+    return (*pp != NULL) ? 0 : ENOMEM;
+}
+
+#define FRAMES 1024
+#define WARMUP 50
+#define RUNS 200
+
+/* Returns the number of heap allocations in steady state */
+static unsigned Play(aout_filters_t *filters, int rate)
+{
+    const unsigned frame_size = 2 * sizeof (int16_t);
+    unsigned count = 0;
+
+    for (unsigned i = 0; i < WARMUP + RUNS; i++)
+    {
+        block_t *block = block_Alloc(FRAMES * frame_size);
+        assert(block != NULL);
+
+        memset(block->p_buffer, i, block->i_buffer);
+        block->i_nb_samples = FRAMES;
+        block->i_pts = block->i_dts = VLC_TS_0 + i * CLOCK_FREQ * FRAMES / 44100;
+        block->i_length = CLOCK_FREQ * FRAMES / 44100;
+
+        atomic_store(&allocations, 0);
+        atomic_store(&counting, i >= WARMUP);
+        block = aout_FiltersPlay(filters, block, rate);
+        if (block != NULL)
+            block_Release(block);
+        atomic_store(&counting, false);
+        count += atomic_load(&allocations);
+    }
+    return count;
+}
+
+static void Test(vlc_object_t *obj, vlc_fourcc_t out_format,
+                 uint32_t out_channels)
+{
+    audio_sample_format_t infmt = {
+        .i_format = VLC_CODEC_S16N,
+        .i_rate = 44100,
+        .i_physical_channels = AOUT_CHANS_STEREO,
+        .i_original_channels = AOUT_CHANS_STEREO,
+    };
+    audio_sample_format_t outfmt = {
+        .i_format = out_format,
+        .i_rate = 48000,
+        .i_physical_channels = out_channels,
+        .i_original_channels = out_channels,
+    };
+    aout_FormatPrepare(&infmt);
+    aout_FormatPrepare(&outfmt);
+
+    aout_filters_t *filters = aout_FiltersNew(obj, &infmt, &outfmt, NULL);
+    assert(filters != NULL);
+
+    static const int rates[] = {
+        INPUT_RATE_DEFAULT, INPUT_RATE_DEFAULT * 2 / 3, INPUT_RATE_DEFAULT / 2,
+    };
+    for (size_t i = 0; i < ARRAY_SIZE(rates); i++)
+    {
+        unsigned count = Play(filters, rates[i]);
+
+        log("%4.4s to %4.4s, %u channels, x%.2f: %u allocations\n",
+            (const char *)&infmt.i_format, (const char *)&outfmt.i_format,
+            aout_FormatNbChannels(&outfmt),
+            (double)INPUT_RATE_DEFAULT / rates[i], count);
+        assert(count == 0);
+    }
+
+    aout_FiltersDelete((vlc_object_t *)NULL, filters);
+}
+
+int main(void)
+{
+    /* Resamplers based on external libraries may allocate internally. */
+    const char *args[test_defaults_nargs + 1];
+
+    memcpy(args, test_defaults_args, sizeof (test_defaults_args));
+    args[test_defaults_nargs] = "--audio-resampler=ugly";
+
+    test_init();
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    assert(vlc != NULL);
+
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    Test(obj, VLC_CODEC_FL32, AOUT_CHANS_STEREO);
+    Test(obj, VLC_CODEC_FL32, AOUT_CHANS_5_1);
+    Test(obj, VLC_CODEC_S16N, AOUT_CHANS_STEREO);
+
+    libvlc_release(vlc);
+    return 0;
+}
+#else
+int main(void)
+{
+    return 77;
+}
+#endif
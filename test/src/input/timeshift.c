@@ -0,0 +1,148 @@
+/*****************************************************************************
+ * timeshift.c: seeking within the timeshift buffer test
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Plays a live WAV stream written to a pipe in real time, pauses it so that
+ * it gets buffered, then seeks back within what was already played from the
+ * buffer, and forward again. The live source cannot seek, so the playback
+ * time only moves if the seeks are done within the buffer. */
+
+#include "../../libvlc/test.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+
+#include <vlc_common.h>
+#include <vlc_atomic.h>
+
+/* Stereo 16-bits samples per second: the stream is read by 16 KiB, which
+ * must not take too long */
+#define RATE  48000
+#define CHUNK 20000 /* Duration of each write, in microseconds */
+
+static int fds[2];
+static atomic_bool stop = ATOMIC_VAR_INIT(false);
+
+static void SetLE32( uint8_t *p, uint32_t i )
+{
+    p[0] = i; p[1] = i >> 8; p[2] = i >> 16; p[3] = i >> 24;
+}
+
+static void *Write( void *data )
+{
+    uint8_t header[44];
+    int16_t samples[2 * RATE * CHUNK / CLOCK_FREQ];
+
+    (void)data;
+    memcpy( header, "RIFF\0\0\0\0WAVEfmt \x10\0\0\0\x01\0\x02\0"
+                    "\0\0\0\0\0\0\0\0\x04\0\x10\0data", 40 );
+    SetLE32( &header[4], 0x7ffffff0 );
+    SetLE32( &header[24], RATE );
+    SetLE32( &header[28], RATE * 4 );
+    SetLE32( &header[40], 0x7ffffff0 - 36 );
+    memset( samples, 0, sizeof (samples) );
+
+    if( write( fds[1], header, sizeof (header) ) == sizeof (header) )
+    {
+        const mtime_t start = mdate();
+
+        for( unsigned i = 0; !atomic_load( &stop ); i++ )
+        {
+            mwait( start + i * CHUNK );
+            if( write( fds[1], samples, sizeof (samples) ) != sizeof (samples) )
+                break;
+        }
+    }
+    close( fds[1] );
+    return NULL;
+}
+
+/* Waits for the playback time to reach i_min */
+static void WaitTime( libvlc_media_player_t *mp, libvlc_time_t i_min )
+{
+    while( libvlc_media_player_get_time( mp ) < i_min )
+        mwait( mdate() + CLOCK_FREQ / 100 );
+}
+
+/* Seeks, and checks the playback time a moment later. The time is set as
+ * requested at once, and only goes on from there if the seek was done. */
+static void Seek( libvlc_media_player_t *mp, libvlc_time_t i_target )
+{
+    libvlc_media_player_set_time( mp, i_target );
+    mwait( mdate() + 3 * CLOCK_FREQ / 2 );
+
+    libvlc_time_t i_time = libvlc_media_player_get_time( mp );
+    log( "Seeked to %"PRId64" ms, at %"PRId64" ms 1.5 s later\n",
+         (int64_t)i_target, (int64_t)i_time );
+    assert( i_time >= i_target + 200 && i_time < i_target + 1500 );
+}
+
+int main( void )
+{
+    const char *args[test_defaults_nargs + 1];
+    char mrl[32];
+
+    memcpy( args, test_defaults_args, sizeof (test_defaults_args) );
+    args[test_defaults_nargs] = "--demux=wav";
+
+    test_init();
+    alarm( 20 );
+    signal( SIGPIPE, SIG_IGN );
+
+    assert( pipe( fds ) == 0 );
+    snprintf( mrl, sizeof (mrl), "stream:///dev/fd/%d", fds[0] );
+
+    vlc_thread_t thread;
+    assert( vlc_clone( &thread, Write, NULL, VLC_THREAD_PRIORITY_LOW ) == 0 );
+
+    libvlc_instance_t *vlc = libvlc_new( ARRAY_SIZE(args), args );
+    assert( vlc != NULL );
+
+    libvlc_media_t *md = libvlc_media_new_location( vlc, mrl );
+    assert( md != NULL );
+    libvlc_media_player_t *mp = libvlc_media_player_new_from_media( md );
+    assert( mp != NULL );
+    libvlc_media_release( md );
+
+    libvlc_media_player_play( mp );
+    WaitTime( mp, 500 );
+
+    /* The stream is buffered from the pause on */
+    log( "Pausing the live stream\n" );
+    libvlc_media_player_set_pause( mp, 1 );
+    mwait( mdate() + 5 * CLOCK_FREQ / 2 );
+    libvlc_media_player_set_pause( mp, 0 );
+
+    /* The playback is now about 2.5 seconds late. Go back a second, to what
+     * was played from the buffer already, then 2 seconds forward, to what
+     * was not read from it yet. */
+    WaitTime( mp, libvlc_media_player_get_time( mp ) + 2000 );
+    Seek( mp, libvlc_media_player_get_time( mp ) - 1000 );
+    Seek( mp, libvlc_media_player_get_time( mp ) + 2000 );
+
+    libvlc_media_player_stop( mp );
+    libvlc_media_player_release( mp );
+    libvlc_release( vlc );
+
+    atomic_store( &stop, true );
+    close( fds[0] );
+    vlc_join( thread, NULL );
+    return 0;
+}
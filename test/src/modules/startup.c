@@ -0,0 +1,117 @@
+/*****************************************************************************
+ * startup.c: LibVLC instance creation benchmark
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Measures how long a fresh process takes to create a LibVLC instance, i.e.
+ * mostly to load the plugins bank, and its peak resident memory. Each run is
+ * a new process, so nothing is shared but the file system cache. */
+
+#include "../../libvlc/test.h"
+
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <vlc_common.h>
+
+#define RUNS 40
+
+struct sample
+{
+    mtime_t duration;
+    long maxrss; /* KiB */
+};
+
+static void Run(const char *const *args, int nargs, int fd)
+{
+    struct sample s;
+    struct rusage ru;
+
+    mtime_t start = mdate();
+    libvlc_instance_t *vlc = libvlc_new(nargs, args);
+    s.duration = mdate() - start;
+    assert(vlc != NULL);
+    assert(getrusage(RUSAGE_SELF, &ru) == 0);
+    s.maxrss = ru.ru_maxrss;
+    libvlc_release(vlc);
+
+    assert(write(fd, &s, sizeof (s)) == sizeof (s));
+}
+
+static int cmp_duration(const void *a, const void *b)
+{
+    const struct sample *sa = a, *sb = b;
+    return (sa->duration > sb->duration) - (sa->duration < sb->duration);
+}
+
+static int cmp_maxrss(const void *a, const void *b)
+{
+    const struct sample *sa = a, *sb = b;
+    return (sa->maxrss > sb->maxrss) - (sa->maxrss < sb->maxrss);
+}
+
+static void bench(const char *name, const char *arg)
+{
+    const char *args[test_defaults_nargs + 1];
+    struct sample samples[RUNS];
+    int fds[2];
+
+    memcpy(args, test_defaults_args, sizeof (test_defaults_args));
+    args[test_defaults_nargs] = arg;
+    assert(pipe(fds) == 0);
+
+    for (unsigned i = 0; i < RUNS; i++)
+    {
+        pid_t pid = fork();
+
+        assert(pid != -1);
+        if (pid == 0)
+        {
+            close(fds[0]);
+            Run(args, ARRAY_SIZE(args), fds[1]);
+            _exit(0);
+        }
+
+        int status;
+        assert(waitpid(pid, &status, 0) == pid);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        assert(read(fds[0], &samples[i], sizeof (samples[i]))
+               == sizeof (samples[i]));
+    }
+    close(fds[1]);
+    close(fds[0]);
+
+    qsort(samples, RUNS, sizeof (samples[0]), cmp_duration);
+    mtime_t duration = samples[RUNS / 2].duration;
+    qsort(samples, RUNS, sizeof (samples[0]), cmp_maxrss);
+    printf("%s: %u runs, median %5.1f ms, %6.1f MiB peak RSS\n", name, RUNS,
+           duration / 1000., samples[RUNS / 2].maxrss / 1024.);
+}
+
+int main(void)
+{
+    test_init();
+    alarm(0); /* a benchmark, not a test */
+
+    /* First create or refresh the cache, then use it */
+    bench("plugins cache reset", "--reset-plugins-cache");
+    bench("plugins cache", "--plugins-cache");
+    bench("no plugins cache", "--no-plugins-cache");
+    return 0;
+}
@@ -0,0 +1,374 @@
+/*****************************************************************************
+ * httpd.c: HTTP server stream tests and benchmark
+ *****************************************************************************
+ * Copyright (C) 2015 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_httpd.h>
+#include <vlc_rand.h>
+
+static httpd_stream_t *stream;
+
+/* Listens on a random port, trying others if it is in use */
+static httpd_host_t *HostNew(libvlc_instance_t *vlc, unsigned *port)
+{
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+    httpd_host_t *host = NULL;
+
+    var_Create(obj, "http-port", VLC_VAR_INTEGER);
+    for (unsigned i = 0; host == NULL && i < 100; i++)
+    {
+        *port = 20000 + vlc_lrand48() % 40000;
+        var_SetInteger(obj, "http-port", *port);
+        host = vlc_http_HostNew(obj);
+    }
+    assert(host != NULL);
+    return host;
+}
+
+#ifdef HTTPD_BENCH
+#define CLIENTS 200
+#define RATE (2 << 20) /* stream bytes per second */
+#define DURATION (CLOCK_FREQ * 3 / 2)
+
+/* Feeds the stream at a constant rate, as a muxer would */
+static void *Feed(void *data)
+{
+    block_t *block = data;
+    mtime_t deadline = mdate();
+
+    for (;;)
+    {
+        deadline += CLOCK_FREQ / 100;
+        mwait(deadline);
+        httpd_StreamSend(stream, block);
+    }
+    return NULL;
+}
+
+/* Connects the clients and reads as fast as possible */
+static void Load(unsigned port, unsigned threads)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    static const char request[] = "GET /bench HTTP/1.0\r\n\r\n";
+    struct pollfd ufd[CLIENTS];
+    uint64_t received[CLIENTS];
+    static char buf[65536];
+
+    for (unsigned i = 0; i < CLIENTS; i++)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        assert(fd != -1);
+        assert(connect(fd, (struct sockaddr *)&addr, sizeof (addr)) == 0);
+        assert(send(fd, request, strlen(request), 0)
+               == (ssize_t)strlen(request));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        ufd[i].fd = fd;
+        ufd[i].events = POLLIN;
+        received[i] = 0;
+    }
+
+    mtime_t start = mdate(), deadline = start + DURATION;
+    uint64_t total = 0;
+
+    while (mdate() < deadline)
+    {
+        if (poll(ufd, CLIENTS, 100) <= 0)
+            continue;
+
+        for (unsigned i = 0; i < CLIENTS; i++)
+        {
+            if (ufd[i].revents == 0)
+                continue;
+
+            ssize_t val = recv(ufd[i].fd, buf, sizeof (buf), 0);
+            assert(val != 0); /* the server must not close connections */
+            if (val > 0)
+            {
+                received[i] += val;
+                total += val;
+            }
+        }
+    }
+
+    mtime_t duration = mdate() - start;
+    unsigned served = 0;
+
+    for (unsigned i = 0; i < CLIENTS; i++)
+    {
+        if (received[i] > 0)
+            served++;
+        close(ufd[i].fd);
+    }
+
+    double rate = (double)total * CLOCK_FREQ / duration;
+    printf("%u thread(s): %u/%u clients served, %6.1f MiB/s "
+           "(%3.0f%% of %u x the stream rate)\n", threads, served, CLIENTS,
+           rate / (1 << 20), 100. * rate / ((double)RATE * CLIENTS), CLIENTS);
+}
+#else
+#define CHUNK 65536 /* bytes per block */
+#define GOP 8 /* blocks per keyframe */
+#define LAG_BYTES (8 << 20) /* well over the 5 MB stream buffer */
+#define LAG_BLOCKS 400 /* upper bound of the stream length */
+
+static void SendChunk(unsigned seq)
+{
+    block_t *block = block_Alloc(CHUNK);
+
+    assert(block != NULL);
+    memset(block->p_buffer, seq, CHUNK);
+    memcpy(block->p_buffer, &seq, sizeof (seq));
+    if ((seq % GOP) == 0)
+        block->i_flags |= BLOCK_FLAG_TYPE_I;
+    httpd_StreamSend(stream, block);
+    block_Release(block);
+}
+
+static bool IsChunk(const unsigned char *p, unsigned seq)
+{
+    return !memcmp(p, &seq, sizeof (seq))
+        && p[sizeof (seq)] == (unsigned char)seq
+        && p[CHUNK - 1] == (unsigned char)seq;
+}
+
+/* Reads until the server closes, or sends the last block */
+static size_t RecvAll(int fd, unsigned char *buf, size_t size, unsigned last,
+                      bool *eof)
+{
+    size_t len = 0;
+
+    *eof = false;
+    while (len < CHUNK || !IsChunk(buf + len - CHUNK, last))
+    {
+        assert(len < size);
+
+        ssize_t val = recv(fd, buf + len, size - len, 0);
+
+        assert(val >= 0);
+        if (val == 0)
+        {
+            *eof = true;
+            break;
+        }
+        len += val;
+    }
+    return len;
+}
+
+static void test_lag(unsigned port, int policy)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    static const char request[] = "GET /lag HTTP/1.0\r\n\r\n";
+    httpd_stream_stats_t stats;
+    unsigned seq = 0;
+
+    httpd_StreamSetPolicy(stream, true, policy, 16 << 20);
+    while (seq < GOP + 2)
+        SendChunk(seq++);
+
+    /* Keep the socket buffers small, so that the client falls behind */
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = 4096;
+
+    assert(fd != -1);
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof (rcvbuf));
+    assert(connect(fd, (struct sockaddr *)&addr, sizeof (addr)) == 0);
+    assert(send(fd, request, strlen(request), 0)
+           == (ssize_t)strlen(request));
+
+    /* Skip the answer header */
+    char c;
+    unsigned crlf = 0;
+    while (crlf < 4)
+    {
+        assert(recv(fd, &c, 1, 0) == 1);
+        crlf = (c == (crlf & 1 ? '\n' : '\r')) ? crlf + 1 : (c == '\r');
+    }
+
+    /* Burst from the last keyframe */
+    unsigned start;
+    assert(recv(fd, &start, sizeof (start), MSG_WAITALL) == sizeof (start));
+    assert(start == GOP);
+
+    /* Stall the client until its unsent data is overwritten. Whatever the
+     * socket buffers hold, the server has no other choice than to spill it
+     * (and says so at once), or to find it lost when the client reads on. */
+    do
+    {
+        assert(seq < LAG_BLOCKS - GOP);
+        SendChunk(seq++);
+        assert(httpd_StreamGetStats(stream, &stats, NULL) == VLC_SUCCESS);
+    }
+    while (policy == HTTPD_STREAM_LAG_SPILL
+           ? stats.i_spill == 0
+           : stats.i_max_lag < LAG_BYTES && stats.i_drops == 0);
+
+    /* Go on up to a keyframe to resume from */
+    do
+        SendChunk(seq++);
+    while ((seq % GOP) != 1);
+
+    size_t size = LAG_BLOCKS * CHUNK;
+    unsigned char *buf = malloc(size);
+    bool eof;
+
+    assert(buf != NULL);
+    size = RecvAll(fd, buf, size, seq - 1, &eof);
+    close(fd);
+
+    /* Walk back the contiguous blocks at the end of the data */
+    unsigned last = seq - 1, first = last;
+    size_t tail = 0;
+
+    if (!eof)
+    {
+        assert(size >= CHUNK && IsChunk(buf + size - CHUNK, last));
+        tail = CHUNK;
+        while (tail + CHUNK <= size
+            && IsChunk(buf + size - tail - CHUNK, first - 1))
+        {
+            tail += CHUNK;
+            first--;
+        }
+    }
+    free(buf);
+
+    assert(httpd_StreamGetStats(stream, &stats, NULL) == VLC_SUCCESS);
+    printf("lag policy %d: %zu bytes received, %u drop(s), %"PRIu64" bytes "
+           "dropped, %u disconnection(s)\n", policy, size, stats.i_drops,
+           stats.i_dropped, stats.i_disconnects);
+
+    switch (policy)
+    {
+        case HTTPD_STREAM_LAG_KEYFRAME:
+            /* resumed on a keyframe after a gap */
+            assert(!eof && tail < size && (first % GOP) == 0);
+            assert(stats.i_drops > 0 && stats.i_dropped > 0);
+            break;
+        case HTTPD_STREAM_LAG_DISCONNECT:
+            assert(eof && stats.i_disconnects > 0);
+            break;
+        case HTTPD_STREAM_LAG_SPILL:
+            /* everything, in order */
+            assert(!eof && tail + CHUNK - sizeof (start) == size);
+            assert(first == GOP + 1);
+            assert(stats.i_drops == 0);
+            break;
+    }
+}
+
+#endif
+
+static libvlc_instance_t *create(unsigned threads)
+{
+    char threadarg[32];
+    const char *args[test_defaults_nargs + 2];
+
+    snprintf(threadarg, sizeof (threadarg), "--http-threads=%u", threads);
+    memcpy(args, test_defaults_args, sizeof (test_defaults_args));
+    args[test_defaults_nargs] = "--http-host=127.0.0.1";
+    args[test_defaults_nargs + 1] = threadarg;
+
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(args), args);
+    assert(vlc != NULL);
+    return vlc;
+}
+
+#ifndef HTTPD_BENCH
+static void lag(int policy)
+{
+    unsigned port;
+    libvlc_instance_t *vlc = create(1);
+    httpd_host_t *host = HostNew(vlc, &port);
+
+    stream = httpd_StreamNew(host, "/lag", "application/octet-stream",
+                             NULL, NULL);
+    assert(stream != NULL);
+
+    test_lag(port, policy);
+
+    httpd_StreamDelete(stream);
+    httpd_HostDelete(host);
+    libvlc_release(vlc);
+}
+
+#else
+static void bench(unsigned threads)
+{
+    unsigned port;
+    libvlc_instance_t *vlc = create(threads);
+    httpd_host_t *host = HostNew(vlc, &port);
+
+    stream = httpd_StreamNew(host, "/bench", "application/octet-stream",
+                             NULL, NULL);
+    assert(stream != NULL);
+
+    block_t *block = block_Alloc(RATE / 100);
+    assert(block != NULL);
+    memset(block->p_buffer, 0x47, block->i_buffer);
+
+    vlc_thread_t th;
+    assert(!vlc_clone(&th, Feed, block, VLC_THREAD_PRIORITY_LOW));
+
+    Load(port, threads);
+
+    vlc_cancel(th);
+    vlc_join(th, NULL);
+    block_Release(block);
+    httpd_StreamDelete(stream);
+    httpd_HostDelete(host);
+    libvlc_release(vlc);
+}
+#endif
+
+int main(void)
+{
+    test_init();
+
+#ifndef HTTPD_BENCH
+    lag(HTTPD_STREAM_LAG_KEYFRAME);
+    lag(HTTPD_STREAM_LAG_DISCONNECT);
+    lag(HTTPD_STREAM_LAG_SPILL);
+#else
+    bench(1);
+    bench(4);
+#endif
+    return 0;
+}